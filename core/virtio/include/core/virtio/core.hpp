@@ -73,6 +73,9 @@ enum {
 	VIRTQ_DESC_F_NEXT = 1, // descriptor is part of a chain
 	VIRTQ_DESC_F_WRITE = 2, // buffer is written by device
 
+	// Bits of the spec::AvailableRing::flags field.
+	VIRTQ_AVAIL_F_NO_INTERRUPT = 1, // no need to interrupt the driver
+
 	// Bits of the spec::UsedRing::flags field.
 	VIRTQ_USED_F_NO_NOTIFY = 1 // no need to notify the device
 };
@@ -338,8 +341,14 @@ public:
 
 	// Processes interrupts for this virtq.
 	// Calls retrieveDescriptor() to complete individual requests.
+	// Can also be called without an interrupt to poll for completions.
 	void processInterrupt();
 
+	// Asks the device not to send interrupts for this virtq.
+	// Completions are then only processed by polling via processInterrupt();
+	// obtainDescriptor() temporarily re-enables interrupts if it runs out of descriptors.
+	void suppressInterrupts(bool suppress);
+
 protected:
 	virtual void notifyTransport() = 0;
 
@@ -366,6 +375,8 @@ private:
 
 	// Keeps track of which entries in the used ring have already been processed.
 	uint16_t _progressHead;
+
+	bool _interruptsSuppressed = false;
 };
 
 } // namespace virtio_core
@@ -1,5 +1,6 @@
 
 #include <assert.h>
+#include <atomic>
 #include <iostream>
 #include <unordered_map>
 #include <optional>
@@ -816,6 +817,25 @@ Queue::Queue(unsigned int queue_index, size_t queue_size, spec::Descriptor *tabl
 async::result<Handle> Queue::obtainDescriptor() {
 	while(true) {
 		if(_descriptorStack.empty()) {
+			// Descriptors might be held by requests that were posted without notification.
+			notify();
+
+			if(_interruptsSuppressed) {
+				processInterrupt();
+				if(!_descriptorStack.empty())
+					continue;
+
+				// Enable interrupts before checking the used ring again
+				// to avoid missing completions that race with the flag update.
+				_availableRing->flags.store(0);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				processInterrupt();
+				if(_descriptorStack.empty())
+					co_await _descriptorDoorbell.async_wait();
+				_availableRing->flags.store(VIRTQ_AVAIL_F_NO_INTERRUPT);
+				continue;
+			}
+
 			co_await _descriptorDoorbell.async_wait();
 			continue;
 		}
@@ -854,6 +874,11 @@ void Queue::notify() {
 		notifyTransport();
 }
 
+void Queue::suppressInterrupts(bool suppress) {
+	_interruptsSuppressed = suppress;
+	_availableRing->flags.store(suppress ? VIRTQ_AVAIL_F_NO_INTERRUPT : 0);
+}
+
 void Queue::processInterrupt() {
 	while(true) {
 		auto used_head = _usedRing->headIndex.load();
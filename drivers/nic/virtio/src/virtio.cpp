@@ -1,6 +1,10 @@
 #include <nic/virtio/virtio.hpp>
 
+#include <algorithm>
+#include <deque>
+
 #include <arch/dma_pool.hpp>
+#include <async/recurring-event.hpp>
 #include <core/virtio/core.hpp>
 
 namespace {
@@ -10,13 +14,23 @@ namespace {
 namespace {
 // Device feature bits.
 constexpr size_t legacyHeaderSize = 10;
+// With VIRTIO_NET_F_MRG_RXBUF, the header includes numBuffers.
+constexpr size_t mergeableHeaderSize = 12;
+// Largest Ethernet frame (without FCS) that we send or receive.
+constexpr size_t maxFrameSize = 1514;
+// Upper bound on the number of buffers that we keep in the receive ring.
+constexpr size_t maxRxBuffers = 256;
 enum {
-	VIRTIO_NET_F_MAC = 5
+	VIRTIO_NET_F_CSUM = 0,
+	VIRTIO_NET_F_GUEST_CSUM = 1,
+	VIRTIO_NET_F_MAC = 5,
+	VIRTIO_NET_F_MRG_RXBUF = 15
 };
 
 // Bits for VirtHeader::flags.
 enum {
-	VIRTIO_NET_HDR_F_NEEDS_CSUM = 1
+	VIRTIO_NET_HDR_F_NEEDS_CSUM = 1,
+	VIRTIO_NET_HDR_F_DATA_VALID = 2
 };
 
 // Values for VirtHeader::gsoType.
@@ -43,15 +57,48 @@ struct VirtioNic : nic::Link {
 	async::result<void> initialize();
 
 	async::result<size_t> receive(arch::dma_buffer_view) override;
+	async::result<ReceivedFrame> receiveFrame(arch::dma_buffer_view) override;
 	async::result<void> send(const arch::dma_buffer_view) override;
+	async::result<void> sendWithChecksum(const arch::dma_buffer_view, ChecksumRequest) override;
+	async::result<std::vector<RxFrame>> receiveBatch(size_t maxFrames) override;
+	async::result<void> sendBatch(std::vector<TxFrame> frames) override;
 
 	~VirtioNic() override = default;
 private:
+	// A buffer in the receive ring. The header is stored in front of the frame.
+	struct RxBuffer : virtio_core::Request {
+		VirtioNic *nic;
+		arch::dma_buffer buffer;
+	};
+
+	// Owns a frame until the device has sent it.
+	struct TxRequest : virtio_core::Request {
+		TxRequest(arch::dma_pool *pool, arch::dma_buffer frame)
+		: header{pool}, frame{std::move(frame)} { }
+
+		arch::dma_object<VirtHeader> header;
+		arch::dma_buffer frame;
+	};
+
+	// Posts a receive buffer without notifying the device.
+	async::result<void> postRxBuffer_(RxBuffer *rx);
+
+	// Pops the next frame from rxCompleted_ and reposts its buffers.
+	async::result<RxFrame> reapRxFrame_();
+
 	mbus_ng::EntityId entity_;
 	std::unique_ptr<virtio_core::Transport> transport_;
 	arch::contiguous_pool dmaPool_;
 	virtio_core::Queue *receiveVq_;
 	virtio_core::Queue *transmitVq_;
+
+	size_t headerSize_ = legacyHeaderSize;
+	bool mergeRxBuffers_ = false;
+
+	std::vector<std::unique_ptr<RxBuffer>> rxBuffers_;
+	// Receive buffers that were filled by the device, in used ring order.
+	std::deque<RxBuffer *> rxCompleted_;
+	async::recurring_event rxEvent_;
 };
 
 VirtioNic::VirtioNic(mbus_ng::EntityId entity, std::unique_ptr<virtio_core::Transport> transport)
@@ -70,11 +117,31 @@ VirtioNic::VirtioNic(mbus_ng::EntityId entity, std::unique_ptr<virtio_core::Tran
 		transport_->acknowledgeDriverFeature(VIRTIO_NET_F_MAC);
 	}
 
+	// The device computes checksums of frames that we send.
+	if(transport_->checkDeviceFeature(VIRTIO_NET_F_CSUM)) {
+		transport_->acknowledgeDriverFeature(VIRTIO_NET_F_CSUM);
+		tx_csum_offload_ = true;
+	}
+	// The device may deliver frames with partial or already validated checksums.
+	if(transport_->checkDeviceFeature(VIRTIO_NET_F_GUEST_CSUM)) {
+		transport_->acknowledgeDriverFeature(VIRTIO_NET_F_GUEST_CSUM);
+		rx_csum_offload_ = true;
+	}
+	// Receive buffers take a single descriptor and frames may span multiple buffers.
+	if(transport_->checkDeviceFeature(VIRTIO_NET_F_MRG_RXBUF)) {
+		transport_->acknowledgeDriverFeature(VIRTIO_NET_F_MRG_RXBUF);
+		headerSize_ = mergeableHeaderSize;
+		mergeRxBuffers_ = true;
+	}
+
 	transport_->finalizeFeatures();
 	transport_->claimQueues(2);
 	receiveVq_ = transport_->setupQueue(0);
 	transmitVq_ = transport_->setupQueue(1);
 
+	// Sent frames are reclaimed by polling in sendBatch().
+	transmitVq_->suppressInterrupts(true);
+
 	promiscuous_ = true;
 	all_multicast_ = true;
 	multicast_ = true;
@@ -85,6 +152,19 @@ VirtioNic::VirtioNic(mbus_ng::EntityId entity, std::unique_ptr<virtio_core::Tran
 }
 
 async::result<void> VirtioNic::initialize() {
+	// Fill the receive ring.
+	size_t descriptorsPerBuffer = mergeRxBuffers_ ? 1 : 2;
+	size_t numRxBuffers = std::min(receiveVq_->numDescriptors() / descriptorsPerBuffer,
+			maxRxBuffers);
+	for(size_t i = 0; i < numRxBuffers; i++) {
+		auto rx = std::make_unique<RxBuffer>();
+		rx->nic = this;
+		rx->buffer = arch::dma_buffer{&dmaPool_, headerSize_ + maxFrameSize};
+		co_await postRxBuffer_(rx.get());
+		rxBuffers_.push_back(std::move(rx));
+	}
+	receiveVq_->notify();
+
 	mbus_ng::Properties netProperties{
 		{"drvcore.mbus-parent", mbus_ng::StringItem{std::to_string(entity_)}},
 		{"unix.subsystem", mbus_ng::StringItem{"net"}},
@@ -104,40 +184,169 @@ async::result<void> VirtioNic::initialize() {
 	}(std::move(netClassEntity));
 }
 
+async::result<void> VirtioNic::postRxBuffer_(RxBuffer *rx) {
+	virtio_core::Chain chain;
+	if(mergeRxBuffers_) {
+		chain.append(co_await receiveVq_->obtainDescriptor());
+		chain.setupBuffer(virtio_core::deviceToHost, rx->buffer);
+	}else{
+		// Legacy devices expect the header in a separate descriptor.
+		chain.append(co_await receiveVq_->obtainDescriptor());
+		chain.setupBuffer(virtio_core::deviceToHost, rx->buffer.subview(0, headerSize_));
+		chain.append(co_await receiveVq_->obtainDescriptor());
+		chain.setupBuffer(virtio_core::deviceToHost, rx->buffer.subview(headerSize_));
+	}
+
+	receiveVq_->postDescriptor(chain.front(), rx,
+			[] (virtio_core::Request *base_request) {
+		auto rx = static_cast<RxBuffer *>(base_request);
+		rx->nic->rxCompleted_.push_back(rx);
+		rx->nic->rxEvent_.raise();
+	});
+}
+
+async::result<nic::Link::RxFrame> VirtioNic::reapRxFrame_() {
+	auto first = rxCompleted_.front();
+	VirtHeader header{};
+	memcpy(&header, first->buffer.data(), headerSize_);
+
+	// Frames with NEEDS_CSUM originate from the host and only carry a partial checksum;
+	// their data is known to be intact.
+	bool checksumValid = rx_csum_offload_
+			&& (header.flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM));
+
+	size_t numBuffers = mergeRxBuffers_ ? std::max<size_t>(header.numBuffers, 1) : 1;
+	if(numBuffers == 1) {
+		rxCompleted_.pop_front();
+
+		// Hand the buffer to the caller and post a fresh one instead.
+		auto frame = first->buffer.subview(headerSize_, first->len - headerSize_);
+		RxFrame result{std::move(first->buffer), frame, checksumValid};
+		first->buffer = arch::dma_buffer{&dmaPool_, headerSize_ + maxFrameSize};
+		co_await postRxBuffer_(first);
+		co_return result;
+	}
+
+	// The frame spans multiple buffers. Only the first one contains a header.
+	while(rxCompleted_.size() < numBuffers)
+		co_await rxEvent_.async_wait();
+
+	size_t size = 0;
+	for(size_t i = 0; i < numBuffers; i++)
+		size += rxCompleted_[i]->len - (i ? 0 : headerSize_);
+
+	arch::dma_buffer merged{&dmaPool_, size};
+	size_t offset = 0;
+	for(size_t i = 0; i < numBuffers; i++) {
+		auto rx = rxCompleted_.front();
+		rxCompleted_.pop_front();
+
+		size_t skip = i ? 0 : headerSize_;
+		memcpy(static_cast<char *>(merged.data()) + offset,
+				static_cast<char *>(rx->buffer.data()) + skip, rx->len - skip);
+		offset += rx->len - skip;
+		co_await postRxBuffer_(rx);
+	}
+
+	auto frame = merged.subview(0, size);
+	co_return RxFrame{std::move(merged), frame, checksumValid};
+}
+
+async::result<std::vector<nic::Link::RxFrame>> VirtioNic::receiveBatch(size_t maxFrames) {
+	while(rxCompleted_.empty())
+		co_await rxEvent_.async_wait();
+
+	std::vector<RxFrame> frames;
+	while(!rxCompleted_.empty() && frames.size() < maxFrames)
+		frames.push_back(co_await reapRxFrame_());
+
+	// Notify once for all reposted buffers.
+	receiveVq_->notify();
+
+	if(logFrames) {
+		std::cout << "virtio-driver: received " << frames.size() << " frames" << std::endl;
+	}
+	co_return frames;
+}
+
 async::result<size_t> VirtioNic::receive(arch::dma_buffer_view frame) {
-	arch::dma_object<VirtHeader> header { &dmaPool_ };
+	co_return (co_await receiveFrame(frame)).size;
+}
 
-	virtio_core::Chain chain;
-	chain.append(co_await receiveVq_->obtainDescriptor());
-	chain.setupBuffer(virtio_core::deviceToHost,
-			header.view_buffer().subview(0, legacyHeaderSize));
-	chain.append(co_await receiveVq_->obtainDescriptor());
-	chain.setupBuffer(virtio_core::deviceToHost, frame);
+async::result<nic::Link::ReceivedFrame> VirtioNic::receiveFrame(arch::dma_buffer_view frame) {
+	auto frames = co_await receiveBatch(1);
+	auto &rx = frames.front();
 
-	co_return (co_await receiveVq_->submitDescriptor(chain.front()) - legacyHeaderSize);
+	auto size = std::min(frame.size(), rx.frame.size());
+	memcpy(frame.data(), rx.frame.data(), size);
+	co_return ReceivedFrame{size, rx.checksumValid};
 }
 
 async::result<void> VirtioNic::send(const arch::dma_buffer_view payload) {
-	if (payload.size() > 1514) {
-		throw std::runtime_error("data exceeds mtu");
+	// sendBatch() needs to own the frame.
+	arch::dma_buffer frame{&dmaPool_, payload.size()};
+	memcpy(frame.data(), payload.data(), payload.size());
+
+	std::vector<TxFrame> frames;
+	frames.push_back({std::move(frame), std::nullopt});
+	co_await sendBatch(std::move(frames));
+}
+
+async::result<void> VirtioNic::sendWithChecksum(const arch::dma_buffer_view payload,
+		ChecksumRequest csum) {
+	if(!tx_csum_offload_) {
+		co_await nic::Link::sendWithChecksum(payload, csum);
+		co_return;
 	}
 
-	arch::dma_object<VirtHeader> header { &dmaPool_ };
-	memset(header.data(), 0, sizeof(VirtHeader));
+	arch::dma_buffer frame{&dmaPool_, payload.size()};
+	memcpy(frame.data(), payload.data(), payload.size());
 
-	virtio_core::Chain chain;
-	chain.append(co_await transmitVq_->obtainDescriptor());
-	chain.setupBuffer(virtio_core::hostToDevice,
-			header.view_buffer().subview(0, legacyHeaderSize));
-	chain.append(co_await transmitVq_->obtainDescriptor());
-	chain.setupBuffer(virtio_core::hostToDevice, payload);
+	std::vector<TxFrame> frames;
+	frames.push_back({std::move(frame), csum});
+	co_await sendBatch(std::move(frames));
+}
 
-	if(logFrames) {
-		std::cout << "virtio-driver: sending frame" << std::endl;
+async::result<void> VirtioNic::sendBatch(std::vector<TxFrame> frames) {
+	// Reclaim the descriptors of frames that the device already sent.
+	transmitVq_->processInterrupt();
+
+	for(auto &tx : frames) {
+		if (tx.frame.size() > maxFrameSize) {
+			throw std::runtime_error("data exceeds mtu");
+		}
+
+		if(tx.checksum && !tx_csum_offload_) {
+			co_await nic::Link::sendWithChecksum(tx.frame, *tx.checksum);
+			continue;
+		}
+
+		auto request = new TxRequest{&dmaPool_, std::move(tx.frame)};
+		memset(request->header.data(), 0, sizeof(VirtHeader));
+		if(tx.checksum) {
+			request->header->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+			request->header->csumStart = tx.checksum->start;
+			request->header->csumOffset = tx.checksum->offset;
+		}
+
+		virtio_core::Chain chain;
+		chain.append(co_await transmitVq_->obtainDescriptor());
+		chain.setupBuffer(virtio_core::hostToDevice,
+				request->header.view_buffer().subview(0, headerSize_));
+		chain.append(co_await transmitVq_->obtainDescriptor());
+		chain.setupBuffer(virtio_core::hostToDevice, request->frame);
+
+		transmitVq_->postDescriptor(chain.front(), request,
+				[] (virtio_core::Request *base_request) {
+			delete static_cast<TxRequest *>(base_request);
+		});
 	}
-	co_await transmitVq_->submitDescriptor(chain.front());
+
+	// Notify once for the entire batch.
+	transmitVq_->notify();
+
 	if(logFrames) {
-		std::cout << "virtio-driver: sent frame" << std::endl;
+		std::cout << "virtio-driver: sent " << frames.size() << " frames" << std::endl;
 	}
 }
 } // namespace
@@ -68,6 +68,11 @@ extern inline __attribute__ (( always_inline )) HelError helCreateQueue(
 	return error;
 };
 
+extern inline __attribute__ (( always_inline )) HelError helGrowQueue(HelHandle handle,
+		unsigned int numChunks) {
+	return helSyscall2(kHelCallGrowQueue, (HelWord)handle, (HelWord)numChunks);
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCancelAsync(HelHandle handle,
 		uint64_t async_id) {
 	return helSyscall2(kHelCallCancelAsync, (HelWord)handle, (HelWord)async_id);
@@ -271,6 +276,11 @@ extern inline __attribute__ (( always_inline )) HelError helLoadahead(HelHandle
 	return helSyscall3(kHelCallLoadahead, (HelWord)handle, (HelWord)offset, (HelWord)length);
 };
 
+extern inline __attribute__ (( always_inline )) HelError helQueryMemoryStats(
+		struct HelMemoryStats *stats) {
+	return helSyscall1(kHelCallQueryMemoryStats, (HelWord)stats);
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCreateThread(HelHandle universe,
 		HelHandle address_space, HelAbi abi, void *ip, void *sp, uint32_t flags,
 		HelHandle *handle) {
@@ -393,6 +403,25 @@ extern inline __attribute__ (( always_inline )) HelError helFutexWake(int *point
 	return helSyscall1(kHelCallFutexWake, (HelWord)pointer);
 };
 
+extern inline __attribute__ (( always_inline )) HelError helFutexWakeN(int *pointer,
+		unsigned int count, unsigned int *woken) {
+	HelWord woken_word;
+	HelError error = helSyscall2_1(kHelCallFutexWakeN, (HelWord)pointer, (HelWord)count,
+			&woken_word);
+	*woken = (unsigned int)woken_word;
+	return error;
+};
+
+extern inline __attribute__ (( always_inline )) HelError helFutexRequeue(int *pointer,
+		int expected, int *target, unsigned int numWake, unsigned int numRequeue,
+		unsigned int *woken) {
+	HelWord woken_word;
+	HelError error = helSyscall5_1(kHelCallFutexRequeue, (HelWord)pointer, (HelWord)expected,
+			(HelWord)target, (HelWord)numWake, (HelWord)numRequeue, &woken_word);
+	*woken = (unsigned int)woken_word;
+	return error;
+};
+
 extern inline __attribute__ (( always_inline )) HelError helCreateOneshotEvent(HelHandle *handle) {
 	HelWord handle_word;
 	HelError error = helSyscall0_1(kHelCallCreateOneshotEvent, &handle_word);
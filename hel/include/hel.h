@@ -18,7 +18,7 @@
 
 enum {
 	// largest system call number plus 1
-	kHelNumCalls = 105,
+	kHelNumCalls = 109,
 
 	kHelCallLog = 1,
 	kHelCallPanic = 10,
@@ -33,6 +33,7 @@ enum {
 	kHelCallCloseDescriptor = 21,
 
 	kHelCallCreateQueue = 89,
+	kHelCallGrowQueue = 107,
 	kHelCallCancelAsync = 92,
 
 	kHelCallAllocateMemory = 51,
@@ -57,6 +58,7 @@ enum {
 	kHelCallUpdateMemory = 47,
 	kHelCallSubmitLockMemoryView = 48,
 	kHelCallLoadahead = 49,
+	kHelCallQueryMemoryStats = 108,
 	kHelCallCreateVirtualizedSpace = 50,
 
 	kHelCallCreateThread = 67,
@@ -87,6 +89,8 @@ enum {
 
 	kHelCallFutexWait = 73,
 	kHelCallFutexWake = 71,
+	kHelCallFutexWakeN = 105,
+	kHelCallFutexRequeue = 106,
 
 	kHelCallCreateOneshotEvent = 96,
 	kHelCallCreateBitsetEvent = 97,
@@ -131,7 +135,8 @@ enum {
 	kHelErrRemoteFault = 21,
 	kHelErrNoHardwareSupport = 16,
 	kHelErrNoMemory = 17,
-	kHelErrAlreadyExists = 22
+	kHelErrAlreadyExists = 22,
+	kHelErrFutexValue = 23
 };
 
 struct HelX86SegmentRegister {
@@ -255,7 +260,9 @@ enum HelMapFlags {
 	kHelMapProtExecute = 1024,
 	kHelMapDontRequireBacking = 128,
 	kHelMapFixed = 2048,
-	kHelMapFixedNoReplace = 4096
+	kHelMapFixedNoReplace = 4096,
+	// Hint that the mapping should use huge pages if the memory object allows it.
+	kHelMapHuge = 8192
 };
 
 enum HelSliceFlags {
@@ -284,6 +291,9 @@ enum HelRegisterSets {
 	kHelRegsThread = 3,
 	kHelRegsDebug = 4,
 	kHelRegsVirtualization = 5,
+	//! On x86_64, the XSAVE area (or the FXSAVE area without XSAVE support).
+	//! If the CPU supports XSAVEC or XSAVES, the area is in the compacted format.
+	//! helStoreRegisters() rejects areas whose XSAVE header does not match this format.
 	kHelRegsSimd = 6,
 	kHelRegsSignal = 7
 };
@@ -572,6 +582,27 @@ struct HelThreadStats {
 	uint64_t userTime;
 };
 
+struct HelMemoryStats {
+	uint64_t totalMemory;
+	uint64_t freeMemory;
+	uint64_t activeCacheMemory;
+	uint64_t inactiveCacheMemory;
+	uint64_t numScannedPages;
+	uint64_t numActivatedPages;
+	uint64_t numDeactivatedPages;
+	uint64_t numReclaimedPages;
+	uint64_t numReclaimWakeups;
+	// Anonymous memory that is swapped out to the compressed store.
+	uint64_t swappedMemory;
+	// Size of the compressed store.
+	uint64_t swapPoolSize;
+	uint64_t numSwapOuts;
+	uint64_t numSwapIns;
+	uint64_t numSwapRejected;
+	uint64_t swapInNanos;
+	uint64_t maxSwapInNanos;
+};
+
 enum {
   kHelVmexitHlt = 0,
   kHelVmexitTranslationFault = 1,
@@ -671,6 +702,9 @@ HEL_C_LINKAGE HelError helCloseDescriptor(HelHandle universeHandle, HelHandle ha
 //! @{
 
 //! Creates an IPC queue.
+//!
+//! Chunks can be at most 1 MiB large and all chunks together
+//! (including a small header per chunk) can take at most 64 MiB.
 //! @param[in] params
 //!    	Parameters for the queue.
 //! @param[out] handle
@@ -678,6 +712,19 @@ HEL_C_LINKAGE HelError helCloseDescriptor(HelHandle universeHandle, HelHandle ha
 HEL_C_LINKAGE HelError helCreateQueue(const struct HelQueueParameters *params,
 		HelHandle *handle);
 
+//! Adds chunks to a queue.
+//!
+//! The chunks are appended to the queue's memory, i.e., the memory grows
+//! but existing chunks keep their offsets. User-space needs to map the
+//! additional memory before it can use the new chunks.
+//! @param[in] handle
+//!    	Handle to the queue.
+//! @param[in] numChunks
+//!    	New total number of chunks. Must not be smaller than the current
+//!    	number of chunks and must not exceed the size of the index queue.
+//!    	Fails with ::kHelErrNoMemory if the memory cannot be allocated.
+HEL_C_LINKAGE HelError helGrowQueue(HelHandle handle, unsigned int numChunks);
+
 //! Cancels an ongoing asynchronous operation.
 //! @param[in] queueHandle
 //!    	Handle to the queue that the operation was submitted to.
@@ -903,6 +950,11 @@ HEL_C_LINKAGE HelError helSubmitLockMemoryView(HelHandle handle, uintptr_t offse
 //!     Length of the memory range that is preloaded.
 HEL_C_LINKAGE HelError helLoadahead(HelHandle handle, uintptr_t offset, size_t length);
 
+//! Query system-wide statistics about physical memory and page cache reclaim.
+//! @param[out] stats
+//!     Memory sizes (in bytes) and reclaim counters (in pages).
+HEL_C_LINKAGE HelError helQueryMemoryStats(struct HelMemoryStats *stats);
+
 HEL_C_LINKAGE HelError helCreateVirtualizedSpace(HelHandle *handle);
 
 //! @}
@@ -1074,6 +1126,10 @@ HEL_C_LINKAGE HelError helCreateStream(HelHandle *lane1, HelHandle *lane2, uint3
 //!     Pointer to array of message items.
 //! @param[in] count
 //!     Number of elements in @p actions.
+//!
+//! For @p kHelActionRecvInline, the @p length field of the action specifies
+//! the maximal size of the message (at most one page). If it is zero,
+//! a default size of 128 bytes is used.
 HEL_C_LINKAGE HelError helSubmitAsync(HelHandle handle, const struct HelAction *actions,
 		size_t count, HelHandle queue, uintptr_t context, uint32_t flags);
 
@@ -1107,6 +1163,38 @@ HEL_C_LINKAGE HelError helFutexWait(int *pointer, int expected, int64_t deadline
 //!     Pointer that identifies the futex.
 HEL_C_LINKAGE HelError helFutexWake(int *pointer);
 
+//! Wakes up a limited number of waiters of a futex.
+//!
+//! Waiters are woken in the order in which they started waiting.
+//! @param[in] pointer
+//!     Pointer that identifies the futex.
+//! @param[in] count
+//!     Maximal number of waiters to wake.
+//! @param[out] woken
+//!     Number of waiters that were woken.
+HEL_C_LINKAGE HelError helFutexWakeN(int *pointer, unsigned int count, unsigned int *woken);
+
+//! Wakes up some waiters of a futex and moves others to a different futex.
+//!
+//! This allows condition variables to wake a single waiter and requeue the remaining
+//! waiters to the mutex instead of waking all of them at once.
+//! @param[in] pointer
+//!     Pointer that identifies the futex.
+//! @param[in] expected
+//!     Expected value of the futex. This function fails with ::kHelErrFutexValue
+//!     (and does not wake or move any waiters) unless the futex pointed to by
+//!     @pointer matches this value.
+//! @param[in] target
+//!     Pointer that identifies the futex that waiters are moved to.
+//! @param[in] numWake
+//!     Maximal number of waiters to wake.
+//! @param[in] numRequeue
+//!     Maximal number of remaining waiters to move to @target.
+//! @param[out] woken
+//!     Number of waiters that were woken.
+HEL_C_LINKAGE HelError helFutexRequeue(int *pointer, int expected, int *target,
+		unsigned int numWake, unsigned int numRequeue, unsigned int *woken);
+
 //! @}
 //! @name Event Handling
 //! @{
@@ -1216,6 +1304,8 @@ extern inline __attribute__ (( always_inline )) const char *_helErrorString(HelE
 		return "Out of bounds";
 	case kHelErrAlreadyExists:
 		return "Already exists";
+	case kHelErrFutexValue:
+		return "Futex value mismatch";
 	default:
 		return 0;
 	}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <helix/ipc.hpp>
+
+namespace helix {
+
+// A pool of worker threads that each own a Dispatcher (and thus a HelQueue).
+// Operations submitted from a worker complete on the same worker;
+// coroutines can be moved between workers via schedule().
+struct DispatcherPool {
+	using Task = std::function<void()>;
+
+	// Worker 0 is the thread that calls run(); the other workers are spawned by run().
+	// If pinWorkers is true, worker i is bound to CPU i via helSetAffinity().
+	// If serialize is true, tasks and completions only run while holding a pool-wide lock
+	// that workers drop while they block on their queues. This allows code that is not
+	// thread-safe to run on the pool.
+	explicit DispatcherPool(unsigned int numWorkers, bool pinWorkers = false,
+			bool serialize = false);
+
+	DispatcherPool(const DispatcherPool &) = delete;
+
+	DispatcherPool &operator= (const DispatcherPool &) = delete;
+
+	unsigned int numWorkers() {
+		return _workers.size();
+	}
+
+	// Returns the index of the calling worker or -1 if not called from a worker.
+	int currentWorker();
+
+	// Runs the task on the given worker.
+	void post(unsigned int worker, Task task);
+
+	// Runs the task on the worker with the fewest pending tasks.
+	void post(Task task);
+
+	// Turns the calling thread into worker 0. Does not return.
+	[[noreturn]] void run();
+
+	struct ScheduleSender {
+		bool await_ready() {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> h) {
+			pool->post([h] { h.resume(); });
+		}
+
+		void await_resume() { }
+
+		DispatcherPool *pool;
+	};
+
+	// Resumes the awaiting coroutine on the least loaded worker.
+	// Unless the pool is serialized, the coroutine must not hold ElementHandles
+	// across this call since those refer to the previous worker's Dispatcher.
+	ScheduleSender schedule() {
+		return {this};
+	}
+
+private:
+	// Context that is posted to a worker's queue to wake it up.
+	struct Doorbell final : Context {
+		void complete(ElementHandle) override { }
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		// Number of tasks; only used as a load estimate.
+		// Whether the worker has tasks is always decided under the mutex.
+		std::atomic<size_t> numPending{0};
+
+		// Handle of the worker's queue; kHelNullHandle until the worker runs.
+		std::atomic<HelHandle> queue{kHelNullHandle};
+		std::atomic<bool> doorbellPending{false};
+		Doorbell doorbell;
+	};
+
+	[[noreturn]] void _work(unsigned int index);
+
+	// Takes the pool-wide lock if the pool is serialized.
+	std::unique_lock<std::mutex> _serialize() {
+		if(!_serialized)
+			return {};
+		return std::unique_lock{_serialMutex};
+	}
+
+	bool _runTask(Worker *worker);
+
+	bool _stealTask(unsigned int index);
+
+	void _ringDoorbell(Worker *worker);
+
+	bool _pinWorkers;
+	bool _serialized;
+	std::mutex _serialMutex;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::vector<std::thread> _threads;
+};
+
+} // namespace helix
@@ -475,7 +475,10 @@ struct RecvBuffer {
 	size_t size;
 };
 
-struct RecvInline { };
+struct RecvInline {
+	// Maximal size of the message; zero selects the kernel's default.
+	size_t maxLength = 0;
+};
 
 struct PushDescriptor {
 	HelHandle handle;
@@ -566,8 +569,8 @@ inline auto recvBuffer(void *data, size_t length) {
 	return RecvBuffer{data, length};
 }
 
-inline auto recvInline() {
-	return RecvInline{};
+inline auto recvInline(size_t maxLength = 0) {
+	return RecvInline{maxLength};
 }
 
 inline auto pushDescriptor(BorrowedDescriptor desc) {
@@ -705,10 +708,11 @@ inline auto createActionsArrayFor(bool chain, const RecvBuffer &item) {
 	return frg::array<HelAction, 1>{action};
 }
 
-inline auto createActionsArrayFor(bool chain, const RecvInline &) {
+inline auto createActionsArrayFor(bool chain, const RecvInline &item) {
 	HelAction action{};
 	action.type = kHelActionRecvInline;
 	action.flags = chain ? kHelItemChain : 0;
+	action.length = item.maxLength;
 
 	return frg::array<HelAction, 1>{action};
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <assert.h>
-#include <tuple>
+#include <algorithm>
 #include <array>
+#include <tuple>
+#include <vector>
 
 #include <async/oneshot-event.hpp>
 
@@ -161,78 +163,87 @@ private:
 
 public:
 	static constexpr int sizeShift = 9;
+	static constexpr size_t chunkSize = 4096;
 
 	static Dispatcher &global();
 
 	Dispatcher()
 	: _handle{kHelNullHandle}, _queue{nullptr},
-			_activeChunks{0}, _retrieveIndex{0}, _nextIndex{0}, _lastProgress{0} { }
+			_activeChunks{0}, _hadWaiters{false},
+			_retrieveIndex{0}, _nextIndex{0}, _lastProgress{0} { }
 
 	Dispatcher(const Dispatcher &) = delete;
 
 	Dispatcher &operator= (const Dispatcher &) = delete;
 
+	// Sets the number of chunks that the queue starts with and the number of chunks
+	// that it can grow to. Must be called before the queue is acquired.
+	void configure(unsigned int numChunks, unsigned int maxChunks) {
+		assert(!_handle);
+		assert(numChunks && numChunks <= maxChunks && maxChunks <= (1u << sizeShift));
+		_initialChunks = numChunks;
+		_maxChunks = maxChunks;
+	}
+
 	HelHandle acquire() {
 		if(!_handle) {
 			HelQueueParameters params {
 				.flags = 0,
 				.ringShift = sizeShift,
-				.numChunks = 16,
-				.chunkSize = 4096,
+				.numChunks = _initialChunks,
+				.chunkSize = chunkSize,
 			};
 			HEL_CHECK(helCreateQueue(&params, &_handle));
 
-			auto chunksOffset = (sizeof(HelQueue) + (sizeof(int) << sizeShift) + 63) & ~size_t(63);
-			auto reservedPerChunk = (sizeof(HelChunk) + params.chunkSize + 63) & ~size_t(63);
-			auto overallSize = chunksOffset + params.numChunks * reservedPerChunk;
-
-			void *mapping;
-			HEL_CHECK(helMapMemory(_handle, kHelNullHandle, nullptr,
-					0, (overallSize + 0xFFF) & ~size_t(0xFFF),
-					kHelMapProtRead | kHelMapProtWrite, &mapping));
-
+			auto mapping = _mapChunks(_initialChunks);
 			_queue = reinterpret_cast<HelQueue *>(mapping);
-			auto chunksPtr = reinterpret_cast<std::byte *>(mapping) + chunksOffset;
-			for(unsigned int i = 0; i < 16; ++i)
-				_chunks[i] = reinterpret_cast<HelChunk *>(chunksPtr + i * reservedPerChunk);
 		}
 
 		return _handle;
 	}
 
+	// Blocks until at least one element is available and dispatches all available elements.
 	void wait() {
+		_dispatch(true);
+		while(_dispatch(false))
+			;
+	}
+
+	// Like wait() but returns false instead of blocking if no element is available.
+	bool tryWait() {
+		return _dispatch(false);
+	}
+
+	// Blocks until an element is available but does not dispatch it.
+	// Must only be called after tryWait() returned false.
+	void block() {
+		bool done;
+		_waitProgressFutex(&done, true);
+	}
+
+private:
+	bool _dispatch(bool block) {
 		while(true) {
 			// TODO: Initialize all chunks when setting up the queue.
 			if(_retrieveIndex == _nextIndex) {
-				assert(_activeChunks < 16);
-
-				// Reset and enqueue the new chunk.
-				_chunks[_activeChunks]->progressFutex = 0;
+				if(_activeChunks == _chunks.size())
+					_grow();
+				assert(_activeChunks < _chunks.size());
 
-				_queue->indexQueue[_nextIndex & ((1 << sizeShift) - 1)] = _activeChunks;
-				_nextIndex = ((_nextIndex + 1) & kHelHeadMask);
-				_wakeHeadFutex();
-
-				_refCounts[_activeChunks] = 1;
-				_activeChunks++;
+				_enqueueNewChunk();
 				continue;
-			}else if (_hadWaiters && _activeChunks < (1 << sizeShift)) {
-				assert(_activeChunks < 16);
-
-				// Reset and enqueue the new chunk.
-				_chunks[_activeChunks]->progressFutex = 0;
-
-				_queue->indexQueue[_nextIndex & ((1 << sizeShift) - 1)] = _activeChunks;
-				_nextIndex = ((_nextIndex + 1) & kHelHeadMask);
-				_wakeHeadFutex();
-
-				_refCounts[_activeChunks] = 1;
-				_activeChunks++;
+			}else if(_hadWaiters && _activeChunks < (1 << sizeShift)) {
+				// The kernel ran out of chunks; supply another one (growing the queue if needed).
+				if(_activeChunks == _chunks.size())
+					_grow();
+				if(_activeChunks < _chunks.size())
+					_enqueueNewChunk();
 				_hadWaiters = false;
 			}
 
 			bool done;
-			_waitProgressFutex(&done);
+			if(!_waitProgressFutex(&done, block))
+				return false;
 			if(done) {
 				_surrender(_numberOf(_retrieveIndex));
 
@@ -250,10 +261,52 @@ public:
 			_refCounts[_numberOf(_retrieveIndex)]++;
 			context->complete(ElementHandle{this, _numberOf(_retrieveIndex),
 					ptr + sizeof(HelElement)});
-			return;
+			return true;
 		}
 	}
 
+	// Maps the queue such that the first numChunks chunks are accessible.
+	// Chunks that are not mapped yet are appended to _chunks.
+	void *_mapChunks(unsigned int numChunks) {
+		auto chunksOffset = (sizeof(HelQueue) + (sizeof(int) << sizeShift) + 63) & ~size_t(63);
+		auto reservedPerChunk = (sizeof(HelChunk) + chunkSize + 63) & ~size_t(63);
+		auto overallSize = chunksOffset + numChunks * reservedPerChunk;
+
+		void *mapping;
+		HEL_CHECK(helMapMemory(_handle, kHelNullHandle, nullptr,
+				0, (overallSize + 0xFFF) & ~size_t(0xFFF),
+				kHelMapProtRead | kHelMapProtWrite, &mapping));
+
+		auto chunksPtr = reinterpret_cast<std::byte *>(mapping) + chunksOffset;
+		for(size_t i = _chunks.size(); i < numChunks; ++i) {
+			_chunks.push_back(reinterpret_cast<HelChunk *>(chunksPtr + i * reservedPerChunk));
+			_refCounts.push_back(0);
+		}
+		return mapping;
+	}
+
+	// Doubles the number of chunks (up to _maxChunks).
+	// Existing mappings stay valid, so outstanding ElementHandles are not affected.
+	void _grow() {
+		auto numChunks = std::min(2 * static_cast<unsigned int>(_chunks.size()), _maxChunks);
+		if(numChunks == _chunks.size())
+			return;
+		HEL_CHECK(helGrowQueue(_handle, numChunks));
+		_mapChunks(numChunks);
+	}
+
+	void _enqueueNewChunk() {
+		// Reset and enqueue the new chunk.
+		_chunks[_activeChunks]->progressFutex = 0;
+
+		_queue->indexQueue[_nextIndex & ((1 << sizeShift) - 1)] = _activeChunks;
+		_nextIndex = ((_nextIndex + 1) & kHelHeadMask);
+		_wakeHeadFutex();
+
+		_refCounts[_activeChunks] = 1;
+		_activeChunks++;
+	}
+
 private:
 	void _surrender(int cn) {
 		assert(_refCounts[cn] > 0);
@@ -292,19 +345,23 @@ private:
 		}
 	}
 
-	void _waitProgressFutex(bool *done) {
+	// Returns false if there is no progress and block is false.
+	bool _waitProgressFutex(bool *done, bool block) {
 		while(true) {
 			auto futex = __atomic_load_n(&_retrieveChunk()->progressFutex, __ATOMIC_ACQUIRE);
 			assert(!(futex & ~(kHelProgressMask | kHelProgressWaiters | kHelProgressDone)));
 			do {
 				if(_lastProgress != (futex & kHelProgressMask)) {
 					*done = false;
-					return;
+					return true;
 				}else if(futex & kHelProgressDone) {
 					*done = true;
-					return;
+					return true;
 				}
 
+				if(!block)
+					return false;
+
 				if(futex & kHelProgressWaiters)
 					break; // Waiters bit is already set (in a previous iteration).
 			} while(!__atomic_compare_exchange_n(&_retrieveChunk()->progressFutex, &futex,
@@ -319,9 +376,12 @@ private:
 private:
 	HelHandle _handle;
 	HelQueue *_queue;
-	HelChunk *_chunks[16];
+	std::vector<HelChunk *> _chunks;
+
+	unsigned int _initialChunks = 16;
+	unsigned int _maxChunks = 256;
 
-	int _activeChunks;
+	size_t _activeChunks;
 	bool _hadWaiters;
 
 	// Index of the chunk that we are currently retrieving/inserting next.
@@ -332,7 +392,7 @@ private:
 	int _lastProgress;
 
 	// Per-chunk reference counts.
-	int _refCounts[16];
+	std::vector<int> _refCounts;
 };
 
 inline void CurrentDispatcherToken::wait() {
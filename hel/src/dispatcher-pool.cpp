@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <helix/dispatcher-pool.hpp>
+
+namespace helix {
+
+namespace {
+	thread_local int currentWorkerIndex = -1;
+}
+
+DispatcherPool::DispatcherPool(unsigned int numWorkers, bool pinWorkers, bool serialize)
+: _pinWorkers{pinWorkers}, _serialized{serialize} {
+	assert(numWorkers >= 1);
+	for(unsigned int i = 0; i < numWorkers; ++i)
+		_workers.push_back(std::make_unique<Worker>());
+}
+
+int DispatcherPool::currentWorker() {
+	return currentWorkerIndex;
+}
+
+void DispatcherPool::post(unsigned int index, Task task) {
+	assert(index < _workers.size());
+	auto worker = _workers[index].get();
+	{
+		std::lock_guard lock{worker->mutex};
+		worker->tasks.push_back(std::move(task));
+		worker->numPending.fetch_add(1, std::memory_order_relaxed);
+	}
+	_ringDoorbell(worker);
+}
+
+void DispatcherPool::post(Task task) {
+	// Prefer the current worker on ties to keep coroutines where they are.
+	unsigned int best = currentWorkerIndex >= 0 ? currentWorkerIndex : 0;
+	size_t bestPending = _workers[best]->numPending.load(std::memory_order_relaxed);
+	for(unsigned int i = 0; i < _workers.size(); ++i) {
+		auto pending = _workers[i]->numPending.load(std::memory_order_relaxed);
+		if(pending < bestPending) {
+			best = i;
+			bestPending = pending;
+		}
+	}
+	post(best, std::move(task));
+}
+
+void DispatcherPool::run() {
+	for(unsigned int i = 1; i < _workers.size(); ++i)
+		_threads.emplace_back([this, i] { _work(i); });
+	_work(0);
+}
+
+void DispatcherPool::_work(unsigned int index) {
+	auto worker = _workers[index].get();
+	currentWorkerIndex = index;
+
+	if(_pinWorkers) {
+		std::vector<uint8_t> mask((index + 8) / 8);
+		mask[index / 8] = 1 << (index % 8);
+		// Fails if the CPU does not exist; in that case, the worker remains unpinned.
+		auto error = helSetAffinity(kHelThisThread, mask.data(), mask.size());
+		if(error != kHelErrOutOfBounds)
+			HEL_CHECK(error);
+	}
+
+	// Publish our queue. Tasks posted before this point are picked up below.
+	auto &dispatcher = Dispatcher::global();
+	worker->queue.store(dispatcher.acquire());
+
+	while(true) {
+		{
+			// Re-take the lock for every item so that other workers can make progress.
+			auto serialLock = _serialize();
+			if(dispatcher.tryWait())
+				continue;
+			if(_runTask(worker))
+				continue;
+			if(_stealTask(index))
+				continue;
+
+			// Clear the doorbell before re-checking our tasks under the mutex.
+			// If post() enqueues its task after our check, its _ringDoorbell()
+			// is ordered after our store by the mutex and sees the cleared doorbell.
+			worker->doorbellPending.store(false, std::memory_order_relaxed);
+			std::lock_guard lock{worker->mutex};
+			if(!worker->tasks.empty())
+				continue;
+		}
+		dispatcher.block();
+	}
+}
+
+bool DispatcherPool::_runTask(Worker *worker) {
+	Task task;
+	{
+		std::lock_guard lock{worker->mutex};
+		if(worker->tasks.empty())
+			return false;
+		task = std::move(worker->tasks.front());
+		worker->tasks.pop_front();
+		worker->numPending.fetch_sub(1, std::memory_order_relaxed);
+	}
+	task();
+	return true;
+}
+
+bool DispatcherPool::_stealTask(unsigned int index) {
+	for(unsigned int k = 1; k < _workers.size(); ++k) {
+		auto victim = _workers[(index + k) % _workers.size()].get();
+		if(!victim->numPending.load(std::memory_order_relaxed))
+			continue;
+
+		Task task;
+		{
+			std::unique_lock lock{victim->mutex, std::try_to_lock};
+			if(!lock.owns_lock() || victim->tasks.empty())
+				continue;
+			// Steal from the back; the victim works from the front.
+			task = std::move(victim->tasks.back());
+			victim->tasks.pop_back();
+			victim->numPending.fetch_sub(1, std::memory_order_relaxed);
+		}
+		task();
+		return true;
+	}
+	return false;
+}
+
+// Must be called after the task was enqueued (and the worker's mutex was released).
+void DispatcherPool::_ringDoorbell(Worker *worker) {
+	if(worker->doorbellPending.exchange(true, std::memory_order_relaxed))
+		return;
+
+	// If the worker did not publish its queue yet, it checks its tasks before blocking.
+	auto queue = worker->queue.load();
+	if(queue == kHelNullHandle)
+		return;
+
+	// An AwaitClock in the past completes immediately and wakes up the worker.
+	uint64_t asyncId;
+	HEL_CHECK(helSubmitAwaitClock(0, queue,
+			reinterpret_cast<uintptr_t>(static_cast<Context *>(&worker->doorbell)), &asyncId));
+}
+
+} // namespace helix
@@ -25,6 +25,47 @@ private:
 		return illegalAddress;
 	}
 
+	// Finds a root within the first `limit` roots that has a free chunk of at least `target`.
+	// Uses the summary (if available) such that we do not need to scan all roots.
+	AddressType findAllocatableRoot(AddressType limit, int target) {
+		if (!summary_)
+			return findAllocatableChunk(buddyPointer_, 0, limit, target);
+
+		auto words = summaryWordsPerOrder(numRoots_);
+		uint64_t *summary = summary_ + target * words;
+		for (size_t w = 0; w < words; w++) {
+			auto base = AddressType(w) * 64;
+			if (base >= limit)
+				break;
+			auto mask = summary[w];
+			if (limit - base < 64)
+				mask &= (uint64_t{1} << (limit - base)) - 1;
+			if (mask)
+				return base + __builtin_ctzll(mask);
+		}
+		return illegalAddress;
+	}
+
+	// Updates the summary after the given root has changed.
+	void updateSummary(AddressType root) {
+		if (!summary_)
+			return;
+
+		auto words = summaryWordsPerOrder(numRoots_);
+		auto bit = uint64_t{1} << (root % 64);
+		int freeOrder = buddyPointer_[root];
+		for (int order = 0; order <= tableOrder_; order++) {
+			auto word = &summary_[order * words + root / 64];
+			if (freeOrder >= order) {
+				*word |= bit;
+			} else {
+				*word &= ~bit;
+			}
+		}
+	}
+
+	static size_t summaryWordsPerOrder(AddressType numRoots) { return (numRoots + 63) / 64; }
+
 	// Determines the largest free chunk in the given range.
 	static int scanFreeChunks(int8_t *slice, AddressType base, AddressType limit, int order) {
 		int freeOrder = -1;
@@ -113,6 +154,13 @@ public:
 		return size;
 	}
 
+	// Determines the number of 64-bit words required for the free-root summary.
+	// The summary stores one bitmap of roots per order; a bit is set if the root
+	// contains a free chunk of at least this order.
+	static size_t determineSummaryWords(AddressType numRoots, int tableOrder) {
+		return (tableOrder + 1) * summaryWordsPerOrder(numRoots);
+	}
+
 	// Inititalizes the buddy allocator array.
 	static void initialize(int8_t *pointer, AddressType numRoots, int tableOrder) {
 		int8_t *slice = pointer;
@@ -141,6 +189,23 @@ public:
 
 	int tableOrder() { return tableOrder_; }
 
+	// Attaches a free-root summary to this accessor and initializes it from the buddy tree.
+	// The summary is optional; without it, allocations scan all roots linearly.
+	void attachSummary(uint64_t *summary) {
+		summary_ = summary;
+		for (size_t i = 0; i < determineSummaryWords(numRoots_, tableOrder_); i++)
+			summary_[i] = 0;
+		for (AddressType i = 0; i < numRoots_; i++)
+			updateSummary(i);
+	}
+
+	// Returns true if there is a free chunk of at least the given order.
+	bool hasFreeChunk(int order) {
+		if (order > tableOrder_)
+			return false;
+		return findAllocatableRoot(numRoots_, order) != illegalAddress;
+	}
+
 	AddressType allocate(int order, int addressBits) {
 		assert(order >= 0);
 		if (order > tableOrder_)
@@ -165,6 +230,10 @@ public:
 			if (addressableRange < (AddressType{1} << (order + _sizeShift)))
 				return illegalAddress;
 
+			// Below, we descend without consulting the summary; reject exhausted regions first.
+			if (summary_ && !hasFreeChunk(order))
+				return illegalAddress;
+
 			// Descend until some constant number (i.e., 4) of roots are fully addressable,
 			// i.e., are addressable with addressBits-many bits.
 			while (currentOrder > order && (addressableRange >> (currentOrder + _sizeShift)) > 4) {
@@ -180,7 +249,12 @@ public:
 
 		// First phase: Descent to the target order.
 		// In this phase find a free element.
-		AddressType allocIndex = findAllocatableChunk(slice, 0, eligibleRoots, order);
+		AddressType allocIndex;
+		if (slice == buddyPointer_) {
+			allocIndex = findAllocatableRoot(eligibleRoots, order);
+		} else {
+			allocIndex = findAllocatableChunk(slice, 0, eligibleRoots, order);
+		}
 		if (allocIndex == illegalAddress)
 			return illegalAddress;
 		while (currentOrder > order) {
@@ -207,6 +281,7 @@ public:
 			slice -= size_t(numRoots_) << (tableOrder_ - currentOrder);
 			slice[updateIndex] = freeOrder;
 		}
+		updateSummary(updateIndex);
 
 		AddressType physical = _baseAddress + (allocIndex << (order + _sizeShift));
 		if (addressBits < static_cast<int>(sizeof(AddressType) * 8))
@@ -250,6 +325,7 @@ public:
 			slice -= size_t(numRoots_) << (tableOrder_ - currentOrder);
 			slice[updateIndex] = freeOrder;
 		}
+		updateSummary(updateIndex);
 
 		if constexpr (enableBuddySanityChecking)
 			sanityCheck();
@@ -258,6 +334,16 @@ public:
 	void sanityCheck() {
 		for (size_t i = 0; i < size_t(numRoots_); ++i)
 			traverseForSanityCheck(buddyPointer_, tableOrder_, i);
+
+		if (summary_) {
+			auto words = summaryWordsPerOrder(numRoots_);
+			for (size_t i = 0; i < size_t(numRoots_); ++i) {
+				for (int order = 0; order <= tableOrder_; order++) {
+					bool bit = summary_[order * words + i / 64] & (uint64_t{1} << (i % 64));
+					assert(bit == (buddyPointer_[i] >= order));
+				}
+			}
+		}
 	}
 
 private:
@@ -266,4 +352,5 @@ private:
 	int8_t *buddyPointer_;
 	AddressType numRoots_;
 	int tableOrder_;
+	uint64_t *summary_ = nullptr;
 };
@@ -46,6 +46,7 @@ enum {
 	kMsrIndexGsBase = 0xC0000101,
 	kMsrIndexKernelGsBase = 0xC0000102,
 	kMsrIndexVmCr = 0xC0010114,
+	kMsrXss = 0x00000DA0,
 };
 
 enum { kMsrSyscallEnable = 1 };
@@ -66,6 +67,38 @@ inline void xrstor(uint8_t *area, uint64_t rfbm) {
 	asm volatile("xrstor %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
 }
 
+inline void xsaveopt(uint8_t *area, uint64_t rfbm) {
+	assert(!((uintptr_t)area & 0x3F));
+
+	uintptr_t low = rfbm & 0xFFFFFFFF;
+	uintptr_t high = (rfbm >> 32) & 0xFFFFFFFF;
+	asm volatile("xsaveopt %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
+}
+
+inline void xsavec(uint8_t *area, uint64_t rfbm) {
+	assert(!((uintptr_t)area & 0x3F));
+
+	uintptr_t low = rfbm & 0xFFFFFFFF;
+	uintptr_t high = (rfbm >> 32) & 0xFFFFFFFF;
+	asm volatile("xsavec %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
+}
+
+inline void xsaves(uint8_t *area, uint64_t rfbm) {
+	assert(!((uintptr_t)area & 0x3F));
+
+	uintptr_t low = rfbm & 0xFFFFFFFF;
+	uintptr_t high = (rfbm >> 32) & 0xFFFFFFFF;
+	asm volatile("xsaves %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
+}
+
+inline void xrstors(uint8_t *area, uint64_t rfbm) {
+	assert(!((uintptr_t)area & 0x3F));
+
+	uintptr_t low = rfbm & 0xFFFFFFFF;
+	uintptr_t high = (rfbm >> 32) & 0xFFFFFFFF;
+	asm volatile("xrstors %0" : : "m"(*area), "a"(low), "d"(high) : "memory");
+}
+
 inline void wrmsr(uint32_t index, uint64_t value) {
 	uint32_t low = value;
 	uint32_t high = value >> 32;
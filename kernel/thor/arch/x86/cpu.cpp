@@ -54,7 +54,9 @@ static constexpr uint32_t mxcsrInitializer = 0b1111110000000;
 
 size_t Executor::determineSimdSize() {
 	assert(cpuFeaturesKnown);
-	if(getGlobalCpuFeatures()->haveXsave){
+	if(getGlobalCpuFeatures()->haveXsavec || getGlobalCpuFeatures()->haveXsaves){
+		return getGlobalCpuFeatures()->xsaveCompactRegionSize;
+	}else if(getGlobalCpuFeatures()->haveXsave){
 		return getGlobalCpuFeatures()->xsaveRegionSize;
 	}else{
 		return sizeof(FxState);
@@ -66,6 +68,58 @@ size_t Executor::determineSize() {
 	return sizeof(General) + 0x10 + determineSimdSize();
 }
 
+// Fills in the XSAVE header such that restoring the area loads the x87 and SSE state
+// that we set up above while all other components are loaded in their initial state.
+static void initializeXsaveHeader(uint8_t *area) {
+	if(!getGlobalCpuFeatures()->haveXsave)
+		return;
+
+	uint64_t xstateBv = 0b11;
+	memcpy(area + 512, &xstateBv, sizeof(uint64_t));
+
+	// XRSTORS only accepts areas in the compacted format; XSAVEC also saves in that format.
+	if(getGlobalCpuFeatures()->haveXsavec || getGlobalCpuFeatures()->haveXsaves) {
+		uint64_t xcompBv = (uint64_t(1) << 63) | getGlobalCpuFeatures()->xsaveMask;
+		memcpy(area + 520, &xcompBv, sizeof(uint64_t));
+	}
+}
+
+bool Executor::validateSimdState(const void *image) {
+	auto area = reinterpret_cast<const uint8_t *>(image);
+
+	// Reserved MXCSR bits make FXRSTOR and XRSTOR(S) fault.
+	uint32_t mxcsr;
+	memcpy(&mxcsr, area + offsetof(FxState, mxcsr), sizeof(uint32_t));
+	if(mxcsr & ~uint32_t(0xFFFF))
+		return false;
+
+	if(!getGlobalCpuFeatures()->haveXsave)
+		return true;
+
+	uint64_t xstateBv;
+	uint64_t xcompBv;
+	memcpy(&xstateBv, area + 512, sizeof(uint64_t));
+	memcpy(&xcompBv, area + 520, sizeof(uint64_t));
+
+	// Only components that are enabled in XCR0 can be restored.
+	if(xstateBv & ~getGlobalCpuFeatures()->xsaveMask)
+		return false;
+
+	// The format of the area must match the format that we save in.
+	uint64_t expectedXcompBv = 0;
+	if(getGlobalCpuFeatures()->haveXsavec || getGlobalCpuFeatures()->haveXsaves)
+		expectedXcompBv = (uint64_t(1) << 63) | getGlobalCpuFeatures()->xsaveMask;
+	if(xcompBv != expectedXcompBv)
+		return false;
+
+	// The remaining bytes of the XSAVE header are reserved and must be zero.
+	for(size_t i = 528; i < 576; i++) {
+		if(area[i])
+			return false;
+	}
+	return true;
+}
+
 Executor::Executor()
 : _pointer{nullptr}, _syscallStack{nullptr}, _tss{nullptr} { }
 
@@ -79,6 +133,7 @@ Executor::Executor(UserContext *context, AbiParameters abi) {
 
 	_fxState()->mxcsr |= mxcsrInitializer;
 	_fxState()->fcw |= fcwInitializer;
+	initializeXsaveHeader(reinterpret_cast<uint8_t *>(_fxState()));
 
 	general()->rip = abi.ip;
 	general()->rflags = 0x200;
@@ -101,6 +156,7 @@ Executor::Executor(FiberContext *context, AbiParameters abi)
 
 	_fxState()->mxcsr |= mxcsrInitializer;
 	_fxState()->fcw |= fcwInitializer;
+	initializeXsaveHeader(reinterpret_cast<uint8_t *>(_fxState()));
 
 	general()->rip = abi.ip;
 	general()->rflags = 0x200;
@@ -140,11 +196,7 @@ void saveExecutor(Executor *executor, FaultImageAccessor accessor) {
 	executor->general()->clientFs = common::x86::rdmsr(common::x86::kMsrIndexFsBase);
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
-	if(getGlobalCpuFeatures()->haveXsave){
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	} else {
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveCurrentSimdState(executor);
 }
 
 void saveExecutor(Executor *executor, IrqImageAccessor accessor) {
@@ -173,12 +225,7 @@ void saveExecutor(Executor *executor, IrqImageAccessor accessor) {
 	executor->general()->clientFs = common::x86::rdmsr(common::x86::kMsrIndexFsBase);
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
-
-	if(getGlobalCpuFeatures()->haveXsave){
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	}else{
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveCurrentSimdState(executor);
 }
 
 void saveExecutor(Executor *executor, SyscallImageAccessor accessor) {
@@ -207,11 +254,7 @@ void saveExecutor(Executor *executor, SyscallImageAccessor accessor) {
 	executor->general()->clientFs = common::x86::rdmsr(common::x86::kMsrIndexFsBase);
 	executor->general()->clientGs = common::x86::rdmsr(common::x86::kMsrIndexKernelGsBase);
 
-	if(getGlobalCpuFeatures()->haveXsave){
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	}else{
-		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
-	}
+	saveCurrentSimdState(executor);
 }
 
 extern "C" void workStub();
@@ -254,10 +297,21 @@ extern "C" [[ noreturn ]] void _restoreExecutorRegisters(void *pointer);
 	common::x86::wrmsr(common::x86::kMsrIndexFsBase, executor->general()->clientFs);
 	common::x86::wrmsr(common::x86::kMsrIndexKernelGsBase, executor->general()->clientGs);
 
-	if(getGlobalCpuFeatures()->haveXsave){
-		common::x86::xrstor((uint8_t*)executor->_fxState(), ~0);
-	}else{
-		asm volatile ("fxrstorq %0" : : "m" (*executor->_fxState()));
+	// If the SIMD registers still contain the state of this executor, we can skip the restore.
+	// This is the case if we switch back to the same thread without running another one.
+	auto cpuData = getCpuData();
+	if(cpuData->simdOwner != executor || executor->_simdLoadedOn != cpuData) {
+		auto features = getGlobalCpuFeatures();
+		auto area = reinterpret_cast<uint8_t *>(executor->_fxState());
+		if(features->haveXsaves){
+			common::x86::xrstors(area, features->xsaveMask);
+		}else if(features->haveXsave){
+			common::x86::xrstor(area, features->xsaveMask);
+		}else{
+			asm volatile ("fxrstorq %0" : : "m" (*executor->_fxState()));
+		}
+		cpuData->simdOwner = executor;
+		executor->_simdLoadedOn = cpuData;
 	}
 
 	uint16_t cs = executor->general()->cs;
@@ -400,6 +454,47 @@ static initgraph::Task enumerateCpuFeaturesTask{&globalInitEngine, "x86.enumerat
 			}else{
 				debugLogger() << "thor: CPUs do not support AVX-512!" << frg::endlog;
 			}
+
+			uint64_t mask = 0;
+			mask |= (uint64_t(1) << 0); // x87 feature set
+			mask |= (uint64_t(1) << 1); // SSE feature set
+			if(globalCpuFeatures.haveAvx)
+				mask |= (uint64_t(1) << 2); // AVX feature set
+			if(globalCpuFeatures.haveZmm) {
+				mask |= (uint64_t(1) << 5); // AVX-512 opmask
+				mask |= (uint64_t(1) << 6); // ZMM{0 -> 15}
+				mask |= (uint64_t(1) << 7); // ZMM{16 -> 31}
+			}
+			globalCpuFeatures.xsaveMask = mask;
+
+			auto xsaveSubCpuid = common::x86::cpuid(0xD, 1);
+			if(xsaveSubCpuid[0] & (uint32_t(1) << 0)) {
+				debugLogger() << "thor: CPUs support XSAVEOPT" << frg::endlog;
+				globalCpuFeatures.haveXsaveopt = true;
+			}
+			if(xsaveSubCpuid[0] & (uint32_t(1) << 1)) {
+				debugLogger() << "thor: CPUs support XSAVEC" << frg::endlog;
+				globalCpuFeatures.haveXsavec = true;
+			}
+			if(xsaveSubCpuid[0] & (uint32_t(1) << 3)) {
+				debugLogger() << "thor: CPUs support XSAVES" << frg::endlog;
+				globalCpuFeatures.haveXsaves = true;
+			}
+
+			// Determine the size of the compacted area: the legacy region and the header
+			// are followed by all enabled components (some of which are 64-byte aligned).
+			size_t compactSize = 576;
+			for(int i = 2; i < 63; i++) {
+				if(!(mask & (uint64_t(1) << i)))
+					continue;
+				auto componentCpuid = common::x86::cpuid(0xD, i);
+				if(componentCpuid[2] & (uint32_t(1) << 1))
+					compactSize = (compactSize + 63) & ~size_t(63);
+				compactSize += componentCpuid[0];
+			}
+			globalCpuFeatures.xsaveCompactRegionSize = compactSize;
+			debugLogger() << "thor: XSAVE area is " << globalCpuFeatures.xsaveRegionSize
+					<< " bytes (" << compactSize << " bytes compacted)" << frg::endlog;
 		}
 
 		if(common::x86::cpuid(0x80000007)[3] & (1 << 8)) {
@@ -419,6 +514,13 @@ static initgraph::Task enumerateCpuFeaturesTask{&globalInitEngine, "x86.enumerat
 					<< frg::endlog;
 		}
 
+		if(common::x86::cpuid(common::x86::kCpuIndexExtendedFeatures)[3] & (1 << 26)) {
+			debugLogger() << "thor: CPUs support 1 GiB pages" << frg::endlog;
+			globalCpuFeatures.haveGigabytePages = true;
+		}else{
+			debugLogger() << "thor: CPUs do not support 1 GiB pages!" << frg::endlog;
+		}
+
 		auto intelPmLeaf = common::x86::cpuid(0xA)[0];
 		if(intelPmLeaf & 0xFF) {
 			debugLogger() << "thor: CPUs support Intel performance counters"
@@ -556,9 +658,38 @@ static initgraph::Task initBootProcessorTask{&globalInitEngine, "x86.init-boot-p
 	}
 };
 
+// Determines the core and package of the current CPU from its x2APIC ID.
+static void detectCpuTopology(CpuData *cpuData) {
+	if(common::x86::cpuid(0)[0] < 0xB)
+		return;
+
+	int smtShift = -1;
+	int coreShift = -1;
+	for(uint32_t i = 0; ; i++) {
+		auto leaf = common::x86::cpuid(0xB, i);
+		auto type = (leaf[2] >> 8) & 0xFF;
+		if(!type)
+			break;
+		if(type == 1)
+			smtShift = leaf[0] & 0x1F;
+		if(type == 2)
+			coreShift = leaf[0] & 0x1F;
+	}
+	if(smtShift < 0 || coreShift < 0)
+		return;
+
+	auto x2apicId = common::x86::cpuid(0xB, 0)[3];
+	cpuData->coreId = (x2apicId & ((uint32_t(1) << coreShift) - 1)) >> smtShift;
+	cpuData->packageId = x2apicId >> coreShift;
+}
+
 void initializeThisProcessor() {
 	auto cpuData = getCpuData();
 
+	detectCpuTopology(cpuData);
+	debugLogger() << "thor: CPU #" << cpuData->cpuIndex << " is core " << cpuData->coreId
+			<< " of package " << cpuData->packageId << frg::endlog;
+
 	// Allocate per-CPU areas.
 	cpuData->irqStack = UniqueKernelStack::make();
 	cpuData->dfStack = UniqueKernelStack::make();
@@ -630,20 +761,12 @@ void initializeThisProcessor() {
 		cr4 |= uint32_t(1) << 18; // Enable XSAVE and x{get, set}bv
 		asm volatile ("mov %0, %%cr4" : : "r" (cr4));
 
-		uint64_t xcr0 = 0;
-		xcr0 |= (uint64_t(1) << 0); // Enable saving of x87 feature set
-		xcr0 |= (uint64_t(1) << 1); // Enable saving of SSE feature set
-
-		if(getGlobalCpuFeatures()->haveAvx)
-			xcr0 |= (uint64_t(1) << 2); // Enable saving of AVX feature set and enable it
-
-		if(getGlobalCpuFeatures()->haveZmm) {
-			xcr0 |= (uint64_t(1) << 5); // Enable AVX-512
-			xcr0 |= (uint64_t(1) << 6); // Enable management of ZMM{0 -> 15}
-			xcr0 |= (uint64_t(1) << 7); // Enable management of ZMM{16 -> 31}
-		}
+		// Enable x87, SSE and (if available) AVX and AVX-512.
+		common::x86::wrxcr(0, getGlobalCpuFeatures()->xsaveMask);
 
-		common::x86::wrxcr(0, xcr0);
+		// We do not manage any supervisor state components.
+		if(getGlobalCpuFeatures()->haveXsaves)
+			common::x86::wrmsr(common::x86::kMsrXss, 0);
 	}
 
 	// Enable the SMAP extension.
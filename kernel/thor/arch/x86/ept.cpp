@@ -109,9 +109,9 @@ bool EptOperations::submitShootdown(ShootNode *node) {
 }
 
 frg::expected<Error> EptOperations::mapPresentPages(VirtualAddr va, MemoryView *view,
-		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode, bool huge) {
 	return mapPresentPagesByCursor<EptCursor>(pageSpace_,
-			va, view, offset, size, flags, mode);
+			va, view, offset, size, flags, mode, huge);
 }
 
 frg::expected<Error> EptOperations::remapPresentPages(VirtualAddr va, MemoryView *view,
@@ -1,10 +1,12 @@
 #include <thor-internal/cpu-data.hpp>
+#include <thor-internal/fiber.hpp>
 #include <thor-internal/int-call.hpp>
 #include <thor-internal/profile.hpp>
 #include <thor-internal/thread.hpp>
 #include <thor-internal/arch-generic/cpu.hpp>
 #include <thor-internal/arch/pmc-amd.hpp>
 #include <thor-internal/arch/pmc-intel.hpp>
+#include <thor-internal/arch/paging.hpp>
 #include <thor-internal/arch/system.hpp>
 #include <thor-internal/arch/pic.hpp>
 
@@ -554,6 +556,95 @@ namespace {
 			}
 		}
 	}
+
+#ifdef THOR_HAS_FRAME_POINTERS
+	// Returns the top of the kernel stack that contains sp or zero if sp is not on a known stack.
+	uintptr_t findKernelStackTop(CpuData *cpuData, uintptr_t sp) {
+		uintptr_t tops[] = {
+			reinterpret_cast<uintptr_t>(cpuData->syscallStack),
+			cpuData->activeFiber
+				? reinterpret_cast<uintptr_t>(cpuData->activeFiber->stack().basePtr()) : 0,
+			reinterpret_cast<uintptr_t>(cpuData->irqStack.basePtr()),
+			reinterpret_cast<uintptr_t>(cpuData->detachedStack.basePtr()),
+			reinterpret_cast<uintptr_t>(cpuData->dfStack.basePtr()),
+		};
+		for(auto top : tops) {
+			if(top && sp <= top && sp >= top - UniqueKernelStack::kSize)
+				return top;
+		}
+		return 0;
+	}
+#endif
+
+	// Records the interrupted IP together with the kernel and user call chains.
+	// Call chains are reconstructed by following frame pointers.
+	void captureProfileSample(CpuData *cpuData, NmiImageAccessor image) {
+		bool inUser = *image.cs() == kSelClientUserCode;
+		// User samples can only be attributed (and walked) if we know the thread.
+		if(inUser && (cpuData->activeFiber || !cpuData->activeThread))
+			return;
+
+		struct {
+			ProfileSample sample;
+			uint64_t frames[ProfileSample::maxKernelFrames + ProfileSample::maxUserFrames];
+		} record;
+		record.sample = {};
+		record.sample.magic = ProfileSample::sampleMagic;
+		record.sample.cpu = cpuData->cpuIndex;
+
+		size_t n = 0;
+		if(!inUser) {
+			record.frames[n++] = *image.ip();
+#ifdef THOR_HAS_FRAME_POINTERS
+			// Only follow frames within the stack that we interrupted
+			// to avoid faulting on garbage frame pointers.
+			uintptr_t sp = *image.sp();
+			uintptr_t bp = *image.bp();
+			auto top = findKernelStackTop(cpuData, sp);
+			while(top && n < ProfileSample::maxKernelFrames) {
+				if(bp < sp || bp > top - 16 || (bp & 7))
+					break;
+				auto frame = reinterpret_cast<uintptr_t *>(bp);
+				if(!frame[1])
+					break;
+				record.frames[n++] = frame[1];
+				sp = bp + 16;
+				bp = frame[0];
+			}
+#endif
+			record.sample.numKernelFrames = n;
+		}
+
+		// Attribute the sample to the current thread (unless a fiber is running).
+		if(!cpuData->activeFiber && cpuData->activeThread) {
+			auto thread = cpuData->activeThread.get();
+			auto credentials = thread->credentials();
+			memcpy(&record.sample.threadId, credentials.data(), sizeof(uint64_t));
+			record.sample.universeId = reinterpret_cast<uintptr_t>(thread->getUniverse().get());
+
+			if(inUser) {
+				// User space memory is read by walking the page tables since we cannot fault here.
+				auto base = n;
+				record.frames[n++] = *image.ip();
+				uint64_t sp = *image.sp();
+				uint64_t bp = *image.bp();
+				while(n - base < ProfileSample::maxUserFrames) {
+					if(bp < sp || bp - sp > (uint64_t{1} << 23))
+						break;
+					uint64_t nextBp, ip;
+					if(!peekUserWord(bp, nextBp) || !peekUserWord(bp + 8, ip) || !ip)
+						break;
+					record.frames[n++] = ip;
+					sp = bp + 16;
+					bp = nextBp;
+				}
+				record.sample.numUserFrames = n - base;
+			}
+		}
+
+		cpuData->localProfileRing->enqueue(&record,
+				sizeof(ProfileSample) + n * sizeof(uint64_t));
+	}
 }
 
 extern "C" void onPlatformNmi(NmiImageAccessor image) {
@@ -573,15 +664,13 @@ extern "C" void onPlatformNmi(NmiImageAccessor image) {
 	bool explained = false;
 	auto pmcMechanism = cpuData->profileMechanism.load(std::memory_order_acquire);
 	if(pmcMechanism == ProfileMechanism::intelPmc && checkIntelPmcOverflow()) {
-		uintptr_t ip = *image.ip();
-		cpuData->localProfileRing->enqueue(&ip, sizeof(uintptr_t));
+		captureProfileSample(cpuData, image);
 		// Note: on Intel, the PMI is automatically masked on raises.
 		LocalApicContext::clearPmi();
 		setIntelPmc();
 		explained = true;
 	}else if(pmcMechanism == ProfileMechanism::amdPmc && checkAmdPmcOverflow()) {
-		uintptr_t ip = *image.ip();
-		cpuData->localProfileRing->enqueue(&ip, sizeof(uintptr_t));
+		captureProfileSample(cpuData, image);
 		setAmdPmc();
 		explained = true;
 	}
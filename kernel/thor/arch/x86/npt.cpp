@@ -97,9 +97,9 @@ bool NptOperations::submitShootdown(ShootNode *node) {
 }
 
 frg::expected<Error> NptOperations::mapPresentPages(VirtualAddr va, MemoryView *view,
-		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode, bool huge) {
 	return mapPresentPagesByCursor<NptCursor>(pageSpace_,
-			va, view, offset, size, flags, mode);
+			va, view, offset, size, flags, mode, huge);
 }
 
 frg::expected<Error> NptOperations::remapPresentPages(VirtualAddr va, MemoryView *view,
@@ -1,6 +1,7 @@
 
 #include <arch/variable.hpp>
 #include <frg/list.hpp>
+#include <thor-internal/arch/cpu.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/physical.hpp>
 #include <thor-internal/mm-rc.hpp>
@@ -67,6 +68,10 @@ void invalidatePage(int asid, const void *address) {
 	}
 }
 
+bool haveGigabytePages() {
+	return getGlobalCpuFeatures()->haveGigabytePages;
+}
+
 // --------------------------------------------------------
 // Kernel paging management.
 // --------------------------------------------------------
@@ -166,8 +171,10 @@ ClientPageSpace::~ClientPageSpace() {
 		PageAccessor accessor{ps};
 		auto tbl = reinterpret_cast<uint64_t *>(accessor.get());
 		for(int i = 0; i < 512; i++) {
-			if(tbl[i] & ptePresent)
-				physicalAllocator->free(tbl[i] & pteAddress, kPageSize);
+			if(!(tbl[i] & ptePresent))
+				continue;
+			assert(!(tbl[i] & pteHuge) && "huge page still mapped in destructed page space");
+			physicalAllocator->free(tbl[i] & pteAddress, kPageSize);
 		}
 	};
 
@@ -177,6 +184,7 @@ ClientPageSpace::~ClientPageSpace() {
 		for(int i = 0; i < 512; i++) {
 			if(!(tbl[i] & ptePresent))
 				continue;
+			assert(!(tbl[i] & pteHuge) && "huge page still mapped in destructed page space");
 			clearLevel2(tbl[i] & pteAddress);
 			physicalAllocator->free(tbl[i] & pteAddress, kPageSize);
 		}
@@ -199,4 +207,41 @@ bool ClientPageSpace::updatePageAccess(VirtualAddr, PageFlags) {
 	return false;
 }
 
+bool peekUserWord(uintptr_t address, uint64_t &word) {
+	if(address & 7)
+		return false;
+	if(address >= (uintptr_t{1} << getLowerHalfBits()))
+		return false;
+
+	PhysicalAddr table;
+	asm volatile ("mov %%cr3, %0" : "=r" (table));
+	table &= pteAddress;
+
+	// Walk the page tables that are currently loaded. Since this CPU still uses them,
+	// they cannot be freed concurrently.
+	for(int level = 0; level < 4; level++) {
+		auto shift = 39 - 9 * level;
+		PageAccessor accessor{table};
+		auto pte = __atomic_load_n(reinterpret_cast<uint64_t *>(accessor.get())
+				+ ((address >> shift) & 511), __ATOMIC_RELAXED);
+		if(!(pte & ptePresent) || !(pte & pteUser))
+			return false;
+
+		if((level == 1 || level == 2) && (pte & pteHuge)) {
+			auto physical = (pte & pteAddress & ~((PhysicalAddr{1} << shift) - 1))
+					+ (address & ((uintptr_t{1} << shift) - 1));
+			PageAccessor pageAccessor{physical & ~PhysicalAddr{kPageSize - 1}};
+			memcpy(&word, reinterpret_cast<char *>(pageAccessor.get())
+					+ (physical & (kPageSize - 1)), sizeof(uint64_t));
+			return true;
+		}
+		table = pte & pteAddress;
+	}
+
+	PageAccessor pageAccessor{table};
+	memcpy(&word, reinterpret_cast<char *>(pageAccessor.get())
+			+ (address & (kPageSize - 1)), sizeof(uint64_t));
+	return true;
+}
+
 } // namespace thor
@@ -18,6 +18,7 @@ struct AssemblyCpuData {
 };
 
 struct Thread;
+struct Executor;
 
 struct PlatformCpuData : public AssemblyCpuData {
 	PlatformCpuData();
@@ -33,6 +34,10 @@ struct PlatformCpuData : public AssemblyCpuData {
 
 	common::x86::Tss64 tss;
 
+	// Executor whose state was most recently loaded into this CPU's SIMD registers.
+	// Only used for comparison; may point to a destroyed executor.
+	Executor *simdOwner{nullptr};
+
 	bool havePcids = false;
 	bool haveSmap = false;
 	bool haveVirtualization = false;
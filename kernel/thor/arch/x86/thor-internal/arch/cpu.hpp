@@ -285,6 +285,8 @@ struct NmiImageAccessor {
 	}
 
 	Word *ip() { return &_frame()->rip; }
+	Word *sp() { return &_frame()->rsp; }
+	Word *bp() { return &_frame()->rbp; }
 	Word *cs() { return &_frame()->cs; }
 	Word *rflags() { return &_frame()->rflags; }
 
@@ -380,6 +382,8 @@ struct Executor {
 
 	static size_t determineSize();
 	static size_t determineSimdSize();
+	// Checks that a SIMD state image of determineSimdSize() bytes can be restored.
+	static bool validateSimdState(const void *image);
 
 	Executor();
 
@@ -405,6 +409,11 @@ struct Executor {
 	Word *cs() { return &general()->cs; }
 	Word *ss() { return &general()->ss; }
 
+	// Must be called after the saved SIMD state was modified in memory.
+	void invalidateSimdState() {
+		_simdLoadedOn = nullptr;
+	}
+
 	Word *arg0() { return &general()->rsi; }
 	Word *arg1() { return &general()->rdx; }
 	Word *result0() { return &general()->rdi; }
@@ -501,6 +510,10 @@ private:
 	char *_pointer;
 	void *_syscallStack;
 	common::x86::Tss64 *_tss;
+
+	// CPU whose SIMD registers were last loaded from (or saved to) this executor.
+	// Together with PlatformCpuData::simdOwner, this allows us to skip restores.
+	CpuData *_simdLoadedOn{nullptr};
 };
 
 struct CpuFeatures {
@@ -508,14 +521,23 @@ struct CpuFeatures {
 	static constexpr uint32_t profileAmdSupported = 2;
 
 	bool haveXsave;
+	bool haveXsaveopt;
+	bool haveXsavec;
+	bool haveXsaves;
 	bool haveAvx;
 	bool haveZmm;
 	bool haveInvariantTsc;
 	bool haveTscDeadline;
+	bool haveGigabytePages;
 	bool haveVmx;
 	bool haveSvm;
 	uint32_t profileFlags;
+	// Size of the standard (non-compacted) XSAVE area for all supported features.
 	size_t xsaveRegionSize;
+	// Size of the compacted XSAVE area for the features in xsaveMask.
+	size_t xsaveCompactRegionSize;
+	// Features that we enable in XCR0 (and save on context switch).
+	uint64_t xsaveMask;
 };
 
 extern bool cpuFeaturesKnown;
@@ -539,10 +561,20 @@ void initializeThisProcessor();
 void bootSecondary(unsigned int apic_id);
 
 // Save the current SIMD register state into the given executor.
+// Uses the most efficient XSAVE variant that the CPU supports; XSAVEOPT, XSAVEC and XSAVES
+// skip components that are in their initial state or unmodified since the last restore.
 inline void saveCurrentSimdState(Executor *executor) {
-	if(getGlobalCpuFeatures()->haveXsave) {
-		common::x86::xsave((uint8_t*)executor->_fxState(), ~0);
-	} else {
+	auto features = getGlobalCpuFeatures();
+	auto area = reinterpret_cast<uint8_t *>(executor->_fxState());
+	if(features->haveXsaves) {
+		common::x86::xsaves(area, features->xsaveMask);
+	}else if(features->haveXsavec) {
+		common::x86::xsavec(area, features->xsaveMask);
+	}else if(features->haveXsaveopt) {
+		common::x86::xsaveopt(area, features->xsaveMask);
+	}else if(features->haveXsave) {
+		common::x86::xsave(area, features->xsaveMask);
+	}else{
 		asm volatile ("fxsaveq %0" : : "m" (*executor->_fxState()));
 	}
 }
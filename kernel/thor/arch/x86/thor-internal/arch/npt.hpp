@@ -24,7 +24,8 @@ struct NptOperations final : VirtualOperations {
 	bool submitShootdown(ShootNode *node) override;
 
 	frg::expected<Error> mapPresentPages(VirtualAddr va, MemoryView *view,
-			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override;
+			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode,
+			bool huge) override;
 
 	frg::expected<Error> remapPresentPages(VirtualAddr va, MemoryView *view,
 			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override;
@@ -20,7 +20,9 @@ constexpr uint64_t ptePwt = 0x8;
 constexpr uint64_t ptePcd = 0x10;
 constexpr uint64_t pteDirty = 0x40;
 constexpr uint64_t ptePat = 0x80;
+constexpr uint64_t pteHuge = 0x80; // Only in PDPT and PD entries.
 constexpr uint64_t pteGlobal = 0x100;
+constexpr uint64_t pteHugePat = 0x1000; // Only in PDPT and PD entries.
 constexpr uint64_t pteXd = 0x8000000000000000;
 constexpr uint64_t pteAddress = 0x000F'FFFF'FFFF'F000;
 
@@ -28,6 +30,13 @@ inline int getLowerHalfBits() {
 	return 47;
 }
 
+// Whether the CPU supports 1 GiB pages.
+bool haveGigabytePages();
+
+// Reads a word from the currently active user address space without faulting.
+// This walks the page tables directly and is thus safe to call from NMI context.
+bool peekUserWord(uintptr_t address, uint64_t &word);
+
 template <bool Kernel>
 struct X86CursorPolicy {
 	static inline constexpr size_t maxLevels = 4;
@@ -100,13 +109,60 @@ struct X86CursorPolicy {
 
 		return newPtAddr | ptePresent | pteWrite | pteUser;
 	}
+
+
+	// Level 1 (PDPT) entries can map 1 GiB pages, level 2 (PD) entries can map 2 MiB pages.
+	static bool supportsHugePages(size_t level) {
+		if(level == 2)
+			return true;
+		if(level == 1)
+			return haveGigabytePages();
+		return false;
+	}
+
+	static constexpr bool pteIsHuge(uint64_t pte, size_t level) {
+		if(level != 1 && level != 2)
+			return false;
+		return (pte & ptePresent) && (pte & pteHuge);
+	}
+
+	static constexpr PhysicalAddr pteHugeAddress(uint64_t pte, size_t level) {
+		auto shift = (level == 1) ? 30 : 21;
+		return pte & pteAddress & ~((uint64_t{1} << shift) - 1);
+	}
+
+	static constexpr uint64_t pteBuildHuge(PhysicalAddr physical, PageFlags flags,
+			CachingMode cachingMode, size_t level) {
+		(void)level;
+		// Huge PTEs store the PAT bit at a different position.
+		auto pte = pteBuild(physical, flags, cachingMode);
+		if(pte & ptePat)
+			pte = (pte & ~ptePat) | pteHugePat;
+		return pte | pteHuge;
+	}
+
+	static constexpr uint64_t pteSplitHuge(uint64_t pte, size_t level, size_t n) {
+		auto physical = pteHugeAddress(pte, level);
+		auto attributes = pte & ~pteAddress;
+		if(level == 1) {
+			// Split into 2 MiB pages; these keep the huge PTE format.
+			return (physical + (n << 21)) | attributes | (pte & pteHugePat);
+		}
+
+		// Split into 4 KiB pages.
+		assert(level == 2);
+		attributes &= ~pteHuge;
+		if(pte & pteHugePat)
+			attributes |= ptePat;
+		return (physical + (n << 12)) | attributes;
+	}
 };
 
 using KernelCursorPolicy = X86CursorPolicy<true>;
-static_assert(CursorPolicy<KernelCursorPolicy>);
+static_assert(HugePageCursorPolicy<KernelCursorPolicy>);
 
 using ClientCursorPolicy = X86CursorPolicy<false>;
-static_assert(CursorPolicy<ClientCursorPolicy>);
+static_assert(HugePageCursorPolicy<ClientCursorPolicy>);
 
 
 struct KernelPageSpace : PageSpace {
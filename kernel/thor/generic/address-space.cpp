@@ -11,10 +11,16 @@ namespace thor {
 
 extern size_t kernelMemoryUsage;
 
+extern "C" int doCopyFromUser(void *dest, const void *src, size_t size);
+extern "C" int doCopyToUser(void *dest, const void *src, size_t size);
+
 namespace {
 	constexpr bool logCleanup = false;
 	constexpr bool logUsage = false;
 
+	// Size of the (aligned) window around faulting addresses in which present pages are mapped.
+	constexpr size_t faultAroundSize = 16 * kPageSize;
+
 	[[maybe_unused]]
 	void logRss(VirtualSpace *space) {
 		if(!logUsage)
@@ -40,7 +46,7 @@ namespace {
 // --------------------------------------------------------
 
 frg::expected<Error> VirtualOperations::mapPresentPages(VirtualAddr va, MemoryView *view,
-		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+		uintptr_t offset, size_t size, PageFlags flags, CachingMode mode, bool) {
 	assert(!(va & (kPageSize - 1)));
 	assert(!(offset & (kPageSize - 1)));
 	assert(!(size & (kPageSize - 1)));
@@ -107,6 +113,16 @@ frg::expected<Error> VirtualOperations::faultPage(VirtualAddr va, MemoryView *vi
 	return {};
 }
 
+frg::expected<Error> VirtualOperations::faultAroundPages(VirtualAddr, MemoryView *,
+		uintptr_t, size_t, PageFlags, CachingMode) {
+	return {};
+}
+
+frg::expected<Error> VirtualOperations::faultHugePage(VirtualAddr, MemoryView *,
+		uintptr_t, size_t, PageFlags, CachingMode) {
+	return Error::fault;
+}
+
 frg::expected<Error> VirtualOperations::cleanPages(VirtualAddr va, MemoryView *view,
 		uintptr_t offset, size_t size) {
 	assert(!(va & (kPageSize - 1)));
@@ -320,13 +336,90 @@ coroutine<void> Mapping::runEvictionLoop() {
 // CowMapping
 // --------------------------------------------------------
 
-CowChain::CowChain()
-: _pages{*kernelAlloc} {
+CowChain::CowChain(smarter::shared_ptr<CowChain> parent, uintptr_t offset, size_t length)
+: _offset{offset}, _length{length}, _parent{std::move(parent)}, _pages{*kernelAlloc} {
+	if(_parent) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_parent->_mutex);
+		_parent->_numChildren++;
+	}
 }
 
 CowChain::~CowChain() {
 	if(logCleanup)
 		infoLogger() << "thor: Releasing CowChain" << frg::endlog;
+
+	assert(!_numViews);
+	assert(!_numChildren);
+	for(size_t pg = 0; pg < _length && _numPages; pg += kPageSize) {
+		auto index = (_offset + pg) >> kPageShift;
+		auto it = _pages.find(index);
+		if(!it)
+			continue;
+		physicalAllocator->free(*it, kPageSize);
+		removePage(index);
+	}
+
+	if(_parent) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_parent->_mutex);
+		assert(_parent->_numChildren);
+		_parent->_numChildren--;
+	}
+}
+
+void CowChain::insertPage(uint64_t index, PhysicalAddr physical) {
+	if(auto it = _pages.find(index); it) {
+		// The old page is shadowed; as it is not observable anymore, we can free it.
+		physicalAllocator->free(*it, kPageSize);
+		*it = physical;
+		return;
+	}
+	_pages.insert(index, physical);
+	_numPages++;
+}
+
+void CowChain::removePage(uint64_t index) {
+	assert(_numPages);
+	_pages.erase(index);
+	_numPages--;
+}
+
+void CowChain::collapse() {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	while(_parent) {
+		smarter::shared_ptr<CowChain> grandparent;
+		{
+			auto parentLock = frg::guard(&_parent->_mutex);
+			if(_parent->_numViews || _parent->_numChildren > 1)
+				break;
+			assert(_parent->_numChildren == 1);
+
+			// Move all pages that are not shadowed by pages of this chain.
+			for(size_t pg = 0; pg < _length && _parent->_numPages; pg += kPageSize) {
+				auto index = (_offset + pg) >> kPageShift;
+				auto it = _parent->_pages.find(index);
+				if(!it)
+					continue;
+				auto physical = *it;
+				_parent->removePage(index);
+
+				if(_pages.find(index)) {
+					physicalAllocator->free(physical, kPageSize);
+				}else{
+					_pages.insert(index, physical);
+					_numPages++;
+				}
+			}
+
+			// The grandparent's reference is transferred to this chain.
+			grandparent = std::move(_parent->_parent);
+			_parent->_numChildren--;
+		}
+		_parent = std::move(grandparent);
+	}
 }
 
 // --------------------------------------------------------
@@ -426,14 +519,19 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 			}
 			actualAddress = FRG_CO_TRY(_allocateAt(address, length));
 		}else{
+			// Align huge mappings such that they can actually use huge pages.
+			size_t alignment = kPageSize;
+			if((flags & kMapHuge) && length >= kHugePageSize)
+				alignment = kHugePageSize;
+
 			if(address && !_areMappingsInRange(address, length)) {
 				if(auto res = _allocateAt(address, length)) {
 					actualAddress = res.unwrap();
 				}else {
-					actualAddress = FRG_CO_TRY(_allocate(length, flags));
+					actualAddress = FRG_CO_TRY(_allocate(length, flags, alignment));
 				}
 			}else {
-				actualAddress = FRG_CO_TRY(_allocate(length, flags));
+				actualAddress = FRG_CO_TRY(_allocate(length, flags, alignment));
 			}
 		}
 
@@ -467,6 +565,8 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 
 		if(flags & kMapDontRequireBacking)
 			mappingFlags |= MappingFlags::dontRequireBacking;
+		if(flags & kMapHuge)
+			mappingFlags |= MappingFlags::huge;
 
 		mapping = smarter::allocate_shared<Mapping>(Allocator{},
 				length, static_cast<MappingFlags>(mappingFlags),
@@ -499,7 +599,8 @@ VirtualSpace::map(smarter::borrowed_ptr<MemorySlice> slice,
 			pageFlags |= page_access::read;
 
 		auto mapOutcome = _ops->mapPresentPages(mapping->address, mapping->view.get(),
-				mapping->viewOffset, mapping->length, pageFlags, caching);
+				mapping->viewOffset, mapping->length, pageFlags, caching,
+				mappingFlags & MappingFlags::huge);
 		assert(mapOutcome);
 	}
 
@@ -656,6 +757,38 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags,
 	// TODO: Aligning should not be necessary here.
 	auto offset = (address - mapping->address) & ~(kPageSize - 1);
 
+	auto caching = CachingMode::null;
+	if(mapping->slice->getCachingFlags() == cacheWriteCombine)
+		caching = CachingMode::writeCombine;
+
+	// For huge mappings, try to map the entire huge page around the faulting address.
+	// This only works if the huge page is fully contained in the mapping and if the view
+	// is backed by sufficiently large contiguous chunks; otherwise, fall back to 4 KiB pages.
+	if(mapping->flags & MappingFlags::huge) {
+		auto hugeAddress = address & ~(kHugePageSize - 1);
+		auto hugeOffset = hugeAddress - mapping->address;
+		if(hugeAddress >= mapping->address
+				&& hugeOffset + kHugePageSize <= mapping->length
+				&& !((mapping->viewOffset + hugeOffset) & (kHugePageSize - 1))
+				&& mapping->view->contiguousGranularity() >= kHugePageSize) {
+			FetchFlags fetchFlags = 0;
+			if(mapping->flags & MappingFlags::dontRequireBacking)
+				fetchFlags |= fetchDisallowBacking;
+
+			FRG_CO_TRY(co_await mapping->view->fetchRange(
+					mapping->viewOffset + hugeOffset, fetchFlags, wq));
+
+			co_await mapping->evictionMutex.async_lock();
+			frg::unique_lock evictionLock{frg::adopt_lock, mapping->evictionMutex};
+
+			auto hugeOutcome = _ops->faultHugePage(hugeAddress,
+					mapping->view.get(), mapping->viewOffset + hugeOffset, kHugePageSize,
+					mapping->compilePageFlags(), caching);
+			if(hugeOutcome || hugeOutcome.error() == Error::spuriousOperation)
+				co_return {};
+		}
+	}
+
 	while(true) {
 		FetchFlags fetchFlags = 0;
 		if(mapping->flags & MappingFlags::dontRequireBacking)
@@ -664,10 +797,6 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags,
 		FRG_CO_TRY(co_await mapping->view->fetchRange(
 				mapping->viewOffset + offset, fetchFlags, wq));
 
-		auto caching = CachingMode::null;
-		if(mapping->slice->getCachingFlags() == cacheWriteCombine)
-			caching = CachingMode::writeCombine;
-
 		co_await mapping->evictionMutex.async_lock();
 		frg::unique_lock evictionLock{frg::adopt_lock, mapping->evictionMutex};
 
@@ -687,6 +816,16 @@ VirtualSpace::handleFault(VirtualAddr address, uint32_t faultFlags,
 			}
 		}
 
+		// Map neighboring pages that are already present; this avoids one page fault
+		// per page if the mapping is accessed sequentially (e.g., when executing binaries).
+		auto aroundAddress = frg::max(address & ~(faultAroundSize - 1), mapping->address);
+		auto aroundEnd = frg::min((address & ~(faultAroundSize - 1)) + faultAroundSize,
+				mapping->address + mapping->length);
+		auto aroundOutcome = _ops->faultAroundPages(aroundAddress,
+				mapping->view.get(), mapping->viewOffset + (aroundAddress - mapping->address),
+				aroundEnd - aroundAddress, mapping->compilePageFlags(), caching);
+		assert(aroundOutcome);
+
 		co_return {};
 	}
 }
@@ -709,7 +848,8 @@ VirtualSpace::retrievePhysical(VirtualAddr address, smarter::shared_ptr<WorkQueu
 	auto offset = (address - mapping->address) & ~(kPageSize - 1);
 
 	while(true) {
-		FetchFlags fetchFlags = 0;
+		// The physical address escapes to the caller, hence the page must not be swapped out.
+		FetchFlags fetchFlags = fetchPin;
 		if(mapping->flags & MappingFlags::dontRequireBacking)
 			fetchFlags |= fetchDisallowBacking;
 
@@ -764,55 +904,63 @@ bool VirtualSpace::_areMappingsInRange(VirtualAddr address, size_t length) {
 	return false;
 }
 
-frg::expected<Error, VirtualAddr> VirtualSpace::_allocate(size_t length, MapFlags flags) {
+frg::expected<Error, VirtualAddr> VirtualSpace::_allocate(size_t length, MapFlags flags,
+		size_t alignment) {
 	assert(length > 0);
 	assert((length % kPageSize) == 0);
+	assert(!(alignment & (alignment - 1)));
 //	infoLogger() << "Allocate virtual memory area"
 //			<< ", size: 0x" << frg::hex_fmt(length) << frg::endlog;
 
-	if(_holes.get_root()->largestHole < length)
+	// Any hole of this size can fit an aligned range of the requested length.
+	auto requiredHole = length + alignment - kPageSize;
+	if(_holes.get_root()->largestHole < requiredHole) {
+		// Fall back to an unaligned allocation.
+		if(alignment > kPageSize)
+			return _allocate(length, flags);
 		return Error::noMemory;
+	}
 
 	auto current = _holes.get_root();
 	while(true) {
 		if(flags & kMapPreferBottom) {
 			// Try to allocate memory at the bottom of the range.
 			if(HoleTree::get_left(current)
-					&& HoleTree::get_left(current)->largestHole >= length) {
+					&& HoleTree::get_left(current)->largestHole >= requiredHole) {
 				current = HoleTree::get_left(current);
 				continue;
 			}
 
-			if(current->length() >= length) {
+			if(current->length() >= requiredHole) {
 				// Note that _splitHole can deallocate the hole!
-				auto address = current->address();
-				_splitHole(current, 0, length);
+				auto address = (current->address() + alignment - 1) & ~(alignment - 1);
+				_splitHole(current, address - current->address(), length);
 				return address;
 			}
 
 			assert(HoleTree::get_right(current));
-			assert(HoleTree::get_right(current)->largestHole >= length);
+			assert(HoleTree::get_right(current)->largestHole >= requiredHole);
 			current = HoleTree::get_right(current);
 		}else{
 			// Try to allocate memory at the top of the range.
 			assert(flags & kMapPreferTop);
 
 			if(HoleTree::get_right(current)
-					&& HoleTree::get_right(current)->largestHole >= length) {
+					&& HoleTree::get_right(current)->largestHole >= requiredHole) {
 				current = HoleTree::get_right(current);
 				continue;
 			}
 
-			if(current->length() >= length) {
+			if(current->length() >= requiredHole) {
 				// Note that _splitHole can deallocate the hole!
-				auto offset = current->length() - length;
-				auto address = current->address() + offset;
-				_splitHole(current, offset, length);
+				auto address = (current->address() + current->length() - length)
+						& ~(alignment - 1);
+				_splitHole(current, address - current->address(), length);
 				return address;
 			}
 
 			assert(HoleTree::get_left(current));
-			assert(HoleTree::get_left(current)->largestHole >= length);
+			assert(HoleTree::get_left(current)->largestHole >= requiredHole);
 			current = HoleTree::get_left(current);
 		}
 	}
@@ -1091,82 +1239,49 @@ coroutine<bool> VirtualSpace::_unmapMappings(VirtualAddr address, size_t length,
 
 coroutine<size_t> VirtualSpace::readPartialSpace(uintptr_t address,
 		void *buffer, size_t size, smarter::shared_ptr<WorkQueue> wq) {
-	// We do not take _consistencyMutex here since we are only interested in a snapshot.
-
-	size_t progress = 0;
-	while(progress < size) {
-		smarter::shared_ptr<Mapping> mapping;
-		{
-			auto irqLock = frg::guard(&irqMutex());
-			auto spaceGuard = frg::guard(&_snapshotMutex);
-
-			mapping = _findMapping(address + progress);
-		}
-		if(!mapping)
-			co_return progress;
-
-		auto startInMapping = address + progress - mapping->address;
-		auto limitInMapping = frg::min(size - progress, mapping->length - startInMapping);
-		// Otherwise, _findMapping() would have returned garbage.
-		assert(limitInMapping);
-
-		auto lockOutcome = co_await mapping->lockVirtualRange(startInMapping, limitInMapping, wq);
-		if(!lockOutcome)
-			co_return progress;
-
-		FetchFlags fetchFlags = 0;
-		if(mapping->flags & MappingFlags::dontRequireBacking)
-			fetchFlags |= fetchDisallowBacking;
+	return _transferPartialSpace(address, reinterpret_cast<std::byte *>(buffer),
+			size, PartialTransfer::read, std::move(wq), nullptr);
+}
 
-		// This loop iterates until we hit the end of the mapping.
-		bool success = true;
-		while(progress < size) {
-			auto offsetInMapping = address + progress - mapping->address;
-			if(offsetInMapping == mapping->length)
-				break;
-			assert(offsetInMapping < mapping->length);
+coroutine<size_t> VirtualSpace::writePartialSpace(uintptr_t address,
+		const void *buffer, size_t size, smarter::shared_ptr<WorkQueue> wq) {
+	return _transferPartialSpace(address,
+			const_cast<std::byte *>(reinterpret_cast<const std::byte *>(buffer)),
+			size, PartialTransfer::write, std::move(wq), nullptr);
+}
 
-			// Ensure that the page is available.
-			// TODO: there is no real reason why we need to page aligned here; however, the
-			//       fetchRange() code does not handle the unaligned code correctly so far.
-			auto touchOutcome = co_await mapping->view->fetchRange(
-					(mapping->viewOffset + offsetInMapping) & ~(kPageSize - 1), fetchFlags, wq);
-			if(!touchOutcome) {
-				success = false;
-				break;
-			}
+coroutine<size_t> VirtualSpace::readPartialSpaceToUser(uintptr_t address,
+		void *userBuffer, size_t size, smarter::shared_ptr<WorkQueue> wq, bool *userFault) {
+	return _transferPartialSpace(address, reinterpret_cast<std::byte *>(userBuffer),
+			size, PartialTransfer::readToUser, std::move(wq), userFault);
+}
 
-			auto [physical, cacheMode] = mapping->resolveRange(
-					offsetInMapping & ~(kPageSize - 1));
-			// Since we have locked the MemoryView, the physical address remains valid here.
-			assert(physical != PhysicalAddr(-1));
+coroutine<size_t> VirtualSpace::writePartialSpaceFromUser(uintptr_t address,
+		const void *userBuffer, size_t size, smarter::shared_ptr<WorkQueue> wq, bool *userFault) {
+	return _transferPartialSpace(address,
+			const_cast<std::byte *>(reinterpret_cast<const std::byte *>(userBuffer)),
+			size, PartialTransfer::writeFromUser, std::move(wq), userFault);
+}
 
-			// Do heavy copying on the WQ.
-			co_await wq->schedule();
+coroutine<size_t> VirtualSpace::_transferPartialSpace(uintptr_t address,
+		std::byte *buffer, size_t size, PartialTransfer transfer,
+		smarter::shared_ptr<WorkQueue> wq, bool *userFault) {
+	// We do not take _consistencyMutex here since we are only interested in a snapshot.
 
-			PageAccessor accessor{physical};
-			auto misalign = offsetInMapping & (kPageSize - 1);
-			auto chunk = frg::min(size - progress, kPageSize - misalign);
-			assert(chunk); // Otherwise, we would have finished already.
-			memcpy(reinterpret_cast<std::byte *>(buffer) + progress,
-					reinterpret_cast<const std::byte *>(accessor.get()) + misalign,
-					chunk);
-			progress += chunk;
+	bool toBuffer = (transfer == PartialTransfer::read || transfer == PartialTransfer::readToUser);
+	bool userBuffer = (transfer == PartialTransfer::readToUser
+			|| transfer == PartialTransfer::writeFromUser);
+	if(userBuffer) {
+		*userFault = false;
+
+		uintptr_t userLimit;
+		if(__builtin_add_overflow(reinterpret_cast<uintptr_t>(buffer), size, &userLimit)
+				|| inHigherHalf(userLimit)) {
+			*userFault = true;
+			co_return 0;
 		}
-
-		mapping->unlockVirtualRange(startInMapping, limitInMapping);
-
-		if(!success)
-			co_return progress;
 	}
 
-	co_return progress;
-}
-
-coroutine<size_t> VirtualSpace::writePartialSpace(uintptr_t address,
-		const void *buffer, size_t size, smarter::shared_ptr<WorkQueue> wq) {
-	// We do not take _consistencyMutex here since we are only interested in a snapshot.
-
 	size_t progress = 0;
 	while(progress < size) {
 		smarter::shared_ptr<Mapping> mapping;
@@ -1215,16 +1330,38 @@ coroutine<size_t> VirtualSpace::writePartialSpace(uintptr_t address,
 			// Since we have locked the MemoryView, the physical address remains valid here.
 			assert(physical != PhysicalAddr(-1));
 
-			// Do heavy copying on the WQ.
-			co_await wq->schedule();
+			if(userBuffer) {
+				// User memory is only accessible on the WQ.
+				co_await wq->enter();
+			}else{
+				// Do heavy copying on the WQ.
+				co_await wq->schedule();
+			}
 
 			PageAccessor accessor{physical};
 			auto misalign = offsetInMapping & (kPageSize - 1);
 			auto chunk = frg::min(size - progress, kPageSize - misalign);
 			assert(chunk); // Otherwise, we would have finished already.
-			memcpy(reinterpret_cast<std::byte *>(accessor.get()) + misalign,
-					reinterpret_cast<const std::byte *>(buffer) + progress,
-					chunk);
+			auto page = reinterpret_cast<std::byte *>(accessor.get()) + misalign;
+			if(userBuffer) {
+				enableUserAccess();
+				int e;
+				if(toBuffer) {
+					e = doCopyToUser(buffer + progress, page, chunk);
+				}else{
+					e = doCopyFromUser(page, buffer + progress, chunk);
+				}
+				disableUserAccess();
+				if(e) {
+					*userFault = true;
+					success = false;
+					break;
+				}
+			}else if(toBuffer) {
+				memcpy(buffer + progress, page, chunk);
+			}else{
+				memcpy(page, buffer + progress, chunk);
+			}
 			progress += chunk;
 		}
 
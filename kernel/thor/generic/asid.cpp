@@ -11,12 +11,12 @@ THOR_DEFINE_PERCPU(asidData);
 
 namespace {
 
-void invalidateNode(int asid, ShootNode *node) {
+void invalidateNode(int asid, ShootNode *node, bool invalidateAll) {
 	// If we're invalidating a lot of pages, just invalidate the
 	// whole ASID instead.
 	// invalidateAsid(globalBindingId) is not allowed, so avoid
 	// the optimization in that case.
-	if(asid != globalBindingId && (node->size >> kPageShift) >= 64) {
+	if(asid != globalBindingId && (invalidateAll || (node->size >> kPageShift) >= 64)) {
 		invalidateAsid(asid);
 	} else {
 		for(size_t off = 0; off < node->size; off += kPageSize)
@@ -42,7 +42,7 @@ PageBinding::completeShootdown_(PageSpace *space, uint64_t afterSequence, bool d
 			// Signal completion of the shootdown.
 			if(current->initiatorCpu_ != getCpuData()) {
 				if(doShootdown) {
-					invalidateNode(id_, current);
+					invalidateNode(id_, current, current->invalidateAll_);
 				}
 
 				if(current->bindingsToShoot_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
@@ -286,12 +286,15 @@ bool PageSpace::submitShootdown(ShootNode *node) {
 
 		auto unshotBindings = numBindings_;
 
+		// If an earlier shootdown took the flag, it completes before this one.
+		node->invalidateAll_ = hugeSplit_.exchange(false, std::memory_order_relaxed);
+
 		auto &bindings = asidData.get()->bindings;
 
 		// Perform synchronous shootdown.
 		if(this == &KernelPageSpace::global()) {
 			assert(unshotBindings);
-			invalidateNode(globalBindingId, node);
+			invalidateNode(globalBindingId, node, node->invalidateAll_);
 			unshotBindings--;
 		} else {
 			for(size_t i = 0; i < bindings.size(); i++) {
@@ -299,7 +302,7 @@ bool PageSpace::submitShootdown(ShootNode *node) {
 					continue;
 
 				assert(unshotBindings);
-				invalidateNode(bindings[i].id(), node);
+				invalidateNode(bindings[i].id(), node, node->invalidateAll_);
 				unshotBindings--;
 			}
 		}
@@ -0,0 +1,230 @@
+#include <atomic>
+#include <string.h>
+
+#include <thor-internal/arch-generic/paging.hpp>
+#include <thor-internal/arch-generic/timer.hpp>
+#include <thor-internal/compressed-swap.hpp>
+#include <thor-internal/debug.hpp>
+#include <thor-internal/kernel_heap.hpp>
+
+namespace thor {
+
+namespace {
+	// Pages whose compressed size exceeds this limit are not stored.
+	constexpr size_t maxCompressedSize = kPageSize * 3 / 4;
+
+	// The LZ4 block format requires that the last 5 bytes are literals
+	// and that the last match starts at least 12 bytes before the end.
+	constexpr size_t lastLiterals = 5;
+	constexpr size_t matchLimit = 12;
+	constexpr size_t minMatch = 4;
+
+	constexpr int hashLog = 10;
+
+	uint32_t read32(const uint8_t *p) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(uint32_t));
+		return v;
+	}
+
+	uint32_t hash32(uint32_t v) {
+		return (v * 2654435761u) >> (32 - hashLog);
+	}
+
+	// Writes the extra length bytes of a literal or match length.
+	bool writeLength(uint8_t *&op, uint8_t *end, size_t length) {
+		while(length >= 255) {
+			if(op == end)
+				return false;
+			*op++ = 255;
+			length -= 255;
+		}
+		if(op == end)
+			return false;
+		*op++ = length;
+		return true;
+	}
+
+	// Emits a sequence of literals followed by a match (if matchLength is non-zero).
+	bool writeSequence(uint8_t *&op, uint8_t *end, const uint8_t *literals, size_t numLiterals,
+			size_t offset, size_t matchLength) {
+		if(op == end)
+			return false;
+		auto token = op++;
+		*token = (numLiterals < 15 ? numLiterals : 15) << 4;
+		if(numLiterals >= 15 && !writeLength(op, end, numLiterals - 15))
+			return false;
+
+		if(static_cast<size_t>(end - op) < numLiterals)
+			return false;
+		memcpy(op, literals, numLiterals);
+		op += numLiterals;
+
+		if(!matchLength)
+			return true;
+
+		if(end - op < 2)
+			return false;
+		*op++ = offset & 0xFF;
+		*op++ = offset >> 8;
+
+		auto extra = matchLength - minMatch;
+		*token |= extra < 15 ? extra : 15;
+		if(extra >= 15 && !writeLength(op, end, extra - 15))
+			return false;
+		return true;
+	}
+
+	// Greedy LZ4 block compression. Returns the compressed size or zero
+	// if the output does not fit into the buffer.
+	size_t compressBlock(const uint8_t *src, size_t size, uint8_t *dest, size_t capacity) {
+		uint16_t table[1 << hashLog];
+		memset(table, 0, sizeof(table));
+
+		uint8_t *op = dest;
+		uint8_t *end = dest + capacity;
+		size_t ip = 0;
+		size_t anchor = 0;
+
+		if(size > matchLimit) {
+			while(ip < size - matchLimit) {
+				auto h = hash32(read32(src + ip));
+				size_t ref = table[h];
+				table[h] = ip;
+				if(ref >= ip || read32(src + ref) != read32(src + ip)) {
+					ip++;
+					continue;
+				}
+
+				size_t length = minMatch;
+				while(ip + length < size - lastLiterals && src[ref + length] == src[ip + length])
+					length++;
+
+				if(!writeSequence(op, end, src + anchor, ip - anchor, ip - ref, length))
+					return 0;
+				ip += length;
+				anchor = ip;
+			}
+		}
+
+		if(!writeSequence(op, end, src + anchor, size - anchor, 0, 0))
+			return 0;
+		return op - dest;
+	}
+
+	void decompressBlock(const uint8_t *src, size_t size, uint8_t *dest, size_t capacity) {
+		size_t ip = 0;
+		size_t op = 0;
+		while(true) {
+			assert(ip < size);
+			auto token = src[ip++];
+
+			size_t numLiterals = token >> 4;
+			if(numLiterals == 15) {
+				uint8_t b;
+				do {
+					b = src[ip++];
+					numLiterals += b;
+				} while(b == 255);
+			}
+			assert(ip + numLiterals <= size);
+			assert(op + numLiterals <= capacity);
+			memcpy(dest + op, src + ip, numLiterals);
+			ip += numLiterals;
+			op += numLiterals;
+
+			// The last sequence only consists of literals.
+			if(ip == size)
+				break;
+
+			size_t offset = src[ip] | (src[ip + 1] << 8);
+			ip += 2;
+			assert(offset && offset <= op);
+
+			size_t length = token & 0xF;
+			if(length == 15) {
+				uint8_t b;
+				do {
+					b = src[ip++];
+					length += b;
+				} while(b == 255);
+			}
+			length += minMatch;
+			assert(op + length <= capacity);
+
+			// Matches may overlap with their own output, hence we copy byte by byte.
+			for(size_t i = 0; i < length; i++)
+				dest[op + i] = dest[op - offset + i];
+			op += length;
+		}
+		assert(op == capacity);
+	}
+
+	std::atomic<uint64_t> numStoredPages{0};
+	std::atomic<uint64_t> poolSize{0};
+	std::atomic<uint64_t> numSwapOuts{0};
+	std::atomic<uint64_t> numSwapIns{0};
+	std::atomic<uint64_t> numRejected{0};
+	std::atomic<uint64_t> swapInNanos{0};
+	std::atomic<uint64_t> maxSwapInNanos{0};
+}
+
+struct CompressedPage {
+	size_t size;
+	uint8_t data[];
+};
+
+CompressedPage *compressPage(const void *page) {
+	uint8_t buffer[maxCompressedSize];
+	auto size = compressBlock(static_cast<const uint8_t *>(page), kPageSize,
+			buffer, maxCompressedSize);
+	if(!size) {
+		numRejected.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	auto compressed = static_cast<CompressedPage *>(
+			kernelAlloc->allocate(sizeof(CompressedPage) + size));
+	compressed->size = size;
+	memcpy(compressed->data, buffer, size);
+
+	numStoredPages.fetch_add(1, std::memory_order_relaxed);
+	poolSize.fetch_add(size, std::memory_order_relaxed);
+	numSwapOuts.fetch_add(1, std::memory_order_relaxed);
+	return compressed;
+}
+
+void decompressPage(CompressedPage *compressed, void *page) {
+	auto start = getClockNanos();
+	decompressBlock(compressed->data, compressed->size, static_cast<uint8_t *>(page), kPageSize);
+	auto elapsed = getClockNanos() - start;
+
+	numSwapIns.fetch_add(1, std::memory_order_relaxed);
+	swapInNanos.fetch_add(elapsed, std::memory_order_relaxed);
+	auto max = maxSwapInNanos.load(std::memory_order_relaxed);
+	while(max < elapsed && !maxSwapInNanos.compare_exchange_weak(max, elapsed,
+			std::memory_order_relaxed))
+		;
+
+	discardCompressedPage(compressed);
+}
+
+void discardCompressedPage(CompressedPage *compressed) {
+	numStoredPages.fetch_sub(1, std::memory_order_relaxed);
+	poolSize.fetch_sub(compressed->size, std::memory_order_relaxed);
+	kernelAlloc->free(compressed);
+}
+
+CompressedSwapStats getCompressedSwapStats() {
+	CompressedSwapStats stats;
+	stats.numStoredPages = numStoredPages.load(std::memory_order_relaxed);
+	stats.poolSize = poolSize.load(std::memory_order_relaxed);
+	stats.numSwapOuts = numSwapOuts.load(std::memory_order_relaxed);
+	stats.numSwapIns = numSwapIns.load(std::memory_order_relaxed);
+	stats.numRejected = numRejected.load(std::memory_order_relaxed);
+	stats.swapInNanos = swapInNanos.load(std::memory_order_relaxed);
+	stats.maxSwapInNanos = maxSwapInNanos.load(std::memory_order_relaxed);
+	return stats;
+}
+
+} // namespace thor
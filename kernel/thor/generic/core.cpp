@@ -298,15 +298,190 @@ constinit frg::manual_box<PhysicalChunkAllocator> physicalAllocator = {};
 
 constinit frg::manual_box<KernelVirtualAlloc> kernelVirtualAlloc = {};
 
-constinit frg::manual_box<
-	frg::slab_pool<
-		KernelVirtualAlloc,
-		IrqSpinlock
-	>
-> kernelHeap = {};
+constinit frg::manual_box<KernelHeap> kernelHeap = {};
+
+constinit frg::manual_box<KernelHeapFrontend> kernelHeapFrontend = {};
 
 constinit frg::manual_box<KernelAlloc> kernelAlloc = {};
 
+// --------------------------------------------------------
+// KernelHeapFrontend
+// --------------------------------------------------------
+
+extern PerCpu<KernelHeapCache> kernelHeapCache;
+THOR_DEFINE_PERCPU(kernelHeapCache);
+
+void KernelHeapFrontend::enablePerCpuCaches() {
+#ifndef THOR_KASAN
+	// With KASAN, freed objects need to go back to the slab pool immediately
+	// such that accesses to them are caught.
+	_cachesEnabled.store(true, std::memory_order_relaxed);
+#endif
+}
+
+void *KernelHeapFrontend::allocate(size_t size) {
+	auto sc = KernelHeapCache::sizeClassOf(size);
+	if(sc < 0)
+		return _pool->allocate(size);
+	if(!_cachesEnabled.load(std::memory_order_relaxed))
+		return _pool->allocate(KernelHeapCache::classSize(sc));
+	return _allocateCached(sc);
+}
+
+void KernelHeapFrontend::deallocate(void *pointer, size_t size) {
+	if(!pointer)
+		return;
+
+	// Note that size might be smaller than the allocated size (e.g., if a derived
+	// object is destructed through a pointer to its base). This is fine since
+	// the object is then only reused for smaller allocations.
+	auto sc = KernelHeapCache::sizeClassOf(size);
+	if(sc < 0 || !_cachesEnabled.load(std::memory_order_relaxed)) {
+		_pool->free(pointer);
+		return;
+	}
+	_freeCached(pointer, sc);
+}
+
+void KernelHeapFrontend::free(void *pointer) {
+	if(!pointer)
+		return;
+	_pool->free(pointer);
+}
+
+void *KernelHeapFrontend::_allocateCached(int sc) {
+	{
+		auto irqLock = frg::guard(&irqMutex());
+
+		auto cls = &kernelHeapCache.get().classes[sc];
+		cls->numAllocations++;
+
+		if(!cls->loaded || !cls->loaded->count) {
+			if(cls->previous && cls->previous->count) {
+				std::swap(cls->loaded, cls->previous);
+			}else{
+				// Trade our empty magazine for a full one from the depot.
+				auto depot = &_depots[sc];
+				Magazine *full = nullptr;
+				{
+					auto lock = frg::guard(&depot->mutex);
+					if(depot->fullList) {
+						full = depot->fullList;
+						depot->fullList = full->next;
+						depot->numFull--;
+
+						if(cls->previous) {
+							cls->previous->next = depot->emptyList;
+							depot->emptyList = cls->previous;
+						}
+					}
+				}
+
+				if(full) {
+					cls->numDepotExchanges++;
+					cls->previous = cls->loaded;
+					cls->loaded = full;
+				}
+			}
+		}
+
+		if(cls->loaded && cls->loaded->count) {
+			cls->numHits++;
+			return cls->loaded->objects[--cls->loaded->count];
+		}
+		cls->numPoolOperations++;
+	}
+
+	return _pool->allocate(KernelHeapCache::classSize(sc));
+}
+
+void KernelHeapFrontend::_freeCached(void *pointer, int sc) {
+	auto capacity = KernelHeapCache::capacity(sc);
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+
+		auto cls = &kernelHeapCache.get().classes[sc];
+		cls->numFrees++;
+
+		if(!cls->loaded || cls->loaded->count == capacity) {
+			if(cls->previous && cls->previous->count < capacity) {
+				std::swap(cls->loaded, cls->previous);
+			}else{
+				// Trade our full magazine for an empty one from the depot.
+				auto depot = &_depots[sc];
+				Magazine *empty = nullptr;
+				bool exchanged = false;
+				{
+					auto lock = frg::guard(&depot->mutex);
+					if(depot->numFull < maxFullMagazines) {
+						if(cls->previous) {
+							cls->previous->next = depot->fullList;
+							depot->fullList = cls->previous;
+							depot->numFull++;
+						}
+						if(depot->emptyList) {
+							empty = depot->emptyList;
+							depot->emptyList = empty->next;
+						}
+						exchanged = true;
+					}
+				}
+
+				if(exchanged) {
+					// Magazines are never returned to the pool.
+					if(!empty)
+						empty = new (_pool->allocate(sizeof(Magazine))) Magazine{};
+					empty->count = 0;
+
+					cls->numDepotExchanges++;
+					cls->previous = cls->loaded;
+					cls->loaded = empty;
+				}
+			}
+		}
+
+		if(cls->loaded && cls->loaded->count < capacity) {
+			cls->loaded->objects[cls->loaded->count++] = pointer;
+			return;
+		}
+		cls->numPoolOperations++;
+	}
+
+	_pool->free(pointer);
+}
+
+KernelHeapClassStats KernelHeapFrontend::getClassStats(int sc) {
+	KernelHeapClassStats stats;
+	stats.objectSize = KernelHeapCache::classSize(sc);
+	if(!_cachesEnabled.load(std::memory_order_relaxed))
+		return stats;
+
+	// Note that we read the counters of other CPUs without synchronization;
+	// the result is only meant as a statistical snapshot.
+	for(size_t i = 0; i < getCpuCount(); i++) {
+		auto cls = &kernelHeapCache.getFor(i).classes[sc];
+		stats.numAllocations += cls->numAllocations;
+		stats.numFrees += cls->numFrees;
+		stats.numHits += cls->numHits;
+		stats.numDepotExchanges += cls->numDepotExchanges;
+		stats.numPoolOperations += cls->numPoolOperations;
+		if(auto loaded = cls->loaded; loaded)
+			stats.numCachedObjects += loaded->count;
+		if(auto previous = cls->previous; previous)
+			stats.numCachedObjects += previous->count;
+	}
+
+	auto depot = &_depots[sc];
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&depot->mutex);
+		stats.numCachedObjects += depot->numFull * KernelHeapCache::capacity(sc);
+	}
+	stats.numDepotContended = depot->mutex.numContended();
+	return stats;
+}
+
 // --------------------------------------------------------
 // CpuData
 // --------------------------------------------------------
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <cstddef>
+#include <type_traits>
 
 #include <async/algorithm.hpp>
 #include <async/cancellation.hpp>
@@ -8,6 +9,7 @@
 #include <frg/dyn_array.hpp>
 #include <frg/small_vector.hpp>
 #include <thor-internal/event.hpp>
+#include <thor-internal/compressed-swap.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/io.hpp>
 #include <thor-internal/ipc-queue.hpp>
@@ -32,6 +34,13 @@
 using namespace thor;
 
 namespace {
+	// Flows of at least this size are copied directly from the sender's address space
+	// to the receiver's buffer instead of bouncing through kernel buffers.
+	constexpr size_t directTransferThreshold = 4 * kPageSize;
+
+	// Size of RecvInline buffers if userspace does not specify a size.
+	constexpr size_t defaultRecvInlineSize = 128;
+
 	// TODO: Replace this by a function that returns the type of special descriptor.
 	bool isSpecialMemoryView(HelHandle handle) {
 		return handle == kHelZeroMemory;
@@ -97,6 +106,23 @@ bool writeUserArray(T *pointer, const T *array, size_t count) {
 	return writeUserMemory(pointer, array, size);
 }
 
+// Gathers the buffers of an SG list. Fails if they do not add up to exactly size bytes.
+bool readUserSgList(void *kernelPtr, const HelSgItem *sglist, size_t count, size_t size) {
+	size_t offset = 0;
+	for(size_t i = 0; i < count; i++) {
+		HelSgItem item;
+		if(!readUserObject(sglist + i, item))
+			return false;
+		if(item.length > size - offset)
+			return false;
+		if(!readUserMemory(reinterpret_cast<char *>(kernelPtr) + offset,
+				item.buffer, item.length))
+			return false;
+		offset += item.length;
+	}
+	return offset == size;
+}
+
 size_t ipcSourceSize(size_t size) {
 	return (size + 7) & ~size_t(7);
 }
@@ -379,6 +405,8 @@ HelError helCreateQueue(const HelQueueParameters *paramsPtr, HelHandle *handle)
 
 	if(params.flags)
 		return kHelErrIllegalArgs;
+	if(!IpcQueue::validParameters(params.ringShift, params.numChunks, params.chunkSize))
+		return kHelErrIllegalArgs;
 
 	auto queue = smarter::allocate_shared<IpcQueue>(*kernelAlloc,
 			params.ringShift, params.numChunks, params.chunkSize);
@@ -394,6 +422,33 @@ HelError helCreateQueue(const HelQueueParameters *paramsPtr, HelHandle *handle)
 	return kHelErrNone;
 }
 
+HelError helGrowQueue(HelHandle handle, unsigned int numChunks) {
+	auto thisThread = getCurrentThread();
+	auto thisUniverse = thisThread->getUniverse();
+
+	smarter::shared_ptr<IpcQueue> queue;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		Universe::Guard universeGuard(thisUniverse->lock);
+
+		auto wrapper = thisUniverse->getDescriptor(universeGuard, handle);
+		if(!wrapper)
+			return kHelErrNoDescriptor;
+		if(!wrapper->is<QueueDescriptor>())
+			return kHelErrBadDescriptor;
+		queue = wrapper->get<QueueDescriptor>().queue;
+	}
+
+	auto error = Thread::asyncBlockCurrent(queue->grow(numChunks));
+	if(error == Error::illegalArgs)
+		return kHelErrIllegalArgs;
+	if(error == Error::noMemory)
+		return kHelErrNoMemory;
+	assert(error == Error::success);
+
+	return kHelErrNone;
+}
+
 HelError helCancelAsync(HelHandle handle, uint64_t async_id) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
@@ -477,10 +532,13 @@ HelError helResizeMemory(HelHandle handle, size_t newSize) {
 		memory = wrapper->get<MemoryViewDescriptor>().memory;
 	}
 
-	Thread::asyncBlockCurrent([] (smarter::shared_ptr<MemoryView> memory, size_t newSize)
-			-> coroutine<void> {
-		co_await memory->resize(newSize);
+	auto error = Thread::asyncBlockCurrent([] (smarter::shared_ptr<MemoryView> memory,
+			size_t newSize) -> coroutine<Error> {
+		co_return co_await memory->resize(newSize);
 	}(std::move(memory), newSize));
+	if(error == Error::noMemory)
+		return kHelErrNoMemory;
+	assert(error == Error::success);
 
 	return kHelErrNone;
 }
@@ -877,6 +935,8 @@ HelError helMapMemory(HelHandle memory_handle, HelHandle space_handle,
 
 	if(flags & kHelMapDontRequireBacking)
 		map_flags |= AddressSpace::kMapDontRequireBacking;
+	if(flags & kHelMapHuge)
+		map_flags |= AddressSpace::kMapHuge;
 
 	smarter::shared_ptr<MemorySlice> slice;
 	smarter::shared_ptr<AddressSpace, BindableHandle> space;
@@ -1192,7 +1252,14 @@ HelError helSubmitReadMemory(HelHandle handle, uintptr_t address,
 		(void)limit;
 
 		Error error = Error::success;
-		{
+		if constexpr (std::is_base_of_v<VirtualSpace, Space>) {
+			// Copy directly into the submitter's buffer.
+			bool userFault;
+			auto copied = co_await space->readPartialSpaceToUser(address, buffer, length,
+					submitThread->mainWorkQueue()->take(), &userFault);
+			if(copied != length)
+				error = Error::fault;
+		}else{
 			char temp[4096]; // TODO: Use a temporarily allocated page?
 			size_t progress = 0;
 			while(progress < length) {
@@ -1332,7 +1399,14 @@ HelError helSubmitWriteMemory(HelHandle handle, uintptr_t address,
 		(void)limit;
 
 		Error error = Error::success;
-		{
+		if constexpr (std::is_base_of_v<VirtualSpace, Space>) {
+			// Copy directly from the submitter's buffer.
+			bool userFault;
+			auto copied = co_await space->writePartialSpaceFromUser(address, buffer, length,
+					submitThread->mainWorkQueue()->take(), &userFault);
+			if(copied != length)
+				error = Error::fault;
+		}else{
 			char temp[4096]; // TODO: Use a temporarily allocated page?
 			size_t progress = 0;
 			while(progress < length) {
@@ -1576,7 +1650,8 @@ HelError helSubmitLockMemoryView(HelHandle handle, uintptr_t offset, size_t size
 }
 
 HelError helLoadahead(HelHandle handle, uintptr_t offset, size_t length) {
-	assert(offset % kPageSize == 0 && length % kPageSize == 0);
+	if(offset % kPageSize || length % kPageSize)
+		return kHelErrIllegalArgs;
 
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
@@ -1594,12 +1669,36 @@ HelError helLoadahead(HelHandle handle, uintptr_t offset, size_t length) {
 		memory = memory_wrapper->get<MemoryViewDescriptor>().memory;
 	}
 
-/*	auto handle_load = smarter::allocate_shared<AsyncInitiateLoad>(*kernelAlloc,
-			NullCompleter(), offset, length);
-	{
-		// TODO: protect memory object with a guard
-		memory->submitInitiateLoad(std::move(handle_load));
-	}*/
+	memory->loadahead(offset, length);
+
+	return kHelErrNone;
+}
+
+HelError helQueryMemoryStats(HelMemoryStats *user_stats) {
+	auto reclaimStats = getReclaimStats();
+	auto swapStats = getCompressedSwapStats();
+
+	HelMemoryStats stats;
+	memset(&stats, 0, sizeof(HelMemoryStats));
+	stats.totalMemory = physicalAllocator->numTotalPages() * kPageSize;
+	stats.freeMemory = physicalAllocator->numFreePages() * kPageSize;
+	stats.activeCacheMemory = reclaimStats.numActivePages * kPageSize;
+	stats.inactiveCacheMemory = reclaimStats.numInactivePages * kPageSize;
+	stats.numScannedPages = reclaimStats.numScannedPages;
+	stats.numActivatedPages = reclaimStats.numActivatedPages;
+	stats.numDeactivatedPages = reclaimStats.numDeactivatedPages;
+	stats.numReclaimedPages = reclaimStats.numReclaimedPages;
+	stats.numReclaimWakeups = reclaimStats.numWakeups;
+	stats.swappedMemory = swapStats.numStoredPages * kPageSize;
+	stats.swapPoolSize = swapStats.poolSize;
+	stats.numSwapOuts = swapStats.numSwapOuts;
+	stats.numSwapIns = swapStats.numSwapIns;
+	stats.numSwapRejected = swapStats.numRejected;
+	stats.swapInNanos = swapStats.swapInNanos;
+	stats.maxSwapInNanos = swapStats.maxSwapInNanos;
+
+	if(!writeUserObject(user_stats, stats))
+		return kHelErrFault;
 
 	return kHelErrNone;
 }
@@ -2149,8 +2248,15 @@ HelError helStoreRegisters(HelHandle handle, int set, const void *image) {
 #endif
 	}else if(set == kHelRegsSimd) {
 #if defined(__x86_64__)
-		if(!readUserMemory(thread->_executor._fxState(), image, Executor::determineSimdSize()))
+		// Validate the image before installing it; restoring a bad image faults in the kernel.
+		auto size = Executor::determineSimdSize();
+		frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, size);
+		if(!readUserMemory(buffer.data(), image, size))
 			return kHelErrFault;
+		if(!Executor::validateSimdState(buffer.data()))
+			return kHelErrIllegalArgs;
+		memcpy(thread->_executor._fxState(), buffer.data(), size);
+		thread->_executor.invalidateSimdState();
 #elif defined(__aarch64__)
 		if(!readUserMemory(&thread->_executor.general()->fp, image, sizeof(FpRegisters)))
 			return kHelErrFault;
@@ -2283,6 +2389,7 @@ HelError helSubmitAwaitClock(uint64_t counter, HelHandle queue_handle, uintptr_t
 
 			worklet.setup(&Closure::elapsed, getCurrentThread()->mainWorkQueue());
 			PrecisionTimerNode::setup(nanos, cancelEvent, &worklet);
+			PrecisionTimerNode::setSlack(userTimerSlack);
 		}
 
 		void handleCancellation() override {
@@ -2454,7 +2561,15 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 				ipcSize += ipcSourceSize(sizeof(HelCredentialsResult));
 				break;
 			case kHelActionSendFromBuffer:
-				if(recipe->length <= kPageSize) {
+				if(recipe->length <= StreamNode::inlineCapacity) {
+					if(!readUserMemory(node->_inlineData,
+							reinterpret_cast<char *>(recipe->buffer), recipe->length))
+						return kHelErrFault;
+
+					node->_tag = kTagSendKernelBuffer;
+					node->_isInline = true;
+					node->_inlineLength = recipe->length;
+				}else if(recipe->length <= kPageSize) {
 					frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, recipe->length);
 					if(!readUserMemory(reinterpret_cast<char *>(buffer.data()),
 							reinterpret_cast<char *>(recipe->buffer), recipe->length))
@@ -2474,33 +2589,48 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 				auto sglist = reinterpret_cast<HelSgItem *>(recipe->buffer);
 				for(size_t j = 0; j < recipe->length; j++) {
 					HelSgItem item;
-					readUserObject(sglist + j, item);
-					length += item.length;
+					if(!readUserObject(sglist + j, item))
+						return kHelErrFault;
+					if(__builtin_add_overflow(length, item.length, &length))
+						return kHelErrIllegalArgs;
 				}
 
-				frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, length);
-				size_t offset = 0;
-				for(size_t j = 0; j < recipe->length; j++) {
-					HelSgItem item;
-					readUserObject(sglist + j, item);
-					if(!readUserMemory(reinterpret_cast<char *>(buffer.data()) + offset,
-							reinterpret_cast<char *>(item.buffer), item.length))
+				if(length >= directTransferThreshold) {
+					// Large SG lists are not gathered; see handleFlow below.
+					node->_tag = kTagSendFlow;
+					node->_maxLength = length;
+					++numFlows;
+				}else if(length <= StreamNode::inlineCapacity) {
+					if(!readUserSgList(node->_inlineData, sglist, recipe->length, length))
 						return kHelErrFault;
-					offset += item.length;
-				}
 
-				node->_tag = kTagSendKernelBuffer;
-				node->_inBuffer = std::move(buffer);
+					node->_tag = kTagSendKernelBuffer;
+					node->_isInline = true;
+					node->_inlineLength = length;
+				}else{
+					frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, length);
+					if(!readUserSgList(buffer.data(), sglist, recipe->length, length))
+						return kHelErrFault;
+
+					node->_tag = kTagSendKernelBuffer;
+					node->_inBuffer = std::move(buffer);
+				}
 				ipcSize += ipcSourceSize(sizeof(HelSimpleResult));
 				break;
 			}
-			case kHelActionRecvInline:
-				// TODO: For now, we hardcode a size of 128 bytes.
+			case kHelActionRecvInline: {
+				// A length of zero selects the default size for compatibility.
+				size_t maxLength = recipe->length ? recipe->length : defaultRecvInlineSize;
+				if(maxLength > kPageSize)
+					return kHelErrIllegalArgs;
+
 				node->_tag = kTagRecvKernelBuffer;
-				node->_maxLength = 128;
+				node->_maxLength = maxLength;
+				node->_acceptsInline = true;
 				ipcSize += ipcSourceSize(sizeof(HelLengthResult));
-				ipcSize += ipcSourceSize(128);
+				ipcSize += ipcSourceSize(maxLength);
 				break;
+			}
 			case kHelActionRecvToBuffer:
 				node->_tag = kTagRecvFlow;
 				node->_maxLength = recipe->length;
@@ -2631,10 +2761,9 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 					link(&item->mainSource);
 				}else if(recipe->type == kHelActionRecvInline) {
 					item->helInlineResult = {translateError(node->error()),
-							0, node->_transmitBuffer.size()};
+							0, node->transmitSize()};
 					item->mainSource.setup(&item->helInlineResult, sizeof(HelInlineResultNoFlex));
-					item->dataSource.setup(node->_transmitBuffer.data(),
-							node->_transmitBuffer.size());
+					item->dataSource.setup(node->transmitData(), node->transmitSize());
 					link(&item->mainSource);
 					link(&item->dataSource);
 				}else if(recipe->type == kHelActionRecvToBuffer) {
@@ -2744,13 +2873,19 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 				continue;
 			}
 
-			if(recipe->type == kHelActionSendFromBuffer
-					&& node->tag() == kTagSendFlow
+			if(node->tag() == kTagSendFlow
 					&& peer->tag() == kTagRecvKernelBuffer) {
-				frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, recipe->length);
+				frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, node->_maxLength);
 
 				co_await thread->mainWorkQueue()->enter();
-				auto outcome = readUserMemory(buffer.data(), recipe->buffer, recipe->length);
+				bool outcome;
+				if(recipe->type == kHelActionSendFromBufferSg) {
+					outcome = readUserSgList(buffer.data(),
+							reinterpret_cast<HelSgItem *>(recipe->buffer), recipe->length,
+							node->_maxLength);
+				}else{
+					outcome = readUserMemory(buffer.data(), recipe->buffer, recipe->length);
+				}
 				if(!outcome) {
 					// We complete with fault; the remote with success.
 					// TODO: it probably makes sense to introduce a "remote fault" error.
@@ -2765,6 +2900,75 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 				peer->_transmitBuffer = std::move(buffer);
 				peer->complete();
 				node->complete();
+			}else if(node->tag() == kTagSendFlow
+					&& peer->tag() == kTagRecvFlow
+					&& node->_maxLength >= directTransferThreshold) {
+				// The receiver copies directly from our address space.
+				// We send one packet per buffer and wait for its ack before sending the next.
+				frg::vector<HelSgItem, KernelAlloc> buffers{*kernelAlloc};
+				bool sourceFault = false;
+				if(recipe->type == kHelActionSendFromBufferSg) {
+					co_await thread->mainWorkQueue()->enter();
+					auto sglist = reinterpret_cast<HelSgItem *>(recipe->buffer);
+					size_t total = 0;
+					for(size_t j = 0; j < recipe->length; j++) {
+						HelSgItem item;
+						if(!readUserObject(sglist + j, item)
+								|| __builtin_add_overflow(total, item.length, &total)) {
+							sourceFault = true;
+							break;
+						}
+						if(item.length)
+							buffers.push_back(item);
+					}
+					// The SG list might have changed since submission.
+					if(total != node->_maxLength)
+						sourceFault = true;
+				}else{
+					buffers.push_back({recipe->buffer, recipe->length});
+				}
+
+				auto space = thread->getAddressSpace().get();
+				bool anyRemoteFault = false;
+				bool terminated = false;
+				for(size_t j = 0; j < buffers.size(); j++) {
+					if(sourceFault || anyRemoteFault)
+						break;
+
+					terminated = (j + 1 == buffers.size());
+					// Send the packet (may deallocate the peer!).
+					peer->flowQueue.put({
+						.size = buffers[j].length,
+						.space = space,
+						.address = reinterpret_cast<uintptr_t>(buffers[j].buffer),
+						.terminate = terminated
+					});
+
+					auto ackPacket = co_await node->flowQueue.async_get();
+					assert(ackPacket);
+					if(ackPacket->fault)
+						anyRemoteFault = true;
+					if(ackPacket->sourceFault)
+						sourceFault = true;
+				}
+
+				if(!terminated) {
+					// Send the packet (may deallocate the peer!).
+					peer->flowQueue.put({ .terminate = true, .fault = sourceFault });
+
+					// Retrieve but ignore the ack.
+					auto ackPacket = co_await node->flowQueue.async_get();
+					assert(ackPacket);
+				}
+
+				if(sourceFault) {
+					node->_error = Error::fault;
+				}else if(anyRemoteFault) {
+					node->_error = Error::remoteFault;
+				}else{
+					node->_error = Error::success;
+				}
+				node->complete();
 			}else if(recipe->type == kHelActionSendFromBuffer
 					&& node->tag() == kTagSendFlow
 					&& peer->tag() == kTagRecvFlow) {
@@ -2862,7 +3066,7 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 					&& peer->tag() == kTagSendKernelBuffer) {
 				co_await thread->mainWorkQueue()->enter();
 				auto outcome = writeUserMemory(recipe->buffer,
-						peer->_inBuffer.data(), peer->_inBuffer.size());
+						peer->inData(), peer->inSize());
 				if(!outcome) {
 					// We complete with fault; the remote with success.
 					// TODO: it probably makes sense to introduce a "remote fault" error.
@@ -2874,7 +3078,7 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 				}
 
 				// Both nodes complete successfully.
-				node->_actualLength = peer->_inBuffer.size();
+				node->_actualLength = peer->inSize();
 				peer->complete();
 				node->complete();
 			}else{
@@ -2883,12 +3087,31 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 
 				size_t progress = 0;
 				bool didFault = false;
+				bool sourceFault = false;
 				// Each iteration of this loop sends one ack packet.
 				while(true) {
 					auto xferPacket = co_await node->flowQueue.async_get();
 					assert(xferPacket);
 
-					if(xferPacket->data && !didFault) {
+					if(xferPacket->space && !didFault && !sourceFault) {
+						// Otherwise, there would have been a transmission error.
+						assert(progress + xferPacket->size <= recipe->length);
+
+						co_await thread->mainWorkQueue()->enter();
+						bool userFault;
+						auto copied = co_await xferPacket->space->readPartialSpaceToUser(
+								xferPacket->address,
+								reinterpret_cast<std::byte *>(recipe->buffer) + progress,
+								xferPacket->size, thread->mainWorkQueue()->take(), &userFault);
+						progress += copied;
+						if(copied != xferPacket->size) {
+							if(userFault) {
+								didFault = true;
+							}else{
+								sourceFault = true;
+							}
+						}
+					}else if(xferPacket->data && !didFault) {
 						// Otherwise, there would have been a transmission error.
 						assert(progress + xferPacket->size <= recipe->length);
 
@@ -2910,8 +3133,8 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 							node->_error = Error::fault;
 						}else{
 							// Ack the packet (may deallocate the peer!).
-							peer->flowQueue.put({ .terminate = true });
-							if(xferPacket->fault) {
+							peer->flowQueue.put({ .terminate = true, .sourceFault = sourceFault });
+							if(xferPacket->fault || sourceFault) {
 								node->_error = Error::remoteFault;
 							}else{
 								node->_actualLength = progress;
@@ -2930,7 +3153,7 @@ HelError helSubmitAsync(HelHandle handle, const HelAction *actions, size_t count
 					if(didFault) {
 						peer->flowQueue.put({ .fault = true });
 					}else{
-						peer->flowQueue.put({});
+						peer->flowQueue.put({ .sourceFault = sourceFault });
 					}
 				}
 
@@ -2995,7 +3218,8 @@ HelError helFutexWait(int *pointer, int expected, int64_t deadline) {
 							cancellation);
 				},
 				[&] (async::cancellation_token cancellation) {
-					return generalTimerEngine()->sleep(deadline, cancellation);
+					return generalTimerEngine()->sleep(deadline, cancellation,
+							userTimerSlack);
 				}
 			)
 		);
@@ -3016,6 +3240,45 @@ HelError helFutexWake(int *pointer) {
 	return kHelErrNone;
 }
 
+HelError helFutexWakeN(int *pointer, unsigned int count, unsigned int *woken) {
+	auto thisThread = getCurrentThread();
+	auto space = thisThread->getAddressSpace();
+
+	auto identityOrError = space->resolveGlobalFutex(reinterpret_cast<uintptr_t>(pointer));
+	if(!identityOrError)
+		return kHelErrFault;
+	*woken = getGlobalFutexRealm()->wake(identityOrError.value(), count);
+
+	return kHelErrNone;
+}
+
+HelError helFutexRequeue(int *pointer, int expected, int *target,
+		unsigned int numWake, unsigned int numRequeue, unsigned int *woken) {
+	auto thisThread = getCurrentThread();
+	auto space = thisThread->getAddressSpace();
+
+	auto toOrError = space->resolveGlobalFutex(reinterpret_cast<uintptr_t>(target));
+	if(!toOrError)
+		return kHelErrFault;
+
+	// Grab the futex (and not only its identity) to compare its value under the bucket lock.
+	auto futexOrError = Thread::asyncBlockCurrent(
+			space->grabGlobalFutex(reinterpret_cast<uintptr_t>(pointer),
+					thisThread->mainWorkQueue()->take()));
+	if(!futexOrError)
+		return kHelErrFault;
+
+	auto wokenOrError = getGlobalFutexRealm()->requeue(std::move(futexOrError.value()),
+			toOrError.value(), expected, numWake, numRequeue);
+	if(!wokenOrError) {
+		assert(wokenOrError.error() == Error::futexRace);
+		return kHelErrFutexValue;
+	}
+	*woken = wokenOrError.value();
+
+	return kHelErrNone;
+}
+
 HelError helCreateOneshotEvent(HelHandle *handle) {
 	auto this_thread = getCurrentThread();
 	auto this_universe = this_thread->getUniverse();
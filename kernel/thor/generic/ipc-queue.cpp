@@ -11,23 +11,73 @@ namespace thor {
 // IpcQueue
 // ----------------------------------------------------------------------------
 
+size_t IpcQueue::reservedPerChunk(size_t chunkSize) {
+	return (sizeof(ChunkStruct) + chunkSize + 63) & ~size_t(63);
+}
+
+bool IpcQueue::validParameters(unsigned int ringShift, unsigned int numChunks, size_t chunkSize) {
+	if(ringShift > 16 || !numChunks || numChunks > (1u << ringShift))
+		return false;
+	if(chunkSize > maxChunkSize)
+		return false;
+	return numChunks * reservedPerChunk(chunkSize) <= maxChunksMemory;
+}
+
 IpcQueue::IpcQueue(unsigned int ringShift, unsigned int numChunks, size_t chunkSize)
 : _ringShift{ringShift}, _chunkSize{chunkSize}, _chunkOffsets{*kernelAlloc},
 		_currentIndex{0}, _currentProgress{0}, _anyNodes{false} {
-	auto chunksOffset = (sizeof(QueueStruct) + (sizeof(int) << ringShift) + 63) & ~size_t(63);
-	auto reservedPerChunk = (sizeof(ChunkStruct) + chunkSize + 63) & ~size_t(63);
-	auto overallSize = chunksOffset + numChunks * reservedPerChunk;
+	_chunksOffset = (sizeof(QueueStruct) + (sizeof(int) << ringShift) + 63) & ~size_t(63);
+	_reservedPerChunk = reservedPerChunk(chunkSize);
+	auto overallSize = _chunksOffset + numChunks * _reservedPerChunk;
 
 	// Setup internal state.
 	_memory = smarter::allocate_shared<ImmediateMemory>(*kernelAlloc, overallSize);
 	_memory->selfPtr = _memory;
 	_chunkOffsets.resize(numChunks);
 	for(unsigned int i = 0; i < numChunks; ++i)
-		_chunkOffsets[i] = chunksOffset + i * reservedPerChunk;
+		_chunkOffsets[i] = _chunksOffset + i * _reservedPerChunk;
 
 	async::detach_with_allocator(*kernelAlloc, _runQueue());
 }
 
+coroutine<Error> IpcQueue::grow(unsigned int numChunks) {
+	if(!validParameters(_ringShift, numChunks, _chunkSize))
+		co_return Error::illegalArgs;
+
+	co_await _growMutex.async_lock();
+
+	size_t currentChunks;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		currentChunks = _chunkOffsets.size();
+	}
+	if(numChunks < currentChunks) {
+		_growMutex.unlock();
+		co_return Error::illegalArgs;
+	}
+
+	// Chunks are appended to the end of the queue memory, hence existing chunks stay in place.
+	auto error = co_await _memory->resize(_chunksOffset + numChunks * _reservedPerChunk);
+	if(error != Error::success) {
+		_growMutex.unlock();
+		co_return error;
+	}
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		_chunkOffsets.resize(numChunks);
+		for(unsigned int i = currentChunks; i < numChunks; ++i)
+			_chunkOffsets[i] = _chunksOffset + i * _reservedPerChunk;
+	}
+
+	_growMutex.unlock();
+	co_return Error::success;
+}
+
 bool IpcQueue::validSize(size_t size) {
 	return sizeof(ElementStruct) + size <= _chunkSize;
 }
@@ -102,29 +152,43 @@ coroutine<void> IpcQueue::_runQueue() {
 			if(!_anyNodes.load(std::memory_order_relaxed))
 				continue;
 
-			// Check if there is enough space in the current chunk.
-			IpcNode *node;
 			uintptr_t progress;
 			{
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&_mutex);
 
-				assert(!_nodeQueue.empty());
-				node = _nodeQueue.front();
 				progress = _currentProgress;
 			}
 
-			// Compute the overall length of the element.
-			size_t length = 0;
-			for(auto sgSource = _nodeQueue.front()->_source; sgSource; sgSource = sgSource->link)
-				length += (sgSource->size + 7) & ~size_t(7);
-			assert(length <= _chunkSize);
+			// Emit as many elements as possible before publishing them to user space,
+			// such that a batch of elements only requires a single futex wake.
+			NodeList batch;
+			bool retireChunk = false;
+			while(true) {
+				IpcNode *node;
+				{
+					auto irqLock = frg::guard(&irqMutex());
+					auto lock = frg::guard(&_mutex);
+
+					if(_nodeQueue.empty())
+						break;
+					node = _nodeQueue.front();
+				}
+
+				// Compute the overall length of the element.
+				size_t length = 0;
+				for(auto sgSource = node->_source; sgSource; sgSource = sgSource->link)
+					length += (sgSource->size + 7) & ~size_t(7);
+				assert(sizeof(ElementStruct) + length <= _chunkSize);
+
+				// Check if we need to retire the current chunk.
+				if(progress + sizeof(ElementStruct) + length > _chunkSize) {
+					retireChunk = true;
+					break;
+				}
 
-			// Check if we need to retire the current chunk.
-			bool emitElement = true;
-			if(progress + length <= _chunkSize) {
 				// Emit the next element to the current chunk.
-				auto elementOffset = offsetof(ChunkStruct, buffer) + _currentProgress;
+				auto elementOffset = offsetof(ChunkStruct, buffer) + progress;
 				assert(!(elementOffset & 0x7));
 
 				ElementStruct element;
@@ -140,17 +204,26 @@ coroutine<void> IpcQueue::_runQueue() {
 							sgSource->pointer, sgSource->size);
 					sgOffset += (sgSource->size + 7) & ~size_t(7);
 				}
-			}else{
-				emitElement = false;
+				progress += sizeof(ElementStruct) + length;
+
+				// Retire the node (it is completed after the batch is published).
+				{
+					auto irqLock = frg::guard(&irqMutex());
+					auto lock = frg::guard(&_mutex);
+
+					_nodeQueue.pop_front();
+
+					assert(_anyNodes.load(std::memory_order_relaxed));
+					if(_nodeQueue.empty())
+						_anyNodes.store(false, std::memory_order_relaxed);
+				}
+				batch.push_back(node);
 			}
 
 			// Update the progress futex.
-			unsigned int newProgressWord;
-			if(emitElement) {
-				newProgressWord = progress + sizeof(ElementStruct) + length;
-			}else{
-				newProgressWord = progress | kProgressDone;
-			}
+			unsigned int newProgressWord = progress;
+			if(retireChunk)
+				newProgressWord |= kProgressDone;
 
 			auto progressFutexWord = __atomic_exchange_n(&chunkHead->progressFutex,
 					newProgressWord, __ATOMIC_RELEASE);
@@ -161,30 +234,27 @@ coroutine<void> IpcQueue::_runQueue() {
 				getGlobalFutexRealm()->wake(_memory->resolveImmediateFutex(pfOffset));
 			}
 
-			// Update our internal state and retire the chunk.
-			if(!emitElement) {
-				auto irqLock = frg::guard(&irqMutex());
-				auto lock = frg::guard(&_mutex);
-
-				_currentIndex = ((_currentIndex + 1) & kHeadMask);
-				_currentProgress = 0;
-				break;
-			}
-
-			// Update our internal state and retire the node.
+			// Update our internal state and retire the chunk if necessary.
 			{
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&_mutex);
 
-				_currentProgress += sizeof(ElementStruct) + length;
-				_nodeQueue.pop_front();
+				if(retireChunk) {
+					_currentIndex = ((_currentIndex + 1) & kHeadMask);
+					_currentProgress = 0;
+				}else{
+					_currentProgress = progress;
+				}
+			}
 
-				assert(_anyNodes.load(std::memory_order_relaxed));
-				if(_nodeQueue.empty())
-					_anyNodes.store(false, std::memory_order_relaxed);
+			while(!batch.empty()) {
+				auto node = batch.front();
+				batch.pop_front();
+				node->complete();
 			}
 
-			node->complete();
+			if(retireChunk)
+				break;
 		}
 	}
 }
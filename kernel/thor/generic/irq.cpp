@@ -149,7 +149,7 @@ IrqPin::IrqPin(frg::string<KernelAlloc> name)
 
 			auto ms = static_cast<uint64_t>(50) * (1 << self->_unstallExponent);
 			co_await generalTimerEngine()->sleepFor(static_cast<uint64_t>(50'000'000)
-					* (1 << self->_unstallExponent));
+					* (1 << self->_unstallExponent), {}, 10'000'000);
 
 			// Kick the IRQ.
 			{
@@ -101,6 +101,37 @@ private:
 			resp.set_error(managarm::kerncfg::Error::SUCCESS);
 			resp.set_num_cpu(getCpuCount());
 
+			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
+			bragi::write_head_only(resp, respBuffer);
+			auto respError = co_await SendBufferSender{lane, std::move(respBuffer)};
+			if(respError != Error::success) {
+				co_return respError;
+			}
+		}else if(preamble.id() == bragi::message_id<managarm::kerncfg::GetHeapStatisticsRequest>) {
+			auto req = bragi::parse_head_only<managarm::kerncfg::GetHeapStatisticsRequest>(reqBuffer, *kernelAlloc);
+
+			if (!req) {
+				co_return Error::protocolViolation;
+			}
+
+			managarm::kerncfg::GetHeapStatisticsResponse<KernelAlloc> resp(*kernelAlloc);
+			resp.set_num_size_classes(KernelHeapCache::numSizeClasses);
+			resp.set_num_pool_contended(kernelHeapFrontend->numPoolContended());
+			if(req->size_class() < KernelHeapCache::numSizeClasses) {
+				auto stats = kernelHeapFrontend->getClassStats(req->size_class());
+				resp.set_error(managarm::kerncfg::Error::SUCCESS);
+				resp.set_object_size(stats.objectSize);
+				resp.set_num_allocations(stats.numAllocations);
+				resp.set_num_frees(stats.numFrees);
+				resp.set_num_hits(stats.numHits);
+				resp.set_num_depot_exchanges(stats.numDepotExchanges);
+				resp.set_num_pool_operations(stats.numPoolOperations);
+				resp.set_num_depot_contended(stats.numDepotContended);
+				resp.set_num_cached_objects(stats.numCachedObjects);
+			}else{
+				resp.set_error(managarm::kerncfg::Error::ILLEGAL_ARGUMENTS);
+			}
+
 			frg::unique_memory<KernelAlloc> respBuffer{*kernelAlloc, resp.size_of_head()};
 			bragi::write_head_only(resp, respBuffer);
 			auto respError = co_await SendBufferSender{lane, std::move(respBuffer)};
@@ -1,5 +1,7 @@
 #include <frg/unique.hpp>
+#include <thor-internal/arch-generic/ints.hpp>
 #include <thor-internal/load-balancing.hpp>
+#include <thor-internal/schedule.hpp>
 #include <thor-internal/timer.hpp>
 
 namespace thor {
@@ -16,6 +18,43 @@ constexpr uint64_t lbInterval = 100'000'000;
 constexpr uint64_t lbDecay = 184;
 constexpr uint64_t lbDecayInterval = 1'000'000'000;
 
+// Balancing across packages is only done every few rounds since it degrades caches the most.
+constexpr uint64_t lbSystemRoundInterval = 4;
+
+// Minimum time between two attempts of an idle CPU to steal work.
+constexpr uint64_t idleStealInterval = 1'000'000;
+
+// Scheduling domains, from the closest to the most distant CPUs.
+enum LbLevel {
+	smtLevel,
+	packageLevel,
+	systemLevel,
+	numLbLevels
+};
+
+// Returns true if a and b share the given scheduling domain.
+bool inDomain(CpuData *a, CpuData *b, int level) {
+	switch(level) {
+	case smtLevel:
+		return a->packageId == b->packageId
+				&& a->coreId >= 0 && a->coreId == b->coreId;
+	case packageLevel:
+		return a->packageId == b->packageId;
+	default:
+		return true;
+	}
+}
+
+// Returns true if b is a candidate for balancing with a at the given level,
+// i.e., if b is in the domain but was not already considered at a lower level.
+bool inLevel(CpuData *a, CpuData *b, int level) {
+	if(a == b)
+		return false;
+	if(!inDomain(a, b, level))
+		return false;
+	return !level || !inDomain(a, b, level - 1);
+}
+
 frg::eternal<LoadBalancer> loadBalancer;
 
 } // namespace
@@ -26,8 +65,7 @@ LoadBalancer &LoadBalancer::singleton() {
 	return loadBalancer.get();
 }
 
-LoadBalancer::LoadBalancer()
-: barrier_{0} {}
+LoadBalancer::LoadBalancer() = default;
 
 void LoadBalancer::setOnline(CpuData *cpu) {
 	auto *node = &lbNode.get(cpu);
@@ -55,20 +93,16 @@ void LoadBalancer::connect(Thread *thread, CpuData *cpu) {
 coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 	auto *thisNode = &lbNode.get(cpu);
 
-	bool joined = false;
+	// All load balancing happens on this CPU's WorkQueue.
+	co_await cpu->generalWorkQueue->enter();
+
+	// Stagger the rounds of different CPUs such that they do not contend on the same locks.
+	co_await generalTimerEngine()->sleep(getClockNanos()
+			+ lbInterval * cpu->cpuIndex / getCpuCount(), {}, lbInterval / 10);
+
 	uint64_t lastDecay = getClockNanos();
 
 	while(true) {
-		// Global barrier to wait for initiation of load balancing.
-		async::barrier::arrival_token token;
-		if (!joined) {
-			token = barrier_.arrive_and_join();
-			joined = true;
-		} else {
-			token = barrier_.arrive();
-		}
-		co_await barrier_.async_wait(token);
-
 		if (debugLb)
 			infoLogger() << "CPU #" << cpu->cpuIndex << " enters load balancing" << frg::endlog;
 
@@ -106,52 +140,153 @@ coroutine<void> LoadBalancer::run_(CpuData *cpu) {
 				cb->load_ = thread->loadLevel();
 				load += cb->load_;
 			}
-		}
 
-		thisNode->totalLoad = load;
-		thisNode->currentLoad = load;
+			thisNode->currentLoad = load;
+		}
+		thisNode->totalLoad.store(load, std::memory_order_relaxed);
 
 		if (debugLb)
 			infoLogger() << "CPU #" << cpu->cpuIndex << " has load " << load << frg::endlog;
 
-		// Global barrier to wait until all CPUs know their load level.
-		co_await barrier_.async_wait(barrier_.arrive());
-
-		// Enter our own WorkQueue such that all CPUs can balance in parallel.
-		co_await cpu->generalWorkQueue->enter();
-
-		// Sum load of all CPUs.
-		// TODO: Doing this on all CPUs is unnecessary. However, it is also reasonably fast
-		//       and might be preferable over synchronization overhead.
-		uint64_t systemLoad = 0;
-		for (size_t i = 0; i < getCpuCount(); ++i)
-			systemLoad += lbNode.getFor(i).totalLoad;
-		uint64_t idealLoad = systemLoad / getCpuCount();
-		if (debugLb && cpu == getCpuData(0))
-			infoLogger() << "Total system load is " << systemLoad
-					<< " (ideal load: " << idealLoad << ")" << frg::endlog;
-
 		if (enableLb) {
-			// Distribute load from other CPUs to this CPU.
-			// TODO: This loop probably does not scale very well since all CPUs try to pull from
-			//       all other CPUs in the same order (and this can cause lock contention).
-			uint64_t newLoad = thisNode->totalLoad;
-			for (size_t i = 0; i < getCpuCount(); ++i) {
-				auto *toCpu = getCpuData(i);
-				if (cpu != toCpu)
-					balanceBetween_(&lbNode.get(toCpu), thisNode, newLoad, idealLoad);
+			// Pull load from other CPUs to this CPU, starting with the closest ones.
+			// Loads of other CPUs may be slightly out of date; this is fine since
+			// all CPUs balance periodically.
+			uint64_t newLoad = load;
+			for (int level = 0; level < numLbLevels; ++level) {
+				if (level == systemLevel && (thisNode->round % lbSystemRoundInterval))
+					break;
+
+				// Determine the ideal load within this domain.
+				uint64_t domainLoad = 0;
+				size_t domainSize = 0;
+				for (size_t i = 0; i < getCpuCount(); ++i) {
+					auto *otherCpu = getCpuData(i);
+					if (otherCpu != cpu && !inDomain(cpu, otherCpu, level))
+						continue;
+					domainLoad += lbNode.get(otherCpu).totalLoad.load(std::memory_order_relaxed);
+					++domainSize;
+				}
+				uint64_t idealLoad = domainLoad / domainSize;
+
+				// Visit other CPUs in a rotating order to avoid that all CPUs
+				// pull from the same CPU first.
+				size_t n = getCpuCount();
+				size_t start = (cpu->cpuIndex + thisNode->round) % n;
+				for (size_t k = 0; k < n; ++k) {
+					auto *srcCpu = getCpuData((start + k) % n);
+					if (!inLevel(cpu, srcCpu, level))
+						continue;
+					auto *srcNode = &lbNode.get(srcCpu);
+					if (!srcNode->cpu)
+						continue;
+
+					// Moving threads across cores or packages is more expensive;
+					// only do it if the imbalance is significant.
+					auto srcLoad = srcNode->totalLoad.load(std::memory_order_relaxed);
+					if (level != smtLevel && srcLoad <= idealLoad + idealLoad / 8)
+						continue;
+
+					balanceBetween_(srcNode, thisNode, newLoad, idealLoad);
+				}
 			}
 		}
+		thisNode->round++;
 
 		// Balance load again after some time has passed.
-		// Note that we only wait on CPU zero. All other CPUs wait on the barrier instead.
-		if (!cpu->cpuIndex)
-			co_await generalTimerEngine()->sleep(getClockNanos() + lbInterval);
+		co_await generalTimerEngine()->sleep(getClockNanos() + lbInterval, {},
+				lbInterval / 10);
 	}
 
 	co_return;
 }
 
+void LoadBalancer::stealForIdle(CpuData *cpu) {
+	if (!enableLb)
+		return;
+
+	auto *thisNode = &lbNode.get(cpu);
+	if (!thisNode->cpu)
+		return;
+
+	auto now = getClockNanos();
+	if (now - thisNode->lastIdleSteal < idleStealInterval)
+		return;
+	thisNode->lastIdleSteal = now;
+
+	for (int level = 0; level < numLbLevels; ++level) {
+		// Find the CPU with the most threads waiting in its scheduler queue.
+		LbNode *victim = nullptr;
+		size_t maxWaiting = 0;
+		for (size_t i = 0; i < getCpuCount(); ++i) {
+			auto *otherCpu = getCpuData(i);
+			if (!inLevel(cpu, otherCpu, level))
+				continue;
+			auto *otherNode = &lbNode.get(otherCpu);
+			if (!otherNode->cpu)
+				continue;
+
+			auto numWaiting = localScheduler.get(otherCpu).numWaitingHint();
+			if (numWaiting > maxWaiting) {
+				victim = otherNode;
+				maxWaiting = numWaiting;
+			}
+		}
+
+		if (victim && stealTask_(victim, thisNode))
+			return;
+	}
+}
+
+bool LoadBalancer::stealTask_(LbNode *srcNode, LbNode *dstNode) {
+	LbControlBlock *stolen = nullptr;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&srcNode->mutex);
+
+		// Prefer the thread with the highest load.
+		for (auto *cb : srcNode->tasks) {
+			if (stolen && cb->load_ <= stolen->load_)
+				continue;
+			if (!cb->inAffinityMask(dstNode->cpu->cpuIndex))
+				continue;
+			// Blocked threads do not help us; they would only be moved back later.
+			// Note that srcNode's CPU has other threads waiting, so even stealing its
+			// currently running thread frees up that CPU.
+			auto thread = cb->thread_.lock();
+			if (!thread || !thread->isRunnable())
+				continue;
+			stolen = cb;
+		}
+
+		if (!stolen)
+			return false;
+
+		if (debugLb)
+			infoLogger() << "Idle CPU " << dstNode->cpu->cpuIndex
+					<< " steals thread with load " << stolen->load_
+					<< " from CPU " << srcNode->cpu->cpuIndex << frg::endlog;
+
+		assert(stolen->node_ == srcNode);
+		srcNode->tasks.erase(srcNode->tasks.iterator_to(stolen));
+		srcNode->currentLoad -= frg::min(srcNode->currentLoad, stolen->load_);
+		stolen->node_ = dstNode;
+		stolen->_assignedCpu.store(dstNode->cpu, std::memory_order_relaxed);
+	}
+
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&dstNode->mutex);
+
+		dstNode->tasks.push_back(stolen);
+		dstNode->currentLoad += stolen->load_;
+	}
+
+	// The thread migrates once srcNode's CPU reaches its next preemption point.
+	sendPingIpi(srcNode->cpu);
+	return true;
+}
+
 void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad) {
 	auto improvesBalance = [] (uint64_t srcLoad, uint64_t dstLoad, uint64_t stolenLoad) -> bool {
 		uint64_t srcLoadPostMove = srcLoad - stolenLoad;
@@ -220,6 +355,7 @@ void LoadBalancer::balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &n
 		auto lock = frg::guard(&dstNode->mutex);
 
 		dstNode->tasks.splice(dstNode->tasks.end(), stolenTasks);
+		dstNode->currentLoad = newLoad;
 	}
 }
 
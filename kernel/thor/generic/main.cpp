@@ -98,11 +98,14 @@ extern "C" void thorInitialize() {
 
 	kernelVirtualAlloc.initialize();
 	kernelHeap.initialize(*kernelVirtualAlloc);
-	kernelAlloc.initialize(kernelHeap.get());
+	kernelHeapFrontend.initialize(kernelHeap.get());
+	kernelAlloc.initialize(kernelHeapFrontend.get());
 
 	infoLogger() << "thor: Basic memory management is ready" << frg::endlog;
 
 	runBootCpuDataInitializers();
+	physicalAllocator->enablePerCpuCaches();
+	kernelHeapFrontend->enablePerCpuCaches();
 	initializeAsidContext(getCpuData());
 }
 
@@ -584,6 +587,9 @@ void handleSyscall(SyscallImageAccessor image) {
 		*image.error() = helCreateQueue((const HelQueueParameters *)arg0, &handle);
 		*image.out0() = handle;
 	} break;
+	case kHelCallGrowQueue: {
+		*image.error() = helGrowQueue((HelHandle)arg0, (unsigned int)arg1);
+	} break;
 	case kHelCallCancelAsync: {
 		*image.error() = helCancelAsync((HelHandle)arg0, (uint64_t)arg1);
 	} break;
@@ -691,6 +697,9 @@ void handleSyscall(SyscallImageAccessor image) {
 	case kHelCallLoadahead: {
 		*image.error() = helLoadahead((HelHandle)arg0, (uintptr_t)arg1, (size_t)arg2);
 	} break;
+	case kHelCallQueryMemoryStats: {
+		*image.error() = helQueryMemoryStats((HelMemoryStats *)arg0);
+	} break;
 	case kHelCallCreateVirtualizedSpace: {
 		HelHandle handle;
 		*image.error() = helCreateVirtualizedSpace(&handle);
@@ -794,6 +803,17 @@ void handleSyscall(SyscallImageAccessor image) {
 	case kHelCallFutexWake: {
 		*image.error() = helFutexWake((int *)arg0);
 	} break;
+	case kHelCallFutexWakeN: {
+		unsigned int woken;
+		*image.error() = helFutexWakeN((int *)arg0, (unsigned int)arg1, &woken);
+		*image.out0() = woken;
+	} break;
+	case kHelCallFutexRequeue: {
+		unsigned int woken;
+		*image.error() = helFutexRequeue((int *)arg0, (int)arg1, (int *)arg2,
+				(unsigned int)arg3, (unsigned int)arg4, &woken);
+		*image.out0() = woken;
+	} break;
 
 	case kHelCallCreateOneshotEvent: {
 		HelHandle handle;
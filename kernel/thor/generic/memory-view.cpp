@@ -1,4 +1,5 @@
 #include <thor-internal/address-space.hpp>
+#include <thor-internal/compressed-swap.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/fiber.hpp>
 #include <thor-internal/main.hpp>
@@ -21,16 +22,47 @@ namespace {
 // Reclaim implementation.
 // --------------------------------------------------------
 
+// Pages are first collected in per-CPU batches to avoid taking the global lock
+// on each insertion. Batched pages are moved to the inactive LRU list in bulk.
+// Accesses only set CachePage::reclaimReferenced; the reclaimer ages pages
+// using a CLOCK-like algorithm on two lists:
+// * Referenced pages on the inactive list are promoted to the active list.
+// * Unreferenced pages at the head of the inactive list are evicted.
+// * If the active list grows larger than the inactive list, unreferenced pages
+//   are moved from the active list to the inactive list.
+struct ReclaimBatch {
+	static constexpr size_t capacity = 16;
+
+	frg::ticket_spinlock mutex;
+	CachePage *pages[capacity];
+	size_t count = 0;
+};
+
+extern PerCpu<ReclaimBatch> reclaimBatch;
+THOR_DEFINE_PERCPU(reclaimBatch);
+
 struct MemoryReclaimer {
 	void addPage(CachePage *page) {
 		auto irqLock = frg::guard(&irqMutex());
-		auto lock = frg::guard(&_mutex);
 
 		assert(!(page->flags & CachePage::reclaimRegistered));
+		page->flags |= CachePage::reclaimRegistered | CachePage::reclaimBatched;
 
-		_lruList.push_back(page);
-		page->flags |= CachePage::reclaimRegistered;
-		_cachedSize += kPageSize;
+		auto batch = &reclaimBatch.get();
+		bool full;
+		{
+			auto batchLock = frg::guard(&batch->mutex);
+
+			assert(batch->count < ReclaimBatch::capacity);
+			page->batchCpu = getCpuData()->cpuIndex;
+			batch->pages[batch->count++] = page;
+			full = batch->count == ReclaimBatch::capacity;
+		}
+
+		if(full) {
+			auto lock = frg::guard(&_mutex);
+			_flushBatch(batch);
+		}
 	}
 
 	void removePage(CachePage *page) {
@@ -39,27 +71,44 @@ struct MemoryReclaimer {
 
 		assert(page->flags & CachePage::reclaimRegistered);
 
-		if(page->flags & CachePage::reclaimPosted) {
+		if(page->flags & CachePage::reclaimBatched) {
+			auto batch = &reclaimBatch.getFor(page->batchCpu);
+			auto batchLock = frg::guard(&batch->mutex);
+
+			size_t i = 0;
+			while(batch->pages[i] != page) {
+				i++;
+				assert(i < batch->count);
+			}
+			batch->pages[i] = batch->pages[--batch->count];
+			page->flags &= ~CachePage::reclaimBatched;
+		}else if(page->flags & CachePage::reclaimPosted) {
 			if(!(page->flags & CachePage::reclaimInflight)) {
 				auto it = page->bundle->_reclaimList.iterator_to(page);
 				page->bundle->_reclaimList.erase(it);
 			}
 
 			page->flags &= ~(CachePage::reclaimPosted | CachePage::reclaimInflight);
+			_numPosted--;
 		}else{
-			auto it = _lruList.iterator_to(page);
-			_lruList.erase(it);
-			_cachedSize -= kPageSize;
+			_unlinkPage(page);
 		}
-		page->flags &= ~CachePage::reclaimRegistered;
+		page->flags &= ~(CachePage::reclaimRegistered | CachePage::reclaimReferenced);
 	}
 
 	void bumpPage(CachePage *page) {
+		assert(page->flags & CachePage::reclaimRegistered);
+
+		// Fast path: mark the page as referenced; the reclaimer picks this up lazily.
+		if(!(page->flags & CachePage::reclaimPosted)) {
+			page->flags |= CachePage::reclaimReferenced;
+			return;
+		}
+
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
 
-		assert(page->flags & CachePage::reclaimRegistered);
-
+		// The page was posted for eviction but it is still needed.
 		if(page->flags & CachePage::reclaimPosted) {
 			if(!(page->flags & CachePage::reclaimInflight)) {
 				auto it = page->bundle->_reclaimList.iterator_to(page);
@@ -67,13 +116,15 @@ struct MemoryReclaimer {
 			}
 
 			page->flags &= ~(CachePage::reclaimPosted | CachePage::reclaimInflight);
+			_numPosted--;
+
+			page->flags |= CachePage::reclaimActive;
+			_activeList.push_back(page);
+			_numActive++;
 			_cachedSize += kPageSize;
 		}else{
-			auto it = _lruList.iterator_to(page);
-			_lruList.erase(it);
+			page->flags |= CachePage::reclaimReferenced;
 		}
-
-		_lruList.push_back(page);
 	}
 
 	auto awaitReclaim(CacheBundle *bundle, async::cancellation_token ct = {}) {
@@ -105,6 +156,53 @@ struct MemoryReclaimer {
 		return page;
 	}
 
+	// Bundles call this to stop their reclaim worker once all posted pages are processed.
+	// Returns false if more pages were posted in the meantime.
+	bool finishReclaim(CacheBundle *bundle) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		if(!bundle->_reclaimList.empty())
+			return false;
+		bundle->_reclaimRunning = false;
+		return true;
+	}
+
+	// Called by the physical allocator when the number of free pages drops
+	// below the low watermark. The allocator does not call this again until
+	// the fiber re-arms the watermark or memory recovers above the high watermark.
+	void wakeup() {
+		if(_wakeupPending.exchange(true, std::memory_order_acq_rel))
+			return;
+		_numWakeups.fetch_add(1, std::memory_order_relaxed);
+		_wakeupEvent.raise();
+	}
+
+	ReclaimStats getStats() {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		ReclaimStats stats = _stats;
+		stats.numActivePages = _numActive;
+		stats.numInactivePages = _numInactive;
+		stats.numPostedPages = _numPosted;
+		stats.numWakeups = _numWakeups.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	// Reclaim starts once fewer than lowWatermark() pages are free
+	// and continues until highWatermark() pages are free (or posted for eviction).
+	static size_t lowWatermark() {
+		return physicalAllocator->numTotalPages() / 4;
+	}
+
+	static size_t highWatermark() {
+		return physicalAllocator->numTotalPages() * 5 / 16;
+	}
+
+	// Minimal delay (in nanoseconds) between two passes if a pass did not find anything to reclaim.
+	static constexpr uint64_t retryDelay = 100'000'000;
+
 	void runReclaimFiber() {
 		auto checkReclaim = [this] () -> bool {
 			if(disableUncaching)
@@ -113,70 +211,177 @@ struct MemoryReclaimer {
 			auto irqLock = frg::guard(&irqMutex());
 			auto lock = frg::guard(&_mutex);
 
-			if(_lruList.empty())
-				return false;
-
 			if(!tortureUncaching) {
-				auto pagesWatermark = physicalAllocator->numTotalPages() * 3 / 4;
-				auto usedPages = physicalAllocator->numUsedPages();
-				if(usedPages < pagesWatermark) {
+				auto freePages = physicalAllocator->numFreePages();
+				if(freePages + _numPosted >= highWatermark()) {
 					return false;
 				}else{
 					if(logUncaching)
-						infoLogger() << "thor: Uncaching page. " << usedPages
-								<< " pages are in use (watermark: " << pagesWatermark << ")"
+						infoLogger() << "thor: Uncaching page. " << freePages
+								<< " pages are free (watermark: " << highWatermark() << ")"
 								<< frg::endlog;
 				}
 			}
 
-			auto page = _lruList.pop_front();
+			// If all inactive pages are referenced, they are promoted to the active list;
+			// in this case, we have to deactivate pages before retrying.
+			CachePage *page = nullptr;
+			for(int i = 0; i < 2 && !page; i++) {
+				_balanceLists();
+				page = _scanInactive();
+			}
+			if(!page)
+				return false;
 
 			assert(page->flags & CachePage::reclaimRegistered);
 			assert(!(page->flags & CachePage::reclaimPosted));
 			assert(!(page->flags & CachePage::reclaimInflight));
 
 			page->flags |= CachePage::reclaimPosted;
-			_cachedSize -= kPageSize;
+			_numPosted++;
+			_stats.numReclaimedPages++;
 
 			page->bundle->_reclaimList.push_back(page);
-			page->bundle->_reclaimEvent.raise();
+			page->bundle->reclaimPosted();
 
 			return true;
 		};
 
 		KernelFiber::run([=, this] {
 			while(true) {
-				if(logUncaching) {
+				// Clear the flag before checking the watermarks such that no wakeup is lost.
+				_wakeupPending.store(false, std::memory_order_release);
+
+				{
 					auto irqLock = frg::guard(&irqMutex());
 					auto lock = frg::guard(&_mutex);
-					infoLogger() << "thor: " << (_cachedSize / 1024)
-							<< " KiB of cached pages" << frg::endlog;
+					for(size_t i = 0; i < getCpuCount(); i++)
+						_flushBatch(&reclaimBatch.getFor(i));
+
+					if(logUncaching)
+						infoLogger() << "thor: " << (_cachedSize / 1024)
+								<< " KiB of cached pages" << frg::endlog;
 				}
 
+				size_t numPosted = 0;
 				while(checkReclaim())
-					;
+					numPosted++;
 				if(tortureUncaching) {
 					KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(10'000'000));
 				}else{
-					KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000'000));
+					// If there was nothing to reclaim, retrying immediately would not help.
+					// Rate-limit the wakeups by delaying the re-arm of the watermark.
+					if(!numPosted)
+						KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(retryDelay));
+					physicalAllocator->rearmLowWatermark();
+
+					KernelFiber::asyncBlockCurrent(_wakeupEvent.async_wait_if([this] () -> bool {
+						return !_wakeupPending.load(std::memory_order_acquire);
+					}));
 				}
 			}
 		});
 	}
 
 private:
-	frg::ticket_spinlock _mutex;
+	// Must be called with _mutex held.
+	void _flushBatch(ReclaimBatch *batch) {
+		auto batchLock = frg::guard(&batch->mutex);
+
+		for(size_t i = 0; i < batch->count; i++) {
+			auto page = batch->pages[i];
+			assert(page->flags & CachePage::reclaimBatched);
+			page->flags &= ~CachePage::reclaimBatched;
+			_inactiveList.push_back(page);
+			_numInactive++;
+			_cachedSize += kPageSize;
+		}
+		batch->count = 0;
+	}
+
+	// Must be called with _mutex held.
+	void _unlinkPage(CachePage *page) {
+		if(page->flags & CachePage::reclaimActive) {
+			auto it = _activeList.iterator_to(page);
+			_activeList.erase(it);
+			_numActive--;
+			page->flags &= ~CachePage::reclaimActive;
+		}else{
+			auto it = _inactiveList.iterator_to(page);
+			_inactiveList.erase(it);
+			_numInactive--;
+		}
+		_cachedSize -= kPageSize;
+	}
+
+	// Moves unreferenced pages from the active list to the inactive list
+	// until the inactive list is at least as large as the active list.
+	// Must be called with _mutex held.
+	void _balanceLists() {
+		size_t budget = _numActive;
+		while(_numActive > _numInactive && budget) {
+			budget--;
+			auto page = _activeList.pop_front();
+			if(page->flags.fetch_and(~CachePage::reclaimReferenced) & CachePage::reclaimReferenced) {
+				// Give the page a second chance.
+				_activeList.push_back(page);
+				continue;
+			}
+			page->flags &= ~CachePage::reclaimActive;
+			_numActive--;
+			_inactiveList.push_back(page);
+			_numInactive++;
+			_stats.numDeactivatedPages++;
+		}
+	}
+
+	// Returns an unreferenced page from the head of the inactive list (or nullptr).
+	// Referenced pages are promoted to the active list.
+	// Must be called with _mutex held.
+	CachePage *_scanInactive() {
+		while(!_inactiveList.empty()) {
+			auto page = _inactiveList.pop_front();
+			_numInactive--;
+			_stats.numScannedPages++;
+
+			if(page->flags.fetch_and(~CachePage::reclaimReferenced) & CachePage::reclaimReferenced) {
+				page->flags |= CachePage::reclaimActive;
+				_activeList.push_back(page);
+				_numActive++;
+				_stats.numActivatedPages++;
+				continue;
+			}
 
-	frg::intrusive_list<
+			_cachedSize -= kPageSize;
+			return page;
+		}
+		return nullptr;
+	}
+
+	using PageList = frg::intrusive_list<
 		CachePage,
 		frg::locate_member<
 			CachePage,
 			frg::default_list_hook<CachePage>,
 			&CachePage::listHook
 		>
-	> _lruList;
+	>;
+
+	frg::ticket_spinlock _mutex;
+
+	PageList _activeList;
+	PageList _inactiveList;
+	size_t _numActive = 0;
+	size_t _numInactive = 0;
+	size_t _numPosted = 0;
 
 	size_t _cachedSize = 0;
+
+	std::atomic<bool> _wakeupPending{false};
+	std::atomic<uint64_t> _numWakeups{0};
+	async::recurring_event _wakeupEvent;
+
+	ReclaimStats _stats;
 };
 
 static frg::manual_box<MemoryReclaimer> globalReclaimer;
@@ -186,14 +391,27 @@ static initgraph::Task initReclaim{&globalInitEngine, "generic.init-reclaim",
 	[] {
 		globalReclaimer.initialize();
 		globalReclaimer->runReclaimFiber();
+
+		physicalAllocator->setWatermarks(MemoryReclaimer::lowWatermark(),
+				MemoryReclaimer::highWatermark(), [] {
+			globalReclaimer->wakeup();
+		});
 	}
 };
 
+ReclaimStats getReclaimStats() {
+	return globalReclaimer->getStats();
+}
+
+void CacheBundle::reclaimPosted() {
+	_reclaimEvent.raise();
+}
+
 // --------------------------------------------------------
 // MemoryView.
 // --------------------------------------------------------
 
-void MemoryView::resize(size_t newSize, async::any_receiver<void> receiver) {
+void MemoryView::resize(size_t newSize, async::any_receiver<Error> receiver) {
 	(void)newSize;
 	(void)receiver;
 	panicLogger() << "MemoryView does not support resize!" << frg::endlog;
@@ -342,10 +560,22 @@ MemoryView::touchRange(uintptr_t offset, size_t size,
 	co_return {};
 }
 
+size_t MemoryView::contiguousGranularity() {
+	return kPageSize;
+}
+
+frg::tuple<PhysicalAddr, CachingMode> MemoryView::peekContiguousRange(uintptr_t, size_t) {
+	return frg::tuple<PhysicalAddr, CachingMode>{PhysicalAddr(-1), CachingMode::null};
+}
+
 Error MemoryView::updateRange(ManageRequest, size_t, size_t) {
 	return Error::illegalObject;
 }
 
+void MemoryView::loadahead(uintptr_t, size_t) {
+	// Views without a backing store have nothing to preload.
+}
+
 void MemoryView::submitManage(ManageNode *) {
 	panicLogger() << "MemoryView does not support management!" << frg::endlog;
 }
@@ -460,7 +690,8 @@ ImmediateMemory::~ImmediateMemory() {
 		physicalAllocator->free(_physicalPages[i], kPageSize);
 }
 
-void ImmediateMemory::resize(size_t newSize, async::any_receiver<void> receiver) {
+void ImmediateMemory::resize(size_t newSize, async::any_receiver<Error> receiver) {
+	Error error = Error::success;
 	{
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
@@ -471,7 +702,14 @@ void ImmediateMemory::resize(size_t newSize, async::any_receiver<void> receiver)
 		_physicalPages.resize(newNumPages);
 		for(size_t i = currentNumPages; i < newNumPages; ++i) {
 			auto physical = physicalAllocator->allocate(kPageSize, 64);
-			assert(physical != PhysicalAddr(-1) && "OOM when allocating ImmediateMemory");
+			if(physical == PhysicalAddr(-1)) {
+				// Undo the partial resize.
+				for(size_t j = currentNumPages; j < i; ++j)
+					physicalAllocator->free(_physicalPages[j], kPageSize);
+				_physicalPages.resize(currentNumPages);
+				error = Error::noMemory;
+				break;
+			}
 
 			PageAccessor accessor{physical};
 			memset(accessor.get(), 0, kPageSize);
@@ -480,7 +718,7 @@ void ImmediateMemory::resize(size_t newSize, async::any_receiver<void> receiver)
 		}
 	}
 
-	receiver.set_value();
+	receiver.set_value(error);
 }
 
 frg::expected<Error, frg::tuple<smarter::shared_ptr<GlobalFutexSpace>, uintptr_t>>
@@ -532,6 +770,9 @@ size_t ImmediateMemory::getLength() {
 
 coroutine<frg::expected<Error, PhysicalAddr>> ImmediateMemory::takeGlobalFutex(uintptr_t offset,
 		smarter::shared_ptr<WorkQueue>) {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
 	auto index = offset >> kPageShift;
 	if(index >= _physicalPages.size())
 		co_return Error::fault;
@@ -575,6 +816,18 @@ frg::tuple<PhysicalAddr, CachingMode> HardwareMemory::peekRange(uintptr_t offset
 	return frg::tuple<PhysicalAddr, CachingMode>{_base + offset, _cacheMode};
 }
 
+size_t HardwareMemory::contiguousGranularity() {
+	return _length;
+}
+
+frg::tuple<PhysicalAddr, CachingMode> HardwareMemory::peekContiguousRange(uintptr_t offset,
+		size_t size) {
+	assert(!(offset & (size - 1)));
+	if(offset + size > _length)
+		return frg::tuple<PhysicalAddr, CachingMode>{PhysicalAddr(-1), CachingMode::null};
+	return frg::tuple<PhysicalAddr, CachingMode>{_base + offset, _cacheMode};
+}
+
 coroutine<frg::expected<Error, PhysicalRange>>
 HardwareMemory::fetchRange(uintptr_t offset, FetchFlags, smarter::shared_ptr<WorkQueue>) {
 	assert(offset % kPageSize == 0);
@@ -631,7 +884,7 @@ AllocatedMemory::~AllocatedMemory() {
 				<< (physicalAllocator->numUsedPages() * 4) << " KiB in use)" << frg::endlog;
 }
 
-void AllocatedMemory::resize(size_t newSize, async::any_receiver<void> receiver) {
+void AllocatedMemory::resize(size_t newSize, async::any_receiver<Error> receiver) {
 	{
 		auto irq_lock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
@@ -641,7 +894,7 @@ void AllocatedMemory::resize(size_t newSize, async::any_receiver<void> receiver)
 		assert(num_chunks >= _physicalChunks.size());
 		_physicalChunks.resize(num_chunks, PhysicalAddr(-1));
 	}
-	receiver.set_value();
+	receiver.set_value(Error::success);
 }
 
 frg::expected<Error, frg::tuple<smarter::shared_ptr<GlobalFutexSpace>, uintptr_t>>
@@ -675,6 +928,29 @@ frg::tuple<PhysicalAddr, CachingMode> AllocatedMemory::peekRange(uintptr_t offse
 			CachingMode::null};
 }
 
+size_t AllocatedMemory::contiguousGranularity() {
+	return _chunkSize;
+}
+
+frg::tuple<PhysicalAddr, CachingMode> AllocatedMemory::peekContiguousRange(uintptr_t offset,
+		size_t size) {
+	assert(!(offset & (size - 1)));
+
+	// Chunks are allocated as a whole, hence the range is contiguous if it fits into one chunk.
+	if(size > _chunkSize)
+		return frg::tuple<PhysicalAddr, CachingMode>{PhysicalAddr(-1), CachingMode::null};
+
+	auto irq_lock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	auto index = offset / _chunkSize;
+	auto disp = offset & (_chunkSize - 1);
+	if(index >= _physicalChunks.size() || _physicalChunks[index] == PhysicalAddr(-1))
+		return frg::tuple<PhysicalAddr, CachingMode>{PhysicalAddr(-1), CachingMode::null};
+	return frg::tuple<PhysicalAddr, CachingMode>{_physicalChunks[index] + disp,
+			CachingMode::null};
+}
+
 coroutine<frg::expected<Error, PhysicalRange>>
 AllocatedMemory::fetchRange(uintptr_t offset, FetchFlags, smarter::shared_ptr<WorkQueue>) {
 	auto irq_lock = frg::guard(&irqMutex());
@@ -925,6 +1201,61 @@ void ManagedSpace::_progressManagement(ManageList &pending) {
 	}
 }
 
+void ManagedSpace::_queueInitialization(size_t index, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		if(!(index + i < numPages))
+			break;
+		auto [pit, wasInserted] = pages.find_or_insert(index + i, this, index + i);
+		assert(pit);
+		if(pit->loadState == kStateMissing) {
+			pit->loadState = kStateWantInitialization;
+			_initializationList.push_back(&pit->cachePage);
+		}
+	}
+}
+
+void ManagedSpace::_readaheadOnMiss(size_t index) {
+	auto &window = _readaheadWindow;
+
+	// Faults inside or directly behind the current window are sequential.
+	size_t count;
+	if(index >= window.start && index <= window.start + window.size) {
+		count = frg::min(frg::max(2 * window.size, minReadaheadPages), maxReadaheadPages);
+	}else{
+		count = minReadaheadPages;
+	}
+	_startReadahead(index, count);
+}
+
+void ManagedSpace::_readaheadOnMarker(ManagedPage *pit) {
+	auto &window = _readaheadWindow;
+	pit->readaheadMarker = false;
+
+	// Ignore stale markers of previous windows.
+	auto index = pit->cachePage.identity;
+	if(index < window.start || index >= window.start + window.size)
+		return;
+	_startReadahead(window.start + window.size,
+			frg::min(2 * window.size, maxReadaheadPages));
+}
+
+void ManagedSpace::_startReadahead(size_t index, size_t count) {
+	if(!(index < numPages))
+		return;
+	count = frg::min(count, numPages - index);
+	_queueInitialization(index, count);
+
+	// Place a marker in the middle of the window such that the next window
+	// is requested before the current one is consumed.
+	_readaheadWindow.start = index;
+	_readaheadWindow.size = count;
+	if(count > 1) {
+		auto [pit, wasInserted] = pages.find_or_insert(index + count / 2, this, index + count / 2);
+		assert(pit);
+		pit->readaheadMarker = true;
+	}
+}
+
 void ManagedSpace::_progressMonitors(MonitorList &pending) {
 	// TODO: Accelerate this by storing the monitors in a RB tree ordered by their progress.
 	auto progressNode = [&] (MonitorNode *node) -> bool {
@@ -963,12 +1294,12 @@ void ManagedSpace::_progressMonitors(MonitorList &pending) {
 // BackingMemory
 // --------------------------------------------------------
 
-void BackingMemory::resize(size_t newSize, async::any_receiver<void> receiver) {
+void BackingMemory::resize(size_t newSize, async::any_receiver<Error> receiver) {
 	assert(!(newSize & (kPageSize - 1)));
 	auto newPages = newSize >> kPageShift;
 
 	async::detach_with_allocator(*kernelAlloc, [] (BackingMemory *self, size_t newPages,
-			async::any_receiver<void> receiver) -> coroutine<void> {
+			async::any_receiver<Error> receiver) -> coroutine<void> {
 		size_t oldPages;
 		{
 			auto irqLock = frg::guard(&irqMutex());
@@ -986,7 +1317,7 @@ void BackingMemory::resize(size_t newSize, async::any_receiver<void> receiver) {
 					oldPages << kPageShift);
 		}
 
-		receiver.set_value();
+		receiver.set_value(Error::success);
 	}(this, newPages, std::move(receiver)));
 }
 
@@ -1210,6 +1541,20 @@ FrontalMemory::fetchRange(uintptr_t offset, FetchFlags flags, smarter::shared_pt
 				globalReclaimer->addPage(&pit->cachePage);
 			}
 
+			if(!pit->readaheadMarker)
+				co_return PhysicalRange{physical + misalign, kPageSize - misalign,
+						CachingMode::null};
+
+			// Hitting the marker starts the next readahead window asynchronously.
+			_managed->_readaheadOnMarker(pit);
+			_managed->_progressManagement(pendingManagement);
+			lock.unlock();
+			irq_lock.unlock();
+
+			while(!pendingManagement.empty()) {
+				auto node = pendingManagement.pop_front();
+				node->complete();
+			}
 			co_return PhysicalRange{physical + misalign, kPageSize - misalign, CachingMode::null};
 		}else{
 			assert(pit->loadState == ManagedSpace::kStateMissing
@@ -1223,25 +1568,16 @@ FrontalMemory::fetchRange(uintptr_t offset, FetchFlags flags, smarter::shared_pt
 		}
 
 		// We have to take the slow-path, i.e., perform the fetch asynchronously.
-		if(pit->loadState == ManagedSpace::kStateMissing) {
-			pit->loadState = ManagedSpace::kStateWantInitialization;
-			_managed->_initializationList.push_back(&pit->cachePage);
+		// Readahead queues the faulting page as the first page of its window.
+		if(!_managed->readahead) {
+			_managed->_queueInitialization(index, 1);
+		}else if(pit->readaheadMarker) {
+			_managed->_readaheadOnMarker(pit);
+			_managed->_queueInitialization(index, 1);
+		}else if(pit->loadState == ManagedSpace::kStateMissing) {
+			_managed->_readaheadOnMiss(index);
 		}
 
-		// Perform readahead.
-		if(_managed->readahead)
-			for(size_t i = 1; i < 4; ++i) {
-				if(!(index + i < _managed->numPages))
-					break;
-				auto [pit, wasInserted] = _managed->pages.find_or_insert(
-						index + i, _managed.get(), index + i);
-				assert(pit);
-				if(pit->loadState == ManagedSpace::kStateMissing) {
-					pit->loadState = ManagedSpace::kStateWantInitialization;
-					_managed->_initializationList.push_back(&pit->cachePage);
-				}
-			}
-
 		_managed->_progressManagement(pendingManagement);
 
 		fetchMonitor.setup(ManageRequest::initialize, offset, kPageSize);
@@ -1313,6 +1649,29 @@ void FrontalMemory::markDirty(uintptr_t offset, size_t size) {
 	_managed->_deferredManagement.invoke();
 }
 
+void FrontalMemory::loadahead(uintptr_t offset, size_t length) {
+	ManageList pendingManagement;
+	{
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_managed->mutex);
+
+		auto index = offset >> kPageShift;
+		if(!(index < _managed->numPages))
+			return;
+		auto count = frg::min((length + kPageSize - 1) >> kPageShift,
+				_managed->numPages - index);
+
+		// Large requests are fused into few initialization requests by _progressManagement().
+		_managed->_queueInitialization(index, count);
+		_managed->_progressManagement(pendingManagement);
+	}
+
+	while(!pendingManagement.empty()) {
+		auto node = pendingManagement.pop_front();
+		node->complete();
+	}
+}
+
 size_t FrontalMemory::getLength() {
 	// Size is constant so we do not need to lock.
 	return _managed->numPages << kPageShift;
@@ -1470,12 +1829,6 @@ Error IndirectMemory::setIndirection(size_t slot, smarter::shared_ptr<MemoryView
 // CopyOnWriteMemory
 // --------------------------------------------------------
 
-CowPage::~CowPage() {
-	assert(state == CowState::hasCopy);
-	assert(physical != PhysicalAddr(-1));
-	physicalAllocator->free(physical, kPageSize);
-}
-
 CopyOnWriteMemory::CopyOnWriteMemory(smarter::shared_ptr<MemoryView> view,
 		uintptr_t offset, size_t length,
 		smarter::shared_ptr<CowChain> chain)
@@ -1485,9 +1838,39 @@ CopyOnWriteMemory::CopyOnWriteMemory(smarter::shared_ptr<MemoryView> view,
 	assert(length);
 	assert(!(offset & (kPageSize - 1)));
 	assert(!(length & (kPageSize - 1)));
+
+	if(_copyChain) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto chainLock = frg::guard(&_copyChain->_mutex);
+		_copyChain->_numViews++;
+	}
 }
 
 CopyOnWriteMemory::~CopyOnWriteMemory() {
+	// Note that no page is being evicted since the reclaim worker keeps this object alive.
+	for(size_t pg = 0; pg < _length; pg += kPageSize) {
+		auto page = _ownedPages.find(pg >> kPageShift);
+		if(!page)
+			continue;
+		assert(page->state == CowState::hasCopy);
+		assert(!page->evicting);
+		if(page->cachePage.flags & CachePage::reclaimRegistered)
+			globalReclaimer->removePage(&page->cachePage);
+
+		if(page->compressed) {
+			discardCompressedPage(page->compressed);
+		}else{
+			assert(page->physical != PhysicalAddr(-1));
+			physicalAllocator->free(page->physical, kPageSize);
+		}
+	}
+
+	if(_copyChain) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto chainLock = frg::guard(&_copyChain->_mutex);
+		assert(_copyChain->_numViews);
+		_copyChain->_numViews--;
+	}
 }
 
 size_t CopyOnWriteMemory::getLength() {
@@ -1509,10 +1892,10 @@ void CopyOnWriteMemory::fork(async::any_receiver<frg::tuple<Error, smarter::shar
 			async::any_receiver<frg::tuple<Error, smarter::shared_ptr<MemoryView>>> receiver)
 			-> coroutine<void> {
 		smarter::shared_ptr<CopyOnWriteMemory> forked;
-		smarter::shared_ptr<CowChain> newChain;
-		frg::vector<frg::tuple<size_t, smarter::shared_ptr<CowPage>>, KernelAlloc> inProgressPages{*kernelAlloc};
+		smarter::shared_ptr<CowChain> chain;
+		frg::vector<size_t, KernelAlloc> inProgressPages{*kernelAlloc};
 
-		auto doCopyOnePage = [&] (size_t pg, smarter::borrowed_ptr<CowPage> page) {
+		auto doCopyOnePage = [&] (size_t index, CowPage *page) {
 			// The page is locked. We *need* to keep it in the old address space.
 			if(page->lockCount /*|| disableCow */) {
 				// Allocate a new physical page for a copy.
@@ -1524,21 +1907,22 @@ void CopyOnWriteMemory::fork(async::any_receiver<frg::tuple<Error, smarter::shar
 				PageAccessor copyAccessor{copyPhysical};
 				memcpy(copyAccessor.get(), lockedAccessor.get(), kPageSize);
 
-				// Update the chains.
-				auto copyPage = smarter::allocate_shared<CowPage>(*kernelAlloc);
+				// Once the page is registered, the forked mapping's reclaim worker may run.
+				auto forkedLock = frg::guard(&forked->_mutex);
+				auto copyPage = forked->_ownedPages.insert(index, forked.get(), index);
 				copyPage->state = CowState::hasCopy;
 				copyPage->physical = copyPhysical;
-				auto copyIt = forked->_ownedPages.insert(pg >> kPageShift);
-				*copyIt = copyPage;
+				globalReclaimer->addPage(&copyPage->cachePage);
 			}else{
+				// Pages in CowChains are never evicted.
+				self->_retainPage(page);
 				auto physical = page->physical;
 				assert(physical != PhysicalAddr(-1));
+				self->_ownedPages.erase(index);
 
-				// Update the chains.
-				auto pageOffset = self->_viewOffset + pg;
-				auto newIt = newChain->_pages.insert(pageOffset >> kPageShift);
-				*newIt = page.lock();
-				self->_ownedPages.erase(pg >> kPageShift);
+				// Update the chain.
+				auto chainLock = frg::guard(&chain->_mutex);
+				chain->insertPage((self->_viewOffset >> kPageShift) + index, physical);
 			}
 		};
 
@@ -1546,52 +1930,59 @@ void CopyOnWriteMemory::fork(async::any_receiver<frg::tuple<Error, smarter::shar
 			auto irqLock = frg::guard(&irqMutex());
 			auto lock = frg::guard(&self->_mutex);
 
-			// Create a new CowChain for both the original and the forked mapping.
-			// To correct handle locks pages, we move only non-locked pages from
-			// the original mapping to the new chain.
-			auto curChain = self->_copyChain;
-			newChain = smarter::allocate_shared<CowChain>(*kernelAlloc);
+			// Merge chains that are not observable by other views anymore.
+			// This keeps the number of chains that lookups have to walk small.
+			chain = self->_copyChain;
+			if(chain)
+				chain->collapse();
+
+			// If no other view (and no other chain) can observe our chain, we move our pages
+			// into it. Otherwise, we create a new chain on top of it for both the original
+			// and the forked mapping. To correctly handle locked pages, we move only
+			// non-locked pages from the original mapping to the chain.
+			bool reuseChain = false;
+			if(chain) {
+				auto chainLock = frg::guard(&chain->_mutex);
+				reuseChain = chain->_numViews == 1 && !chain->_numChildren;
+			}
+			if(!reuseChain) {
+				chain = smarter::allocate_shared<CowChain>(*kernelAlloc,
+						self->_copyChain, self->_viewOffset, self->_length);
 
-			// Update the original mapping
-			self->_copyChain = newChain;
+				if(self->_copyChain) {
+					auto chainLock = frg::guard(&self->_copyChain->_mutex);
+					self->_copyChain->_numViews--;
+				}
+				{
+					auto chainLock = frg::guard(&chain->_mutex);
+					chain->_numViews++;
+				}
+				self->_copyChain = chain;
+			}
 
 			// Create a new mapping in the forked space.
 			forked = smarter::allocate_shared<CopyOnWriteMemory>(*kernelAlloc,
-							self->_view, self->_viewOffset, self->_length, newChain);
+							self->_view, self->_viewOffset, self->_length, chain);
 			forked->selfPtr = forked;
 
 			// Inspect all copied pages owned by the original mapping.
+			// Pages that are not owned are already visible through the chain.
 			for(size_t pg = 0; pg < self->_length; pg += kPageSize) {
-				auto it = self->_ownedPages.find(pg >> kPageShift);
-
-				if(!it) {
-					// If the page is missing in this memory object, look at the CowChain.
-					auto pageOffset = self->_viewOffset + pg;
-					if (curChain) {
-						auto chainLock = frg::guard(&curChain->_mutex);
-
-						if(auto it = curChain->_pages.find(pageOffset >> kPageShift); it) {
-							auto page = *it;
-							assert(page->state == CowState::hasCopy);
-							auto newIt = newChain->_pages.insert(pageOffset >> kPageShift);
-							*newIt = page;
-						}
-					}
+				auto page = self->_ownedPages.find(pg >> kPageShift);
+				if(!page)
 					continue;
-				}
 
-				auto page = *it;
 				if(page->state == CowState::inProgress) {
 					// We wait for the in progress pages later, as we
 					// need to drop the locks we're holding before
 					// suspending, but they are ensuring consistency
 					// of the object we're working on.
-					inProgressPages.push(frg::make_tuple(pg, page));
+					inProgressPages.push(pg >> kPageShift);
 					continue;
 				}else
 					assert(page->state == CowState::hasCopy);
 
-				doCopyOnePage(pg, page);
+				doCopyOnePage(pg >> kPageShift, page);
 			}
 		}
 
@@ -1602,8 +1993,10 @@ void CopyOnWriteMemory::fork(async::any_receiver<frg::tuple<Error, smarter::shar
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&self->_mutex);
 
-				for (auto [_, inProgressPage] : inProgressPages) {
-					if (inProgressPage->state == CowState::inProgress)
+				for (auto index : inProgressPages) {
+					auto page = self->_ownedPages.find(index);
+					assert(page);
+					if (page->state == CowState::inProgress)
 						return true;
 				}
 
@@ -1617,9 +2010,11 @@ void CopyOnWriteMemory::fork(async::any_receiver<frg::tuple<Error, smarter::shar
 			auto lock = frg::guard(&self->_mutex);
 
 			// Copy all the previously in progress pages now that they're done copying.
-			for (auto [pg, page] : inProgressPages) {
+			for (auto index : inProgressPages) {
+				auto page = self->_ownedPages.find(index);
+				assert(page);
 				assert(page->state == CowState::hasCopy);
-				doCopyOnePage(pg, page);
+				doCopyOnePage(index, page);
 			}
 		}
 
@@ -1643,40 +2038,35 @@ bool CopyOnWriteMemory::asyncLockRange(uintptr_t offset, size_t size,
 		size_t progress = 0;
 		while(progress < size) {
 			auto offset = overallOffset + progress;
+			auto index = offset >> kPageShift;
 
-			smarter::shared_ptr<CowChain> chain;
 			smarter::shared_ptr<MemoryView> view;
 			uintptr_t viewOffset;
-			smarter::shared_ptr<CowPage> cowPage;
+			PhysicalAddr physical = PhysicalAddr(-1);
 			bool waitForCopy = false;
 			{
 				// If the page is present in our private chain, we just return it.
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&self->_mutex);
 
-				auto cowIt = self->_ownedPages.find(offset >> kPageShift);
-				if(cowIt) {
-					cowPage = *cowIt;
-					if(cowPage->state == CowState::hasCopy) {
-						assert(cowPage->physical != PhysicalAddr(-1));
+				if(auto page = self->_ownedPages.find(index); page) {
+					if(page->state == CowState::hasCopy) {
+						self->_lockPage(page);
+						assert(page->physical != PhysicalAddr(-1));
 
-						cowPage->lockCount++;
 						progress += kPageSize;
 						continue;
 					}else{
-						assert(cowPage->state == CowState::inProgress);
+						assert(page->state == CowState::inProgress);
 						waitForCopy = true;
 					}
 				}else{
-					chain = self->_copyChain;
 					view = self->_view;
 					viewOffset = self->_viewOffset;
 
 					// Otherwise we need to copy from the chain or from the root view.
-					cowPage = smarter::allocate_shared<CowPage>(*kernelAlloc);
-					cowPage->state = CowState::inProgress;
-					cowIt = self->_ownedPages.insert(offset >> kPageShift);
-					*cowIt = cowPage;
+					self->_makePage(index);
+					physical = self->_copyFromChain(index);
 				}
 			}
 
@@ -1684,13 +2074,15 @@ bool CopyOnWriteMemory::asyncLockRange(uintptr_t offset, size_t size,
 				bool stillWaiting;
 				do {
 					stillWaiting = co_await self->_copyEvent.async_wait_if([&] () -> bool {
-						// TODO: this could be faster if cowPage->state was atomic.
+						// TODO: this could be faster if the page's state was atomic.
 						auto irqLock = frg::guard(&irqMutex());
 						auto lock = frg::guard(&self->_mutex);
 
-						if(cowPage->state == CowState::inProgress)
+						auto page = self->_ownedPages.find(index);
+						assert(page);
+						if(page->state == CowState::inProgress)
 							return true;
-						assert(cowPage->state == CowState::hasCopy);
+						assert(page->state == CowState::hasCopy);
 						return false;
 					});
 					co_await wq->schedule();
@@ -1700,40 +2092,23 @@ bool CopyOnWriteMemory::asyncLockRange(uintptr_t offset, size_t size,
 					auto irqLock = frg::guard(&irqMutex());
 					auto lock = frg::guard(&self->_mutex);
 
-					assert(cowPage->state == CowState::hasCopy);
-					cowPage->lockCount++;
+					auto page = self->_ownedPages.find(index);
+					assert(page);
+					assert(page->state == CowState::hasCopy);
+					self->_lockPage(page);
 				}
 				progress += kPageSize;
 				continue;
 			}
 
-			PhysicalAddr physical = physicalAllocator->allocate(kPageSize);
-			assert(physical != PhysicalAddr(-1) && "OOM");
-			PageAccessor accessor{physical};
-
-			// Try to copy from a descendant CoW chain.
-			auto pageOffset = viewOffset + offset;
-			bool chainHasCopy = false;
-			if(chain) {
-				auto irqLock = frg::guard(&irqMutex());
-				auto lock = frg::guard(&chain->_mutex);
-
-				if(auto it = chain->_pages.find(pageOffset >> kPageShift); it) {
-					auto page = *it;
-					// We can just copy synchronously here -- the descendant is not evicted.
-					assert(page->state == CowState::hasCopy);
-					auto srcPhysical = page->physical;
-					assert(srcPhysical != PhysicalAddr(-1));
-					auto srcAccessor = PageAccessor{srcPhysical};
-					memcpy(accessor.get(), srcAccessor.get(), kPageSize);
-					chainHasCopy = true;
-				}
-			}
-
 			// Copy from the root view.
-			if(!chainHasCopy) {
+			if(physical == PhysicalAddr(-1)) {
+				physical = physicalAllocator->allocate(kPageSize);
+				assert(physical != PhysicalAddr(-1) && "OOM");
+				PageAccessor accessor{physical};
+
 				// TODO: Handle errors here -- we need to drop the lock again.
-				auto copyOutcome = co_await view->copyFrom(pageOffset & ~(kPageSize - 1),
+				auto copyOutcome = co_await view->copyFrom((viewOffset + offset) & ~(kPageSize - 1),
 						accessor.get(), kPageSize, wq);
 				assert(copyOutcome);
 			}
@@ -1746,10 +2121,12 @@ bool CopyOnWriteMemory::asyncLockRange(uintptr_t offset, size_t size,
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&self->_mutex);
 
-				assert(cowPage->state == CowState::inProgress);
-				cowPage->state = CowState::hasCopy;
-				cowPage->physical = physical;
-				cowPage->lockCount++;
+				auto page = self->_ownedPages.find(index);
+				assert(page);
+				assert(page->state == CowState::inProgress);
+				page->state = CowState::hasCopy;
+				page->physical = physical;
+				page->lockCount++;
 			}
 			self->_copyEvent.raise();
 			progress += kPageSize;
@@ -1766,12 +2143,10 @@ void CopyOnWriteMemory::unlockRange(uintptr_t offset, size_t size) {
 	auto lock = frg::guard(&_mutex);
 
 	for(size_t pg = 0; pg < size; pg += kPageSize) {
-		auto it = _ownedPages.find((offset + pg) >> kPageShift);
-		assert(it);
-		auto page = *it;
+		auto page = _ownedPages.find((offset + pg) >> kPageShift);
+		assert(page);
 		assert(page->state == CowState::hasCopy);
-		assert(page->lockCount > 0);
-		page->lockCount--;
+		_unlockPage(page);
 	}
 }
 
@@ -1779,9 +2154,16 @@ frg::tuple<PhysicalAddr, CachingMode> CopyOnWriteMemory::peekRange(uintptr_t off
 	auto irq_lock = frg::guard(&irqMutex());
 	auto lock = frg::guard(&_mutex);
 
-	if(auto it = _ownedPages.find(offset >> kPageShift); it) {
-		auto page = *it;
-		assert(page->state == CowState::hasCopy);
+	if(auto page = _ownedPages.find(offset >> kPageShift); page) {
+		// Pages that are being copied or that are swapped out are not present.
+		if(page->state != CowState::hasCopy || page->compressed)
+			return frg::tuple<PhysicalAddr, CachingMode>{PhysicalAddr(-1), CachingMode::null};
+
+		if(page->evicting) {
+			// Cancel evication -- the page is still needed.
+			page->evicting = false;
+			globalReclaimer->addPage(&page->cachePage);
+		}
 		return frg::tuple<PhysicalAddr, CachingMode>{page->physical, CachingMode::null};
 	}
 
@@ -1789,38 +2171,35 @@ frg::tuple<PhysicalAddr, CachingMode> CopyOnWriteMemory::peekRange(uintptr_t off
 }
 
 coroutine<frg::expected<Error, PhysicalRange>>
-CopyOnWriteMemory::fetchRange(uintptr_t offset, FetchFlags, smarter::shared_ptr<WorkQueue> wq) {
-	smarter::shared_ptr<CowChain> chain;
+CopyOnWriteMemory::fetchRange(uintptr_t offset, FetchFlags flags, smarter::shared_ptr<WorkQueue> wq) {
+	auto index = offset >> kPageShift;
+
 	smarter::shared_ptr<MemoryView> view;
 	uintptr_t viewOffset;
-	smarter::shared_ptr<CowPage> cowPage;
+	PhysicalAddr physical = PhysicalAddr(-1);
 	bool waitForCopy = false;
 	{
 		// If the page is present in our private chain, we just return it.
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
 
-		auto cowIt = _ownedPages.find(offset >> kPageShift);
-		if(cowIt) {
-			cowPage = *cowIt;
-			if(cowPage->state == CowState::hasCopy) {
-				assert(cowPage->physical != PhysicalAddr(-1));
+		if(auto page = _ownedPages.find(index); page) {
+			if(page->state == CowState::hasCopy) {
+				_accessPage(page, flags);
+				assert(page->physical != PhysicalAddr(-1));
 
-				co_return PhysicalRange{cowPage->physical, kPageSize, CachingMode::null};
+				co_return PhysicalRange{page->physical, kPageSize, CachingMode::null};
 			}else{
-				assert(cowPage->state == CowState::inProgress);
+				assert(page->state == CowState::inProgress);
 				waitForCopy = true;
 			}
 		}else{
-			chain = _copyChain;
 			view = _view;
 			viewOffset = _viewOffset;
 
 			// Otherwise we need to copy from the chain or from the root view.
-			cowPage = smarter::allocate_shared<CowPage>(*kernelAlloc);
-			cowPage->state = CowState::inProgress;
-			cowIt = _ownedPages.insert(offset >> kPageShift);
-			*cowIt = cowPage;
+			_makePage(index);
+			physical = _copyFromChain(index);
 		}
 	}
 
@@ -1828,47 +2207,37 @@ CopyOnWriteMemory::fetchRange(uintptr_t offset, FetchFlags, smarter::shared_ptr<
 		bool stillWaiting;
 		do {
 			stillWaiting = co_await _copyEvent.async_wait_if([&] () -> bool {
-				// TODO: this could be faster if cowIt->state was atomic.
+				// TODO: this could be faster if the page's state was atomic.
 				auto irqLock = frg::guard(&irqMutex());
 				auto lock = frg::guard(&_mutex);
 
-				if(cowPage->state == CowState::inProgress)
+				auto page = _ownedPages.find(index);
+				assert(page);
+				if(page->state == CowState::inProgress)
 					return true;
-				assert(cowPage->state == CowState::hasCopy);
+				assert(page->state == CowState::hasCopy);
 				return false;
 			});
 			co_await wq->schedule();
 		} while(stillWaiting);
 
-		co_return PhysicalRange{cowPage->physical, kPageSize, CachingMode::null};
-	}
-
-	PhysicalAddr physical = physicalAllocator->allocate(kPageSize);
-	assert(physical != PhysicalAddr(-1) && "OOM");
-	PageAccessor accessor{physical};
-
-	// Try to copy from a descendant CoW chain.
-	auto pageOffset = viewOffset + offset;
-	bool chainHasCopy = false;
-	if(chain) {
 		auto irqLock = frg::guard(&irqMutex());
-		auto lock = frg::guard(&chain->_mutex);
+		auto lock = frg::guard(&_mutex);
 
-		if(auto it = chain->_pages.find(pageOffset >> kPageShift); it) {
-			auto page = *it;
-			// We can just copy synchronously here -- the descendant is not evicted.
-			assert(page->state == CowState::hasCopy);
-			auto srcPhysical = page->physical;
-			assert(srcPhysical != PhysicalAddr(-1));
-			auto srcAccessor = PageAccessor{srcPhysical};
-			memcpy(accessor.get(), srcAccessor.get(), kPageSize);
-			chainHasCopy = true;
-		}
+		auto page = _ownedPages.find(index);
+		assert(page);
+		assert(page->state == CowState::hasCopy);
+		_accessPage(page, flags);
+		co_return PhysicalRange{page->physical, kPageSize, CachingMode::null};
 	}
 
 	// Copy from the root view.
-	if(!chainHasCopy) {
-		FRG_CO_TRY(co_await view->copyFrom(pageOffset & ~(kPageSize - 1),
+	if(physical == PhysicalAddr(-1)) {
+		physical = physicalAllocator->allocate(kPageSize);
+		assert(physical != PhysicalAddr(-1) && "OOM");
+		PageAccessor accessor{physical};
+
+		FRG_CO_TRY(co_await view->copyFrom((viewOffset + offset) & ~(kPageSize - 1),
 				accessor.get(), kPageSize, wq));
 	}
 
@@ -1880,12 +2249,20 @@ CopyOnWriteMemory::fetchRange(uintptr_t offset, FetchFlags, smarter::shared_ptr<
 		auto irqLock = frg::guard(&irqMutex());
 		auto lock = frg::guard(&_mutex);
 
-		assert(cowPage->state == CowState::inProgress);
-		cowPage->state = CowState::hasCopy;
-		cowPage->physical = physical;
+		auto page = _ownedPages.find(index);
+		assert(page);
+		assert(page->state == CowState::inProgress);
+		assert(!page->lockCount);
+		page->state = CowState::hasCopy;
+		page->physical = physical;
+		if(flags & fetchPin) {
+			page->pinned = true;
+		}else{
+			globalReclaimer->addPage(&page->cachePage);
+		}
 	}
 	_copyEvent.raise();
-	co_return PhysicalRange{cowPage->physical, kPageSize, CachingMode::null};
+	co_return PhysicalRange{physical, kPageSize, CachingMode::null};
 }
 
 void CopyOnWriteMemory::markDirty(uintptr_t, size_t) {
@@ -1907,6 +2284,184 @@ void CopyOnWriteMemory::retireGlobalFutex(uintptr_t offset) {
 	unlockRange(offset & ~(kPageSize - 1), kPageSize);
 }
 
+void CopyOnWriteMemory::reclaimPosted() {
+	// This is called with the reclaimer's lock held, hence we defer the actual work.
+	if(_reclaimRunning)
+		return;
+	auto self = selfPtr.lock();
+	if(!self) // The object is being destructed.
+		return;
+	_reclaimRunning = true;
+
+	async::detach_with_allocator(*kernelAlloc,
+			[] (smarter::shared_ptr<CopyOnWriteMemory> self) -> coroutine<void> {
+		co_await WorkQueue::generalQueue()->schedule();
+
+		while(true) {
+			size_t index;
+			PhysicalAddr physical;
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&self->_mutex);
+
+				auto cachePage = globalReclaimer->reclaimPage(self.get());
+				if(!cachePage) {
+					if(globalReclaimer->finishReclaim(self.get()))
+						break;
+					continue;
+				}
+
+				index = cachePage->identity;
+				auto page = self->_ownedPages.find(index);
+				assert(page);
+				assert(page->state == CowState::hasCopy);
+				assert(!page->lockCount && !page->pinned);
+				page->evicting = true;
+				globalReclaimer->removePage(cachePage);
+				physical = page->physical;
+			}
+
+			co_await self->_evictQueue.evictRange(index << kPageShift, kPageSize);
+
+			// The page is not mapped anymore. Any access cancels the eviction,
+			// hence we can compress the page without holding the lock.
+			CompressedPage *compressed;
+			{
+				PageAccessor accessor{physical};
+				compressed = compressPage(accessor.get());
+			}
+
+			{
+				auto irqLock = frg::guard(&irqMutex());
+				auto lock = frg::guard(&self->_mutex);
+
+				// If the page was accessed in the meantime, it might have been moved to a chain
+				// by fork(); in this case, the page that we find here (if any) is not evicting.
+				auto page = self->_ownedPages.find(index);
+				if(!page || !page->evicting) {
+					if(compressed)
+						discardCompressedPage(compressed);
+					continue;
+				}
+				page->evicting = false;
+
+				// Pages that do not compress well stay in RAM.
+				if(!compressed) {
+					globalReclaimer->addPage(&page->cachePage);
+					continue;
+				}
+				page->compressed = compressed;
+				page->physical = PhysicalAddr(-1);
+			}
+
+			physicalAllocator->free(physical, kPageSize);
+		}
+	}(std::move(self)));
+}
+
+CowPage *CopyOnWriteMemory::_makePage(size_t index) {
+	auto page = _ownedPages.insert(index, this, index);
+	page->state = CowState::inProgress;
+	return page;
+}
+
+// Looks up a page in the chain and its ancestors. If no other view can observe the page,
+// it is taken over; otherwise, it is copied. Returns PhysicalAddr(-1) if there is no such page.
+PhysicalAddr CopyOnWriteMemory::_copyFromChain(size_t index) {
+	if(!_copyChain)
+		return PhysicalAddr(-1);
+	auto chainIndex = (_viewOffset >> kPageShift) + index;
+
+	// Since fork() takes _mutex, the chains' references cannot increase while we walk them.
+	// We lock the chains hand-over-hand, as CowChain::collapse() moves pages to child chains.
+	auto chain = _copyChain.get();
+	chain->_mutex.lock();
+	bool exclusive = chain->_numViews == 1 && !chain->_numChildren;
+	while(true) {
+		if(auto it = chain->_pages.find(chainIndex); it) {
+			auto physical = *it;
+			if(exclusive) {
+				chain->removePage(chainIndex);
+				chain->_mutex.unlock();
+				return physical;
+			}
+
+			// We can just copy synchronously here -- the descendant is not evicted.
+			auto copyPhysical = physicalAllocator->allocate(kPageSize);
+			assert(copyPhysical != PhysicalAddr(-1) && "OOM");
+			PageAccessor srcAccessor{physical};
+			PageAccessor copyAccessor{copyPhysical};
+			memcpy(copyAccessor.get(), srcAccessor.get(), kPageSize);
+			chain->_mutex.unlock();
+			return copyPhysical;
+		}
+
+		auto parent = chain->_parent.get();
+		if(!parent) {
+			chain->_mutex.unlock();
+			return PhysicalAddr(-1);
+		}
+		parent->_mutex.lock();
+		exclusive = exclusive && !parent->_numViews && parent->_numChildren == 1;
+		chain->_mutex.unlock();
+		chain = parent;
+	}
+}
+
+void CopyOnWriteMemory::_swapIn(CowPage *page) {
+	assert(page->compressed);
+	auto physical = physicalAllocator->allocate(kPageSize);
+	assert(physical != PhysicalAddr(-1) && "OOM");
+
+	PageAccessor accessor{physical};
+	decompressPage(page->compressed, accessor.get());
+	page->compressed = nullptr;
+	page->physical = physical;
+}
+
+// Makes sure that the page is present and that it is not subject to reclaim.
+void CopyOnWriteMemory::_retainPage(CowPage *page) {
+	assert(page->state == CowState::hasCopy);
+	if(page->compressed) {
+		_swapIn(page);
+	}else if(page->evicting) {
+		// Cancel the eviction -- the page is still needed.
+		page->evicting = false;
+	}else if(page->cachePage.flags & CachePage::reclaimRegistered) {
+		globalReclaimer->removePage(&page->cachePage);
+	}
+}
+
+// Makes sure that the page is present when it is accessed through fetchRange().
+void CopyOnWriteMemory::_accessPage(CowPage *page, FetchFlags flags) {
+	if(flags & fetchPin) {
+		if(!page->pinned) {
+			_retainPage(page);
+			page->pinned = true;
+		}
+		return;
+	}
+
+	if(page->compressed || page->evicting) {
+		// Neither locked nor pinned pages are evicted.
+		_retainPage(page);
+		globalReclaimer->addPage(&page->cachePage);
+	}else if(page->cachePage.flags & CachePage::reclaimRegistered) {
+		globalReclaimer->bumpPage(&page->cachePage);
+	}
+}
+
+void CopyOnWriteMemory::_lockPage(CowPage *page) {
+	if(!page->lockCount++)
+		_retainPage(page);
+}
+
+void CopyOnWriteMemory::_unlockPage(CowPage *page) {
+	assert(page->lockCount > 0);
+	if(!--page->lockCount && !page->pinned)
+		globalReclaimer->addPage(&page->cachePage);
+}
+
 // --------------------------------------------------------------------------------------
 
 namespace {
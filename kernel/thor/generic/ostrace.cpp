@@ -3,6 +3,7 @@
 #include <frg/cmdline.hpp>
 #include <frg/small_vector.hpp>
 #include <frg/span.hpp>
+#include <frg/vector.hpp>
 #include <thor-internal/fiber.hpp>
 #include <thor-internal/kernel-io.hpp>
 #include <thor-internal/main.hpp>
@@ -31,6 +32,22 @@ namespace {
 std::atomic<uint64_t> nextId{1};
 frg::manual_box<LogRingBuffer> globalOsTraceRing;
 
+// Header of records in the global ostrace ring.
+struct Header {
+	uint32_t size;
+};
+
+// Allocates per-CPU rings for all CPUs that do not have one yet.
+void allocateCpuRings() {
+	for(size_t i = 0; i < getCpuCount(); ++i) {
+		auto *ctx = &ostrace::context.get(getCpuData(i));
+		if(ctx->ring.load(std::memory_order_relaxed))
+			continue;
+		ctx->ring.store(frg::construct<ostrace::CpuRing>(*kernelAlloc),
+				std::memory_order_release);
+	}
+}
+
 initgraph::Task initOsTraceCore{&globalInitEngine, "generic.init-ostrace-core",
 	initgraph::Entails{getOsTraceAvailableStage()},
 	[] {
@@ -45,6 +62,7 @@ initgraph::Task initOsTraceCore{&globalInitEngine, "generic.init-ostrace-core",
 
 		void *osTraceMemory = kernelAlloc->allocate(1 << 20);
 		globalOsTraceRing.initialize(reinterpret_cast<uintptr_t>(osTraceMemory), 1 << 20);
+		allocateCpuRings();
 
 		osTraceInUse.store(true);
 
@@ -56,23 +74,16 @@ void doEmit(frg::span<char> payload) {
 	if(!osTraceInUse.load(std::memory_order_relaxed))
 		return;
 
-	struct Header {
-		uint32_t size;
-	};
-
-	frg::small_vector<char, 64, KernelAlloc> buffer{*kernelAlloc};
-	buffer.resize(sizeof(Header) + payload.size());
-
-	auto hdr = new (buffer.data()) Header;
-	hdr->size = payload.size();
-
-	memcpy(buffer.data() + sizeof(Header), payload.data(), payload.size());
-
-	// We want to be able to call this function from any context, but we cannot wake the waiters
-	// in all contexts. For now, only wake waiters if IRQs are enabled.
-	globalOsTraceRing->enqueue(buffer.data(), buffer.size(), !intsAreEnabled());
+	auto irqLock = frg::guard(&irqMutex());
+	auto buffer = ostrace::reserveRecord(payload.size(), getClockNanos());
+	if(!buffer)
+		return;
+	memcpy(buffer, payload.data(), payload.size());
+	ostrace::commitRecord();
 }
 
+// Writes a record directly to the global ring, bypassing the per-CPU rings.
+// This is used for definitions since they need to precede all events that refer to them.
 template<typename R>
 void commitOsTrace(R record) {
 	if(!osTraceInUse.load(std::memory_order_relaxed))
@@ -80,17 +91,114 @@ void commitOsTrace(R record) {
 
 	auto ts = record.size_of_tail();
 	frg::small_vector<char, 64, KernelAlloc> ser(*kernelAlloc);
-	ser.resize(8 + ts);
+	ser.resize(sizeof(Header) + 8 + ts);
+	Header hdr{.size = static_cast<uint32_t>(8 + ts)};
+	memcpy(ser.data(), &hdr, sizeof(Header));
 	bool encodeSuccess = bragi::write_head_tail(record,
-			frg::span<char>(ser.data(), 8),
-			frg::span<char>(ser.data() + 8, ts));
+			frg::span<char>(ser.data() + sizeof(Header), 8),
+			frg::span<char>(ser.data() + sizeof(Header) + 8, ts));
 	assert(encodeSuccess);
 
-	doEmit({ser.data(), ser.size()});
+	// We want to be able to call this function from any context, but we cannot wake the waiters
+	// in all contexts. For now, only wake waiters if IRQs are enabled.
+	globalOsTraceRing->enqueue(ser.data(), ser.size(), !intsAreEnabled());
+}
+
+// Moves records from the per-CPU rings to the global ring.
+// Records that are present at the start of each round are merged by timestamp.
+void drainCpuRings() {
+	frg::vector<uint64_t, KernelAlloc> limits{*kernelAlloc};
+	frg::vector<uint64_t, KernelAlloc> reportedDrops{*kernelAlloc};
+
+	while(true) {
+		allocateCpuRings();
+
+		auto n = getCpuCount();
+		limits.resize(n);
+		reportedDrops.resize(n);
+
+		for(size_t i = 0; i < n; ++i) {
+			auto *ctx = &ostrace::context.get(getCpuData(i));
+			auto ring = ctx->ring.load(std::memory_order_acquire);
+			limits[i] = ring ? ring->peekHeadPtr() : 0;
+
+			// Report drops such that consumers know that the trace is incomplete.
+			auto numDropped = ctx->numDropped.load(std::memory_order_relaxed);
+			if(numDropped != reportedDrops[i]) {
+				managarm::ostrace::DroppedRecords<KernelAlloc> record{*kernelAlloc};
+				record.set_cpu(i);
+				record.set_count(numDropped - reportedDrops[i]);
+				commitOsTrace(std::move(record));
+				infoLogger() << "thor: ostrace dropped " << (numDropped - reportedDrops[i])
+						<< " records on CPU " << i << frg::endlog;
+				reportedDrops[i] = numDropped;
+			}
+		}
+
+		while(true) {
+			// Find the oldest record among all CPUs.
+			ostrace::CpuRing *oldestRing = nullptr;
+			const char *oldestData = nullptr;
+			size_t oldestSize = 0;
+			uint64_t oldestTs = 0;
+			for(size_t i = 0; i < n; ++i) {
+				auto *ring = ostrace::context.get(getCpuData(i)).ring.load(
+						std::memory_order_acquire);
+				if(!ring)
+					continue;
+				size_t size;
+				uint64_t ts;
+				auto data = ring->front(limits[i], size, ts);
+				if(!data)
+					continue;
+				if(oldestRing && ts >= oldestTs)
+					continue;
+				oldestRing = ring;
+				oldestData = data;
+				oldestSize = size;
+				oldestTs = ts;
+			}
+			if(!oldestRing)
+				break;
+
+			globalOsTraceRing->enqueue(oldestData, oldestSize);
+			oldestRing->pop(oldestSize);
+		}
+
+		KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(10'000'000,
+				{}, 5'000'000));
+	}
 }
 
 } // anonymous namespace
 
+namespace ostrace {
+
+char *reserveRecord(size_t size, uint64_t ts) {
+	auto *ctx = &context.get();
+	auto ring = ctx->ring.load(std::memory_order_acquire);
+	if(!ring) {
+		ctx->numDropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	auto buffer = ring->reserve(sizeof(Header) + size, ts);
+	if(!buffer) {
+		ctx->numDropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Header hdr{.size = static_cast<uint32_t>(size)};
+	memcpy(buffer, &hdr, sizeof(Header));
+	return buffer + sizeof(Header);
+}
+
+void commitRecord() {
+	context.get().ring.load(std::memory_order_relaxed)->commit();
+}
+
+} // namespace ostrace
+
 LogRingBuffer *getGlobalOsTraceRing() {
 	return globalOsTraceRing.get();
 }
@@ -248,6 +356,10 @@ initgraph::Task initOsTraceMbus{&globalInitEngine, "generic.init-ostrace-sinks",
 			// Only dump to an I/O channel if ostrace is supported (otherwise, the ring buffer
 			// does not even exist).
 			if(wantOsTrace) {
+				KernelFiber::run([] {
+					drainCpuRings();
+				});
+
 				auto channel = solicitIoChannel("ostrace");
 				if(channel) {
 					infoLogger() << "thor: Connecting ostrace to I/O channel" << frg::endlog;
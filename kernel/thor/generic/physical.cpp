@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include <thor-internal/arch-generic/paging.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/debug.hpp>
@@ -8,6 +9,9 @@ namespace thor {
 
 static bool logPhysicalAllocs = false;
 
+extern PerCpu<PhysicalPageCache> physicalPageCache;
+THOR_DEFINE_PERCPU(physicalPageCache);
+
 THOR_DEFINE_ELF_NOTE(memoryLayoutNote){elf_note_type::memoryLayout, {}};
 
 void poisonPhysicalAccess(PhysicalAddr physical) {
@@ -31,35 +35,50 @@ PhysicalChunkAllocator::PhysicalChunkAllocator() {
 }
 
 void PhysicalChunkAllocator::bootstrapRegion(PhysicalAddr address,
-		int order, size_t numRoots, int8_t *buddyTree) {
-	if(_numRegions >= 8) {
-		infoLogger() << "thor: Ignoring memory region (can only handle 8 regions)"
-				<< frg::endlog;
-		return;
+		int order, size_t numRoots, int8_t *buddyTree, int numaNode) {
+	if(_numRegions == _regionCapacity) {
+		// Note that the old table is not freed since it is either _initialRegions
+		// or it was obtained from _allocateMetadata().
+		auto newCapacity = 2 * _regionCapacity;
+		auto newRegions = static_cast<Region *>(_allocateMetadata(newCapacity * sizeof(Region)));
+		memcpy(newRegions, _regions, _numRegions * sizeof(Region));
+		_regions = newRegions;
+		_regionCapacity = newCapacity;
 	}
 
-	int n = _numRegions++;
-	_allRegions[n].physicalBase = address;
-	_allRegions[n].regionSize = numRoots << (order + kPageShift);
-	_allRegions[n].buddyAccessor = BuddyAccessor{address, kPageShift,
+	// Keep the table sorted such that we can binary search it in _findRegion().
+	size_t n = _numRegions;
+	while(n && _regions[n - 1].physicalBase > address) {
+		_regions[n] = _regions[n - 1];
+		n--;
+	}
+	_numRegions++;
+
+	_regions[n].physicalBase = address;
+	_regions[n].regionSize = numRoots << (order + kPageShift);
+	_regions[n].buddyAccessor = BuddyAccessor{address, kPageShift,
 			buddyTree, numRoots, order};
+	_regions[n].numaNode = numaNode;
 
 	auto currentTotal = _totalPages.load(std::memory_order_relaxed);
 	auto currentFree = _freePages.load(std::memory_order_relaxed);
 	_totalPages.store(currentTotal + (numRoots << order), std::memory_order_relaxed);
 	_freePages.store(currentFree + (numRoots << order), std::memory_order_relaxed);
-}
 
-PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
-	auto irq_lock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_mutex);
+	// The summary can only be allocated once the region is part of the table
+	// (as it might be the only region that we have so far).
+	auto summarySize = BuddyAccessor::determineSummaryWords(numRoots, order) * sizeof(uint64_t);
+	auto summary = static_cast<uint64_t *>(_allocateMetadata(summarySize));
+	auto region = _findRegion(address);
+	assert(region);
+	region->buddyAccessor.attachSummary(summary);
+}
 
-	auto currentFree = _freePages.load(std::memory_order_relaxed);
-	auto currentUsed = _usedPages.load(std::memory_order_relaxed);
-	assert(currentFree > size / kPageSize);
-	_freePages.store(currentFree - size / kPageSize, std::memory_order_relaxed);
-	_usedPages.store(currentUsed + size / kPageSize, std::memory_order_relaxed);
+void PhysicalChunkAllocator::enablePerCpuCaches() {
+	_cachesEnabled.store(true, std::memory_order_relaxed);
+}
 
+PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 	// TODO: This could be solved better.
 	int target = 0;
 	while(size > (size_t(kPageSize) << target))
@@ -69,45 +88,219 @@ PhysicalAddr PhysicalChunkAllocator::allocate(size_t size, int addressBits) {
 	if(logPhysicalAllocs)
 		infoLogger() << "thor: Allocating physical memory of order "
 					<< (target + kPageShift) << frg::endlog;
-	for(int i = 0; i < _numRegions; i++) {
-		if(target > _allRegions[i].buddyAccessor.tableOrder())
-			continue;
 
-		auto physical = _allRegions[i].buddyAccessor.allocate(target, addressBits);
-		if(physical == BuddyAccessor::illegalAddress)
-			continue;
-	//	infoLogger() << "Allocate " << (void *)physical << frg::endlog;
-		assert(!(physical % (size_t(kPageSize) << target)));
-		return physical;
+	auto irqLock = frg::guard(&irqMutex());
+
+	auto currentFree = _freePages.fetch_sub(size / kPageSize, std::memory_order_relaxed);
+	assert(currentFree > size / kPageSize);
+	_usedPages.fetch_add(size / kPageSize, std::memory_order_relaxed);
+
+	// The cache only holds chunks that are not subject to address restrictions.
+	bool useCache = target < PhysicalPageCache::numCachedOrders
+			&& addressBits >= 64
+			&& _cachesEnabled.load(std::memory_order_relaxed);
+
+	PhysicalAddr physical = BuddyAccessor::illegalAddress;
+	if(useCache) {
+		auto cache = &physicalPageCache.get();
+		auto magazine = &cache->magazines[target];
+		if(magazine->count) {
+			cache->numHits++;
+		}else{
+			cache->numMisses++;
+			cache->numRefills++;
+
+			auto lock = frg::guard(&_mutex);
+			while(magazine->count < PhysicalPageCache::batchSize(target)) {
+				auto chunk = _allocateFromBuddy(target, 64);
+				if(chunk == BuddyAccessor::illegalAddress)
+					break;
+				magazine->chunks[magazine->count++] = chunk;
+			}
+		}
+
+		if(magazine->count)
+			physical = magazine->chunks[--magazine->count];
+	}else{
+		auto lock = frg::guard(&_mutex);
+		physical = _allocateFromBuddy(target, addressBits);
+	}
+
+	// Chunks held by our own cache might prevent coalescing in the buddy allocator.
+	// Flush them and try once more before giving up.
+	if(physical == BuddyAccessor::illegalAddress
+			&& _cachesEnabled.load(std::memory_order_relaxed)) {
+		drainLocalCache();
+
+		auto lock = frg::guard(&_mutex);
+		physical = _allocateFromBuddy(target, addressBits);
+	}
+
+	if(physical == BuddyAccessor::illegalAddress) {
+		_freePages.fetch_add(size / kPageSize, std::memory_order_relaxed);
+		_usedPages.fetch_sub(size / kPageSize, std::memory_order_relaxed);
+		return static_cast<PhysicalAddr>(-1);
 	}
 
-	return static_cast<PhysicalAddr>(-1);
+	//	infoLogger() << "Allocate " << (void *)physical << frg::endlog;
+	assert(!(physical % (size_t(kPageSize) << target)));
+
+	if(currentFree - size / kPageSize < _lowWatermark.load(std::memory_order_relaxed)
+			&& _lowWatermarkArmed.load(std::memory_order_relaxed)
+			&& _lowWatermarkArmed.exchange(false, std::memory_order_relaxed)) {
+		auto callback = _lowWatermarkCallback.load(std::memory_order_acquire);
+		if(callback)
+			callback();
+	}
+	return physical;
 }
 
 void PhysicalChunkAllocator::free(PhysicalAddr address, size_t size) {
-	auto irq_lock = frg::guard(&irqMutex());
-	auto lock = frg::guard(&_mutex);
-	
 	int target = 0;
 	while(size > (size_t(kPageSize) << target))
 		target++;
 
-	for(int i = 0; i < _numRegions; i++) {
-		if(address < _allRegions[i].physicalBase)
-			continue;
-		if(address + size - _allRegions[i].physicalBase > _allRegions[i].regionSize)
-			continue;
+	auto irqLock = frg::guard(&irqMutex());
+
+	auto currentUsed = _usedPages.fetch_sub(size / kPageSize, std::memory_order_relaxed);
+	assert(currentUsed > size / kPageSize);
+	auto currentFree = _freePages.fetch_add(size / kPageSize, std::memory_order_relaxed);
+
+	// Hysteresis: only re-arm the low watermark once enough memory is free again.
+	if(!_lowWatermarkArmed.load(std::memory_order_relaxed)
+			&& currentFree + size / kPageSize >= _highWatermark.load(std::memory_order_relaxed))
+		rearmLowWatermark();
 
-		_allRegions[i].buddyAccessor.free(address, target);
-		auto currentFree = _freePages.load(std::memory_order_relaxed);
-		auto currentUsed = _usedPages.load(std::memory_order_relaxed);
-		assert(currentUsed > size / kPageSize);
-		_freePages.store(currentFree + size / kPageSize, std::memory_order_relaxed);
-		_usedPages.store(currentUsed - size / kPageSize, std::memory_order_relaxed);
+	if(target < PhysicalPageCache::numCachedOrders
+			&& _cachesEnabled.load(std::memory_order_relaxed)) {
+		auto cache = &physicalPageCache.get();
+		auto magazine = &cache->magazines[target];
+		if(magazine->count == PhysicalPageCache::capacity(target)) {
+			cache->numDrains++;
+
+			auto lock = frg::guard(&_mutex);
+			for(size_t i = 0; i < PhysicalPageCache::batchSize(target); i++)
+				_freeToBuddy(magazine->chunks[--magazine->count], target);
+		}
+
+		magazine->chunks[magazine->count++] = address;
 		return;
 	}
 
-	assert(!"Physical page is not part of any region");
+	auto lock = frg::guard(&_mutex);
+	_freeToBuddy(address, target);
+}
+
+void PhysicalChunkAllocator::drainLocalCache() {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	auto cache = &physicalPageCache.get();
+	for(int order = 0; order < PhysicalPageCache::numCachedOrders; order++) {
+		auto magazine = &cache->magazines[order];
+		if(magazine->count)
+			cache->numDrains++;
+		while(magazine->count)
+			_freeToBuddy(magazine->chunks[--magazine->count], order);
+	}
+}
+
+PhysicalCacheStats PhysicalChunkAllocator::getCacheStats() {
+	PhysicalCacheStats stats;
+	if(!_cachesEnabled.load(std::memory_order_relaxed))
+		return stats;
+
+	// Note that we read the counters of other CPUs without synchronization;
+	// the result is only meant as a statistical snapshot.
+	for(size_t i = 0; i < getCpuCount(); i++) {
+		auto cache = &physicalPageCache.getFor(i);
+		stats.numHits += cache->numHits;
+		stats.numMisses += cache->numMisses;
+		stats.numRefills += cache->numRefills;
+		stats.numDrains += cache->numDrains;
+		for(int order = 0; order < PhysicalPageCache::numCachedOrders; order++)
+			stats.numCachedPages += cache->magazines[order].count << order;
+	}
+	return stats;
+}
+
+void PhysicalChunkAllocator::setWatermarks(size_t lowPages, size_t highPages,
+		void (*callback)()) {
+	assert(lowPages <= highPages);
+	_lowWatermark.store(lowPages, std::memory_order_relaxed);
+	_highWatermark.store(highPages, std::memory_order_relaxed);
+	_lowWatermarkCallback.store(callback, std::memory_order_release);
+}
+
+// Must be called with _mutex held.
+PhysicalAddr PhysicalChunkAllocator::_allocateFromBuddy(int order, int addressBits) {
+	for(size_t i = 0; i < _numRegions; i++) {
+		// Since the table is sorted, no further region can satisfy the allocation.
+		if(addressBits < 64 && (_regions[i].physicalBase >> addressBits))
+			break;
+
+		// allocate() consults the region's summary; no need to check hasFreeChunk() here.
+		auto physical = _regions[i].buddyAccessor.allocate(order, addressBits);
+		if(physical == BuddyAccessor::illegalAddress)
+			continue;
+		return physical;
+	}
+
+	return BuddyAccessor::illegalAddress;
+}
+
+// Must be called with _mutex held.
+void PhysicalChunkAllocator::_freeToBuddy(PhysicalAddr address, int order) {
+	auto region = _findRegion(address);
+	assert(region && "Physical page is not part of any region");
+	assert(address + (size_t(kPageSize) << order) - region->physicalBase <= region->regionSize);
+	region->buddyAccessor.free(address, order);
+}
+
+auto PhysicalChunkAllocator::_findRegion(PhysicalAddr address) -> Region * {
+	// Find the last region that starts at or below address.
+	size_t low = 0;
+	size_t high = _numRegions;
+	while(low < high) {
+		auto mid = low + (high - low) / 2;
+		if(_regions[mid].physicalBase <= address) {
+			low = mid + 1;
+		}else{
+			high = mid;
+		}
+	}
+	if(!low)
+		return nullptr;
+
+	auto region = &_regions[low - 1];
+	if(address - region->physicalBase >= region->regionSize)
+		return nullptr;
+	return region;
+}
+
+void *PhysicalChunkAllocator::_allocateMetadata(size_t size) {
+	size = (size + 15) & ~size_t(15);
+
+	if(size > _metadataSpace) {
+		int order = 0;
+		while(size > (size_t(kPageSize) << order))
+			order++;
+
+		auto physical = _allocateFromBuddy(order, 64);
+		assert(physical != BuddyAccessor::illegalAddress
+				&& "thor: Failed to allocate physical allocator meta data");
+		auto numPages = size_t(1) << order;
+		_freePages.fetch_sub(numPages, std::memory_order_relaxed);
+		_usedPages.fetch_add(numPages, std::memory_order_relaxed);
+
+		_metadataPtr = reinterpret_cast<uintptr_t>(mapDirectPhysical(physical));
+		_metadataSpace = size_t(kPageSize) << order;
+	}
+
+	auto pointer = reinterpret_cast<void *>(_metadataPtr);
+	_metadataPtr += size;
+	_metadataSpace -= size;
+	return pointer;
 }
 
 PhysicalWindow::PhysicalWindow(PhysicalAddr physical, size_t size, CachingMode caching)
@@ -30,26 +30,10 @@ namespace {
 			}
 		}
 	};
-}
 
-void initializeProfile() {
 #ifdef __x86_64__
-	if(!wantKernelProfile)
-		return;
-
-	if(!(getGlobalCpuFeatures()->profileFlags & CpuFeatures::profileIntelSupported)
-			&& !(getGlobalCpuFeatures()->profileFlags & CpuFeatures::profileAmdSupported)) {
-		urgentLogger() << "thor: Kernel profiling was requested but"
-				" no hardware support is available" << frg::endlog;
-		return;
-	}
-
-	void *profileMemory = kernelAlloc->allocate(1 << 20);
-	globalProfileRing.initialize(reinterpret_cast<uintptr_t>(profileMemory), 1 << 20);
-
-	// Dump the per-CPU profiling data to the global ring buffer.
-	// TODO: Start one such fiber per CPU.
-	KernelFiber::run([=] {
+	// Enables sampling on the current CPU and moves samples to the global ring.
+	void drainLocalProfileRing() {
 		getCpuData()->localProfileRing = frg::construct<SingleContextRecordRing>(*kernelAlloc);
 
 		if(getGlobalCpuFeatures()->profileFlags & CpuFeatures::profileIntelSupported) {
@@ -66,19 +50,50 @@ void initializeProfile() {
 
 		uint64_t deqPtr = 0;
 		while(true) {
-			char buffer[128];
+			char buffer[ProfileSample::maxSize + 1];
 			auto [success, recordPtr, newPtr, size] = getCpuData()->localProfileRing->dequeueAt(
-					deqPtr, buffer, 128);
+					deqPtr, buffer, sizeof(buffer));
 			deqPtr = newPtr;
 			if(!success) {
 				KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(1'000'000));
 				continue;
 			}
 			assert(size);
-			assert(size < 128);
+			assert(size <= ProfileSample::maxSize);
 
 			globalProfileRing->enqueue(buffer, size);
 		}
+	}
+#endif
+}
+
+void initializeProfile() {
+#ifdef __x86_64__
+	if(!wantKernelProfile)
+		return;
+
+	if(!(getGlobalCpuFeatures()->profileFlags & CpuFeatures::profileIntelSupported)
+			&& !(getGlobalCpuFeatures()->profileFlags & CpuFeatures::profileAmdSupported)) {
+		urgentLogger() << "thor: Kernel profiling was requested but"
+				" no hardware support is available" << frg::endlog;
+		return;
+	}
+
+	void *profileMemory = kernelAlloc->allocate(1 << 20);
+	globalProfileRing.initialize(reinterpret_cast<uintptr_t>(profileMemory), 1 << 20);
+
+	// Start one fiber per CPU that enables the PMC and dumps the per-CPU profiling data
+	// to the global ring buffer. Since APs are booted later, poll for new CPUs.
+	KernelFiber::run([=] {
+		size_t numLaunched = 0;
+		while(true) {
+			for(; numLaunched < getCpuCount(); ++numLaunched)
+				KernelFiber::run([] {
+					drainLocalProfileRing();
+				}, &localScheduler.get(getCpuData(numLaunched)));
+
+			KernelFiber::asyncBlockCurrent(generalTimerEngine()->sleepFor(100'000'000));
+		}
 	});
 #endif
 }
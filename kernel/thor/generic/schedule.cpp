@@ -4,6 +4,7 @@
 #include <thor-internal/arch-generic/ints.hpp>
 #include <thor-internal/cpu-data.hpp>
 #include <thor-internal/debug.hpp>
+#include <thor-internal/load-balancing.hpp>
 #include <thor-internal/ostrace.hpp>
 #include <thor-internal/schedule.hpp>
 #include <thor-internal/thread.hpp>
@@ -30,6 +31,10 @@ namespace {
 			runOnStack([] (Continuation) {
 				if(logIdle)
 					infoLogger() << "System is idle" << frg::endlog;
+				// Try to pull work from busy CPUs before halting.
+				// Note that we cannot do this in Scheduler::_schedule() since the caller
+				// may hold locks that the load balancer also takes.
+				LoadBalancer::singleton().stealForIdle(getCpuData());
 				suspendSelf();
 				__builtin_trap();
 			}, getCpuData()->idleStack.base());
@@ -255,6 +260,7 @@ void Scheduler::updateQueue() {
 		_waitQueue.push(entity);
 		_numWaiting++;
 	}
+	_numWaitingHint.store(_numWaiting, std::memory_order_relaxed);
 }
 
 bool Scheduler::maybeReschedule() {
@@ -339,6 +345,7 @@ void Scheduler::_unschedule() {
 			|| _current->state == ScheduleState::active) {
 		_waitQueue.push(_current);
 		_numWaiting++;
+		_numWaitingHint.store(_numWaiting, std::memory_order_relaxed);
 	}
 
 	_current = nullptr;
@@ -358,6 +365,7 @@ void Scheduler::_schedule() {
 	auto entity = _waitQueue.top();
 	_waitQueue.pop();
 	_numWaiting--;
+	_numWaitingHint.store(_numWaiting, std::memory_order_relaxed);
 
 	// Increase the unfairness at the start of the time slice.
 	assert(entity->state == ScheduleState::active);
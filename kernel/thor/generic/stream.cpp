@@ -44,14 +44,24 @@ static void transfer(ImbueExtract, StreamNode *from, StreamNode *to) {
 }
 
 static void transfer(SendRecvInline, StreamNode *from, StreamNode *to) {
-	auto buffer = std::move(from->_inBuffer);
+	if(from->inSize() <= to->_maxLength) {
+		if(!from->_isInline) {
+			to->_transmitBuffer = std::move(from->_inBuffer);
+		}else if(to->_acceptsInline) {
+			// Fast path for small messages: copy from node to node without allocating.
+			memcpy(to->_inlineData, from->_inlineData, from->_inlineLength);
+			to->_inlineLength = from->_inlineLength;
+			to->_isInline = true;
+		}else{
+			frg::unique_memory<KernelAlloc> buffer(*kernelAlloc, from->_inlineLength);
+			memcpy(buffer.data(), from->_inlineData, from->_inlineLength);
+			to->_transmitBuffer = std::move(buffer);
+		}
 
-	if(buffer.size() <= to->_maxLength) {
 		from->_error = Error::success;
 		from->complete();
 
 		to->_error = Error::success;
-		to->_transmitBuffer = std::move(buffer);
 		to->complete();
 	}else{
 		from->_error = Error::bufferTooSmall;
@@ -169,7 +179,7 @@ void Stream::Submitter::run() {
 		}else if(u->tag() == kTagSendKernelBuffer && v->tag() == kTagRecvKernelBuffer) {
 			transfer(SendRecvInline{}, u, v);
 		}else if(u->tag() == kTagSendFlow && v->tag() == kTagRecvKernelBuffer) {
-			if(u->_inBuffer.size() > v->_maxLength) {
+			if(u->_maxLength > v->_maxLength) {
 				// Both nodes complete with bufferTooSmall.
 				u->_error = Error::bufferTooSmall;
 				v->_error = Error::bufferTooSmall;
@@ -186,7 +196,7 @@ void Stream::Submitter::run() {
 			u->peerNode = v;
 			u->issueFlow.raise();
 		}else if(u->tag() == kTagSendKernelBuffer && v->tag() == kTagRecvFlow) {
-			if(u->_inBuffer.size() > v->_maxLength) {
+			if(u->inSize() > v->_maxLength) {
 				// Both nodes complete with bufferTooSmall.
 				u->_error = Error::bufferTooSmall;
 				v->_error = Error::bufferTooSmall;
@@ -194,7 +204,7 @@ void Stream::Submitter::run() {
 				u->complete();
 				v->issueFlow.raise();
 				continue;
-			}else if(!u->_inBuffer.size()) {
+			}else if(!u->inSize()) {
 				u->complete();
 				v->issueFlow.raise();
 				continue;
@@ -27,9 +27,35 @@ inline CachingMode determineCachingMode(CachingMode physicalRangeCaching,
 	return physicalRangeCaching;
 }
 
+// Page sizes that we try to use for huge mappings (largest first).
+// Cursors reject the sizes that are not supported by the architecture.
+inline constexpr size_t hugePageSizes[] = {size_t{1} << 30, size_t{1} << 21};
+
+// Smallest huge page size; this is the alignment that kMapHuge mappings receive.
+inline constexpr size_t kHugePageSize = size_t{1} << 21;
+
+// Tries to map a huge page of the given size at the cursor's position.
+template<typename Cursor>
+bool mapHugeByCursor(Cursor &c, MemoryView *view, uintptr_t offset, size_t hugeSize,
+		PageFlags flags, CachingMode mode) {
+	if(c.virtualAddress() & (hugeSize - 1))
+		return false;
+	if(view->contiguousGranularity() < hugeSize)
+		return false;
+	auto physicalRange = view->peekContiguousRange(offset, hugeSize);
+	if(physicalRange.template get<0>() == PhysicalAddr(-1))
+		return false;
+	if(physicalRange.template get<0>() & (hugeSize - 1))
+		return false;
+	return c.mapHuge(hugeSize, physicalRange.template get<0>(), flags,
+			determineCachingMode(physicalRange.template get<1>(), mode));
+}
+
+// If huge is set, present pages are mapped as huge pages where possible.
 template<typename Cursor, typename PageSpace>
 frg::expected<Error> mapPresentPagesByCursor(PageSpace *ps, VirtualAddr va,
-		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode,
+		bool huge) {
 	assert(!(va & (kPageSize - 1)));
 	assert(!(offset & (kPageSize - 1)));
 	assert(!(size & (kPageSize - 1)));
@@ -37,6 +63,20 @@ frg::expected<Error> mapPresentPagesByCursor(PageSpace *ps, VirtualAddr va,
 	Cursor c{ps, va};
 	while(c.virtualAddress() < va + size) {
 		auto progress = c.virtualAddress() - va;
+
+		bool mappedHuge = false;
+		for(auto hugeSize : hugePageSizes) {
+			if(!huge || progress + hugeSize > size || (offset + progress) & (hugeSize - 1))
+				continue;
+			if(mapHugeByCursor(c, view, offset + progress, hugeSize, flags, mode)) {
+				c.moveTo(c.virtualAddress() + hugeSize);
+				mappedHuge = true;
+				break;
+			}
+		}
+		if(mappedHuge)
+			continue;
+
 		auto physicalRange = view->peekRange(offset + progress);
 		if(physicalRange.template get<0>() == PhysicalAddr(-1)) {
 			c.advance4k();
@@ -93,6 +133,11 @@ frg::expected<Error> faultPageByCursor(PageSpace *ps, VirtualAddr va,
 
 	Cursor c{ps, va};
 
+	// Huge pages are only changed by operations that perform shootdown. Since the PTEs
+	// of huge pages do not change on faults, this fault must be spurious.
+	if(c.hugePageSize())
+		return Error::spuriousOperation;
+
 	auto physicalRange = view->peekRange(offset);
 	if(physicalRange.get<0>() == PhysicalAddr(-1))
 		return Error::fault;
@@ -107,6 +152,52 @@ frg::expected<Error> faultPageByCursor(PageSpace *ps, VirtualAddr va,
 	return {};
 }
 
+// Maps the pages of the view that are present but not mapped yet.
+// In contrast to remapPresentPagesByCursor(), existing PTEs are left untouched.
+template<typename Cursor, typename PageSpace>
+frg::expected<Error> faultAroundPagesByCursor(PageSpace *ps, VirtualAddr va,
+		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+	assert(!(va & (kPageSize - 1)));
+	assert(!(offset & (kPageSize - 1)));
+	assert(!(size & (kPageSize - 1)));
+
+	Cursor c{ps, va};
+	while(c.virtualAddress() < va + size) {
+		auto progress = c.virtualAddress() - va;
+		if(c.isPresent()) {
+			c.advance4k();
+			continue;
+		}
+
+		auto physicalRange = view->peekRange(offset + progress);
+		if(physicalRange.template get<0>() == PhysicalAddr(-1)) {
+			c.advance4k();
+			continue;
+		}
+		assert(!(physicalRange.template get<0>() & (kPageSize - 1)));
+
+		c.map4k(physicalRange.template get<0>(), flags,
+			determineCachingMode(physicalRange.template get<1>(), mode));
+		c.advance4k();
+	}
+	return {};
+}
+
+template<typename Cursor, typename PageSpace>
+frg::expected<Error> faultHugePageByCursor(PageSpace *ps, VirtualAddr va,
+		MemoryView *view, uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) {
+	assert(!(va & (size - 1)));
+	assert(!(offset & (size - 1)));
+
+	Cursor c{ps, va};
+	if(c.hugePageSize() >= size)
+		return Error::spuriousOperation;
+
+	if(!mapHugeByCursor(c, view, offset, size, flags, mode))
+		return Error::fault;
+	return {};
+}
+
 template<typename Cursor, typename PageSpace>
 frg::expected<Error> cleanPagesByCursor(PageSpace *ps, VirtualAddr va,
 		MemoryView *view, uintptr_t offset, size_t size) {
@@ -139,6 +230,19 @@ frg::expected<Error> unmapPagesByCursor(PageSpace *ps, VirtualAddr va,
 	while(c.findPresent(va + size)) {
 		auto progress = c.virtualAddress() - va;
 
+		// Unmap huge pages as a whole if they are entirely contained in the range.
+		// Otherwise, unmap4k() splits them.
+		auto hugeSize = c.hugePageSize();
+		if(hugeSize && !(c.virtualAddress() & (hugeSize - 1)) && progress + hugeSize <= size) {
+			auto [status, _] = c.unmapHuge();
+			assert(status & page_status::present);
+			if(status & page_status::dirty)
+				view->markDirty(offset + progress, hugeSize);
+
+			c.moveTo(c.virtualAddress() + hugeSize);
+			continue;
+		}
+
 		auto [status, _] = c.unmap4k();
 		assert(status & page_status::present);
 		if(status & page_status::dirty)
@@ -184,8 +288,9 @@ struct VirtualOperations {
 	// The following API is based on MemoryView and will replace the legacy API above.
 	// The advantage of this approach is that we do not need on virtual call per page anymore.
 
+	// Huge pages are only used if huge is set (i.e., for kMapHuge mappings).
 	virtual frg::expected<Error> mapPresentPages(VirtualAddr va, MemoryView *view,
-			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode);
+			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode, bool huge);
 
 	virtual frg::expected<Error> remapPresentPages(VirtualAddr va, MemoryView *view,
 			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode);
@@ -193,6 +298,16 @@ struct VirtualOperations {
 	virtual frg::expected<Error> faultPage(VirtualAddr va, MemoryView *view,
 			uintptr_t offset, PageFlags flags, CachingMode mode);
 
+	// Maps pages of the given range that are present in the view but not mapped yet.
+	// This is only an optimization to avoid further page faults; by default, nothing is mapped.
+	virtual frg::expected<Error> faultAroundPages(VirtualAddr va, MemoryView *view,
+			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode);
+
+	// Maps a huge page of the given size. Returns Error::fault if this is not possible;
+	// the caller is expected to fall back to faultPage() in this case.
+	virtual frg::expected<Error> faultHugePage(VirtualAddr va, MemoryView *view,
+			uintptr_t offset, size_t size, PageFlags flags, CachingMode mode);
+
 	virtual frg::expected<Error> cleanPages(VirtualAddr va, MemoryView *view,
 			uintptr_t offset, size_t size);
 
@@ -335,7 +450,8 @@ enum MappingFlags : uint32_t {
 	protWrite = 0x20,
 	protExecute = 0x40,
 
-	dontRequireBacking = 0x100
+	dontRequireBacking = 0x100,
+	huge = 0x200
 };
 
 struct TouchVirtualResult {
@@ -518,7 +634,8 @@ public:
 		kMapProtExecute = 0x20,
 		kMapPopulate = 0x200,
 		kMapDontRequireBacking = 0x400,
-		kMapFixedNoReplace = 0x800
+		kMapFixedNoReplace = 0x800,
+		kMapHuge = 0x1000
 	};
 
 	enum FaultFlags : uint32_t {
@@ -568,6 +685,16 @@ public:
 	coroutine<size_t> writePartialSpace(uintptr_t address, const void *buffer, size_t size,
 			smarter::shared_ptr<WorkQueue> wq);
 
+	// These functions copy between this space and the user memory of the address space
+	// that wq executes in. The pages of this space are pinned while they are accessed;
+	// thus, no intermediate kernel buffer is needed.
+	// They return the number of bytes that were copied. If that is less than size,
+	// *userFault is set to true if the fault occurred in user memory.
+	coroutine<size_t> readPartialSpaceToUser(uintptr_t address, void *userBuffer,
+			size_t size, smarter::shared_ptr<WorkQueue> wq, bool *userFault);
+	coroutine<size_t> writePartialSpaceFromUser(uintptr_t address, const void *userBuffer,
+			size_t size, smarter::shared_ptr<WorkQueue> wq, bool *userFault);
+
 	auto readSpace(uintptr_t address, void *buffer, size_t size,
 			smarter::shared_ptr<WorkQueue> wq) {
 		return async::transform(
@@ -643,7 +770,8 @@ public:
 
 private:
 	// Allocates a new mapping of the given length somewhere in the address space.
-	frg::expected<Error, VirtualAddr> _allocate(size_t length, MapFlags flags);
+	frg::expected<Error, VirtualAddr> _allocate(size_t length, MapFlags flags,
+			size_t alignment = kPageSize);
 
 	frg::expected<Error, VirtualAddr> _allocateAt(VirtualAddr address, size_t length);
 
@@ -663,6 +791,20 @@ private:
 	// Returns whether shootdown needs to be performed (any of the mappings got unmapped).
 	coroutine<bool> _unmapMappings(VirtualAddr address, size_t length, Mapping *start, Mapping *end);
 
+	// Direction of the copy in _transferPartialSpace() and whether the buffer is user memory.
+	enum class PartialTransfer {
+		read,
+		write,
+		readToUser,
+		writeFromUser,
+	};
+
+	// Implementation of the read/write functions above.
+	// userFault is only written for readToUser and writeFromUser; otherwise, it can be null.
+	coroutine<size_t> _transferPartialSpace(uintptr_t address, std::byte *buffer,
+			size_t size, PartialTransfer transfer, smarter::shared_ptr<WorkQueue> wq,
+			bool *userFault);
+
 	VirtualOperations *_ops;
 
 	// Since changing memory mappings requires TLB shootdown, most mapping-related operations
@@ -699,9 +841,10 @@ struct AddressSpace final : VirtualSpace, smarter::crtp_counter<AddressSpace, Bi
 		}
 
 		frg::expected<Error> mapPresentPages(VirtualAddr va, MemoryView *view,
-				uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override {
+				uintptr_t offset, size_t size, PageFlags flags, CachingMode mode,
+				bool huge) override {
 			return mapPresentPagesByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
-					va, view, offset, size, flags, mode);
+					va, view, offset, size, flags, mode, huge);
 		}
 
 		frg::expected<Error> remapPresentPages(VirtualAddr va, MemoryView *view,
@@ -716,6 +859,18 @@ struct AddressSpace final : VirtualSpace, smarter::crtp_counter<AddressSpace, Bi
 					va, view, offset, flags, mode);
 		}
 
+		frg::expected<Error> faultAroundPages(VirtualAddr va, MemoryView *view,
+				uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override {
+			return faultAroundPagesByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
+					va, view, offset, size, flags, mode);
+		}
+
+		frg::expected<Error> faultHugePage(VirtualAddr va, MemoryView *view,
+				uintptr_t offset, size_t size, PageFlags flags, CachingMode mode) override {
+			return faultHugePageByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
+					va, view, offset, size, flags, mode);
+		}
+
 		frg::expected<Error> cleanPages(VirtualAddr va, MemoryView *view,
 				uintptr_t offset, size_t size) override {
 			return cleanPagesByCursor<ClientPageSpace::Cursor>(&space_->pageSpace_,
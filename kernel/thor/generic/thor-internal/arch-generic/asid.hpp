@@ -44,6 +44,9 @@ private:
 	// Timestamp at which shootdown began.
 	uint64_t sequence_;
 
+	// Invalidate the entire ASID, not only the given range.
+	bool invalidateAll_;
+
 	std::atomic<size_t> bindingsToShoot_;
 
 };
@@ -185,6 +188,13 @@ struct PageSpace {
 	// shootdown.
 	bool submitShootdown(ShootNode *node);
 
+	// Must be called after a huge page is split into smaller pages.
+	// The next shootdown then invalidates the entire ASID, such that no CPU keeps
+	// using TLB entries of the huge page once the smaller pages are changed.
+	void noteHugeSplit() {
+		hugeSplit_.store(true, std::memory_order_relaxed);
+	}
+
 	auto &tableMutex() {
 		return tableMutex_;
 	}
@@ -195,6 +205,8 @@ private:
 	std::atomic<bool> wantToRetire_ = false;
 	RetireNode *retireNode_ = nullptr;
 
+	std::atomic<bool> hugeSplit_ = false;
+
 	frg::ticket_spinlock mutex_;
 	frg::ticket_spinlock tableMutex_;
 
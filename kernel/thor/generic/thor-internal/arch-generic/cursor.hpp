@@ -41,10 +41,29 @@ concept CursorPolicy = requires (uint64_t pte, uint64_t *ptePtr,
 	{ T::pteNewTable() } -> std::same_as<uint64_t>;
 };
 
+// Policies that additionally support huge pages, i.e., leaf PTEs in tables above the last level.
+// Here, level refers to the level of the table that contains the PTE.
+template <typename T>
+concept HugePageCursorPolicy = CursorPolicy<T> && requires (uint64_t pte,
+		PhysicalAddr pa, PageFlags flags, CachingMode cachingMode, size_t level, size_t n) {
+	// Check whether PTEs in tables of the given level can map huge pages.
+	{ T::supportsHugePages(level) } -> std::same_as<bool>;
+	// Check whether the given PTE maps a huge page.
+	{ T::pteIsHuge(pte, level) } -> std::same_as<bool>;
+	// Get the page address from the given huge PTE.
+	{ T::pteHugeAddress(pte, level) } -> std::same_as<PhysicalAddr>;
+	// Construct a new huge PTE from the given parameters.
+	{ T::pteBuildHuge(pa, flags, cachingMode, level) } -> std::same_as<uint64_t>;
+	// Construct the n-th entry of the table that replaces the given huge PTE
+	// (i.e., the entries map the same memory using the next smaller page size).
+	{ T::pteSplitHuge(pte, level, n) } -> std::same_as<uint64_t>;
+};
+
 template <CursorPolicy Policy>
 struct PageCursor {
 	inline static constexpr uintptr_t levelMask = (uintptr_t{1} << Policy::bitsPerLevel) - 1;
 	inline static constexpr size_t lastLevel = Policy::maxLevels - 1;
+	inline static constexpr size_t noHugeLevel = Policy::maxLevels;
 
 	PageCursor(PageSpace *space, uintptr_t va)
 	: space_{space}, va_{}, initialLevel_{Policy::maxLevels - Policy::numLevels()} {
@@ -86,6 +105,7 @@ public:
 		}
 
 		va_ = va;
+		hugeLevel_ = noHugeLevel;
 		reloadLevel_(lastLevel);
 	}
 
@@ -93,8 +113,27 @@ public:
 		moveTo(va_ + kPageSize);
 	}
 
+	// Returns the size of the huge page that maps the current address (or zero).
+	size_t hugePageSize() {
+		if(hugeLevel_ == noHugeLevel)
+			return 0;
+		return size_t{1} << levelShift(hugeLevel_);
+	}
+
+	// Returns true if the current address is mapped (by a 4 KiB or by a huge page).
+	bool isPresent() {
+		if(hugeLevel_ != noHugeLevel)
+			return true;
+		if(!accessors_[lastLevel])
+			return false;
+		return Policy::ptePagePresent(readCurrentPte_());
+	}
+
 	bool findPresent(uintptr_t limit) {
 		while(va_ < limit) {
+			if(hugeLevel_ != noHugeLevel)
+				return true;
+
 			if(!accessors_[lastLevel]) {
 				advance4k();
 				continue;
@@ -112,6 +151,15 @@ public:
 
 	bool findDirty(uintptr_t limit) {
 		while(va_ < limit) {
+			if(hugeLevel_ != noHugeLevel) {
+				// Skip clean huge pages entirely; dirty ones are split by clean4k().
+				auto ptEnt = __atomic_load_n(hugePtePtr_(), __ATOMIC_RELAXED);
+				if(Policy::ptePageStatus(ptEnt) & page_status::dirty)
+					return true;
+				moveTo((va_ & ~(hugePageSize() - 1)) + hugePageSize());
+				continue;
+			}
+
 			if(!accessors_[lastLevel]) {
 				advance4k();
 				continue;
@@ -128,6 +176,7 @@ public:
 	}
 
 	void map4k(PhysicalAddr pa, PageFlags flags, CachingMode cachingMode) {
+		splitHugePages_();
 		if(!accessors_[lastLevel])
 			realizePts_();
 
@@ -140,6 +189,7 @@ public:
 	}
 
 	PageStatus remap4k(PhysicalAddr pa, PageFlags flags, CachingMode cachingMode) {
+		splitHugePages_();
 		if(!accessors_[lastLevel])
 			realizePts_();
 
@@ -150,6 +200,7 @@ public:
 	}
 
 	PageStatus clean4k() {
+		splitHugePages_();
 		if(!accessors_[lastLevel])
 			return 0;
 
@@ -157,6 +208,7 @@ public:
 	}
 
 	std::tuple<PageStatus, PhysicalAddr> unmap4k() {
+		splitHugePages_();
 		if(!accessors_[lastLevel])
 			return {0, 0};
 
@@ -164,9 +216,62 @@ public:
 		return {Policy::ptePageStatus(ptEnt), Policy::ptePageAddress(ptEnt)};
 	}
 
+	// Maps a huge page of the given size at the current (suitably aligned) address.
+	// Returns false if the policy does not support huge pages of this size or if
+	// the corresponding PTE is already in use (e.g., by a page table).
+	bool mapHuge(size_t size, PhysicalAddr pa, PageFlags flags, CachingMode cachingMode) {
+		if constexpr (HugePageCursorPolicy<Policy>) {
+			size_t level = initialLevel_ + 1;
+			while(level < lastLevel && levelShift(level) != static_cast<size_t>(__builtin_ctzll(size)))
+				level++;
+			if(level == lastLevel || (size_t{1} << levelShift(level)) != size)
+				return false;
+			if(!Policy::supportsHugePages(level) || hugeLevel_ != noHugeLevel)
+				return false;
+			assert(!(va_ & (size - 1)));
+			assert(!(pa & (size - 1)));
+
+			auto irqLock = frg::guard(&irqMutex());
+			auto lock = frg::guard(&space_->tableMutex());
+
+			realizeLevel_(level);
+			auto ptPtr = reinterpret_cast<uint64_t *>(accessors_[level].get())
+				+ ((va_ >> levelShift(level)) & levelMask);
+			if(__atomic_load_n(ptPtr, __ATOMIC_RELAXED))
+				return false;
+
+			__atomic_store_n(ptPtr, Policy::pteBuildHuge(pa, flags, cachingMode, level),
+					__ATOMIC_RELAXED);
+			hugeLevel_ = level;
+			return true;
+		}else{
+			(void)size;
+			(void)pa;
+			(void)flags;
+			(void)cachingMode;
+			return false;
+		}
+	}
+
+	// Unmaps the huge page at the current address. The caller must ensure that
+	// the unmapped range matches hugePageSize().
+	std::tuple<PageStatus, PhysicalAddr> unmapHuge() {
+		if constexpr (HugePageCursorPolicy<Policy>) {
+			assert(hugeLevel_ != noHugeLevel);
+			auto level = hugeLevel_;
+			auto ptEnt = __atomic_exchange_n(hugePtePtr_(), 0, __ATOMIC_RELAXED);
+			hugeLevel_ = noHugeLevel;
+			return {Policy::ptePageStatus(ptEnt), Policy::pteHugeAddress(ptEnt, level)};
+		}else{
+			assert(!"unmapHuge() called on a policy without huge page support");
+			__builtin_unreachable();
+		}
+	}
+
 	// Low-level API for use by arch-specific code.
 public:
 	uint64_t *getPtePtr() {
+		splitHugePages_();
 		if (!accessors_[lastLevel])
 			return nullptr;
 		return currentPtePtr_();
@@ -181,11 +286,59 @@ private:
 		if(!Policy::pteTablePresent(ptEnt))
 			return false;
 
+		if constexpr (HugePageCursorPolicy<Policy>) {
+			if(Policy::pteIsHuge(ptEnt, level)) {
+				hugeLevel_ = level;
+				return false;
+			}
+		}
+
 		auto subPtPtr = Policy::pteTableAddress(ptEnt);
 		subPt = PageAccessor{subPtPtr};
 		return true;
 	}
 
+	uint64_t *hugePtePtr_() {
+		assert(hugeLevel_ != noHugeLevel);
+		return reinterpret_cast<uint64_t *>(accessors_[hugeLevel_].get())
+			+ ((va_ >> levelShift(hugeLevel_)) & levelMask);
+	}
+
+	// Replaces huge pages that map the current address by tables of smaller pages
+	// until the current address is mapped by a 4 KiB page. Callers must perform a shootdown
+	// after modifying the smaller pages; that shootdown then invalidates the entire ASID
+	// (see PageSpace::noteHugeSplit()), which also drops the TLB entries of the huge page.
+	void splitHugePages_() {
+		if constexpr (HugePageCursorPolicy<Policy>) {
+			while(hugeLevel_ != noHugeLevel) {
+				auto level = hugeLevel_;
+				{
+					auto irqLock = frg::guard(&irqMutex());
+					auto lock = frg::guard(&space_->tableMutex());
+
+					auto ptPtr = hugePtePtr_();
+					auto ptEnt = __atomic_load_n(ptPtr, __ATOMIC_RELAXED);
+					if(Policy::pteIsHuge(ptEnt, level)) {
+						auto subPtEnt = Policy::pteNewTable();
+						PageAccessor subPt{Policy::pteTableAddress(subPtEnt)};
+						auto subPtPtr = reinterpret_cast<uint64_t *>(subPt.get());
+
+						// The dirty bit can be set concurrently by the hardware; retry if that happens.
+						do {
+							for(size_t n = 0; n <= levelMask; n++)
+								subPtPtr[n] = Policy::pteSplitHuge(ptEnt, level, n);
+						} while(!__atomic_compare_exchange_n(ptPtr, &ptEnt, subPtEnt,
+								false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+						space_->noteHugeSplit();
+					}
+				}
+
+				hugeLevel_ = noHugeLevel;
+				reloadLevel_(lastLevel);
+			}
+		}
+	}
+
 	bool reloadLevel_(size_t level) {
 		if(accessors_[level]) /*[[likely]]*/
 			return true;
@@ -202,6 +355,8 @@ private:
 		auto ptEnt = __atomic_load_n(ptPtr, __ATOMIC_ACQUIRE);
 
 		if(Policy::pteTablePresent(ptEnt)) {
+			if constexpr (HugePageCursorPolicy<Policy>)
+				assert(!Policy::pteIsHuge(ptEnt, level));
 			auto subPtPtr = Policy::pteTableAddress(ptEnt);
 			subPt = PageAccessor{subPtPtr};
 			return;
@@ -236,6 +391,9 @@ private:
 
 	size_t initialLevel_;
 
+	// Level of the table that contains a huge PTE mapping va_ (or noHugeLevel).
+	size_t hugeLevel_{noHugeLevel};
+
 	PageAccessor accessors_[Policy::maxLevels];
 };
 
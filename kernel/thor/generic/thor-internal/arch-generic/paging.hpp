@@ -15,12 +15,16 @@ concept ValidCursor = requires (T t, uintptr_t va, PhysicalAddr pa,
 	{ t.virtualAddress() } -> std::same_as<uintptr_t>;
 	{ t.moveTo(va) } -> std::same_as<void>;
 	{ t.advance4k() } -> std::same_as<void>;
+	{ t.isPresent() } -> std::same_as<bool>;
 	{ t.findPresent(va) } -> std::same_as<bool>;
 	{ t.findDirty(va) } -> std::same_as<bool>;
 	{ t.map4k(pa, flags, mode) } -> std::same_as<void>;
 	{ t.remap4k(pa, flags, mode) } -> std::same_as<PageStatus>;
 	{ t.clean4k() } -> std::same_as<PageStatus>;
 	{ t.unmap4k() } -> std::same_as<std::tuple<PageStatus, PhysicalAddr>>;
+	{ t.hugePageSize() } -> std::same_as<size_t>;
+	{ t.mapHuge(size_t{}, pa, flags, mode) } -> std::same_as<bool>;
+	{ t.unmapHuge() } -> std::same_as<std::tuple<PageStatus, PhysicalAddr>>;
 };
 
 template <typename T>
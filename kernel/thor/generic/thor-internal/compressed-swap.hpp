@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace thor {
+
+// In-memory store for evicted anonymous pages (similar to Linux' zram).
+// Pages are compressed using the LZ4 block format and kept on the kernel heap.
+
+struct CompressedPage;
+
+// Compresses a page into the store. Returns nullptr if the page does not compress well;
+// in this case, it is cheaper to keep the page in RAM.
+CompressedPage *compressPage(const void *page);
+
+// Decompresses a page and releases the compressed copy.
+void decompressPage(CompressedPage *compressed, void *page);
+
+// Releases a compressed copy without decompressing it.
+void discardCompressedPage(CompressedPage *compressed);
+
+struct CompressedSwapStats {
+	// Number of pages that are currently stored.
+	uint64_t numStoredPages = 0;
+	// Size of the compressed data (in bytes) that is currently stored.
+	uint64_t poolSize = 0;
+
+	uint64_t numSwapOuts = 0;
+	uint64_t numSwapIns = 0;
+	// Number of pages that were rejected since they did not compress well.
+	uint64_t numRejected = 0;
+
+	// Total and maximal time spent in decompressPage().
+	uint64_t swapInNanos = 0;
+	uint64_t maxSwapInNanos = 0;
+};
+
+CompressedSwapStats getCompressedSwapStats();
+
+} // namespace thor
@@ -40,6 +40,12 @@ struct CpuData : public PlatformCpuData {
 
 	int cpuIndex;
 
+	// CPU topology as far as it is known to the architecture code.
+	// CPUs with equal packageId share a package; CPUs with equal packageId and
+	// coreId are SMT siblings. A coreId of -1 means that there are no known siblings.
+	int coreId{-1};
+	int packageId{0};
+
 	ExecutorContext *executorContext{nullptr};
 	smarter::borrowed_ptr<Thread> activeThread;
 	KernelFiber *activeFiber{nullptr};
@@ -138,6 +138,11 @@ public:
 		return _associatedWorkQueue.get();
 	}
 
+	// The stack that this fiber runs on.
+	UniqueKernelStack &stack() {
+		return _fiberContext.stack;
+	}
+
 private:
 	frg::ticket_spinlock _mutex;
 	bool _blocked;
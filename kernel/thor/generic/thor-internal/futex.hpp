@@ -1,8 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <async/cancellation.hpp>
+#include <frg/expected.hpp>
 #include <frg/functional.hpp>
-#include <frg/hash_map.hpp>
 #include <frg/list.hpp>
 #include <frg/spinlock.hpp>
 
@@ -56,6 +57,8 @@ concept Futex = requires(F f) {
 
 struct FutexRealm {
 private:
+	struct Bucket;
+
 	// Represents a single waiter.
 	struct Node {
 		friend struct FutexRealm;
@@ -72,53 +75,75 @@ private:
 		void cancel_() {
 			{
 				auto irqLock = frg::guard(&irqMutex());
-				auto lock = frg::guard(&realm_->_mutex);
+				auto bucket = lockBucket_();
 
 				if(!result_) {
-					auto sit = realm_->_slots.get(id_);
-					assert(sit);			
-
-					// Invariant: If the slot exists then its queue is not empty.
-					assert(!sit->queue.empty());
-
-					auto nit = sit->queue.iterator_to(this);
-					sit->queue.erase(nit);
+					auto nit = bucket->queue.iterator_to(this);
+					bucket->queue.erase(nit);
 					result_ = Error::cancelled;
-
-					if(sit->queue.empty())
-						realm_->_slots.remove(id_);
 				}else{
 					assert(!queueHook_.in_list);
 				}
+
+				bucket->mutex.unlock();
 			}
 
 			complete();
 		}
 
+		// Locks the bucket that this node is currently queued in.
+		// Since requeue() can concurrently move the node to a different bucket,
+		// we need to re-check the bucket after taking its lock.
+		Bucket *lockBucket_() {
+			while(true) {
+				auto bucket = bucket_.load(std::memory_order_relaxed);
+				bucket->mutex.lock();
+				if(bucket == bucket_.load(std::memory_order_relaxed))
+					return bucket;
+				bucket->mutex.unlock();
+			}
+		}
+
 		FutexRealm *realm_;
+		// Protected by the lock of the bucket that the node is queued in.
 		FutexIdentity id_;
+		std::atomic<Bucket *> bucket_{nullptr};
 		frg::optional<Error> result_; // Set after completion.
 		async::cancellation_observer<frg::bound_mem_fn<&Node::cancel_>> cobs_;
 		frg::default_list_hook<Node> queueHook_;
 	};
 
-	struct Slot {
-		frg::intrusive_list<
+	using NodeList = frg::intrusive_list<
+		Node,
+		frg::locate_member<
 			Node,
-			frg::locate_member<
-				Node,
-				frg::default_list_hook<Node>,
-				&Node::queueHook_
-			>
-		> queue;
+			frg::default_list_hook<Node>,
+			&Node::queueHook_
+		>
+	>;
+
+	// Waiters of all futexes that hash to the same bucket share a queue.
+	// Buckets are cache line aligned to avoid false sharing between their locks.
+	struct alignas(64) Bucket {
+		frg::ticket_spinlock mutex;
+		NodeList queue;
 	};
 
 public:
-	FutexRealm()
-	: _slots{FutexIdentity::Hash{}, *kernelAlloc} { }
+	FutexRealm() = default;
+
+	FutexRealm(const FutexRealm &) = delete;
+
+	FutexRealm &operator= (const FutexRealm &) = delete;
 
 	bool empty() {
-		return _slots.empty();
+		auto irqLock = frg::guard(&irqMutex());
+		for(auto &bucket : _buckets) {
+			auto lock = frg::guard(&bucket.mutex);
+			if(!bucket.queue.empty())
+				return false;
+		}
+		return true;
 	}
 
 	// ----------------------------------------------------------------------------------
@@ -144,7 +169,8 @@ public:
 
 			auto fastPath = [&] {
 				auto irqLock = frg::guard(&irqMutex());
-				auto lock = frg::guard(&realm_->_mutex);
+				auto bucket = realm_->bucketFor_(id_);
+				auto lock = frg::guard(&bucket->mutex);
 
 				if(f.read() != expected_) {
 					result_ = Error::futexRace;
@@ -156,14 +182,9 @@ public:
 					return true;
 				}
 
-				auto sit = realm_->_slots.get(id_);
-				if(!sit) {
-					realm_->_slots.insert(id_, Slot());
-					sit = realm_->_slots.get(id_);
-				}
-
 				assert(!queueHook_.in_list);
-				sit->queue.push_back(this);
+				bucket_.store(bucket, std::memory_order_relaxed);
+				bucket->queue.push_back(this);
 				return false;
 			}(); // Immediately invoked.
 
@@ -214,60 +235,114 @@ public:
 
 	// ----------------------------------------------------------------------------------
 
-	void wake(FutexIdentity id) {
-		frg::intrusive_list<
-			Node,
-			frg::locate_member<
-				Node,
-				frg::default_list_hook<Node>,
-				&Node::queueHook_
-			>
-		> pending;
+	// Wakes up to count waiters of the futex (in FIFO order).
+	// Returns the number of waiters that were woken.
+	size_t wake(FutexIdentity id, size_t count = SIZE_MAX) {
+		return requeue(id, id, count, 0);
+	}
+
+	// Wakes up to numWake waiters of the futex identified by from and moves up to
+	// numRequeue of the remaining waiters to the futex identified by to.
+	// Returns the number of waiters that were woken.
+	size_t requeue(FutexIdentity from, FutexIdentity to, size_t numWake, size_t numRequeue) {
+		return requeue_(from, to, numWake, numRequeue, [] { return true; }).value();
+	}
+
+	// Like requeue() but fails with Error::futexRace unless the futex has the expected value.
+	// The value is read under the bucket lock, hence waiters cannot slip in between.
+	template<Futex F>
+	frg::expected<Error, size_t> requeue(F f, FutexIdentity to, unsigned int expected,
+			size_t numWake, size_t numRequeue) {
+		auto result = requeue_(f.getIdentity(), to, numWake, numRequeue, [&] {
+			return f.read() == expected;
+		});
+		f.retire();
+		return result;
+	}
+
+private:
+	template<typename C>
+	frg::expected<Error, size_t> requeue_(FutexIdentity from, FutexIdentity to,
+			size_t numWake, size_t numRequeue, C check) {
+		NodeList pending;
+		size_t numWoken = 0;
 		{
 			auto irqLock = frg::guard(&irqMutex());
-			auto lock = frg::guard(&_mutex);
+			auto fromBucket = bucketFor_(from);
+			auto toBucket = bucketFor_(to);
+			lockBuckets_(fromBucket, toBucket);
+
+			if(!check()) {
+				unlockBuckets_(fromBucket, toBucket);
+				return Error::futexRace;
+			}
 
-			auto sit = _slots.get(id);
-			if(!sit)
-				return;
-			// Invariant: If the slot exists then its queue is not empty.
-			assert(!sit->queue.empty());
+			size_t numMoved = 0;
+			auto it = fromBucket->queue.begin();
+			while(it != fromBucket->queue.end()) {
+				if(numWoken == numWake && (numMoved == numRequeue || from == to))
+					break;
 
-			// TODO: Enable users to only wake a certain number of waiters.
-			while(!sit->queue.empty()) {
-				auto node = sit->queue.front();
+				auto node = *it;
+				++it;
+				if(!(node->id_ == from))
+					continue;
 				assert(!node->result_);
-				sit->queue.pop_front();
 
-				node->result_ = Error::success;
-				if(node->cobs_.try_reset()) {
-					pending.push_back(node);
+				if(numWoken < numWake) {
+					fromBucket->queue.erase(fromBucket->queue.iterator_to(node));
+
+					node->result_ = Error::success;
+					if(node->cobs_.try_reset())
+						pending.push_back(node);
+					numWoken++;
+				}else if(numMoved < numRequeue) {
+					node->id_ = to;
+					if(toBucket != fromBucket) {
+						fromBucket->queue.erase(fromBucket->queue.iterator_to(node));
+						node->bucket_.store(toBucket, std::memory_order_relaxed);
+						toBucket->queue.push_back(node);
+					}
+					numMoved++;
 				}
 			}
 
-			if(sit->queue.empty())
-				_slots.remove(id);
+			unlockBuckets_(fromBucket, toBucket);
 		}
 
 		while(!pending.empty()) {
 			auto node = pending.pop_front();
 			node->complete();
 		}
+		return numWoken;
 	}
 
-private:
-	using Mutex = frg::ticket_spinlock;
-
-	// TODO: use a scalable hash table with fine-grained locks to
-	// improve the scalability of the futex algorithm.
-	Mutex _mutex;
-
-	frg::hash_map<
-		FutexIdentity,
-		Slot,
-		FutexIdentity::Hash,
-		KernelAlloc
-	> _slots;
+	static constexpr size_t numBuckets = 64;
+
+	Bucket *bucketFor_(FutexIdentity id) {
+		return &_buckets[FutexIdentity::Hash{}(id) % numBuckets];
+	}
+
+	// Takes the locks of both buckets in a consistent order to avoid deadlocks.
+	void lockBuckets_(Bucket *a, Bucket *b) {
+		if(a == b) {
+			a->mutex.lock();
+		}else if(a < b) {
+			a->mutex.lock();
+			b->mutex.lock();
+		}else{
+			b->mutex.lock();
+			a->mutex.lock();
+		}
+	}
+
+	void unlockBuckets_(Bucket *a, Bucket *b) {
+		if(a != b)
+			b->mutex.unlock();
+		a->mutex.unlock();
+	}
+
+	Bucket _buckets[numBuckets];
 };
 
 } // namespace thor
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <async/mutex.hpp>
 #include <frg/list.hpp>
 #include <frg/vector.hpp>
 #include <thor-internal/arch/ints.hpp>
@@ -94,6 +95,14 @@ private:
 	using Mutex = frg::ticket_spinlock;
 
 public:
+	// Upper bounds on the size of each chunk and on the memory of all chunks together.
+	static constexpr size_t maxChunkSize = size_t{1} << 20;
+	static constexpr size_t maxChunksMemory = size_t{64} << 20;
+
+	static size_t reservedPerChunk(size_t chunkSize);
+
+	static bool validParameters(unsigned int ringShift, unsigned int numChunks, size_t chunkSize);
+
 	IpcQueue(unsigned int ringShift, unsigned int numChunks, size_t chunkSize);
 
 	IpcQueue(const IpcQueue &) = delete;
@@ -106,6 +115,10 @@ public:
 
 	bool validSize(size_t size);
 
+	// Appends chunks to the queue such that it has numChunks chunks.
+	// The queue memory grows accordingly; existing chunks are not moved.
+	coroutine<Error> grow(unsigned int numChunks);
+
 	void setupChunk(size_t index, smarter::shared_ptr<AddressSpace, BindableHandle> space, void *pointer);
 
 	void submit(IpcNode *node);
@@ -174,8 +187,13 @@ private:
 
 	unsigned int _ringShift;
 	size_t _chunkSize;
+	size_t _chunksOffset;
+	size_t _reservedPerChunk;
 
+	// Protected by _mutex. Only grows (see grow()).
 	frg::vector<size_t, KernelAlloc> _chunkOffsets;
+	// Serializes grow() operations.
+	async::mutex _growMutex;
 
 	// Index into the queue that we are currently processing.
 	int _currentIndex;
@@ -184,14 +202,7 @@ private:
 
 	async::recurring_event _doorbell;
 
-	frg::intrusive_list<
-		IpcNode,
-		frg::locate_member<
-			IpcNode,
-			frg::default_list_hook<IpcNode>,
-			&IpcNode::_queueNode
-		>
-	> _nodeQueue;
+	NodeList _nodeQueue;
 
 	// Stores whether any nodes are in the queue.
 	// Written only when _mutex is held (but read outside of _mutex).
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
 #include <frg/slab.hpp>
 #include <frg/spinlock.hpp>
 #include <frg/manual_box.hpp>
@@ -73,16 +74,206 @@ public:
 	void output_trace(void *buffer, size_t size);
 };
 
-using KernelAlloc = frg::slab_allocator<KernelVirtualAlloc, IrqSpinlock>;
+// Ticket spinlock that counts how often it was found to be held by another CPU.
+struct CountingSpinlock {
+	constexpr CountingSpinlock() = default;
+
+	void lock() {
+		bool contended = _held.load(std::memory_order_relaxed);
+		_spinlock.lock();
+		_held.store(true, std::memory_order_relaxed);
+		if(contended)
+			_numContended.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		_held.store(false, std::memory_order_relaxed);
+		_spinlock.unlock();
+	}
+
+	uint64_t numContended() {
+		return _numContended.load(std::memory_order_relaxed);
+	}
+
+private:
+	frg::ticket_spinlock _spinlock;
+	std::atomic<bool> _held{false};
+	std::atomic<uint64_t> _numContended{0};
+};
+
+// Lock of the kernel heap's slab pool.
+// Contention is counted in a static member since the slab pool does not expose its lock.
+struct KernelHeapLock {
+	constexpr KernelHeapLock() = default;
+
+	void lock() {
+		irqMutex().lock();
+		bool contended = _held.load(std::memory_order_relaxed);
+		_spinlock.lock();
+		_held.store(true, std::memory_order_relaxed);
+		if(contended)
+			numContended.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		_held.store(false, std::memory_order_relaxed);
+		_spinlock.unlock();
+		irqMutex().unlock();
+	}
+
+	static constinit inline std::atomic<uint64_t> numContended{0};
+
+private:
+	frg::ticket_spinlock _spinlock;
+	std::atomic<bool> _held{false};
+};
+
+using KernelHeap = frg::slab_pool<KernelVirtualAlloc, KernelHeapLock>;
+
+// Per-CPU cache of small kernel heap objects.
+// Objects are cached in per-size-class magazines; full and empty magazines are
+// exchanged with a global depot such that objects can migrate between CPUs
+// without going through the slab pool (and its global lock).
+struct KernelHeapCache {
+	// Size classes are powers of two from 16 bytes up to maxCachedSize.
+	static constexpr int minClassShift = 4;
+	static constexpr int numSizeClasses = 9;
+	static constexpr size_t maxCachedSize = size_t{1} << (minClassShift + numSizeClasses - 1);
+
+	static constexpr size_t classSize(int sc) {
+		return size_t{1} << (minClassShift + sc);
+	}
+
+	// Returns the size class that serves allocations of the given size or -1.
+	static int sizeClassOf(size_t size) {
+		if(size > maxCachedSize)
+			return -1;
+		if(size <= classSize(0))
+			return 0;
+		return (64 - __builtin_clzll(size - 1)) - minClassShift;
+	}
+
+	// Number of objects per magazine. Larger classes use fewer objects
+	// to bound the amount of cached memory.
+	static constexpr size_t maxCapacity = 32;
+
+	static constexpr size_t capacity(int sc) {
+		auto n = (16 * size_t{1024}) / classSize(sc);
+		return n < maxCapacity ? n : maxCapacity;
+	}
+
+	struct Magazine {
+		Magazine *next = nullptr;
+		size_t count = 0;
+		void *objects[maxCapacity];
+	};
+
+	struct SizeClass {
+		// Magazine that allocations and frees operate on.
+		Magazine *loaded = nullptr;
+		// Either full or empty; swapped with loaded before going to the depot.
+		Magazine *previous = nullptr;
+
+		// Statistics. Only modified by the owning CPU with IRQs disabled.
+		uint64_t numAllocations = 0;
+		uint64_t numFrees = 0;
+		uint64_t numHits = 0;
+		uint64_t numDepotExchanges = 0;
+		uint64_t numPoolOperations = 0;
+	};
+
+	SizeClass classes[numSizeClasses];
+};
+
+struct KernelHeapClassStats {
+	size_t objectSize = 0;
+	uint64_t numAllocations = 0;
+	uint64_t numFrees = 0;
+	uint64_t numHits = 0;
+	uint64_t numDepotExchanges = 0;
+	uint64_t numPoolOperations = 0;
+	// Number of times that the depot lock of this class was found to be held.
+	uint64_t numDepotContended = 0;
+	size_t numCachedObjects = 0;
+};
+
+// Magazine layer in front of the kernel heap's slab pool.
+// Small allocations are always rounded up to their size class such that
+// cached objects can be handed out for any size within the class.
+// Since free() does not know the size of the object, it bypasses the cache.
+class KernelHeapFrontend {
+public:
+	KernelHeapFrontend(KernelHeap *pool)
+	: _pool{pool} { }
+
+	KernelHeapFrontend(const KernelHeapFrontend &) = delete;
+
+	KernelHeapFrontend &operator= (const KernelHeapFrontend &) = delete;
+
+	// Enables the per-CPU caches. Must only be called once the per-CPU data
+	// of the boot CPU is initialized.
+	void enablePerCpuCaches();
+
+	void *allocate(size_t size);
+	void deallocate(void *pointer, size_t size);
+	void free(void *pointer);
+
+	// Sums up the statistics of the given size class over all CPUs.
+	KernelHeapClassStats getClassStats(int sc);
+
+	// Returns how often the slab pool's lock was found to be held by another CPU.
+	uint64_t numPoolContended() {
+		return KernelHeapLock::numContended.load(std::memory_order_relaxed);
+	}
+
+private:
+	using Magazine = KernelHeapCache::Magazine;
+
+	struct Depot {
+		CountingSpinlock mutex;
+		Magazine *fullList = nullptr;
+		Magazine *emptyList = nullptr;
+		size_t numFull = 0;
+	};
+
+	// Upper bound on the number of full magazines per depot.
+	static constexpr size_t maxFullMagazines = 8;
+
+	void *_allocateCached(int sc);
+	void _freeCached(void *pointer, int sc);
+
+	KernelHeap *_pool;
+	std::atomic<bool> _cachesEnabled{false};
+	Depot _depots[KernelHeapCache::numSizeClasses];
+};
+
+// Allocator handle that is passed to containers and frg::construct().
+class KernelAlloc {
+public:
+	KernelAlloc(KernelHeapFrontend *frontend)
+	: _frontend{frontend} { }
+
+	void *allocate(size_t size) {
+		return _frontend->allocate(size);
+	}
+
+	void deallocate(void *pointer, size_t size) {
+		_frontend->deallocate(pointer, size);
+	}
+
+	void free(void *pointer) {
+		_frontend->free(pointer);
+	}
+
+private:
+	KernelHeapFrontend *_frontend;
+};
 
 extern constinit frg::manual_box<KernelVirtualAlloc> kernelVirtualAlloc;
 
-extern constinit frg::manual_box<
-	frg::slab_pool<
-		KernelVirtualAlloc,
-		IrqSpinlock
-	>
-> kernelHeap;
+extern constinit frg::manual_box<KernelHeap> kernelHeap;
+
+extern constinit frg::manual_box<KernelHeapFrontend> kernelHeapFrontend;
 
 extern constinit frg::manual_box<KernelAlloc> kernelAlloc;
 
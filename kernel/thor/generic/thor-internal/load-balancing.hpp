@@ -1,6 +1,5 @@
 #pragma once
 
-#include <async/barrier.hpp>
 #include <frg/span.hpp>
 #include <thor-internal/coroutine.hpp>
 #include <thor-internal/cpu-data.hpp>
@@ -99,12 +98,21 @@ struct LbNode {
 		>
 	> tasks;
 
-	// Constant during main phase of load balancing.
-	uint64_t totalLoad{0};
+	// Load of this CPU as computed by its last load balancing round.
+	// Read by other CPUs without holding mutex.
+	std::atomic<uint64_t> totalLoad{0};
 
-	// Equal to totalLoad before load balancing but updated during load balancing.
-	// Protected by mutex during main phase of load balancing.
+	// Equal to totalLoad after the load is computed but updated when tasks are moved.
+	// Protected by mutex.
 	uint64_t currentLoad{0};
+
+	// Number of load balancing rounds that this CPU did so far.
+	// Only accessed by the owning CPU.
+	uint64_t round{0};
+
+	// Time of the last attempt to steal work when going idle.
+	// Only accessed by the owning CPU.
+	uint64_t lastIdleSteal{0};
 };
 
 extern PerCpu<LbNode> lbNode;
@@ -120,6 +128,10 @@ struct LoadBalancer {
 	// Must be called on each CPU before threads can be moved to that CPU.
 	void setOnline(CpuData *cpu);
 
+	// Called by the idle task before the CPU halts.
+	// Moves a runnable thread from a busy CPU (preferring nearby CPUs) to this CPU.
+	void stealForIdle(CpuData *cpu);
+
 	// Attaches a thread to the load balancer.
 	// The load balancer keeps a weak reference to the thread.
 	// The thread is detached from the load balancer when the weak reference goes out of scope.
@@ -132,7 +144,8 @@ private:
 	// newLoad: newLoad at dstNode after balancing.
 	void balanceBetween_(LbNode *srcNode, LbNode *dstNode, uint64_t &newLoad, uint64_t idealLoad);
 
-	async::barrier barrier_;
+	// Moves a single runnable task from srcNode to dstNode. Returns true on success.
+	bool stealTask_(LbNode *srcNode, LbNode *dstNode);
 };
 
 } // namespace thor
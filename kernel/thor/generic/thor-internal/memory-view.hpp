@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 
 #include <async/algorithm.hpp>
@@ -38,6 +39,12 @@ struct CachePage {
 	static constexpr uint32_t reclaimPosted = 0x02;
 	// Page has been evicted (neither in the LRU, nor in the bundle list).
 	static constexpr uint32_t reclaimInflight = 0x04;
+	// Page is in a per-CPU batch and not yet inserted into the LRU lists.
+	static constexpr uint32_t reclaimBatched = 0x08;
+	// Page is in the active (instead of the inactive) LRU list.
+	static constexpr uint32_t reclaimActive = 0x10;
+	// Page was accessed since the reclaimer last looked at it.
+	static constexpr uint32_t reclaimReferenced = 0x20;
 
 	// CacheBundle that owns this page.
 	CacheBundle *bundle = nullptr;
@@ -49,13 +56,26 @@ struct CachePage {
 	// Hooks for LRU lists.
 	frg::default_list_hook<CachePage> listHook;
 
-	uint32_t flags = 0;
+	// CPU whose batch contains the page (only valid if reclaimBatched is set).
+	int batchCpu = -1;
+
+	// Atomic since reclaimReferenced is set without taking the reclaimer's lock.
+	std::atomic<uint32_t> flags{0};
 };
 
 // This is the "backend" part of a memory object.
 struct CacheBundle {
 	friend struct MemoryReclaimer;
 
+protected:
+	// Called by the reclaimer (with its lock held) after a page was posted to the bundle.
+	// By default, this wakes up awaitReclaim().
+	virtual void reclaimPosted();
+
+	// Protected by the reclaimer's lock. Bundles that start a reclaim worker
+	// in reclaimPosted() use this to track whether the worker is running.
+	bool _reclaimRunning = false;
+
 private:
 	frg::intrusive_list<
 		CachePage,
@@ -69,6 +89,21 @@ private:
 	async::recurring_event _reclaimEvent;
 };
 
+struct ReclaimStats {
+	size_t numActivePages = 0;
+	size_t numInactivePages = 0;
+	// Pages that were handed to their bundles for eviction.
+	size_t numPostedPages = 0;
+
+	uint64_t numScannedPages = 0;
+	uint64_t numActivatedPages = 0;
+	uint64_t numDeactivatedPages = 0;
+	uint64_t numReclaimedPages = 0;
+	uint64_t numWakeups = 0;
+};
+
+ReclaimStats getReclaimStats();
+
 struct GlobalFutexSpace {
 protected:
 	~GlobalFutexSpace() = default;
@@ -170,6 +205,8 @@ public:
 
 using FetchFlags = uint32_t;
 inline constexpr FetchFlags fetchDisallowBacking = 1;
+// The page's physical address is handed out (e.g., for DMA); never evict the page again.
+inline constexpr FetchFlags fetchPin = 2;
 
 using CachingFlags = uint32_t;
 inline constexpr CachingFlags cacheWriteCombine = 1;
@@ -276,7 +313,7 @@ public:
 
 	virtual size_t getLength() = 0;
 
-	virtual void resize(size_t newLength, async::any_receiver<void> receiver);
+	virtual void resize(size_t newLength, async::any_receiver<Error> receiver);
 
 	// Returns a unique identity for each memory address.
 	// This is used as a key to access futexes.
@@ -306,6 +343,15 @@ public:
 	// Result stays valid until the range is evicted.
 	virtual frg::tuple<PhysicalAddr, CachingMode> peekRange(uintptr_t offset) = 0;
 
+	// Returns the granularity at which this view is backed by physically contiguous memory,
+	// i.e., each naturally aligned range of this size is contiguous once it is present.
+	// This is used to decide whether mappings of this view can use huge pages.
+	virtual size_t contiguousGranularity();
+
+	// Like peekRange() but only succeeds if the entire (naturally aligned) range
+	// is present, physically contiguous and is never evicted page by page.
+	virtual frg::tuple<PhysicalAddr, CachingMode> peekContiguousRange(uintptr_t offset, size_t size);
+
 	// Makes a range of memory available for peekRange().
 	virtual coroutine<frg::expected<Error>>
 	touchRange(uintptr_t offset, size_t size, FetchFlags flags, smarter::shared_ptr<WorkQueue> wq);
@@ -324,6 +370,9 @@ public:
 	// Called (e.g. by user space) to update a range after loading or writeback.
 	virtual Error updateRange(ManageRequest type, size_t offset, size_t length);
 
+	// Hints that a range will be accessed soon; views may start loading it.
+	virtual void loadahead(uintptr_t offset, size_t length);
+
 	virtual Error setIndirection(size_t slot, smarter::shared_ptr<MemoryView> view,
 			uintptr_t offset, size_t size, CachingFlags flags);
 
@@ -351,6 +400,8 @@ public:
 	struct ResizeOperation;
 
 	struct [[nodiscard]] ResizeSender {
+		using value_type = Error;
+
 		template<typename R>
 		friend ResizeOperation<R>
 		connect(ResizeSender sender, R receiver) {
@@ -383,7 +434,7 @@ public:
 		R receiver_;
 	};
 
-	friend async::sender_awaiter<ResizeSender>
+	friend async::sender_awaiter<ResizeSender, Error>
 	operator co_await(ResizeSender sender) {
 		return {sender};
 	}
@@ -712,7 +763,7 @@ struct ImmediateMemory final : MemoryView, GlobalFutexSpace {
 	ImmediateMemory &operator= (const ImmediateMemory &) = delete;
 
 	size_t getLength() override;
-	void resize(size_t newLength, async::any_receiver<void> receiver) override;
+	void resize(size_t newLength, async::any_receiver<Error> receiver) override;
 	frg::expected<Error, frg::tuple<smarter::shared_ptr<GlobalFutexSpace>, uintptr_t>>
 			resolveGlobalFutex(uintptr_t offset) override;
 	Error lockRange(uintptr_t offset, size_t size) override;
@@ -732,9 +783,7 @@ struct ImmediateMemory final : MemoryView, GlobalFutexSpace {
 	}
 
 	ImmediateFutex getImmediateFutex(uintptr_t offset) {
-		auto index = offset >> kPageShift;
-		assert(index < _physicalPages.size());
-		return {this, offset, _physicalPages[index]};
+		return {this, offset, _pageAt(offset >> kPageShift)};
 	}
 
 	template<typename T>
@@ -743,9 +792,7 @@ struct ImmediateMemory final : MemoryView, GlobalFutexSpace {
 		auto misalign = offset & (kPageSize - 1);
 		assert(misalign + sizeof(T) <= kPageSize);
 
-		auto index = offset >> kPageShift;
-		assert(index < _physicalPages.size());
-		PageAccessor accessor{_physicalPages[index]};
+		PageAccessor accessor{_pageAt(offset >> kPageShift)};
 		return reinterpret_cast<T *>(
 				reinterpret_cast<std::byte *>(accessor.get()) + misalign);
 	}
@@ -756,9 +803,7 @@ struct ImmediateMemory final : MemoryView, GlobalFutexSpace {
 			auto misalign = (offset + progress) & (kPageSize - 1);
 			auto chunk = frg::min(size - progress, kPageSize - misalign);
 
-			auto index = (offset + progress) >> kPageShift;
-			assert(index < _physicalPages.size());
-			PageAccessor accessor{_physicalPages[index]};
+			PageAccessor accessor{_pageAt((offset + progress) >> kPageShift)};
 			memcpy(reinterpret_cast<std::byte *>(accessor.get()) + misalign,
 					reinterpret_cast<std::byte *>(pointer) + progress, chunk);
 			progress += chunk;
@@ -769,6 +814,15 @@ public:
 	// Contract: set by the code that constructs this object.
 	smarter::borrowed_ptr<ImmediateMemory> selfPtr;
 private:
+	// _physicalPages can be reallocated by resize(), hence we need to take the lock.
+	PhysicalAddr _pageAt(size_t index) {
+		auto irqLock = frg::guard(&irqMutex());
+		auto lock = frg::guard(&_mutex);
+
+		assert(index < _physicalPages.size());
+		return _physicalPages[index];
+	}
+
 	frg::ticket_spinlock _mutex;
 
 	frg::vector<PhysicalAddr, KernelAlloc> _physicalPages;
@@ -787,6 +841,9 @@ struct HardwareMemory final : MemoryView {
 	Error lockRange(uintptr_t offset, size_t size) override;
 	void unlockRange(uintptr_t offset, size_t size) override;
 	frg::tuple<PhysicalAddr, CachingMode> peekRange(uintptr_t offset) override;
+	size_t contiguousGranularity() override;
+	frg::tuple<PhysicalAddr, CachingMode> peekContiguousRange(uintptr_t offset,
+			size_t size) override;
 	coroutine<frg::expected<Error, PhysicalRange>>
 			fetchRange(uintptr_t offset, FetchFlags flags,
 			smarter::shared_ptr<WorkQueue> wq) override;
@@ -807,12 +864,15 @@ struct AllocatedMemory final : MemoryView, GlobalFutexSpace {
 	AllocatedMemory &operator= (const AllocatedMemory &) = delete;
 
 	size_t getLength() override;
-	void resize(size_t newLength, async::any_receiver<void> receiver) override;
+	void resize(size_t newLength, async::any_receiver<Error> receiver) override;
 	frg::expected<Error, frg::tuple<smarter::shared_ptr<GlobalFutexSpace>, uintptr_t>>
 			resolveGlobalFutex(uintptr_t offset) override;
 	Error lockRange(uintptr_t offset, size_t size) override;
 	void unlockRange(uintptr_t offset, size_t size) override;
 	frg::tuple<PhysicalAddr, CachingMode> peekRange(uintptr_t offset) override;
+	size_t contiguousGranularity() override;
+	frg::tuple<PhysicalAddr, CachingMode> peekContiguousRange(uintptr_t offset,
+			size_t size) override;
 	coroutine<frg::expected<Error, PhysicalRange>>
 			fetchRange(uintptr_t offset, FetchFlags flags,
 			smarter::shared_ptr<WorkQueue> wq) override;
@@ -858,9 +918,15 @@ struct ManagedSpace : CacheBundle {
 		PhysicalAddr physical = PhysicalAddr(-1);
 		LoadState loadState = kStateMissing;
 		unsigned int lockCount = 0;
+		// Accessing this page triggers the next readahead window.
+		bool readaheadMarker = false;
 		CachePage cachePage;
 	};
 
+	// Bounds for the size of the readahead window (in pages).
+	static constexpr size_t minReadaheadPages = 4;
+	static constexpr size_t maxReadaheadPages = 128;
+
 	// Calls management callbacks from a WQ; required to implement markDirty().
 	struct DeferredManagement {
 		void setUp() {
@@ -898,6 +964,12 @@ struct ManagedSpace : CacheBundle {
 	void _progressManagement(ManageList &pending);
 	void _progressMonitors(MonitorList &pending);
 
+	// The following functions must be called with the mutex held.
+	void _queueInitialization(size_t index, size_t count);
+	void _readaheadOnMiss(size_t index);
+	void _readaheadOnMarker(ManagedPage *pit);
+	void _startReadahead(size_t index, size_t count);
+
 	smarter::borrowed_ptr<ManagedSpace> selfPtr;
 
 	frg::ticket_spinlock mutex;
@@ -907,6 +979,13 @@ struct ManagedSpace : CacheBundle {
 	size_t numPages;
 	bool readahead;
 
+	// Current readahead window. Sequential faults grow the window up to
+	// maxReadaheadPages while random faults collapse it to minReadaheadPages.
+	struct {
+		size_t start = 0;
+		size_t size = 0;
+	} _readaheadWindow;
+
 	EvictionQueue _evictQueue;
 
 	frg::intrusive_list<
@@ -943,7 +1022,7 @@ public:
 	BackingMemory &operator= (const BackingMemory &) = delete;
 
 	size_t getLength() override;
-	void resize(size_t newLength, async::any_receiver<void> receiver) override;
+	void resize(size_t newLength, async::any_receiver<Error> receiver) override;
 	frg::expected<Error, frg::tuple<smarter::shared_ptr<GlobalFutexSpace>, uintptr_t>>
 			resolveGlobalFutex(uintptr_t offset) override;
 	Error lockRange(uintptr_t offset, size_t size) override;
@@ -979,6 +1058,7 @@ public:
 			fetchRange(uintptr_t offset, FetchFlags flags,
 			smarter::shared_ptr<WorkQueue> wq) override;
 	void markDirty(uintptr_t offset, size_t size) override;
+	void loadahead(uintptr_t offset, size_t length) override;
 
 	coroutine<frg::expected<Error, PhysicalAddr>> takeGlobalFutex(uintptr_t offset,
 			smarter::shared_ptr<WorkQueue> wq) override;
@@ -1039,26 +1119,70 @@ enum class CowState {
 	hasCopy
 };
 
+struct CompressedPage;
+
+// Page that is owned by a CopyOnWriteMemory. Stored inline in the radix tree.
 struct CowPage {
-	~CowPage();
+	CowPage(CacheBundle *bundle, uint64_t identity) {
+		cachePage.bundle = bundle;
+		cachePage.identity = identity;
+	}
 
-	PhysicalAddr physical = -1;
+	CowPage(const CowPage &) = delete;
+
+	CowPage &operator= (const CowPage &) = delete;
+
+	PhysicalAddr physical = PhysicalAddr(-1);
 	CowState state = CowState::null;
 	unsigned int lockCount = 0;
+
+	// Pages that are neither locked nor pinned are registered with the reclaimer.
+	// Once evicted, they are swapped out to the compressed store.
+	bool pinned = false;
+	bool evicting = false;
+	CompressedPage *compressed = nullptr;
+	CachePage cachePage;
 };
 
+// Pages that are shared by CopyOnWriteMemory objects after fork().
+// Chains form a tree: lookups that miss in a chain continue in its parent.
+// Each physical page is owned by exactly one chain; chains only store its address.
 struct CowChain {
-	CowChain();
+	CowChain(smarter::shared_ptr<CowChain> parent, uintptr_t offset, size_t length);
+
+	CowChain(const CowChain &) = delete;
 
 	~CowChain();
 
+	CowChain &operator= (const CowChain &) = delete;
+
+	// The following functions must be called with _mutex held.
+	// Pages are indexed by their offset in the root view (in units of pages).
+	void insertPage(uint64_t index, PhysicalAddr physical);
+	void removePage(uint64_t index);
+
+	// Merges ancestors that are only observable through this chain into this chain.
+	// Must be called without holding any chain's _mutex.
+	void collapse();
+
 // TODO: Either this private again or make this class POD-like.
 	frg::ticket_spinlock _mutex;
 
-	frg::rcu_radixtree<smarter::shared_ptr<CowPage>, KernelAlloc> _pages;
+	// Range of the root view that is covered by this chain.
+	uintptr_t _offset;
+	size_t _length;
+
+	smarter::shared_ptr<CowChain> _parent;
+	frg::rcu_radixtree<PhysicalAddr, KernelAlloc> _pages;
+	size_t _numPages = 0;
+
+	// Number of CopyOnWriteMemory objects that use this chain
+	// and number of chains whose parent is this chain.
+	unsigned int _numViews = 0;
+	unsigned int _numChildren = 0;
 };
 
-struct CopyOnWriteMemory final : MemoryView, GlobalFutexSpace /*, MemoryObserver */ {
+struct CopyOnWriteMemory final : MemoryView, GlobalFutexSpace, CacheBundle /*, MemoryObserver */ {
 public:
 	CopyOnWriteMemory(smarter::shared_ptr<MemoryView> view,
 			uintptr_t offset, size_t length,
@@ -1087,17 +1211,29 @@ public:
 			smarter::shared_ptr<WorkQueue> wq) override;
 	void retireGlobalFutex(uintptr_t offset) override;
 
+protected:
+	void reclaimPosted() override;
+
 public:
 	// Contract: set by the code that constructs this object.
 	smarter::borrowed_ptr<CopyOnWriteMemory> selfPtr;
 private:
+	// The following functions must be called with _mutex held.
+	CowPage *_makePage(size_t index);
+	PhysicalAddr _copyFromChain(size_t index);
+	void _swapIn(CowPage *page);
+	void _retainPage(CowPage *page);
+	void _accessPage(CowPage *page, FetchFlags flags);
+	void _lockPage(CowPage *page);
+	void _unlockPage(CowPage *page);
+
 	frg::ticket_spinlock _mutex;
 
 	smarter::shared_ptr<MemoryView> _view;
 	uintptr_t _viewOffset;
 	size_t _length;
 	smarter::shared_ptr<CowChain> _copyChain;
-	frg::rcu_radixtree<smarter::shared_ptr<CowPage>, KernelAlloc> _ownedPages;
+	frg::rcu_radixtree<CowPage, KernelAlloc> _ownedPages;
 	async::recurring_event _copyEvent;
 	EvictionQueue _evictQueue;
 };
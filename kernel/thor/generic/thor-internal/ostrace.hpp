@@ -5,6 +5,7 @@
 #include <bragi/helpers-all.hpp>
 #include <bragi/helpers-frigg.hpp>
 #include <frg/span.hpp>
+#include <thor-internal/arch-generic/timer.hpp>
 #include <thor-internal/main.hpp>
 #include <thor-internal/ring-buffer.hpp>
 #include <ostrace.frigg_bragi.hpp>
@@ -22,8 +23,107 @@ namespace ostrace {
 // Set by the ostrace code one in-kernel ostrace is available.
 extern std::atomic<bool> available;
 
+// Per-CPU ring of ostrace records.
+// The only producer is the owning CPU (with IRQs disabled), the only consumer is
+// the fiber that merges all per-CPU rings into the global ostrace ring.
+// Records are written in place; if the ring is full, new records are dropped
+// (instead of overwriting old ones) such that drops can be accounted for.
+struct CpuRing {
+	static constexpr size_t ringSize = size_t{1} << 16;
+
+	// Reserves size contiguous bytes for a record with timestamp ts.
+	// Returns nullptr if there is not enough free space.
+	char *reserve(size_t size, uint64_t ts) {
+		auto headPtr = headPtr_.load(std::memory_order_relaxed);
+		auto tailPtr = tailPtr_.load(std::memory_order_acquire);
+		auto effective = effectiveSize(size);
+		if(effective > ringSize / 4)
+			return nullptr;
+
+		// Records never wrap around; skip the end of the ring instead.
+		auto offset = headPtr & (ringSize - 1);
+		size_t skip = 0;
+		if(offset + effective > ringSize)
+			skip = ringSize - offset;
+		if(headPtr + skip + effective - tailPtr > ringSize)
+			return nullptr;
+
+		if(skip) {
+			Header marker{.size = skipMarker, .reserved = 0, .ts = 0};
+			memcpy(buffer_ + offset, &marker, sizeof(uint32_t));
+			headPtr += skip;
+			offset = 0;
+		}
+
+		Header hdr{.size = static_cast<uint32_t>(size), .reserved = 0, .ts = ts};
+		memcpy(buffer_ + offset, &hdr, sizeof(Header));
+		pendingPtr_ = headPtr + effective;
+		return buffer_ + offset + sizeof(Header);
+	}
+
+	// Makes the record from the last reserve() call visible to the consumer.
+	void commit() {
+		headPtr_.store(pendingPtr_, std::memory_order_release);
+	}
+
+	uint64_t peekHeadPtr() {
+		return headPtr_.load(std::memory_order_acquire);
+	}
+
+	// Returns the oldest record before limitPtr (or nullptr if there is none).
+	// Called by the consumer.
+	const char *front(uint64_t limitPtr, size_t &size, uint64_t &ts) {
+		auto tailPtr = tailPtr_.load(std::memory_order_relaxed);
+		while(tailPtr != limitPtr) {
+			auto offset = tailPtr & (ringSize - 1);
+			Header hdr;
+			memcpy(&hdr.size, buffer_ + offset, sizeof(uint32_t));
+			if(hdr.size == skipMarker) {
+				tailPtr += ringSize - offset;
+				tailPtr_.store(tailPtr, std::memory_order_release);
+				continue;
+			}
+			memcpy(&hdr, buffer_ + offset, sizeof(Header));
+			size = hdr.size;
+			ts = hdr.ts;
+			return buffer_ + offset + sizeof(Header);
+		}
+		return nullptr;
+	}
+
+	// Removes the record returned by front(). Called by the consumer.
+	void pop(size_t size) {
+		auto tailPtr = tailPtr_.load(std::memory_order_relaxed);
+		tailPtr_.store(tailPtr + effectiveSize(size), std::memory_order_release);
+	}
+
+private:
+	struct Header {
+		uint32_t size;
+		uint32_t reserved;
+		uint64_t ts;
+	};
+
+	static constexpr uint32_t skipMarker = 0xFFFF'FFFF;
+
+	static size_t effectiveSize(size_t size) {
+		return (sizeof(Header) + size + 7) & ~size_t(7);
+	}
+
+	// Only accessed by the producer.
+	uint64_t pendingPtr_{0};
+
+	std::atomic<uint64_t> headPtr_{0};
+	std::atomic<uint64_t> tailPtr_{0};
+	alignas(8) char buffer_[ringSize];
+};
+
 struct Context {
-	frg::vector<char, KernelAlloc> buffer{*kernelAlloc};
+	// Allocated by the ostrace fiber once the CPU is online.
+	std::atomic<CpuRing *> ring{nullptr};
+
+	// Number of records that were dropped on this CPU.
+	std::atomic<uint64_t> numDropped{0};
 };
 
 extern PerCpu<Context> context;
@@ -78,13 +178,24 @@ struct UintAttribute : Term {
 	}
 };
 
+// Reserves space for a record of the given size on the current CPU and returns a pointer
+// to it (or nullptr if the record is dropped). Must be called with IRQs disabled.
+char *reserveRecord(size_t size, uint64_t ts);
+
+// Makes the record from the last reserveRecord() call visible.
+void commitRecord();
+
 template<typename... Args>
 void emit(const Event &event, Args... args) {
 	if (!available.load(std::memory_order_relaxed))
 		return;
 
+	auto irqLock = frg::guard(&irqMutex());
+	auto ts = getClockNanos();
+
 	managarm::ostrace::EventRecord<KernelAlloc> eventRecord{*kernelAlloc};
 	eventRecord.set_id(static_cast<uint64_t>(event.id()));
+	eventRecord.set_ts(ts);
 
 	managarm::ostrace::EndOfRecord<KernelAlloc> endOfRecord{*kernelAlloc};
 
@@ -98,28 +209,25 @@ void emit(const Event &event, Args... args) {
 	(determineSize(args), ...);
 	determineSize(endOfRecord);
 
-	{
-		auto irqLock = frg::guard(&irqMutex());
-		auto *ctx = &context.get();
-
-		ctx->buffer.resize(size);
-
-		// Emit all records to the buffer.
-		size_t offset = 0;
-		auto emitMsg = [&] (auto &msg) {
-			auto ts = msg.size_of_tail();
-			bool encodeSuccess = bragi::write_head_tail(msg,
-					frg::span<char>(ctx->buffer.data() + offset, 8),
-					frg::span<char>(ctx->buffer.data() + offset + 8, ts));
-			assert(encodeSuccess);
-			offset += 8 + ts;
-		};
-		emitMsg(eventRecord);
-		(emitMsg(args), ...);
-		emitMsg(endOfRecord);
-
-		emitBuffer({ctx->buffer.data(), size});
-	}
+	auto buffer = reserveRecord(size, ts);
+	if(!buffer)
+		return;
+
+	// Serialize all records directly into the ring.
+	size_t offset = 0;
+	auto emitMsg = [&] (auto &msg) {
+		auto ts = msg.size_of_tail();
+		bool encodeSuccess = bragi::write_head_tail(msg,
+				frg::span<char>(buffer + offset, 8),
+				frg::span<char>(buffer + offset + 8, ts));
+		assert(encodeSuccess);
+		offset += 8 + ts;
+	};
+	emitMsg(eventRecord);
+	(emitMsg(args), ...);
+	emitMsg(endOfRecord);
+
+	commitRecord();
 }
 
 } // namespace ostrace
@@ -114,17 +114,81 @@ void poisonPhysicalAccess(PhysicalAddr physical);
 void poisonPhysicalWriteAccess(PhysicalAddr physical);
 
 
+// Per-CPU cache of small-order physical chunks.
+// Allocations and frees of these orders are served from the local magazines
+// without touching the global lock; magazines are refilled from (and drained to)
+// the buddy allocator in batches.
+struct PhysicalPageCache {
+	static constexpr int numCachedOrders = 4;
+
+	// Number of chunks that a magazine of the given order can hold.
+	// Higher orders hold fewer chunks to bound the amount of cached memory.
+	static constexpr size_t capacity(int order) {
+		return size_t{64} >> order;
+	}
+
+	// Number of chunks that are moved between the magazine and the buddy allocator at once.
+	static constexpr size_t batchSize(int order) {
+		return capacity(order) / 2;
+	}
+
+	struct Magazine {
+		PhysicalAddr chunks[capacity(0)];
+		size_t count = 0;
+	};
+
+	Magazine magazines[numCachedOrders];
+
+	// Statistics. Only modified by the owning CPU with IRQs disabled.
+	uint64_t numHits = 0;
+	uint64_t numMisses = 0;
+	uint64_t numRefills = 0;
+	uint64_t numDrains = 0;
+};
+
+struct PhysicalCacheStats {
+	uint64_t numHits = 0;
+	uint64_t numMisses = 0;
+	uint64_t numRefills = 0;
+	uint64_t numDrains = 0;
+	size_t numCachedPages = 0;
+};
+
 class PhysicalChunkAllocator {
 	typedef frg::ticket_spinlock Mutex;
 public:
 	PhysicalChunkAllocator();
 	
+	// Adds a region of memory that is managed by the given buddy tree.
+	// numaNode identifies the NUMA node that the region belongs to; it is currently
+	// only recorded and not yet taken into account by allocate().
 	void bootstrapRegion(PhysicalAddr address,
-			int order, size_t numRoots, int8_t *buddyTree);
+			int order, size_t numRoots, int8_t *buddyTree, int numaNode = 0);
+
+	// Enables the per-CPU caches. Must only be called once the per-CPU data
+	// of the boot CPU is initialized.
+	void enablePerCpuCaches();
 
 	PhysicalAddr allocate(size_t size, int addressBits = 64);
 	void free(PhysicalAddr address, size_t size);
 
+	// Returns all chunks in the current CPU's cache to the buddy allocator.
+	void drainLocalCache();
+
+	// Sums up the statistics of all per-CPU caches.
+	PhysicalCacheStats getCacheStats();
+
+	// Installs a callback that is invoked once an allocation leaves fewer than
+	// lowPages free pages. The callback is not invoked again until the number of free
+	// pages recovers to highPages or until rearmLowWatermark() is called.
+	// This is used to wake up memory reclaim; the callback must be safe to call
+	// from any context that allocates memory.
+	void setWatermarks(size_t lowPages, size_t highPages, void (*callback)());
+
+	void rearmLowWatermark() {
+		_lowWatermarkArmed.store(true, std::memory_order_relaxed);
+	}
+
 	size_t numTotalPages() {
 		return _totalPages.load(std::memory_order_relaxed);
 	}
@@ -136,20 +200,45 @@ public:
 	}
 
 private:
-	Mutex _mutex;
-
 	struct Region {
 		PhysicalAddr physicalBase;
 		PhysicalAddr regionSize;
 		BuddyAccessor buddyAccessor;
+		int numaNode;
 	};
 
-	Region _allRegions[8];
-	int _numRegions = 0;
+	PhysicalAddr _allocateFromBuddy(int order, int addressBits);
+	void _freeToBuddy(PhysicalAddr address, int order);
+	Region *_findRegion(PhysicalAddr address);
+
+	// Allocates memory for allocator meta data (i.e., the region table and buddy summaries).
+	// This memory is never freed.
+	void *_allocateMetadata(size_t size);
+
+	Mutex _mutex;
+
+	std::atomic<bool> _cachesEnabled{false};
+
+	// Table of all regions, sorted by physicalBase.
+	// Initially, this points to _initialRegions; it is moved to memory
+	// obtained from _allocateMetadata() once more regions are added.
+	Region _initialRegions[8];
+	Region *_regions = _initialRegions;
+	size_t _numRegions = 0;
+	size_t _regionCapacity = 8;
+
+	// Current chunk from which _allocateMetadata() allocates.
+	uintptr_t _metadataPtr = 0;
+	size_t _metadataSpace = 0;
 
 	std::atomic<size_t> _totalPages{0};
 	std::atomic<size_t> _usedPages{0};
 	std::atomic<size_t> _freePages{0};
+
+	std::atomic<size_t> _lowWatermark{0};
+	std::atomic<size_t> _highWatermark{0};
+	std::atomic<bool> _lowWatermarkArmed{true};
+	std::atomic<void (*)()> _lowWatermarkCallback{nullptr};
 };
 
 extern constinit frg::manual_box<PhysicalChunkAllocator> physicalAllocator;
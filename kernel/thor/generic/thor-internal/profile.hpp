@@ -6,6 +6,27 @@ namespace thor {
 
 extern bool wantKernelProfile;
 
+// Layout of the samples in the kernel profile ring.
+// Each sample is followed by numKernelFrames + numUserFrames return addresses
+// (innermost frame first). The first kernel (or user) frame is the interrupted IP.
+struct ProfileSample {
+	static constexpr uint32_t sampleMagic = 0x5350'5254; // "TRPS" in little endian.
+	static constexpr size_t maxKernelFrames = 32;
+	static constexpr size_t maxUserFrames = 32;
+	static constexpr size_t maxSize = 32 + (maxKernelFrames + maxUserFrames) * sizeof(uint64_t);
+
+	uint32_t magic;
+	uint16_t cpu;
+	uint8_t numKernelFrames;
+	uint8_t numUserFrames;
+	// First 8 bytes of the thread's credentials (or zero for kernel fibers and idle).
+	uint64_t threadId;
+	// Identifies the universe of the thread (or zero).
+	uint64_t universeId;
+	uint64_t reserved;
+};
+static_assert(sizeof(ProfileSample) == 32);
+
 void initializeProfile();
 LogRingBuffer *getGlobalProfileRing();
 
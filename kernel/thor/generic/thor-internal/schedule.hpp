@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
 
 #include <frg/list.hpp>
 #include <frg/pairing_heap.hpp>
@@ -164,6 +165,12 @@ public:
 
 	ScheduleEntity *currentRunnable();
 
+	// Number of entities that wait to be scheduled on this scheduler.
+	// Can be called from other CPUs; the result may be slightly out of date.
+	size_t numWaitingHint() {
+		return _numWaitingHint.load(std::memory_order_relaxed);
+	}
+
 private:
 	void _unschedule();
 	void _schedule();
@@ -192,6 +199,8 @@ private:
 	> _waitQueue;
 
 	size_t _numWaiting = 0;
+	// Copy of _numWaiting that is published to other CPUs.
+	std::atomic<size_t> _numWaitingHint{0};
 
 	// See mustCallPreemption().
 	bool _mustCallPreemption{false};
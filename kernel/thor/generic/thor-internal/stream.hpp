@@ -77,8 +77,15 @@ inline bool usesFlowProtocol(int tag) {
 struct FlowPacket {
 	void *data = nullptr;
 	size_t size = 0;
+	// If space is set, the receiver copies size bytes from address in the sender's
+	// space directly to its own buffer (instead of copying from data).
+	// The sender keeps the space alive until the packet is acked.
+	VirtualSpace *space = nullptr;
+	uintptr_t address = 0;
 	bool terminate = false;
 	bool fault = false;
+	// Set in acks of direct transfers if the sender's buffer faulted.
+	bool sourceFault = false;
 };
 
 struct StreamNode {
@@ -123,6 +130,32 @@ public:
 	frg::unique_memory<KernelAlloc> _inBuffer;
 	AnyDescriptor _inDescriptor;
 
+	// For kTagRecvKernelBuffer: the receiver can consume data from _inlineData.
+	// Otherwise, the data is always delivered via _transmitBuffer.
+	bool _acceptsInline = false;
+
+	// Small payloads are stored inline to avoid allocating a buffer.
+	// For kTagSendKernelBuffer, this is an input (instead of _inBuffer),
+	// for kTagRecvKernelBuffer, it is an output (instead of _transmitBuffer).
+	static constexpr size_t inlineCapacity = 128;
+
+	bool _isInline = false;
+	size_t _inlineLength = 0;
+	alignas(8) char _inlineData[inlineCapacity];
+
+	// Data of a kTagSendKernelBuffer node.
+	const void *inData() {
+		if(_isInline)
+			return _inlineData;
+		return _inBuffer.data();
+	}
+
+	size_t inSize() {
+		if(_isInline)
+			return _inlineLength;
+		return _inBuffer.size();
+	}
+
 	StreamNode *peerNode = nullptr;
 
 	async::oneshot_event issueFlow;
@@ -160,6 +193,19 @@ public:
 		return std::move(_transmitBuffer);
 	}
 
+	// Data received by a kTagRecvKernelBuffer node.
+	void *transmitData() {
+		if(_isInline)
+			return _inlineData;
+		return _transmitBuffer.data();
+	}
+
+	size_t transmitSize() {
+		if(_isInline)
+			return _inlineLength;
+		return _transmitBuffer.size();
+	}
+
 	const frg::array<char, 16> &transmitCredentials() {
 		return _transmitCredentials;
 	}
@@ -372,6 +372,9 @@ public:
 		return _loadLevel.load(std::memory_order_relaxed);
 	}
 
+	// Returns true if the thread is running or waiting in a scheduler queue.
+	bool isRunnable();
+
 	LbControlBlock *_lbCb{nullptr};
 
 private:
@@ -6,6 +6,7 @@
 #include <async/cancellation.hpp>
 #include <frg/container_of.hpp>
 #include <frg/intrusive.hpp>
+#include <frg/list.hpp>
 #include <frg/pairing_heap.hpp>
 #include <frg/spinlock.hpp>
 #include <thor-internal/arch-generic/timer.hpp>
@@ -59,14 +60,28 @@ struct PrecisionTimerNode {
 		_elapsed = elapsed;
 	}
 
+	// Allows the timer to fire up to slack nanoseconds after the deadline.
+	// This enables the engine to coalesce wakeups; timers with a slack of at least
+	// PrecisionTimerEngine::wheelTick are kept in a timer wheel instead of the heap.
+	void setSlack(uint64_t slack) {
+		_slack = slack;
+	}
+
 	bool wasCancelled() {
 		return _wasCancelled;
 	}
 
 	frg::pairing_heap_hook<PrecisionTimerNode> hook;
+	frg::default_list_hook<PrecisionTimerNode> wheelHook;
 
 private:
+	// Latest point in time at which the timer is allowed to fire.
+	uint64_t latest_() const {
+		return _deadline + _slack;
+	}
+
 	uint64_t _deadline;
+	uint64_t _slack = 0;
 	async::cancellation_token _cancelToken;
 	Worklet *_elapsed;
 
@@ -75,12 +90,16 @@ private:
 
 	TimerState _state = TimerState::none;
 	bool _wasCancelled = false;
+	// Only valid while the timer is queued.
+	bool _inWheel = false;
+	int _wheelLevel;
+	int _wheelSlot;
 	async::cancellation_observer<CancelFunctor> _cancelCb;
 };
 
 struct CompareTimer {
 	bool operator() (const PrecisionTimerNode *a, const PrecisionTimerNode *b) const {
-		return a->_deadline > b->_deadline;
+		return a->latest_() > b->latest_();
 	}
 };
 
@@ -115,14 +134,17 @@ public:
 		PrecisionTimerEngine *self;
 		uint64_t deadline;
 		async::cancellation_token cancellation;
+		uint64_t slack;
 	};
 
-	SleepSender sleep(uint64_t deadline, async::cancellation_token cancellation = {}) {
-		return {this, deadline, cancellation};
+	SleepSender sleep(uint64_t deadline, async::cancellation_token cancellation = {},
+			uint64_t slack = 0) {
+		return {this, deadline, cancellation, slack};
 	}
 
-	SleepSender sleepFor(uint64_t nanos, async::cancellation_token cancellation = {}) {
-		return {this, getClockNanos() + nanos, cancellation};
+	SleepSender sleepFor(uint64_t nanos, async::cancellation_token cancellation = {},
+			uint64_t slack = 0) {
+		return {this, getClockNanos() + nanos, cancellation, slack};
 	}
 
 	template<typename R>
@@ -139,7 +161,8 @@ public:
 				auto op = frg::container_of(base, &SleepOperation::worklet_);
 				async::execution::set_value(op->receiver_);
 			}, WorkQueue::generalQueue());
-			node_.setup(s_.deadline, &worklet_);
+			node_.setup(s_.deadline, s_.cancellation, &worklet_);
+			node_.setSlack(s_.slack);
 			s_.self->installTimer(&node_);
 		}
 
@@ -163,8 +186,27 @@ private:
 public:
 	void firedAlarm();
 
+	// Granularity of the timer wheel. Timers with at least this much slack
+	// are put into the wheel (if their deadline is within its range).
+	static constexpr int wheelTickShift = 20; // About 1ms.
+	static constexpr uint64_t wheelTick = uint64_t{1} << wheelTickShift;
+
 private:
+	// The timer wheel is hierarchical: each slot of level k covers 64^k ticks.
+	// Timers are moved (cascaded) to lower levels as time advances.
+	static constexpr int wheelLevels = 4;
+	static constexpr int wheelSlotShift = 6;
+	static constexpr int wheelSlots = 1 << wheelSlotShift;
+
 	void _progress();
+	void _fire(PrecisionTimerNode *timer);
+
+	bool _insertIntoWheel(PrecisionTimerNode *timer);
+	void _removeFromWheel(PrecisionTimerNode *timer);
+	// Returns the next tick at which the wheel has to do work or UINT64_MAX.
+	uint64_t _nextWheelEvent();
+	// Processes all ticks up to the given point in time.
+	void _advanceWheel(uint64_t current);
 
 	CpuData *_ourCpu;
 
@@ -180,13 +222,32 @@ private:
 		CompareTimer
 	> _timerQueue;
 
-	size_t _activeTimers;
+	using WheelList = frg::intrusive_list<
+		PrecisionTimerNode,
+		frg::locate_member<
+			PrecisionTimerNode,
+			frg::default_list_hook<PrecisionTimerNode>,
+			&PrecisionTimerNode::wheelHook
+		>
+	>;
+
+	WheelList _wheel[wheelLevels][wheelSlots];
+	// Bitmap of non-empty slots per level.
+	uint64_t _wheelOccupied[wheelLevels] = {};
+	// First tick that was not processed yet.
+	uint64_t _wheelNow = 0;
+	size_t _wheelTimers = 0;
+
+	size_t _activeTimers = 0;
 };
 
 inline void PrecisionTimerNode::CancelFunctor::operator() () {
 	node_->_engine->cancelTimer(node_);
 }
 
+// Slack of timers that are armed on behalf of user space.
+inline constexpr uint64_t userTimerSlack = 50'000;
+
 PrecisionTimerEngine *generalTimerEngine();
 
 // Schedules preemption to happen when the monotonic clock reaches the
@@ -650,6 +650,14 @@ void Thread::updateLoad() {
 	_loadLevel.store(factor, std::memory_order_relaxed);
 }
 
+bool Thread::isRunnable() {
+	auto irqLock = frg::guard(&irqMutex());
+	auto lock = frg::guard(&_mutex);
+
+	return _runState == kRunActive || _runState == kRunSuspended
+			|| _runState == kRunDeferred;
+}
+
 void Thread::decayLoad(uint64_t decayFactor, int decayScale) {
 	auto irqLock = frg::guard(&irqMutex());
 	auto lock = frg::guard(&_mutex);
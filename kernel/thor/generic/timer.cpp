@@ -124,7 +124,11 @@ void PrecisionTimerEngine::installTimer(PrecisionTimerNode *timer) {
 		return;
 	}
 
-	_timerQueue.push(timer);
+	// The wheel has to be up-to-date before we can insert relative to _wheelNow.
+	_advanceWheel(getClockNanos());
+
+	if(!_insertIntoWheel(timer))
+		_timerQueue.push(timer);
 	_activeTimers++;
 	timer->_state = TimerState::queued;
 
@@ -136,7 +140,11 @@ void PrecisionTimerEngine::cancelTimer(PrecisionTimerNode *timer) {
 	auto lock = frg::guard(&_mutex);
 
 	if(timer->_state == TimerState::queued) {
-		_timerQueue.remove(timer);
+		if(timer->_inWheel) {
+			_removeFromWheel(timer);
+		}else{
+			_timerQueue.remove(timer);
+		}
 		_activeTimers--;
 		timer->_wasCancelled = true;
 	}else{
@@ -156,6 +164,142 @@ void PrecisionTimerEngine::firedAlarm() {
 	_progress();
 }
 
+// Must be called with _mutex held. The timer must already be dequeued.
+void PrecisionTimerEngine::_fire(PrecisionTimerNode *timer) {
+	assert(timer->_state == TimerState::queued);
+	_activeTimers--;
+	if(logProgress)
+		infoLogger() << "thor: Timer completed" << frg::endlog;
+	if(timer->_cancelCb.try_reset()) {
+		timer->_state = TimerState::retired;
+		WorkQueue::post(timer->_elapsed);
+	}else{
+		// Let the cancellation handler invoke the continuation.
+		timer->_state = TimerState::elapsed;
+	}
+}
+
+// Returns false if the timer needs to go into the heap instead.
+bool PrecisionTimerEngine::_insertIntoWheel(PrecisionTimerNode *timer) {
+	if(timer->_slack < wheelTick)
+		return false;
+
+	// Rounding up to the next tick delays the timer by less than wheelTick,
+	// which is covered by the slack.
+	auto tick = (timer->_deadline + wheelTick - 1) >> wheelTickShift;
+	if(tick < _wheelNow)
+		tick = _wheelNow;
+	auto delta = tick - _wheelNow;
+
+	for(int level = 0; level < wheelLevels; level++) {
+		auto shift = wheelSlotShift * level;
+		if(delta >> (shift + wheelSlotShift))
+			continue;
+
+		// Slots are indexed by absolute ticks. Since delta is small enough,
+		// the slot is reached (and cascaded) before any other tick maps to it.
+		int slot = (tick >> shift) & (wheelSlots - 1);
+		_wheel[level][slot].push_back(timer);
+		_wheelOccupied[level] |= uint64_t{1} << slot;
+		_wheelTimers++;
+		timer->_inWheel = true;
+		timer->_wheelLevel = level;
+		timer->_wheelSlot = slot;
+		return true;
+	}
+
+	// The deadline is too far in the future.
+	return false;
+}
+
+void PrecisionTimerEngine::_removeFromWheel(PrecisionTimerNode *timer) {
+	assert(timer->_inWheel);
+	auto list = &_wheel[timer->_wheelLevel][timer->_wheelSlot];
+	list->erase(list->iterator_to(timer));
+	if(list->empty())
+		_wheelOccupied[timer->_wheelLevel] &= ~(uint64_t{1} << timer->_wheelSlot);
+	_wheelTimers--;
+	timer->_inWheel = false;
+}
+
+uint64_t PrecisionTimerEngine::_nextWheelEvent() {
+	if(!_wheelTimers)
+		return UINT64_MAX;
+
+	// Rotates the bitmap such that bit zero corresponds to slot index idx.
+	auto rotate = [] (uint64_t bits, int idx) -> uint64_t {
+		if(!idx)
+			return bits;
+		return (bits >> idx) | (bits << (wheelSlots - idx));
+	};
+
+	uint64_t next = UINT64_MAX;
+	for(int level = 0; level < wheelLevels; level++) {
+		if(!_wheelOccupied[level])
+			continue;
+
+		// Slots of level k are processed at multiples of 64^k ticks.
+		auto shift = wheelSlotShift * level;
+		auto unit = uint64_t{1} << shift;
+		auto base = (_wheelNow + unit - 1) & ~(unit - 1);
+		int idx = (base >> shift) & (wheelSlots - 1);
+		auto distance = __builtin_ctzll(rotate(_wheelOccupied[level], idx));
+		next = frg::min(next, base + (distance << shift));
+	}
+	return next;
+}
+
+// Must be called with _mutex held.
+void PrecisionTimerEngine::_advanceWheel(uint64_t current) {
+	auto currentTick = current >> wheelTickShift;
+
+	while(true) {
+		auto tick = _nextWheelEvent();
+		if(tick > currentTick)
+			break;
+		_wheelNow = tick;
+
+		// Cascade higher levels first, such that timers can drop through
+		// multiple levels within the same tick.
+		for(int level = wheelLevels - 1; level > 0; level--) {
+			auto shift = wheelSlotShift * level;
+			if(tick & ((uint64_t{1} << shift) - 1))
+				continue;
+			int slot = (tick >> shift) & (wheelSlots - 1);
+			auto list = &_wheel[level][slot];
+			if(list->empty())
+				continue;
+
+			// All timers of this slot expire within the next 64^level ticks,
+			// hence they are re-inserted into lower levels (and never into this list).
+			_wheelOccupied[level] &= ~(uint64_t{1} << slot);
+			while(!list->empty()) {
+				auto timer = list->pop_front();
+				_wheelTimers--;
+				timer->_inWheel = false;
+				auto inserted = _insertIntoWheel(timer);
+				assert(inserted);
+				(void)inserted;
+			}
+		}
+
+		int slot = tick & (wheelSlots - 1);
+		auto list = &_wheel[0][slot];
+		_wheelOccupied[0] &= ~(uint64_t{1} << slot);
+		while(!list->empty()) {
+			auto timer = list->pop_front();
+			_wheelTimers--;
+			timer->_inWheel = false;
+			_fire(timer);
+		}
+
+		_wheelNow = tick + 1;
+	}
+
+	if(_wheelNow <= currentTick)
+		_wheelNow = currentTick + 1;
+}
+
 // This function unconditionally calls into setTimerEngineDeadline().
 // This is necessary since we assume that timer IRQs are one shot
 // and not necessarily perfectly accurate.
@@ -163,42 +307,42 @@ void PrecisionTimerEngine::_progress() {
 	assert(getCpuData() == _ourCpu);
 
 	auto current = getClockNanos();
+	uint64_t next;
 	do {
 		// Process all timers that elapsed in the past.
 		if(logProgress)
 			infoLogger() << "thor: Processing timers until " << current << frg::endlog;
-		while(true) {
-			if(_timerQueue.empty()) {
-				setTimerEngineDeadline(frg::null_opt);
-				return;
-			}
-
-			if(_timerQueue.top()->_deadline > current)
-				break;
 
+		// The heap is ordered by the latest point in time at which timers may fire.
+		// We fire all timers at the top of the heap whose deadline has passed;
+		// this coalesces timers with overlapping slack into a single IRQ.
+		while(!_timerQueue.empty()) {
 			auto timer = _timerQueue.top();
-			assert(timer->_state == TimerState::queued);
+			if(timer->_deadline > current)
+				break;
 			_timerQueue.pop();
-			_activeTimers--;
-			if(logProgress)
-				infoLogger() << "thor: Timer completed" << frg::endlog;
-			if(timer->_cancelCb.try_reset()) {
-				timer->_state = TimerState::retired;
-				WorkQueue::post(timer->_elapsed);
-			}else{
-				// Let the cancellation handler invoke the continuation.
-				timer->_state = TimerState::elapsed;
-			}
+			_fire(timer);
 		}
 
+		_advanceWheel(current);
+
 		// Setup the interrupt.
-		assert(!_timerQueue.empty());
-		setTimerEngineDeadline(_timerQueue.top()->_deadline);
+		next = UINT64_MAX;
+		if(!_timerQueue.empty())
+			next = _timerQueue.top()->latest_();
+		if(auto tick = _nextWheelEvent(); tick != UINT64_MAX)
+			next = frg::min(next, tick << wheelTickShift);
+
+		if(next == UINT64_MAX) {
+			setTimerEngineDeadline(frg::null_opt);
+			return;
+		}
+		setTimerEngineDeadline(next);
 
 		// We iterate if there was a race.
 		// Technically, this is optional but it may help to avoid unnecessary IRQs.
 		current = getClockNanos();
-	} while(_timerQueue.top()->_deadline <= current);
+	} while(next <= current);
 }
 
 PrecisionTimerEngine *generalTimerEngine() {
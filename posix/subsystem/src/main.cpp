@@ -1,5 +1,7 @@
 #include <memory>
 
+#include <helix/dispatcher-pool.hpp>
+
 #include <protocols/mbus/client.hpp>
 
 #include "net.hpp"
@@ -40,6 +42,10 @@ std::map<
 	Process *
 > globalCredentialsMap;
 
+// Distributes processes over multiple threads if POSIX_DISPATCHER_THREADS > 1.
+// The pool is serialized since the subsystem's global state is not synchronized.
+helix::DispatcherPool *dispatcherPool = nullptr;
+
 std::shared_ptr<Process> findProcessWithCredentials(helix_ng::CredentialsView credentials) {
 	std::array<char, 16> creds;
 	memcpy(creds.data(), credentials.data(), 16);
@@ -76,6 +82,10 @@ async::result<void> serve(std::shared_ptr<Process> self, std::shared_ptr<Generat
 	auto res = globalCredentialsMap.insert({creds, self.get()});
 	assert(res.second);
 
+	// Operations of this process are submitted to (and complete on) the worker we pick here.
+	if(dispatcherPool)
+		co_await dispatcherPool->schedule();
+
 	co_await async::when_all(
 		observeThread(self, generation),
 		serveSignals(self, generation),
@@ -216,7 +226,15 @@ int main() {
 
 	firmware_dmi::run();
 
-	runInit();
-
-	async::run_forever(helix::currentDispatcher);
+	if constexpr (POSIX_DISPATCHER_THREADS > 1) {
+		std::cout << "posix: Using " << POSIX_DISPATCHER_THREADS
+				<< " dispatcher threads" << std::endl;
+		static helix::DispatcherPool pool{POSIX_DISPATCHER_THREADS, true, true};
+		dispatcherPool = &pool;
+		runInit();
+		pool.run();
+	}else{
+		runInit();
+		async::run_forever(helix::currentDispatcher);
+	}
 }
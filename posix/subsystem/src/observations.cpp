@@ -363,7 +363,20 @@ async::result<void> observeThread(std::shared_ptr<Process> self,
 			if(logRequests || logSignals)
 				std::cout << "posix: SIG_RESTORE supercall" << std::endl;
 
-			co_await self->signalContext()->restoreContext(thread);
+			if(!(co_await self->signalContext()->restoreContext(thread))) {
+				std::cout << "\e[31m" "posix: Invalid signal frame in SIG_RESTORE supercall"
+						"\e[39m" << std::endl;
+
+				auto item = new SignalItem;
+				item->signalNumber = SIGSEGV;
+				if(!self->checkSignalRaise())
+					std::cout << "\e[33m" "posix: Ignoring global signal flag "
+							"during synchronous SIGSEGV" "\e[39m" << std::endl;
+				bool killed;
+				co_await self->signalContext()->raiseContext(item, self.get(), killed);
+				if(killed)
+					break;
+			}
 			HEL_CHECK(helResume(thread.getHandle()));
 		}else if(observe.observation() == kHelObserveSuperCall + posix::superSigKill) {
 			if(logRequests || logSignals)
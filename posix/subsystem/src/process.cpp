@@ -778,7 +778,7 @@ async::result<void> SignalContext::raiseContext(SignalItem *item, Process *proce
 	delete item;
 }
 
-async::result<void> SignalContext::restoreContext(helix::BorrowedDescriptor thread) {
+async::result<bool> SignalContext::restoreContext(helix::BorrowedDescriptor thread) {
 	uintptr_t pcrs[2];
 	HEL_CHECK(helLoadRegisters(thread.getHandle(), kHelRegsProgram, &pcrs));
 	auto frame = pcrs[kHelRegSp] - stackCallMisalign;
@@ -793,6 +793,8 @@ async::result<void> SignalContext::restoreContext(helix::BorrowedDescriptor thre
 			sizeof(SignalFrame), &sf);
 	auto loadSimd = co_await helix_ng::readMemory(thread, frame + sizeof(SignalFrame),
 			simdStateSize, simdState.data());
+	if(loadFrame.error() == kHelErrFault || loadSimd.error() == kHelErrFault)
+		co_return false;
 	HEL_CHECK(loadFrame.error());
 	HEL_CHECK(loadSimd.error());
 
@@ -807,7 +809,12 @@ async::result<void> SignalContext::restoreContext(helix::BorrowedDescriptor thre
 #error Signal register storing code is missing for architecture
 #endif
 
-	HEL_CHECK(helStoreRegisters(thread.getHandle(), kHelRegsSimd, simdState.data()));
+	// The kernel rejects SIMD state that the process corrupted.
+	auto error = helStoreRegisters(thread.getHandle(), kHelRegsSimd, simdState.data());
+	if(error == kHelErrIllegalArgs)
+		co_return false;
+	HEL_CHECK(error);
+	co_return true;
 }
 
 // ----------------------------------------------------------------------------
@@ -300,7 +300,8 @@ public:
 	async::result<void> raiseContext(SignalItem *item, Process *process,
 			bool &killed);
 
-	async::result<void> restoreContext(helix::BorrowedDescriptor thread);
+	// Returns false if the signal frame cannot be restored (e.g., it contains invalid SIMD state).
+	async::result<bool> restoreContext(helix::BorrowedDescriptor thread);
 
 private:
 	SignalHandler _handlers[64];
@@ -283,6 +283,8 @@ std::shared_ptr<Link> DirectoryNode::createRootDirectory() {
 	the_node->_entries.insert(std::move(self_thread_link));
 
 	the_node->directMkregular("uptime", std::make_shared<UptimeNode>());
+	the_node->directMkregular("meminfo", std::make_shared<MeminfoNode>());
+	the_node->directMkregular("vmstat", std::make_shared<VmstatNode>());
 	the_node->directMknode("mounts", std::make_shared<MountsLink>());
 
 	auto sysLink = the_node->directMkdir("sys");
@@ -462,6 +464,64 @@ async::result<void> UptimeNode::store(std::string) {
 	co_return;
 }
 
+async::result<std::string> MeminfoNode::show(Process *) {
+	HelMemoryStats stats;
+	HEL_CHECK(helQueryMemoryStats(&stats));
+
+	// See man 5 proc_meminfo for more details.
+	// The kernel does not track file-backed and anonymous pages separately,
+	// hence Active(file) equals Active.
+	auto cached = stats.activeCacheMemory + stats.inactiveCacheMemory;
+	auto line = [] (std::stringstream &stream, const char *name, uint64_t bytes) {
+		stream << std::left << std::setw(16) << name
+				<< std::right << std::setw(8) << (bytes / 1024) << " kB\n";
+	};
+
+	std::stringstream stream;
+	line(stream, "MemTotal:", stats.totalMemory);
+	line(stream, "MemFree:", stats.freeMemory);
+	line(stream, "MemAvailable:", stats.freeMemory + stats.inactiveCacheMemory);
+	line(stream, "Cached:", cached);
+	line(stream, "Active:", stats.activeCacheMemory);
+	line(stream, "Inactive:", stats.inactiveCacheMemory);
+	line(stream, "Active(file):", stats.activeCacheMemory);
+	line(stream, "Inactive(file):", stats.inactiveCacheMemory);
+	line(stream, "Zswap:", stats.swapPoolSize);
+	line(stream, "Zswapped:", stats.swappedMemory);
+	co_return stream.str();
+}
+
+async::result<void> MeminfoNode::store(std::string) {
+	// TODO: proper error reporting.
+	std::cout << "posix: Can't store to a /proc/meminfo file" << std::endl;
+	co_return;
+}
+
+async::result<std::string> VmstatNode::show(Process *) {
+	HelMemoryStats stats;
+	HEL_CHECK(helQueryMemoryStats(&stats));
+
+	// See man 5 proc_vmstat; only the reclaim counters that we track are reported.
+	std::stringstream stream;
+	stream << "pgscan " << stats.numScannedPages << "\n";
+	stream << "pgsteal " << stats.numReclaimedPages << "\n";
+	stream << "pgactivate " << stats.numActivatedPages << "\n";
+	stream << "pgdeactivate " << stats.numDeactivatedPages << "\n";
+	stream << "pageoutrun " << stats.numReclaimWakeups << "\n";
+	stream << "pswpin " << stats.numSwapIns << "\n";
+	stream << "pswpout " << stats.numSwapOuts << "\n";
+	stream << "zswpin_ns " << stats.swapInNanos << "\n";
+	stream << "zswpin_max_ns " << stats.maxSwapInNanos << "\n";
+	stream << "zswp_reject_compress_poor " << stats.numSwapRejected << "\n";
+	co_return stream.str();
+}
+
+async::result<void> VmstatNode::store(std::string) {
+	// TODO: proper error reporting.
+	std::cout << "posix: Can't store to a /proc/vmstat file" << std::endl;
+	co_return;
+}
+
 async::result<std::string> OstypeNode::show(Process *) {
 	// See man 5 proc for more details.
 	// Based on the man page from Linux man-pages 6.01, updated on 2022-10-09.
@@ -268,6 +268,20 @@ struct UptimeNode final : RegularNode {
 	async::result<void> store(std::string) override;
 };
 
+struct MeminfoNode final : RegularNode {
+	MeminfoNode() {}
+
+	async::result<std::string> show(Process *) override;
+	async::result<void> store(std::string) override;
+};
+
+struct VmstatNode final : RegularNode {
+	VmstatNode() {}
+
+	async::result<std::string> show(Process *) override;
+	async::result<void> store(std::string) override;
+};
+
 struct OstypeNode final : RegularNode {
 	OstypeNode() {}
 
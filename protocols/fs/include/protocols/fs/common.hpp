@@ -44,6 +44,7 @@ enum class Error {
 	internalError = 28,
 	alreadyConnected = 29,
 	notSocket = 30,
+	timedOut = 31,
 };
 
 struct ToFsError {
@@ -84,6 +85,7 @@ inline managarm::fs::Errors operator|(Error e, ToFsError) {
 		case Error::internalError: return managarm::fs::Errors::INTERNAL_ERROR;
 		case Error::alreadyConnected: return managarm::fs::Errors::ALREADY_CONNECTED;
 		case Error::notSocket: return managarm::fs::Errors::NOT_A_SOCKET;
+		case Error::timedOut: return managarm::fs::Errors::TIMED_OUT;
 	}
 }
 
@@ -125,6 +127,7 @@ inline Error operator|(managarm::fs::Errors e, ToFsProtoError) {
 		case managarm::fs::Errors::INTERNAL_ERROR: return Error::internalError;
 		case managarm::fs::Errors::ALREADY_CONNECTED: return Error::alreadyConnected;
 		case managarm::fs::Errors::NOT_A_SOCKET: return Error::notSocket;
+		case managarm::fs::Errors::TIMED_OUT: return Error::timedOut;
 	}
 }
 
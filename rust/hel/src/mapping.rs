@@ -29,6 +29,10 @@ bitflags::bitflags! {
         /// already exists at the same address, it will not be replaced
         /// and the mapping will fail.
         const FIXED_NO_REPLACE = hel_sys::kHelMapFixedNoReplace;
+        /// Hint that the mapping should use huge pages if possible,
+        /// i.e., if the memory object is backed by sufficiently large
+        /// physically contiguous chunks.
+        const HUGE = hel_sys::kHelMapHuge;
     }
 }
 
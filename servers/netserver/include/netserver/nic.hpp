@@ -2,15 +2,18 @@
 
 #include <array>
 #include <arch/dma_pool.hpp>
+#include <async/recurring-event.hpp>
 #include <async/result.hpp>
 #include <frg/logging.hpp>
 #include <frg/formatting.hpp>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <protocols/mbus/client.hpp>
 #include <unordered_map>
+#include <vector>
 
 namespace nic {
 struct MacAddress {
@@ -49,7 +52,7 @@ enum EtherType : uint16_t {
 	ETHER_TYPE_ARP = 0x0806,
 };
 
-// TODO(arsen): Expose interface for csum offloading, constructing frames, and
+// TODO(arsen): Expose interface for constructing frames, and
 // other features of NICs
 struct Link {
 	struct AllocatedBuffer {
@@ -57,12 +60,60 @@ struct Link {
 		arch::dma_buffer_view payload;
 	};
 
+	struct ReceivedFrame {
+		size_t size;
+		// True if the NIC verified the TCP/UDP checksum.
+		bool checksumValid = false;
+	};
+
+	// Describes a TCP/UDP checksum that the NIC should compute.
+	// The checksum covers the frame from start to the end and is stored at start + offset.
+	// The checksum field must contain the (non-complemented) pseudo header sum.
+	struct ChecksumRequest {
+		size_t start;
+		size_t offset;
+	};
+
+	// A frame returned by receiveBatch(). frame points into buffer.
+	struct RxFrame {
+		arch::dma_buffer buffer;
+		arch::dma_buffer_view frame;
+		bool checksumValid = false;
+	};
+
+	// A frame passed to sendBatch().
+	struct TxFrame {
+		arch::dma_buffer frame;
+		std::optional<ChecksumRequest> checksum;
+	};
+
 	Link(unsigned int mtu, arch::dma_pool *dmaPool);
 	virtual ~Link() = default;
 	//! Receives an entire frame from the network
 	virtual async::result<size_t> receive(arch::dma_buffer_view) = 0;
+	//! Like receive(), but also reports offloading results.
+	//! The default implementation calls receive().
+	virtual async::result<ReceivedFrame> receiveFrame(arch::dma_buffer_view);
 	//! Sends an entire ethernet frame
 	virtual async::result<void> send(const arch::dma_buffer_view) = 0;
+	//! Sends an entire ethernet frame and lets the NIC compute the checksum.
+	//! The default implementation computes the checksum in software.
+	virtual async::result<void> sendWithChecksum(const arch::dma_buffer_view, ChecksumRequest);
+	//! Waits for at least one frame and returns up to maxFrames frames.
+	//! The default implementation calls receiveFrame() once.
+	virtual async::result<std::vector<RxFrame>> receiveBatch(size_t maxFrames);
+	//! Sends multiple frames. The NIC keeps the buffers alive until they are sent,
+	//! i.e., this may return before the frames hit the wire.
+	//! The default implementation calls send() or sendWithChecksum() for each frame.
+	virtual async::result<void> sendBatch(std::vector<TxFrame> frames);
+
+	//! Queues a frame for transmission.
+	//! Unless transmission is corked, the queue is flushed immediately.
+	async::result<void> transmit(arch::dma_buffer frame,
+			std::optional<ChecksumRequest> checksum = std::nullopt);
+	//! While corked, transmit() only queues frames so that they are sent in a single batch.
+	void corkTransmit();
+	async::result<void> uncorkTransmit();
 	arch::dma_pool *dmaPool();
 	AllocatedBuffer allocateFrame(size_t payloadSize);
 	AllocatedBuffer allocateFrame(MacAddress to, EtherType type,
@@ -81,6 +132,16 @@ struct Link {
 		return raw_ip_;
 	}
 
+	// Whether sendWithChecksum() is handled by the NIC.
+	bool txChecksumOffload() {
+		return tx_csum_offload_;
+	}
+
+	// Whether receiveFrame() can report verified checksums.
+	bool rxChecksumOffload() {
+		return rx_csum_offload_;
+	}
+
 	mbus_ng::Properties mbusNetworkProperties() {
 		return {
 			{"net.ifname", mbus_ng::StringItem{name()}},
@@ -106,6 +167,20 @@ protected:
 	bool l1_up_ = false;
 
 	bool raw_ip_ = false;
+
+	bool tx_csum_offload_ = false;
+	bool rx_csum_offload_ = false;
+
+private:
+	// Bounds the number of frames queued by transmit().
+	static constexpr size_t maxQueuedFrames = 64;
+
+	async::result<void> flushTransmitQueue_();
+
+	std::deque<TxFrame> txQueue_;
+	async::recurring_event txSpaceEvent_;
+	unsigned int txCorked_ = 0;
+	bool txFlushing_ = false;
 };
 
 async::detached runDevice(std::shared_ptr<Link> dev);
@@ -66,7 +66,7 @@ async::result<void> sendArp(uint16_t op,
 
 	appendData(targetMac);
 	appendData(targetProto);
-	co_await link->send(std::move(buffer.frame));
+	co_await link->transmit(std::move(buffer.frame));
 }
 }
 
@@ -156,7 +156,7 @@ void Neighbours::updateTable(uint32_t ip, nic::MacAddress mac, std::weak_ptr<nic
 	entry.change.raise();
 }
 
-std::map<uint32_t, Neighbours::Entry> &Neighbours::getTable() {
+std::unordered_map<uint32_t, Neighbours::Entry> &Neighbours::getTable() {
 	return table_;
 }
 
@@ -3,7 +3,7 @@
 #include <async/recurring-event.hpp>
 #include <memory>
 #include <netserver/nic.hpp>
-#include <map>
+#include <unordered_map>
 #include <optional>
 
 struct Neighbours {
@@ -26,10 +26,11 @@ struct Neighbours {
 		uint32_t sender);
 	void feedArp(nic::MacAddress destination, arch::dma_buffer_view arpData, std::weak_ptr<nic::Link> link);
 	void updateTable(uint32_t proto, nic::MacAddress hardware, std::weak_ptr<nic::Link> link);
-	std::map<uint32_t, Neighbours::Entry> &getTable();
+	std::unordered_map<uint32_t, Neighbours::Entry> &getTable();
 private:
 	Entry &getEntry(uint32_t addr);
-	std::map<uint32_t, Entry> table_;
+	// Entries are never moved, so references to them stay valid.
+	std::unordered_map<uint32_t, Entry> table_;
 };
 
 Neighbours &neigh4();
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <unordered_map>
+
+// Hash table of sockets that are bound to a local (address, port) pair.
+// A bind to INADDR_ANY conflicts with all other binds to the same port.
+template<typename Socket>
+struct BindTable {
+	bool tryBind(uint32_t addr, uint16_t port, Socket socket) {
+		auto users = portUsers_.find(port);
+		if(users != portUsers_.end()) {
+			if(addr == INADDR_ANY || binds_.contains(key(INADDR_ANY, port))
+					|| binds_.contains(key(addr, port)))
+				return false;
+		}
+
+		binds_.emplace(key(addr, port), std::move(socket));
+		portUsers_[port]++;
+		return true;
+	}
+
+	bool unbind(uint32_t addr, uint16_t port) {
+		if(!binds_.erase(key(addr, port)))
+			return false;
+
+		auto users = portUsers_.find(port);
+		if(!--users->second)
+			portUsers_.erase(users);
+		return true;
+	}
+
+	// Returns the socket that receives packets sent to addr:port or nullptr.
+	Socket *find(uint32_t addr, uint16_t port) {
+		if(auto it = binds_.find(key(addr, port)); it != binds_.end())
+			return &it->second;
+		if(auto it = binds_.find(key(INADDR_ANY, port)); it != binds_.end())
+			return &it->second;
+		return nullptr;
+	}
+
+	size_t size() {
+		return binds_.size();
+	}
+
+private:
+	static uint64_t key(uint32_t addr, uint16_t port) {
+		return (uint64_t(port) << 32) | addr;
+	}
+
+	std::unordered_map<uint64_t, Socket> binds_;
+	// Number of binds per port.
+	std::unordered_map<uint16_t, size_t> portUsers_;
+};
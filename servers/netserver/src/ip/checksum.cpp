@@ -1,32 +1,36 @@
 #include "checksum.hpp"
+#include "ones-complement.hpp"
 
 #include <arch/bit.hpp>
 
 void Checksum::update(uint16_t word)  {
 	state_ += word;
-	while (state_ >> 16 != 0) {
-		state_ = (state_ >> 16) + (state_ & 0xffff);
-	}
 }
 
 void Checksum::update(const void *data, size_t size) {
-	using namespace arch;
-	auto iter = static_cast<const unsigned char*>(data);
-	if (size % 2 != 0) {
-		size--;
-		update(iter[size] << 8);
-	}
-	auto end = iter + size;
-	for (; iter < end; iter += 2) {
-		update(iter[0] << 8 | iter[1]);
-	}
+	state_ += onesComplementSum(data, size);
 }
 
 void Checksum::update(arch::dma_buffer_view view) {
 	update(view.data(), view.size());
 }
 
+uint16_t Checksum::partial() {
+	auto state = state_;
+	while (state >> 16 != 0) {
+		state = (state >> 16) + (state & 0xffff);
+	}
+	return state;
+}
+
 uint16_t Checksum::finalize() {
-	auto state_ = this->state_;
-	return ~state_;
+	return ~partial();
+}
+
+uint16_t Checksum::adjust(uint16_t checksum, uint16_t oldWord, uint16_t newWord) {
+	// HC' = ~(~HC + ~m + m'), RFC 1624 equation 3.
+	uint32_t sum = uint16_t(~checksum) + uint16_t(~oldWord) + newWord;
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	return ~sum;
 }
@@ -5,10 +5,19 @@
 // 16-bit one's compliment sum checksum, as described in RFC791, amongst others
 struct Checksum {
 	void update(uint16_t word);
+	// Each call must start at an even offset of the checksummed data.
 	void update(const void *mem, size_t size);
 	void update(arch::dma_buffer_view area);
 	uint16_t finalize();
 
+	// Folded sum without the final complement. This is what NICs
+	// expect in the checksum field when offloading the checksum.
+	uint16_t partial();
+
+	// Incrementally updates a checksum when a 16-bit word changes from
+	// oldWord to newWord, as described in RFC 1624.
+	static uint16_t adjust(uint16_t checksum, uint16_t oldWord, uint16_t newWord);
+
 private:
-	uint32_t state_ = 0;
+	uint64_t state_ = 0;
 };
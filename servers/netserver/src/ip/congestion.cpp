@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cmath>
+
+#include "congestion.hpp"
+
+namespace {
+
+// ssthresh after a loss, RFC 5681 equation (4).
+uint32_t lossThreshold(TcpCongestionState &s, uint32_t flightSize) {
+	return std::max(flightSize / 2, 2 * s.mss);
+}
+
+// Slow start with appropriate byte counting (RFC 3465, L = 1 SMSS).
+void slowStart(TcpCongestionState &s, uint32_t ackedBytes) {
+	s.cwnd += std::min(ackedBytes, s.mss);
+}
+
+// NewReno as in RFC 5681 and RFC 6582.
+struct NewReno final : TcpCongestionControl {
+	std::string_view name() override {
+		return "newreno";
+	}
+
+	void onAck(TcpCongestionState &s, uint32_t ackedBytes, uint64_t, uint64_t) override {
+		if(s.inSlowStart()) {
+			slowStart(s, ackedBytes);
+			return;
+		}
+
+		// Increase cwnd by one SMSS per cwnd worth of acknowledged data.
+		bytesAcked_ += ackedBytes;
+		if(bytesAcked_ >= s.cwnd) {
+			bytesAcked_ -= s.cwnd;
+			s.cwnd += s.mss;
+		}
+	}
+
+	void onLoss(TcpCongestionState &s, uint32_t flightSize, uint64_t) override {
+		s.ssthresh = lossThreshold(s, flightSize);
+		bytesAcked_ = 0;
+	}
+
+private:
+	uint32_t bytesAcked_ = 0;
+};
+
+// CUBIC as in RFC 9438.
+struct Cubic final : TcpCongestionControl {
+	static constexpr double c = 0.4;
+	static constexpr double beta = 0.7;
+
+	std::string_view name() override {
+		return "cubic";
+	}
+
+	void onAck(TcpCongestionState &s, uint32_t ackedBytes, uint64_t now, uint64_t srtt) override {
+		if(s.inSlowStart()) {
+			slowStart(s, ackedBytes);
+			return;
+		}
+
+		// Windows below are in segments, times in seconds.
+		double cwnd = double(s.cwnd) / s.mss;
+		if(!epochStart_) {
+			epochStart_ = now;
+			if(cwnd < wMax_) {
+				k_ = std::cbrt((wMax_ - cwnd) / c);
+			}else{
+				k_ = 0;
+				wMax_ = cwnd;
+			}
+			wEst_ = cwnd;
+		}
+
+		double rtt = srtt ? srtt / 1e9 : 0.1;
+		double t = (now - epochStart_) / 1e9;
+		double target = c * std::pow(t + rtt - k_, 3) + wMax_;
+		target = std::clamp(target, cwnd, 1.5 * cwnd);
+
+		// Reno-friendly region (section 4.3).
+		double segments = double(ackedBytes) / s.mss;
+		wEst_ += 3 * (1 - beta) / (1 + beta) * segments / cwnd;
+		if(wEst_ > target)
+			target = wEst_;
+
+		// Grow by (target - cwnd) / cwnd segments per acknowledged segment.
+		growth_ += (target - cwnd) / cwnd * segments * s.mss;
+		if(growth_ >= 1) {
+			auto increment = static_cast<uint32_t>(growth_);
+			s.cwnd += increment;
+			growth_ -= increment;
+		}
+	}
+
+	void onLoss(TcpCongestionState &s, uint32_t flightSize, uint64_t) override {
+		double cwnd = double(s.cwnd) / s.mss;
+
+		// Fast convergence (section 4.7).
+		if(cwnd < wMax_) {
+			wMax_ = cwnd * (1 + beta) / 2;
+		}else{
+			wMax_ = cwnd;
+		}
+
+		s.ssthresh = std::max(static_cast<uint32_t>(flightSize * beta), 2 * s.mss);
+		epochStart_ = 0;
+		growth_ = 0;
+	}
+
+private:
+	uint64_t epochStart_ = 0;
+	double wMax_ = 0;
+	double k_ = 0;
+	double wEst_ = 0;
+	double growth_ = 0;
+};
+
+} // anonymous namespace
+
+std::unique_ptr<TcpCongestionControl> makeTcpCongestionControl(std::string_view name) {
+	if(name == "newreno" || name == "reno")
+		return std::make_unique<NewReno>();
+	if(name == "cubic")
+		return std::make_unique<Cubic>();
+	return nullptr;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <stdint.h>
+
+// Congestion window state shared between a TCP socket and its congestion controller.
+// All quantities are in bytes.
+struct TcpCongestionState {
+	uint32_t mss = 0;
+	uint32_t cwnd = 0;
+	uint32_t ssthresh = UINT32_MAX;
+
+	bool inSlowStart() {
+		return cwnd < ssthresh;
+	}
+};
+
+// Interface of congestion control algorithms.
+// Loss recovery itself (fast retransmit/recovery, RTO) is done by the socket;
+// the controller only decides how the window grows and shrinks.
+struct TcpCongestionControl {
+	virtual ~TcpCongestionControl() = default;
+
+	virtual std::string_view name() = 0;
+
+	// Called when new data is acknowledged outside of loss recovery.
+	// now and srtt are in nanoseconds; srtt is zero if no RTT sample exists yet.
+	virtual void onAck(TcpCongestionState &s, uint32_t ackedBytes,
+			uint64_t now, uint64_t srtt) = 0;
+
+	// Called when loss is detected by duplicate ACKs. Updates ssthresh.
+	virtual void onLoss(TcpCongestionState &s, uint32_t flightSize, uint64_t now) = 0;
+
+	// Called when the retransmission timer expires. Updates ssthresh and cwnd.
+	virtual void onRetransmitTimeout(TcpCongestionState &s, uint32_t flightSize, uint64_t now) {
+		onLoss(s, flightSize, now);
+		s.cwnd = s.mss;
+	}
+};
+
+// Returns nullptr if no algorithm with the given name exists.
+std::unique_ptr<TcpCongestionControl> makeTcpCongestionControl(std::string_view name);
+
+// Name of the algorithm that new sockets use.
+inline constexpr std::string_view defaultTcpCongestionControl = "newreno";
@@ -26,29 +26,8 @@ Ip4 &ip4() {
 	return inst;
 }
 
-bool Ip4Router::addRoute(Route r) {
-	return routes.emplace(std::move(r)).second;
-}
-
-std::optional<Route> Ip4Router::resolveRoute(uint32_t ip, std::shared_ptr<nic::Link> link) {
-	for (auto i = routes.begin(); i != routes.end(); i++) {
-		const auto &r = *i;
-		if (r.network.sameNet(ip)) {
-			if(link && r.link.lock()->index() != link->index())
-				continue;
-
-			if (r.link.expired()) {
-				i = routes.erase(i);
-				continue;
-			}
-			return { r };
-		}
-	}
-	return {};
-}
-
-bool operator<(const CidrAddress &lhs, const CidrAddress &) {
-	return std::tie(lhs.prefix, lhs.ip) < std::tie(lhs.prefix, lhs.ip);
+bool operator<(const CidrAddress &lhs, const CidrAddress &rhs) {
+	return std::tie(lhs.prefix, lhs.ip) < std::tie(rhs.prefix, rhs.ip);
 }
 
 auto operator<=>(const Route &lhs, const Route &rhs) {
@@ -71,6 +50,71 @@ bool operator==(const Route &lhs, const Route &rhs) {
 	return operator<=>(lhs, rhs) == 0;
 }
 
+namespace {
+
+// Returns the i-th most significant bit of an address.
+unsigned int prefixBit(uint32_t ip, unsigned int i) {
+	return (ip >> (31 - i)) & 1;
+}
+
+} // anonymous namespace
+
+bool Ip4Router::addRoute(Route r) {
+	auto [it, inserted] = routes.emplace(std::move(r));
+	if (!inserted)
+		return false;
+
+	auto node = &trieRoot_;
+	for (unsigned int i = 0; i < it->network.prefix; i++) {
+		auto &child = node->children[prefixBit(it->network.ip, i)];
+		if (!child)
+			child = std::make_unique<TrieNode>();
+		node = child.get();
+	}
+
+	auto pos = std::lower_bound(node->routes.begin(), node->routes.end(), it,
+			[] (auto a, auto b) { return *a < *b; });
+	node->routes.insert(pos, it);
+	return true;
+}
+
+void Ip4Router::removeRoute_(std::set<Route>::iterator it) {
+	auto node = &trieRoot_;
+	for (unsigned int i = 0; i < it->network.prefix; i++)
+		node = node->children[prefixBit(it->network.ip, i)].get();
+
+	std::erase(node->routes, it);
+	routes.erase(it);
+}
+
+std::optional<Route> Ip4Router::resolveRoute(uint32_t ip, std::shared_ptr<nic::Link> link) {
+	// Walk down the trie; routes with longer prefixes take precedence.
+	std::optional<Route> best;
+	std::vector<std::set<Route>::iterator> expired;
+	auto node = &trieRoot_;
+	for (unsigned int depth = 0; node; depth++) {
+		for (auto it : node->routes) {
+			if (it->link.expired()) {
+				expired.push_back(it);
+				continue;
+			}
+			if (link && it->link.lock()->index() != link->index())
+				continue;
+
+			best = *it;
+			break;
+		}
+
+		if (depth == 32)
+			break;
+		node = node->children[prefixBit(ip, depth)].get();
+	}
+
+	for (auto it : expired)
+		removeRoute_(it);
+	return best;
+}
+
 bool Ip4Packet::parse(arch::dma_buffer owner, arch::dma_buffer_view frame) {
 	buffer_ = std::move(owner);
 	data = frame;
@@ -270,7 +314,7 @@ bool Ip4::hasIp(uint32_t addr) {
 }
 
 async::result<protocols::fs::Error> Ip4::sendFrame(Ip4TargetInfo ti,
-		void *data, size_t len, uint16_t proto) {
+		void *data, size_t len, uint16_t proto, std::optional<size_t> checksumOffset) {
 	using arch::convert_endian;
 	using arch::endian;
 
@@ -332,14 +376,23 @@ async::result<protocols::fs::Error> Ip4::sendFrame(Ip4TargetInfo ti,
 	std::memcpy(fb.payload.data(), &hdr, sizeof(hdr));
 	std::memcpy(fb.payload.subview(header_size).byte_data(), data, len);
 
-	co_await target->send(std::move(fb.frame));
+	std::optional<nic::Link::ChecksumRequest> checksum;
+	if(checksumOffset) {
+		// The payload is at the end of the frame.
+		size_t start = fb.frame.size() - fb.payload.size() + header_size;
+		checksum = nic::Link::ChecksumRequest{start, *checksumOffset};
+	}
+
+	co_await target->transmit(std::move(fb.frame), checksum);
 	co_return protocols::fs::Error::none;
 }
 
 void Ip4::feedPacket(nic::MacAddress, nic::MacAddress,
-		arch::dma_buffer owner, arch::dma_buffer_view frame, std::weak_ptr<nic::Link> link) {
+		arch::dma_buffer owner, arch::dma_buffer_view frame, std::weak_ptr<nic::Link> link,
+		bool l4ChecksumValid) {
 	Ip4Packet hdr{};
 	hdr.link = link;
+	hdr.l4ChecksumValid = l4ChecksumValid;
 
 	if (!hdr.parse(std::move(owner), frame)) {
 		std::cout << "netserver: runt, or otherwise invalid, ip4 frame received"
@@ -11,6 +11,7 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "icmp.hpp"
 #include "udp4.hpp"
@@ -70,7 +71,17 @@ struct Ip4Router {
 		return routes;
 	}
 private:
+	// Binary trie over the network prefixes of all routes.
+	struct TrieNode {
+		std::unique_ptr<TrieNode> children[2];
+		// Routes whose network has exactly this prefix, in the order of routes.
+		std::vector<std::set<Route>::iterator> routes;
+	};
+
+	void removeRoute_(std::set<Route>::iterator it);
+
 	std::set<Route> routes;
+	TrieNode trieRoot_;
 };
 
 class Ip4Packet {
@@ -108,6 +119,8 @@ public:
 	static_assert(sizeof(header) == 20, "bad header size");
 	arch::dma_buffer_view data;
 	std::weak_ptr<nic::Link> link;
+	// True if the NIC already verified the TCP/UDP checksum.
+	bool l4ChecksumValid = false;
 
 	inline arch::dma_buffer_view payload() const {
 		return data.subview(header.ihl * 4);
@@ -133,7 +146,8 @@ struct Ip4 {
 	managarm::fs::Errors serveSocket(helix::UniqueLane lane, int type, int proto, int flags);
 	// frame is a view into the owner buffer, stripping away eth bits
 	void feedPacket(nic::MacAddress dest, nic::MacAddress src,
-		arch::dma_buffer owner, arch::dma_buffer_view frame, std::weak_ptr<nic::Link> link);
+		arch::dma_buffer owner, arch::dma_buffer_view frame, std::weak_ptr<nic::Link> link,
+		bool l4ChecksumValid = false);
 
 	bool hasIp(uint32_t ip);
 	std::shared_ptr<nic::Link> getLink(uint32_t ip);
@@ -143,9 +157,12 @@ struct Ip4 {
 	std::optional<uint32_t> findLinkIp(uint32_t ipOnNet, nic::Link *link);
 
 	async::result<std::optional<Ip4TargetInfo>> targetByRemote(uint32_t, std::shared_ptr<nic::Link> link = {});
+	// If checksumOffset is set, the payload contains a TCP/UDP header whose checksum
+	// (at the given offset) contains only the pseudo header sum and the NIC
+	// (or Link::sendWithChecksum()) completes it.
 	async::result<protocols::fs::Error> sendFrame(Ip4TargetInfo,
 		void*, size_t,
-		uint16_t);
+		uint16_t, std::optional<size_t> checksumOffset = std::nullopt);
 private:
 	std::multimap<int, smarter::shared_ptr<Ip4Socket>> sockets;
 	std::map<CidrAddress, std::weak_ptr<nic::Link>> ips;
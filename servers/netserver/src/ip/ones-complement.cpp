@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "ones-complement.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Folds a 64-bit sum of 16-bit words into 16 bits.
+uint16_t fold(uint64_t sum) {
+	sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+	sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	return sum;
+}
+
+#if defined(__AVX2__)
+// Adds 32-byte blocks. Each 32-bit word is zero-extended into a 64-bit lane,
+// so the accumulators cannot overflow for any realistic size.
+uint64_t sumVector(const unsigned char *&p, size_t &size) {
+	auto zero = _mm256_setzero_si256();
+	auto acc0 = _mm256_setzero_si256();
+	auto acc1 = _mm256_setzero_si256();
+	while(size >= 32) {
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+		p += 32;
+		size -= 32;
+	}
+	auto acc = _mm256_add_epi64(acc0, acc1);
+	alignas(32) uint64_t lanes[4];
+	_mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+
+	// Each lane is at most 2^32 * (size / 32); we fold lane by lane to avoid overflows.
+	uint64_t sum = 0;
+	for(auto lane : lanes)
+		sum += fold(lane);
+	return sum;
+}
+#elif defined(__SSE2__)
+// Same as the AVX2 version, but on 16-byte blocks.
+uint64_t sumVector(const unsigned char *&p, size_t &size) {
+	auto zero = _mm_setzero_si128();
+	auto acc0 = _mm_setzero_si128();
+	auto acc1 = _mm_setzero_si128();
+	while(size >= 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+		p += 16;
+		size -= 16;
+	}
+	auto acc = _mm_add_epi64(acc0, acc1);
+	alignas(16) uint64_t lanes[2];
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	return uint64_t{fold(lanes[0])} + fold(lanes[1]);
+}
+#else
+uint64_t sumVector(const unsigned char *&, size_t &) {
+	return 0;
+}
+#endif
+
+} // anonymous namespace
+
+uint16_t onesComplementSumScalar(const void *data, size_t size) {
+	auto iter = static_cast<const unsigned char *>(data);
+	uint32_t state = 0;
+	auto add = [&] (uint16_t word) {
+		state += word;
+		while(state >> 16 != 0)
+			state = (state >> 16) + (state & 0xffff);
+	};
+
+	if(size % 2 != 0) {
+		size--;
+		add(iter[size] << 8);
+	}
+	auto end = iter + size;
+	for(; iter < end; iter += 2)
+		add(iter[0] << 8 | iter[1]);
+	return state;
+}
+
+uint16_t onesComplementSum(const void *data, size_t size) {
+	auto p = static_cast<const unsigned char *>(data);
+
+	// The one's complement sum is byte order independent (RFC 1071, section 2 (B)):
+	// we sum native words and swap the result at the end.
+	uint64_t sum = sumVector(p, size);
+
+	// Add 64-bit words with end-around carry.
+	while(size >= 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		sum += word;
+		sum += (sum < word);
+		p += 8;
+		size -= 8;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, p, size);
+	sum += tail;
+	sum += (sum < tail);
+
+	uint16_t result = fold(sum);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	result = __builtin_bswap16(result);
+#endif
+	return result;
+}
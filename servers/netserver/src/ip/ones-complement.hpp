@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 16-bit one's complement sums (RFC 1071) over data that starts at an even offset.
+// Both functions return the folded (but not complemented) sum in host byte order,
+// interpreting the data as big endian 16-bit words.
+
+// Straightforward implementation that adds one word at a time.
+uint16_t onesComplementSumScalar(const void *data, size_t size);
+
+// Uses 64-bit accumulators and SSE2/AVX2 if available.
+uint16_t onesComplementSum(const void *data, size_t size);
@@ -1,12 +1,16 @@
 #include <async/basic.hpp>
+#include <async/cancellation.hpp>
 #include <async/recurring-event.hpp>
 #include <async/result.hpp>
 #include <arch/bit.hpp>
 #include <arch/variable.hpp>
+#include <helix/timer.hpp>
 #include <protocols/fs/server.hpp>
+#include <algorithm>
 #include <cstring>
 #include <format>
 #include <iomanip>
+#include <optional>
 #include <random>
 #include <fcntl.h>
 #include <sys/epoll.h>
@@ -14,10 +18,12 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 
 #include <bragi/helpers-std.hpp>
 
 #include "checksum.hpp"
+#include "congestion.hpp"
 #include "ip4.hpp"
 #include "tcp4.hpp"
 
@@ -25,6 +31,54 @@ namespace {
 
 constexpr bool debugTcp = false;
 
+// Retransmission timeout parameters (RFC 6298), in nanoseconds.
+// RFC 6298 recommends a minimum RTO of 1s; like other implementations, we use a lower bound.
+constexpr uint64_t initialRto = 1'000'000'000;
+constexpr uint64_t minRto = 200'000'000;
+constexpr uint64_t maxRto = 60'000'000'000;
+constexpr uint64_t clockGranularity = 1'000'000;
+
+// Number of consecutive retransmission timeouts after which the connection is aborted
+// (R2 in RFC 1122, section 4.2.3.5). Like Linux, we give up on SYNs earlier.
+constexpr unsigned int maxRetransmits = 15;
+constexpr unsigned int maxSynRetransmits = 6;
+
+// Number of duplicate ACKs that trigger a fast retransmit.
+constexpr unsigned int dupAckThreshold = 3;
+
+// TODO: Perform path MTU discovery.
+constexpr uint32_t defaultMss = 1280;
+// MSS that is assumed if the remote does not send an MSS option (RFC 9293).
+constexpr uint32_t fallbackMss = 536;
+
+// Initial size of the send and receive buffers. The buffers grow on demand
+// up to a per-socket limit that can be changed with SO_SNDBUF and SO_RCVBUF.
+constexpr int minRingShift = 14;
+constexpr int defaultRingLimitShift = 18;
+constexpr int maxRingShift = 22;
+
+// Maximal number of disjoint ranges of out-of-order data that we keep.
+constexpr size_t maxOutOfOrderBlocks = 32;
+
+// Size of the timestamp option including padding.
+constexpr size_t timestampOptionSize = 12;
+
+// Values of tcp_info::tcpi_state, as on Linux.
+constexpr uint8_t tcpStateEstablished = 1;
+constexpr uint8_t tcpStateSynSent = 2;
+constexpr uint8_t tcpStateClose = 7;
+
+// Comparison of sequence numbers modulo 2^32.
+bool seqBefore(uint32_t a, uint32_t b) {
+	return static_cast<int32_t>(a - b) < 0;
+}
+
+uint64_t currentClock() {
+	uint64_t now;
+	HEL_CHECK(helGetClock(&now));
+	return now;
+}
+
 struct stl_allocator {
 	void *allocate(size_t size) {
 		return operator new(size);
@@ -46,8 +100,9 @@ struct PseudoHeader {
 static_assert(sizeof(PseudoHeader) == 12);
 
 struct RingBuffer {
+	// Storage is only allocated once data is written.
 	RingBuffer(int shift)
-	: storage_{reinterpret_cast<char *>(operator new (1 << shift))}, shift_{shift} { }
+	: shift_{shift} { }
 
 	RingBuffer(const RingBuffer &) = delete;
 
@@ -57,22 +112,70 @@ struct RingBuffer {
 
 	RingBuffer &operator= (const RingBuffer &) = delete;
 
+	int shift() {
+		return shift_;
+	}
+
+	size_t size() {
+		return size_t{1} << shift_;
+	}
+
 	size_t spaceForEnqueue() {
-		return (size_t{1} << shift_) - (enqPtr_ - deqPtr_);
+		return size() - (enqPtr_ - deqPtr_);
 	}
 
 	size_t availableToDequeue() {
 		return enqPtr_ - deqPtr_;
 	}
 
+	// Increases the size of the buffer to 2^shift bytes.
+	// Keeps all bytes of the old buffer, including those written by writeAhead().
+	void grow(int shift) {
+		assert(shift > shift_);
+		if(!storage_) {
+			shift_ = shift;
+			return;
+		}
+
+		auto storage = reinterpret_cast<char *>(operator new (size_t{1} << shift));
+		size_t newMask = (size_t{1} << shift) - 1;
+		size_t oldSize = size();
+		size_t progress = 0;
+		while(progress < oldSize) {
+			auto oldPtr = (deqPtr_ + progress) & (oldSize - 1);
+			auto newPtr = (deqPtr_ + progress) & newMask;
+			size_t chunk = std::min({oldSize - progress, oldSize - oldPtr, newMask + 1 - newPtr});
+			memcpy(storage + newPtr, storage_ + oldPtr, chunk);
+			progress += chunk;
+		}
+		operator delete(storage_);
+		storage_ = storage;
+		shift_ = shift;
+	}
+
 	void enqueue(void *data, size_t size) {
-		assert(size <= spaceForEnqueue());
+		writeAhead(0, data, size);
+		commit(size);
+	}
+
+	// Writes data at the given offset behind the enqueued data without enqueueing it.
+	void writeAhead(size_t offset, void *data, size_t size) {
+		assert(offset + size <= spaceForEnqueue());
+		if(!size)
+			return;
+		if(!storage_)
+			storage_ = reinterpret_cast<char *>(operator new (size_t{1} << shift_));
 		size_t ringSize = size_t{1} << shift_;
-		auto wrappedPtr = enqPtr_ & (ringSize - 1);
+		auto wrappedPtr = (enqPtr_ + offset) & (ringSize - 1);
 		auto p = reinterpret_cast<char *>(data);
 		size_t bytesUntilEnd = std::min(size, ringSize - wrappedPtr);
 		memcpy(storage_ + wrappedPtr, p, bytesUntilEnd);
 		memcpy(storage_, p + bytesUntilEnd, size - bytesUntilEnd);
+	}
+
+	// Enqueues data that was previously written by writeAhead().
+	void commit(size_t size) {
+		assert(size <= spaceForEnqueue());
 		enqPtr_ += size;
 	}
 
@@ -83,6 +186,8 @@ struct RingBuffer {
 
 	void dequeueLookahead(size_t offset, void *data, size_t size) {
 		assert(offset + size <= availableToDequeue());
+		if(!size)
+			return;
 		size_t ringSize = size_t{1} << shift_;
 		auto wrappedPtr = (deqPtr_ + offset) & (ringSize - 1);
 		auto p = reinterpret_cast<char *>(data);
@@ -96,12 +201,20 @@ struct RingBuffer {
 	}
 
 private:
-	char *storage_;
+	char *storage_ = nullptr;
 	int shift_;
 	uint64_t enqPtr_ = 0;
 	uint64_t deqPtr_ = 0;
 };
 
+// Converts a buffer size (as in SO_RCVBUF) to a ring buffer limit.
+int ringLimitShiftFor(size_t size) {
+	int shift = minRingShift;
+	while(shift < maxRingShift && (size_t{1} << shift) < size)
+		shift++;
+	return shift;
+}
+
 // TODO: Use a CSPRNG, see also UDP.
 static std::mt19937 globalPrng;
 
@@ -110,6 +223,7 @@ static std::mt19937 globalPrng;
 struct TcpHeader {
 	static constexpr arch::field<uint16_t, bool> finFlag{0, 1};
 	static constexpr arch::field<uint16_t, bool> synFlag{1, 1};
+	static constexpr arch::field<uint16_t, bool> rstFlag{2, 1};
 	static constexpr arch::field<uint16_t, bool> ackFlag{4, 1};
 	static constexpr arch::field<uint16_t, unsigned int> headerWords{12, 4};
 
@@ -125,6 +239,61 @@ struct TcpHeader {
 
 static_assert(sizeof(TcpHeader) == 20);
 
+enum class TcpOptionKind : uint8_t {
+	end = 0,
+	nop = 1,
+	mss = 2,
+	windowScale = 3, // RFC 7323.
+	sackPermitted = 4, // RFC 2018.
+	sack = 5, // RFC 2018.
+	timestamp = 8, // RFC 7323.
+};
+
+// Maximal size of the options area.
+constexpr size_t maxTcpOptionsSize = 40;
+
+struct TcpSackBlock {
+	uint32_t left;
+	uint32_t right;
+};
+
+struct TcpOptions {
+	static constexpr size_t maxSackBlocks = 4;
+
+	std::optional<uint16_t> mss;
+	std::optional<uint8_t> windowScale;
+	bool sackPermitted = false;
+	bool hasTimestamp = false;
+	uint32_t tsVal = 0;
+	uint32_t tsEcr = 0;
+	size_t numSackBlocks = 0;
+	TcpSackBlock sackBlocks[maxSackBlocks];
+};
+
+namespace {
+
+uint16_t loadBig16(const uint8_t *p) {
+	return (uint16_t{p[0]} << 8) | p[1];
+}
+
+uint32_t loadBig32(const uint8_t *p) {
+	return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+}
+
+void storeBig16(uint8_t *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+void storeBig32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+} // anonymous namespace
+
 struct TcpPacket {
 	arch::dma_buffer_view payload() {
 		auto words = header.flags.load() & TcpHeader::headerWords;
@@ -143,7 +312,10 @@ struct TcpPacket {
 		if (ipPayload.size() < words * 4)
 			return false;
 
-		if (header.checksum.load()) {
+		parseOptions_(reinterpret_cast<const uint8_t *>(ipPayload.data()) + sizeof(TcpHeader),
+				words * 4 - sizeof(TcpHeader));
+
+		if (header.checksum.load() && !packet->l4ChecksumValid) {
 			PseudoHeader pseudo {
 				.src = packet->header.source,
 				.dst = packet->header.destination,
@@ -163,11 +335,75 @@ struct TcpPacket {
 	}
 
 	TcpHeader header;
+	TcpOptions options;
 	smarter::shared_ptr<const Ip4Packet> packet;
+
+private:
+	// Malformed options are ignored, together with all options that follow them.
+	void parseOptions_(const uint8_t *p, size_t size) {
+		size_t offset = 0;
+		while(offset < size) {
+			auto kind = static_cast<TcpOptionKind>(p[offset]);
+			if(kind == TcpOptionKind::end)
+				return;
+			if(kind == TcpOptionKind::nop) {
+				++offset;
+				continue;
+			}
+
+			if(offset + 2 > size)
+				return;
+			size_t length = p[offset + 1];
+			if(length < 2 || offset + length > size)
+				return;
+			auto data = p + offset + 2;
+
+			if(kind == TcpOptionKind::mss && length == 4) {
+				options.mss = loadBig16(data);
+			}else if(kind == TcpOptionKind::windowScale && length == 3) {
+				// RFC 7323 limits the shift to 14.
+				options.windowScale = std::min(data[0], uint8_t{14});
+			}else if(kind == TcpOptionKind::sackPermitted && length == 2) {
+				options.sackPermitted = true;
+			}else if(kind == TcpOptionKind::sack && !((length - 2) % 8)) {
+				options.numSackBlocks = std::min((length - 2) / 8, TcpOptions::maxSackBlocks);
+				for(size_t i = 0; i < options.numSackBlocks; ++i)
+					options.sackBlocks[i] = {loadBig32(data + i * 8), loadBig32(data + i * 8 + 4)};
+			}else if(kind == TcpOptionKind::timestamp && length == 10) {
+				options.hasTimestamp = true;
+				options.tsVal = loadBig32(data);
+				options.tsEcr = loadBig32(data + 4);
+			}
+
+			offset += length;
+		}
+	}
 };
 
 namespace {
 
+// Fills in the checksum of an outgoing segment. If the link can offload the checksum,
+// only the pseudo header sum is filled in and the offset of the checksum field is returned.
+std::optional<size_t> fillChecksum(TcpHeader *header, std::vector<char> &buf,
+		const Ip4TargetInfo &targetInfo) {
+	PseudoHeader pseudo {
+		.src = targetInfo.source,
+		.dst = targetInfo.remote,
+		.len = buf.size()
+	};
+	Checksum csum;
+	csum.update(&pseudo, sizeof(PseudoHeader));
+
+	if(targetInfo.link->txChecksumOffload()) {
+		header->checksum = csum.partial();
+		return offsetof(TcpHeader, checksum);
+	}
+
+	csum.update(buf.data(), buf.size());
+	header->checksum = csum.finalize();
+	return std::nullopt;
+}
+
 protocols::fs::Error checkAddress(const void *addrPtr, size_t addrLength, TcpEndpoint &e) {
 	struct sockaddr_in sa;
 	if (addrLength < sizeof(sa))
@@ -186,19 +422,26 @@ protocols::fs::Error checkAddress(const void *addrPtr, size_t addrLength, TcpEnd
 
 struct Tcp4Socket {
 	Tcp4Socket(Tcp4 *parent, bool nonBlock)
-	: parent_(parent), nonBlock_{nonBlock}, recvRing_{14}, sendRing_{14} {}
-
-	~Tcp4Socket() {
-		parent_->unbind(localEp_);
+	: parent_(parent), nonBlock_{nonBlock}, recvRing_{minRingShift}, sendRing_{minRingShift} {
+		cc_.mss = mss_;
+		ccAlgorithm_ = makeTcpCongestionControl(defaultTcpCongestionControl);
 	}
 
 	static auto makeSocket(Tcp4 *parent, bool nonBlock) {
 		auto s = smarter::make_shared<Tcp4Socket>(parent, nonBlock);
 		s->holder_ = s;
 		async::detach(s->flushOutPackets_());
+		async::detach(s->runRetransmitTimer_());
 		return s;
 	}
 
+	// Serves the socket until its lane is closed, then closes the socket.
+	static async::result<void> serve(smarter::shared_ptr<Tcp4Socket> self,
+			helix::UniqueLane lane) {
+		co_await protocols::fs::servePassthrough(std::move(lane), self, &ops);
+		self->close_();
+	}
+
 	static async::result<protocols::fs::Error> bind(void *object,
 			helix_ng::CredentialsView creds,
 			const void *addrPtr, size_t addrLength) {
@@ -331,9 +574,13 @@ struct Tcp4Socket {
 			co_return protocols::fs::Error::addressNotAvailable;
 		}
 
+		// Announce a window scale that allows us to use the whole receive buffer.
+		self->localWindowScale_ = std::max(self->recvLimitShift_ - 16, 0);
+
 		// Connect to the remote.
 		self->connectState_ = ConnectState::sendSyn;
 		self->remoteEp_ = connectEp;
+		self->parent_->addConnection(self->holder_.lock(), {self->localEp_, self->remoteEp_});
 		self->flushEvent_.raise();
 
 		while(true) {
@@ -341,6 +588,8 @@ struct Tcp4Socket {
 				break;
 			co_await self->settleEvent_.async_wait();
 		}
+		if(self->error_)
+			co_return *self->error_;
 		co_return protocols::fs::Error::none;
 	}
 
@@ -377,6 +626,8 @@ struct Tcp4Socket {
 			if(!available) {
 				if(progress)
 					break;
+				if(self->error_)
+					co_return *self->error_;
 				if(self->nonBlock_)
 					co_return protocols::fs::Error::wouldBlock;
 				co_await self->inEvent_.async_wait();
@@ -416,7 +667,15 @@ struct Tcp4Socket {
 
 		size_t progress = 0;
 		while(progress < size) {
+			if(self->error_) {
+				if(progress)
+					break;
+				co_return *self->error_;
+			}
+
 			size_t space = self->sendRing_.spaceForEnqueue();
+			if(!space && self->growSendRing_())
+				continue;
 			if(!space) {
 				if(self->nonBlock_) {
 					if(progress)
@@ -455,7 +714,7 @@ struct Tcp4Socket {
 		if(self->outSeq_ > pastSeq)
 			edges |= EPOLLOUT;
 		if(self->hupSeq_ > pastSeq)
-			edges |= EPOLLHUP;
+			edges |= EPOLLHUP | (self->error_ ? EPOLLERR : 0);
 
 		co_return protocols::fs::PollWaitResult{self->currentSeq_, edges};
 	}
@@ -471,6 +730,8 @@ struct Tcp4Socket {
 			active |= EPOLLOUT;
 		if(self->remoteClosed_)
 			active |= EPOLLHUP;
+		if(self->error_)
+			active |= EPOLLHUP | EPOLLERR;
 
 		co_return protocols::fs::PollStatusResult{self->currentSeq_, active};
 	}
@@ -516,12 +777,66 @@ struct Tcp4Socket {
 			}
 		}
 
+		if(layer == SOL_SOCKET && (number == SO_RCVBUF || number == SO_SNDBUF)) {
+			if(optbuf.size() < sizeof(int))
+				co_return protocols::fs::Error::illegalArguments;
+			int size;
+			memcpy(&size, optbuf.data(), sizeof(int));
+			if(size < 0)
+				co_return protocols::fs::Error::illegalArguments;
+
+			// The buffers never shrink; the limit only affects future growth.
+			auto shift = ringLimitShiftFor(size);
+			if(number == SO_RCVBUF) {
+				self->recvLimitShift_ = std::max(shift, self->recvRing_.shift());
+			}else{
+				self->sendLimitShift_ = std::max(shift, self->sendRing_.shift());
+			}
+			co_return {};
+		}
+
+		if(layer == IPPROTO_TCP && number == TCP_CONGESTION) {
+			std::string name{optbuf.data(), strnlen(optbuf.data(), optbuf.size())};
+			auto algorithm = makeTcpCongestionControl(name);
+			if(!algorithm)
+				co_return protocols::fs::Error::illegalArguments;
+			self->ccAlgorithm_ = std::move(algorithm);
+			co_return {};
+		}
+
 		std::cout << std::format("netserver: unhandled TCP socket setsockopt layer {} number {}\n",
 			layer, number);
 
 		co_return protocols::fs::Error::invalidProtocolOption;
 	}
 
+	static async::result<frg::expected<protocols::fs::Error>> getSocketOption(void *object,
+			helix_ng::CredentialsView, int layer, int number, std::vector<char> &optbuf) {
+		auto self = static_cast<Tcp4Socket *>(object);
+
+		if(layer == SOL_SOCKET && (number == SO_RCVBUF || number == SO_SNDBUF)) {
+			int size = 1 << (number == SO_RCVBUF ? self->recvLimitShift_ : self->sendLimitShift_);
+			optbuf.resize(std::min(optbuf.size(), sizeof(int)));
+			memcpy(optbuf.data(), &size, optbuf.size());
+			co_return {};
+		}else if(layer == IPPROTO_TCP && number == TCP_INFO) {
+			auto info = self->getInfo_();
+			optbuf.resize(std::min(optbuf.size(), sizeof(info)));
+			memcpy(optbuf.data(), &info, optbuf.size());
+			co_return {};
+		}else if(layer == IPPROTO_TCP && number == TCP_CONGESTION) {
+			auto name = self->ccAlgorithm_->name();
+			optbuf.resize(std::min(optbuf.size(), name.size()));
+			memcpy(optbuf.data(), name.data(), optbuf.size());
+			co_return {};
+		}
+
+		std::cout << std::format("netserver: unhandled TCP socket getsockopt layer {} number {}\n",
+			layer, number);
+
+		co_return protocols::fs::Error::invalidProtocolOption;
+	}
+
 	constexpr static protocols::fs::FileOperations ops {
 		.read = &read,
 		.write = &write,
@@ -537,6 +852,7 @@ struct Tcp4Socket {
 		.sendMsg = &sendMsg,
 		.peername = &peername,
 		.setSocketOption = &setSocketOption,
+		.getSocketOption = &getSocketOption,
 	};
 
 	bool bindAvailable(uint32_t ipAddress = INADDR_ANY) {
@@ -555,10 +871,64 @@ struct Tcp4Socket {
 	}
 
 private:
+	// Removes the socket from the tables of Tcp4 and stops its coroutines.
+	// The socket is destructed once the last request that refers to it completes.
+	void close_();
+
 	async::result<void> flushOutPackets_();
 
+	async::result<void> runRetransmitTimer_();
+
 	void handleInPacket_(TcpPacket packet);
 
+	void handleAck_(TcpPacket &packet);
+
+	void handleData_(TcpPacket &packet);
+
+	void receiveFin_();
+
+	void updateSacked_(const TcpOptions &options);
+
+	bool findHole_(uint32_t from, uint32_t &holeSn, uint32_t &holeEnd);
+
+	size_t writeOptions_(uint8_t *p, bool syn);
+
+	uint32_t windowField_() {
+		return std::min(recvRing_.spaceForEnqueue() >> recvWindowScale_, size_t{0xFFFF});
+	}
+
+	// Grows the send buffer if it limits the amount of data in flight.
+	bool growSendRing_() {
+		size_t inFlightLimit = std::min(size_t{localWindowSn_ - localSettledSn_},
+				size_t{cc_.cwnd});
+		if(sendRing_.shift() >= sendLimitShift_ || sendRing_.size() >= inFlightLimit)
+			return false;
+		sendRing_.grow(sendRing_.shift() + 1);
+		return true;
+	}
+
+	// Grows the receive buffer if it becomes the limiting factor of the receive window.
+	void growRecvRing_() {
+		if(recvRing_.shift() >= recvLimitShift_
+				|| recvRing_.availableToDequeue() < recvRing_.size() / 2)
+			return;
+		recvRing_.grow(recvRing_.shift() + 1);
+	}
+
+	// Adds [left, right) to the out-of-order ranges. Returns false if there are too many ranges.
+	bool addOutOfOrder_(uint32_t left, uint32_t right);
+
+	void sampleRtt_(uint64_t rtt);
+
+	void armRetransmitTimer_(uint64_t now);
+
+	void retransmitTimeout_(uint64_t now);
+
+	// Gives up on the connection and reports the error to the user.
+	void abort_(protocols::fs::Error error);
+
+	struct tcp_info getInfo_();
+
 private:
 	friend struct Tcp4;
 
@@ -567,6 +937,7 @@ private:
 		sendSyn, // Client-side only.
 		sendSynAck, // Server-side only.
 		connected,
+		aborted,
 	};
 
 	Tcp4 *parent_;
@@ -577,11 +948,20 @@ private:
 
 	ConnectState connectState_ = ConnectState::none;
 	bool remoteClosed_ = false;
+	// Whether the socket's lane was closed.
+	bool closed_ = false;
+	// Error that caused the connection to be aborted.
+	std::optional<protocols::fs::Error> error_;
+	// Whether we need to send a RST after aborting the connection.
+	bool resetPending_ = false;
 
 	// Out-SN corresponding to the front of sendRing_.
 	uint32_t localSettledSn_ = 0;
 	// Out-SN that has already been flushed to the IP layer (>= localSettledSn_).
 	uint32_t localFlushedSn_ = 0;
+	// Highest Out-SN that was ever flushed (>= localFlushedSn_).
+	// Differs from localFlushedSn_ while we go back to retransmit after a timeout.
+	uint32_t localMaxSn_ = 0;
 	// Out-SN of the end of the remote window (>= localSettledSn_).
 	uint32_t localWindowSn_ = 0;
 	// In-SN that we already acknowledged.
@@ -590,13 +970,81 @@ private:
 	uint32_t remoteKnownSn_ = 0;
 	// Size of received window that we announced to the remote side.
 	uint32_t announcedWindow_ = 0;
+	// Whether we sent our SYN already.
+	bool synSent_ = false;
+	// Whether the segment at localSettledSn_ (or the SYN) needs to be retransmitted.
+	bool retransmitFront_ = false;
+	// Whether we need to send an ACK even if remoteAckedSn_ is up-to-date.
+	bool forceAck_ = false;
+	// Out-SN of the segment that needs to be retransmitted if retransmitFront_ is set.
+	uint32_t retransmitSn_ = 0;
+	// Maximal segment size that we send (excluding options).
+	uint32_t mss_ = defaultMss;
+
+	// Options negotiated during the handshake.
+	// Window scaling (RFC 7323) is only used if both sides send the option.
+	uint8_t sendWindowScale_ = 0;
+	uint8_t recvWindowScale_ = 0;
+	// Window scale that we announce in our SYN.
+	uint8_t localWindowScale_ = 0;
+	bool sackEnabled_ = false;
+	bool timestampsEnabled_ = false;
+	// Most recent timestamp that we received and will echo (TS.Recent in RFC 7323).
+	uint32_t tsRecent_ = 0;
+
+	// In-SN ranges beyond remoteKnownSn_ that we received. Sorted and non-overlapping.
+	// Their data is already stored in recvRing_ behind the enqueued data
+	// and it is committed once the gap before them is filled.
+	std::vector<TcpSackBlock> outOfOrder_;
+	// In-SN of the out-of-order FIN (if any).
+	std::optional<uint32_t> outOfOrderFinSn_;
+	// In-SN of the most recently queued out-of-order segment; its block is reported first.
+	uint32_t lastOutOfOrderSn_ = 0;
+
+	// Out-SN ranges above localSettledSn_ that the remote reported via SACK.
+	// Sorted and non-overlapping.
+	std::vector<TcpSackBlock> sacked_;
+	// Out-SN up to which holes were already retransmitted during recovery.
+	uint32_t highRetransmitSn_ = 0;
+
+	// RTT estimation and retransmission timer (RFC 6298). All times are in nanoseconds.
+	uint64_t srtt_ = 0;
+	uint64_t rttVar_ = 0;
+	uint64_t rto_ = initialRto;
+	// Expiration of the retransmission timer, zero if it is not running.
+	uint64_t rtoDeadline_ = 0;
+	// Number of consecutive timeouts.
+	unsigned int backoff_ = 0;
+	// Karn's algorithm: only one segment is timed and the timing is
+	// discarded if any segment is retransmitted.
+	bool rttTiming_ = false;
+	uint32_t rttSampleSn_ = 0;
+	uint64_t rttSampleTime_ = 0;
+
+	// Fast retransmit and fast recovery (RFC 5681, RFC 6582).
+	unsigned int dupAcks_ = 0;
+	bool inRecovery_ = false;
+	uint32_t recoverSn_ = 0;
+
+	TcpCongestionState cc_;
+	std::unique_ptr<TcpCongestionControl> ccAlgorithm_;
+
+	// Statistics for TCP_INFO.
+	uint32_t totalRetransmits_ = 0;
+	uint32_t fastRetransmits_ = 0;
+	uint32_t timeouts_ = 0;
 
 	RingBuffer recvRing_;
 	RingBuffer sendRing_;
+	// Limits on the size of recvRing_ and sendRing_.
+	int recvLimitShift_ = defaultRingLimitShift;
+	int sendLimitShift_ = defaultRingLimitShift;
 
 	async::recurring_event inEvent_;
 	async::recurring_event flushEvent_;
 	async::recurring_event settleEvent_;
+	async::recurring_event timerEvent_;
+	async::cancellation_event cancelTimer_;
 
 	// The following sequence numbers are *not* TCP sequence numbers,
 	// they implement the poll() function.
@@ -609,23 +1057,87 @@ private:
 	std::shared_ptr<nic::Link> boundInterface_ = {};
 };
 
+void Tcp4Socket::close_() {
+	assert(!closed_);
+	closed_ = true;
+
+	if(remoteEp_.port)
+		parent_->removeConnection({localEp_, remoteEp_});
+	if(localEp_.port)
+		parent_->unbind(localEp_);
+
+	cancelTimer_.cancel();
+	flushEvent_.raise();
+	timerEvent_.raise();
+}
+
 async::result<void> Tcp4Socket::flushOutPackets_() {
+	// Keep the socket alive until close_() stops this coroutine.
+	auto self = holder_.lock();
+
 	while(true) {
+		if(closed_)
+			co_return;
+
 		if(connectState_ == ConnectState::none) {
 			co_await flushEvent_.async_wait();
 			continue;
 		}
 
+		if(connectState_ == ConnectState::aborted) {
+			if(!resetPending_) {
+				co_await flushEvent_.async_wait();
+				continue;
+			}
+			resetPending_ = false;
+
+			auto targetInfo = co_await ip4().targetByRemote(remoteEp_.ipAddress, boundInterface_);
+			if (!targetInfo)
+				continue;
+
+			std::vector<char> buf;
+			buf.resize(sizeof(TcpHeader));
+
+			auto header = new (buf.data()) TcpHeader {
+				.srcPort = localEp_.port,
+				.destPort = remoteEp_.port,
+				.seqNumber = localMaxSn_,
+				.ackNumber = 0,
+				.flags = {},
+				.window = 0,
+				.checksum = 0,
+				.urgentPointer = 0,
+			};
+			header->flags.store(TcpHeader::headerWords(buf.size() / 4)
+					| TcpHeader::rstFlag(true));
+
+			auto checksumOffset = fillChecksum(header, buf, *targetInfo);
+
+			if(debugTcp)
+				std::cout << "netserver: Sending TCP RST" << std::endl;
+			auto error = co_await ip4().sendFrame(std::move(*targetInfo),
+				buf.data(), buf.size(), static_cast<uint16_t>(IpProto::tcp), checksumOffset);
+			if (error != protocols::fs::Error::none)
+				std::cout << "netserver: Could not send TCP packet" << std::endl;
+			continue;
+		}
+
 		if(connectState_ == ConnectState::sendSyn) {
-			if(localSettledSn_ != localFlushedSn_) {
+			if(synSent_ && !retransmitFront_) {
 				co_await flushEvent_.async_wait();
 				continue;
 			}
 
-			// Obtain a new random sequence number.
-			auto randomSn = globalPrng();
-			localSettledSn_ = randomSn;
-			localFlushedSn_ = randomSn;
+			if(!synSent_) {
+				// Obtain a new random sequence number.
+				auto randomSn = globalPrng();
+				localSettledSn_ = randomSn;
+				localFlushedSn_ = randomSn;
+				localMaxSn_ = randomSn;
+				recoverSn_ = randomSn;
+			}else{
+				++totalRetransmits_;
+			}
 
 			// Construct and transmit the initial SYN packet.
 			auto targetInfo = co_await ip4().targetByRemote(remoteEp_.ipAddress, boundInterface_);
@@ -635,39 +1147,47 @@ async::result<void> Tcp4Socket::flushOutPackets_() {
 				co_return;
 			}
 
+			uint8_t options[maxTcpOptionsSize];
+			auto optionsSize = writeOptions_(options, true);
+
 			std::vector<char> buf;
-			buf.resize(sizeof(TcpHeader));
+			buf.resize(sizeof(TcpHeader) + optionsSize);
 
+			// The window in SYN segments is never scaled.
 			auto header = new (buf.data()) TcpHeader {
 				.srcPort = localEp_.port,
 				.destPort = remoteEp_.port,
-				.seqNumber = localFlushedSn_,
+				.seqNumber = localSettledSn_,
 				.ackNumber = 0,
 				.flags = {},
-				.window = 0,
+				.window = std::min(recvRing_.spaceForEnqueue(), size_t{0xFFFF}),
 				.checksum = 0,
 				.urgentPointer = 0,
 			};
-			header->flags.store(TcpHeader::headerWords(sizeof(TcpHeader) / 4)
+			header->flags.store(TcpHeader::headerWords(buf.size() / 4)
 					| TcpHeader::synFlag(true));
+			memcpy(buf.data() + sizeof(TcpHeader), options, optionsSize);
 
-			// Fill in the checksum.
-			PseudoHeader pseudo {
-				.src = targetInfo->source,
-				.dst = remoteEp_.ipAddress,
-				.len = buf.size()
-			};
-			Checksum csum;
-			csum.update(&pseudo, sizeof(PseudoHeader));
-			csum.update(buf.data(), buf.size());
-			header->checksum = csum.finalize();
+			auto checksumOffset = fillChecksum(header, buf, *targetInfo);
 
-			++localFlushedSn_;
+			auto now = currentClock();
+			if(!synSent_) {
+				rttTiming_ = true;
+				rttSampleSn_ = localSettledSn_ + 1;
+				rttSampleTime_ = now;
+			}else{
+				rttTiming_ = false;
+			}
+			synSent_ = true;
+			retransmitFront_ = false;
+			localFlushedSn_ = localSettledSn_ + 1; // SYN counts as one byte.
+			localMaxSn_ = localFlushedSn_;
+			armRetransmitTimer_(now);
 
 			if(debugTcp)
 				std::cout << "netserver: Sending TCP SYN" << std::endl;
 			auto error = co_await ip4().sendFrame(std::move(*targetInfo),
-				buf.data(), buf.size(), static_cast<uint16_t>(IpProto::tcp));
+				buf.data(), buf.size(), static_cast<uint16_t>(IpProto::tcp), checksumOffset);
 			if (error != protocols::fs::Error::none) {
 				// TODO: Return an error to users.
 				std::cout << "netserver: Could not send TCP packet" << std::endl;
@@ -684,66 +1204,111 @@ async::result<void> Tcp4Socket::flushOutPackets_() {
 			assert(connectState_ == ConnectState::connected);
 			size_t flushPointer = localFlushedSn_ - localSettledSn_;
 			size_t windowPointer = localWindowSn_ - localSettledSn_;
+			// We may only have cwnd bytes in flight.
+			size_t limitPointer = std::min(windowPointer, size_t{cc_.cwnd});
 
 			size_t bytesAvailable = sendRing_.availableToDequeue();
 			assert(bytesAvailable >= flushPointer);
 
 			// Check whether we need to send a packet.
-			// TODO: Add retransmission here.
-			bool wantData = (bytesAvailable > flushPointer && windowPointer > flushPointer);
-			bool wantAck = (remoteAckedSn_ != remoteKnownSn_);
-			bool wantWindowUpdate = (announcedWindow_ < recvRing_.spaceForEnqueue());
-
-			if(!wantData && !wantAck && !wantWindowUpdate) {
+			uint32_t holeSn = 0;
+			uint32_t holeEnd = 0;
+			if(seqBefore(retransmitSn_, localSettledSn_))
+				retransmitSn_ = localSettledSn_;
+			bool wantRetransmit = (retransmitFront_ && findHole_(retransmitSn_, holeSn, holeEnd));
+			bool wantData = (bytesAvailable > flushPointer && limitPointer > flushPointer);
+			bool wantAck = (remoteAckedSn_ != remoteKnownSn_ || forceAck_);
+			bool wantWindowUpdate = (announcedWindow_ < (windowField_() << recvWindowScale_));
+			retransmitFront_ = false;
+
+			if(!wantRetransmit && !wantData && !wantAck && !wantWindowUpdate) {
 				co_await flushEvent_.async_wait();
 				continue;
 			}
 
+			uint8_t options[maxTcpOptionsSize];
+			auto optionsSize = writeOptions_(options, false);
+			// Timestamps are part of every segment and thus reduce the payload (RFC 6691).
+			// SACK blocks are rare; we accept slightly larger segments in that case.
+			size_t maxPayload = mss_ - (timestampsEnabled_ ? timestampOptionSize : 0);
+
 			// Construct and transmit the TCP packet.
-			auto chunk = std::min({
-				bytesAvailable - flushPointer,
-				windowPointer - flushPointer,
-				size_t{1280} // TODO: Perform path MTU discovery.
-			});
+			// Fast retransmits resend a single hole, regardless of the congestion window.
+			uint32_t sn;
+			size_t offset;
+			size_t chunk = 0;
+			if(wantRetransmit) {
+				sn = holeSn;
+				offset = holeSn - localSettledSn_;
+				chunk = std::min({
+					bytesAvailable - offset,
+					size_t{holeEnd - holeSn},
+					maxPayload
+				});
+				if(seqBefore(highRetransmitSn_, sn + chunk))
+					highRetransmitSn_ = sn + chunk;
+			}else{
+				sn = localFlushedSn_;
+				offset = flushPointer;
+				if(wantData)
+					chunk = std::min({
+						bytesAvailable - flushPointer,
+						limitPointer - flushPointer,
+						maxPayload
+					});
+			}
 
 			std::vector<char> buf;
-			buf.resize(sizeof(TcpHeader) + chunk);
+			buf.resize(sizeof(TcpHeader) + optionsSize + chunk);
 
 			auto header = new (buf.data()) TcpHeader {
 				.srcPort = localEp_.port,
 				.destPort = remoteEp_.port,
-				.seqNumber = localFlushedSn_,
+				.seqNumber = sn,
 				.ackNumber = remoteKnownSn_,
 				.flags = {},
-				.window = std::min(recvRing_.spaceForEnqueue(), size_t{0xFFFF}),
+				.window = windowField_(),
 				.checksum = 0,
 				.urgentPointer = 0,
 			};
-			header->flags.store(TcpHeader::headerWords(sizeof(TcpHeader) / 4)
+			header->flags.store(TcpHeader::headerWords((sizeof(TcpHeader) + optionsSize) / 4)
 					| TcpHeader::ackFlag(true));
+			memcpy(buf.data() + sizeof(TcpHeader), options, optionsSize);
 
-			sendRing_.dequeueLookahead(flushPointer, buf.data() + sizeof(TcpHeader), chunk);
+			sendRing_.dequeueLookahead(offset,
+					buf.data() + sizeof(TcpHeader) + optionsSize, chunk);
 
-			// Fill in the checksum.
-			PseudoHeader pseudo {
-				.src = targetInfo->source,
-				.dst = remoteEp_.ipAddress,
-				.len = buf.size()
-			};
-			Checksum csum;
-			csum.update(&pseudo, sizeof(PseudoHeader));
-			csum.update(buf.data(), buf.size());
-			header->checksum = csum.finalize();
+			auto checksumOffset = fillChecksum(header, buf, *targetInfo);
 
-			localFlushedSn_ += chunk;
+			if(chunk) {
+				auto now = currentClock();
+				if(seqBefore(sn, localMaxSn_)) {
+					// Karn's algorithm: do not take RTT samples across retransmissions.
+					++totalRetransmits_;
+					rttTiming_ = false;
+				}else if(!rttTiming_) {
+					rttTiming_ = true;
+					rttSampleSn_ = sn + chunk;
+					rttSampleTime_ = now;
+				}
+
+				if(!wantRetransmit) {
+					localFlushedSn_ += chunk;
+					if(seqBefore(localMaxSn_, localFlushedSn_))
+						localMaxSn_ = localFlushedSn_;
+				}
+				if(!rtoDeadline_)
+					armRetransmitTimer_(now);
+			}
 			remoteAckedSn_ = remoteKnownSn_;
-			announcedWindow_ = recvRing_.spaceForEnqueue();
+			forceAck_ = false;
+			announcedWindow_ = windowField_() << recvWindowScale_;
 
 			if(debugTcp)
 				std::cout << "netserver: Sending TCP data (" << chunk << " bytes)" << std::endl;
 			auto error = co_await ip4().sendFrame(std::move(*targetInfo),
 				buf.data(), buf.size(),
-				static_cast<uint16_t>(IpProto::tcp));
+				static_cast<uint16_t>(IpProto::tcp), checksumOffset);
 			if (error != protocols::fs::Error::none) {
 				// TODO: Return an error to users.
 				std::cout << "netserver: Could not send TCP packet" << std::endl;
@@ -753,12 +1318,270 @@ async::result<void> Tcp4Socket::flushOutPackets_() {
 	}
 }
 
+async::result<void> Tcp4Socket::runRetransmitTimer_() {
+	// Keep the socket alive until close_() stops this coroutine.
+	auto self = holder_.lock();
+
+	while(true) {
+		if(closed_)
+			co_return;
+
+		if(!rtoDeadline_) {
+			co_await timerEvent_.async_wait();
+			continue;
+		}
+
+		// The deadline may have moved while we were sleeping; simply re-check it.
+		auto now = currentClock();
+		if(now < rtoDeadline_) {
+			co_await helix::sleepFor(rtoDeadline_ - now, cancelTimer_);
+			continue;
+		}
+
+		retransmitTimeout_(now);
+	}
+}
+
+void Tcp4Socket::armRetransmitTimer_(uint64_t now) {
+	bool wasRunning = rtoDeadline_;
+	rtoDeadline_ = now + rto_;
+	if(!wasRunning)
+		timerEvent_.raise();
+}
+
+void Tcp4Socket::retransmitTimeout_(uint64_t now) {
+	rtoDeadline_ = 0;
+
+	if(connectState_ == ConnectState::sendSyn) {
+		if(!synSent_)
+			return;
+		if(backoff_ >= maxSynRetransmits) {
+			abort_(protocols::fs::Error::timedOut);
+			return;
+		}
+		retransmitFront_ = true;
+	}else if(connectState_ == ConnectState::connected) {
+		uint32_t flightSize = localMaxSn_ - localSettledSn_;
+		if(!flightSize)
+			return;
+		if(backoff_ >= maxRetransmits) {
+			abort_(protocols::fs::Error::timedOut);
+			return;
+		}
+
+		if(debugTcp)
+			std::cout << "netserver: TCP retransmission timeout" << std::endl;
+
+		ccAlgorithm_->onRetransmitTimeout(cc_, flightSize, now);
+
+		// Go back and resend everything starting at the first unacknowledged byte.
+		// The SACK information may be outdated (the remote may renege), so drop it.
+		localFlushedSn_ = localSettledSn_;
+		sacked_.clear();
+		dupAcks_ = 0;
+		inRecovery_ = false;
+		recoverSn_ = localMaxSn_;
+	}else{
+		return;
+	}
+
+	// Back off the timer (RFC 6298, section 5.5).
+	++timeouts_;
+	++backoff_;
+	rttTiming_ = false;
+	rto_ = std::min(rto_ * 2, maxRto);
+	armRetransmitTimer_(now);
+	flushEvent_.raise();
+}
+
+void Tcp4Socket::abort_(protocols::fs::Error error) {
+	if(debugTcp)
+		std::cout << "netserver: Aborting TCP connection" << std::endl;
+
+	// The remote does not know about the connection before it answers our SYN.
+	resetPending_ = (connectState_ == ConnectState::connected);
+	connectState_ = ConnectState::aborted;
+	error_ = error;
+	rtoDeadline_ = 0;
+
+	hupSeq_ = ++currentSeq_;
+	inEvent_.raise();
+	settleEvent_.raise();
+	flushEvent_.raise();
+	pollEvent_.raise();
+}
+
+size_t Tcp4Socket::writeOptions_(uint8_t *p, bool syn) {
+	size_t n = 0;
+	auto timestamp = [&] {
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::timestamp);
+		p[n++] = 10;
+		storeBig32(p + n, currentClock() / 1'000'000);
+		storeBig32(p + n + 4, tsRecent_);
+		n += 8;
+	};
+
+	if(syn) {
+		// We always offer all options; they are only used if the remote agrees.
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::mss);
+		p[n++] = 4;
+		storeBig16(p + n, defaultMss);
+		n += 2;
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::sackPermitted);
+		p[n++] = 2;
+		timestamp();
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::nop);
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::windowScale);
+		p[n++] = 3;
+		p[n++] = localWindowScale_;
+		assert(n == 20);
+		return n;
+	}
+
+	if(timestampsEnabled_) {
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::nop);
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::nop);
+		timestamp();
+	}
+
+	if(sackEnabled_ && !outOfOrder_.empty()) {
+		// The FIN occupies one sequence number after the last block.
+		std::vector<TcpSackBlock> blocks = outOfOrder_;
+		if(outOfOrderFinSn_ && blocks.back().right == *outOfOrderFinSn_)
+			++blocks.back().right;
+
+		// RFC 2018: the block containing the most recent segment comes first.
+		auto it = std::find_if(blocks.begin(), blocks.end(), [&] (const TcpSackBlock &block) {
+			return !seqBefore(lastOutOfOrderSn_, block.left)
+					&& seqBefore(lastOutOfOrderSn_, block.right);
+		});
+		if(it != blocks.end())
+			std::rotate(blocks.begin(), it, it + 1);
+
+		size_t numBlocks = std::min(blocks.size(), (maxTcpOptionsSize - n - 4) / 8);
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::nop);
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::nop);
+		p[n++] = static_cast<uint8_t>(TcpOptionKind::sack);
+		p[n++] = 2 + numBlocks * 8;
+		for(size_t i = 0; i < numBlocks; ++i) {
+			storeBig32(p + n, blocks[i].left);
+			storeBig32(p + n + 4, blocks[i].right);
+			n += 8;
+		}
+	}
+
+	assert(!(n % 4) && n <= maxTcpOptionsSize);
+	return n;
+}
+
+void Tcp4Socket::updateSacked_(const TcpOptions &options) {
+	// Forget about blocks that are now cumulatively acknowledged.
+	std::erase_if(sacked_, [&] (const TcpSackBlock &block) {
+		return !seqBefore(localSettledSn_, block.right);
+	});
+	for(auto &block : sacked_) {
+		if(seqBefore(block.left, localSettledSn_))
+			block.left = localSettledSn_;
+	}
+
+	if(!sackEnabled_)
+		return;
+
+	for(size_t i = 0; i < options.numSackBlocks; ++i) {
+		auto block = options.sackBlocks[i];
+
+		// Ignore D-SACKs and bogus blocks.
+		if(!seqBefore(block.left, block.right)
+				|| !seqBefore(localSettledSn_, block.right)
+				|| seqBefore(localMaxSn_, block.right))
+			continue;
+		if(seqBefore(block.left, localSettledSn_))
+			block.left = localSettledSn_;
+
+		// Insert the block and merge it with overlapping blocks.
+		auto it = std::find_if(sacked_.begin(), sacked_.end(), [&] (const TcpSackBlock &other) {
+			return !seqBefore(other.right, block.left);
+		});
+		while(it != sacked_.end() && !seqBefore(block.right, it->left)) {
+			if(seqBefore(it->left, block.left))
+				block.left = it->left;
+			if(seqBefore(block.right, it->right))
+				block.right = it->right;
+			it = sacked_.erase(it);
+		}
+		sacked_.insert(it, block);
+	}
+}
+
+bool Tcp4Socket::findHole_(uint32_t from, uint32_t &holeSn, uint32_t &holeEnd) {
+	holeSn = from;
+	for(auto &block : sacked_) {
+		if(seqBefore(holeSn, block.left)) {
+			holeEnd = block.left;
+			return true;
+		}
+		if(seqBefore(holeSn, block.right))
+			holeSn = block.right;
+	}
+	holeEnd = localMaxSn_;
+	return seqBefore(holeSn, holeEnd);
+}
+
+void Tcp4Socket::sampleRtt_(uint64_t rtt) {
+	// RFC 6298, section 2.
+	if(!srtt_) {
+		srtt_ = rtt;
+		rttVar_ = rtt / 2;
+	}else{
+		uint64_t delta = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+		rttVar_ = (3 * rttVar_ + delta) / 4;
+		srtt_ = (7 * srtt_ + rtt) / 8;
+	}
+	rto_ = std::clamp(srtt_ + std::max(clockGranularity, 4 * rttVar_), minRto, maxRto);
+}
+
+struct tcp_info Tcp4Socket::getInfo_() {
+	struct tcp_info info;
+	memset(&info, 0, sizeof(info));
+
+	if(connectState_ == ConnectState::connected) {
+		info.tcpi_state = tcpStateEstablished;
+	}else if(connectState_ == ConnectState::sendSyn) {
+		info.tcpi_state = tcpStateSynSent;
+	}else{
+		info.tcpi_state = tcpStateClose;
+	}
+	info.tcpi_ca_state = inRecovery_ ? 3 : 0; // TCP_CA_Recovery or TCP_CA_Open.
+	info.tcpi_retransmits = backoff_;
+	info.tcpi_backoff = backoff_;
+	info.tcpi_rto = rto_ / 1000;
+	if(timestampsEnabled_)
+		info.tcpi_options |= TCPI_OPT_TIMESTAMPS;
+	if(sackEnabled_)
+		info.tcpi_options |= TCPI_OPT_SACK;
+	if(sendWindowScale_ || recvWindowScale_) {
+		info.tcpi_options |= TCPI_OPT_WSCALE;
+		info.tcpi_snd_wscale = sendWindowScale_;
+		info.tcpi_rcv_wscale = recvWindowScale_;
+	}
+	info.tcpi_snd_mss = mss_;
+	info.tcpi_rcv_mss = mss_;
+	info.tcpi_unacked = (localMaxSn_ - localSettledSn_ + mss_ - 1) / mss_;
+	info.tcpi_retrans = timeouts_ + fastRetransmits_;
+	info.tcpi_rtt = srtt_ / 1000;
+	info.tcpi_rttvar = rttVar_ / 1000;
+	info.tcpi_snd_ssthresh = cc_.ssthresh == UINT32_MAX ? 0x7FFFFFFF : cc_.ssthresh / mss_;
+	info.tcpi_snd_cwnd = cc_.cwnd / mss_;
+	info.tcpi_total_retrans = totalRetransmits_;
+	return info;
+}
+
 void Tcp4Socket::handleInPacket_(TcpPacket packet) {
 	if(boundInterface_ && boundInterface_->index() != packet.packet->link.lock()->index())
 		return;
 
 	if(connectState_ == ConnectState::sendSyn) {
-		if(localSettledSn_ == localFlushedSn_) {
+		if(!synSent_) {
 			std::cout << "netserver: Rejecting packet before SYN is sent [sendSyn]"
 					<< std::endl;
 			return;
@@ -780,6 +1603,30 @@ void Tcp4Socket::handleInPacket_(TcpPacket packet) {
 			return;
 		}
 
+		auto now = currentClock();
+		if(rttTiming_)
+			sampleRtt_(now - rttSampleTime_);
+		rttTiming_ = false;
+		backoff_ = 0;
+		rtoDeadline_ = 0;
+
+		// Negotiate options.
+		auto &options = packet.options;
+		mss_ = std::min(defaultMss, options.mss ? uint32_t{*options.mss} : fallbackMss);
+		if(options.windowScale) {
+			sendWindowScale_ = *options.windowScale;
+			recvWindowScale_ = localWindowScale_;
+		}
+		sackEnabled_ = options.sackPermitted;
+		if(options.hasTimestamp) {
+			timestampsEnabled_ = true;
+			tsRecent_ = options.tsVal;
+		}
+
+		// Initial window as in RFC 6928.
+		cc_.mss = mss_;
+		cc_.cwnd = std::min(10 * mss_, std::max(2 * mss_, uint32_t{14600}));
+
 		++localSettledSn_;
 		localWindowSn_ = localSettledSn_ + packet.header.window.load();
 		remoteAckedSn_ = packet.header.seqNumber.load();
@@ -788,55 +1635,264 @@ void Tcp4Socket::handleInPacket_(TcpPacket packet) {
 		flushEvent_.raise();
 		settleEvent_.raise();
 	}else if(connectState_ == ConnectState::connected) {
-		if(packet.header.seqNumber.load() == remoteKnownSn_) {
-			bool gotUpdate = false;
+		auto &options = packet.options;
+		if(timestampsEnabled_ && options.hasTimestamp) {
+			// PAWS (RFC 7323, section 5): drop segments with outdated timestamps.
+			if(seqBefore(options.tsVal, tsRecent_)) {
+				forceAck_ = true;
+				flushEvent_.raise();
+				return;
+			}
 
-			auto payload = packet.payload();
-			size_t chunk = std::min(payload.size(), recvRing_.spaceForEnqueue());
-			if(chunk) {
-				recvRing_.enqueue(payload.data(), chunk);
-				remoteKnownSn_ += chunk;
-				if(announcedWindow_ < chunk) {
-					announcedWindow_ = 0;
-				}else{
-					announcedWindow_ -= chunk;
-				}
+			// Only segments that we are about to acknowledge update TS.Recent.
+			if(!seqBefore(remoteAckedSn_, packet.header.seqNumber.load()))
+				tsRecent_ = options.tsVal;
+		}
 
-				inSeq_ = ++currentSeq_;
-				gotUpdate = true;
-			}
+		handleData_(packet);
+
+		if(packet.header.flags.load() & TcpHeader::ackFlag)
+			handleAck_(packet);
+	}
+}
 
-			if(packet.header.flags.load() & TcpHeader::finFlag) {
-				++remoteKnownSn_; // FIN counts as one byte.
-				remoteClosed_ = true;
+void Tcp4Socket::handleData_(TcpPacket &packet) {
+	auto payload = packet.payload();
+	uint32_t sn = packet.header.seqNumber.load();
+	size_t offset = 0;
+	size_t size = payload.size();
+	bool fin = packet.header.flags.load() & TcpHeader::finFlag;
+	if(!size && !fin)
+		return;
 
-				hupSeq_ = ++currentSeq_;
-				gotUpdate = true;
-			}
+	if(remoteClosed_) {
+		forceAck_ = true;
+		flushEvent_.raise();
+		return;
+	}
+
+	// Drop data that we already received.
+	if(seqBefore(sn, remoteKnownSn_)) {
+		size_t duplicate = remoteKnownSn_ - sn;
+		if(duplicate >= size + (fin ? 1 : 0)) {
+			// Acknowledge duplicates; our previous ACK might have been lost.
+			forceAck_ = true;
+			flushEvent_.raise();
+			return;
+		}
+		offset = duplicate;
+		size -= duplicate;
+		sn = remoteKnownSn_;
+	}
+
+	// Drop data beyond the receive window.
+	size_t space = recvRing_.spaceForEnqueue();
+	size_t windowOffset = sn - remoteKnownSn_;
+	if(windowOffset + size > space) {
+		if(windowOffset >= space) {
+			forceAck_ = true;
+			flushEvent_.raise();
+			return;
+		}
+		size = space - windowOffset;
+		fin = false;
+	}
 
-			if(gotUpdate) {
-				inEvent_.raise();
+	if(sn != remoteKnownSn_) {
+		// Store the data behind the enqueued data until the gap before it is filled.
+		if(size) {
+			if(!addOutOfOrder_(sn, sn + size)) {
+				forceAck_ = true;
 				flushEvent_.raise();
-				pollEvent_.raise();
+				return;
 			}
+			recvRing_.writeAhead(windowOffset, static_cast<char *>(payload.data()) + offset, size);
 		}
+		if(fin)
+			outOfOrderFinSn_ = sn + size;
+		lastOutOfOrderSn_ = sn;
 
-		if(packet.header.flags.load() & TcpHeader::ackFlag) {
-			size_t validWindow = localFlushedSn_ - localSettledSn_;
-			size_t ackPointer = packet.header.ackNumber.load() - localSettledSn_;
-			if(ackPointer <= validWindow) {
-				localSettledSn_ += ackPointer;
-				localWindowSn_ = localSettledSn_ + packet.header.window.load();
-				sendRing_.dequeueAdvance(ackPointer);
-				outSeq_ = ++currentSeq_;
-				settleEvent_.raise();
-				pollEvent_.raise();
-			}else{
-				std::cout << "netserver: Rejecting ack-number outside of valid window"
-						<< std::endl;
+		// Acknowledge unexpected segments immediately (RFC 5681, section 4.2);
+		// the duplicate ACKs allow the remote to detect losses.
+		forceAck_ = true;
+		flushEvent_.raise();
+		return;
+	}
+
+	auto previousKnownSn = remoteKnownSn_;
+	recvRing_.writeAhead(0, static_cast<char *>(payload.data()) + offset, size);
+
+	// Take out-of-order data that is now in sequence.
+	uint32_t endSn = sn + size;
+	while(!outOfOrder_.empty() && !seqBefore(endSn, outOfOrder_.front().left)) {
+		if(seqBefore(endSn, outOfOrder_.front().right))
+			endSn = outOfOrder_.front().right;
+		outOfOrder_.erase(outOfOrder_.begin());
+	}
+	if(outOfOrderFinSn_ && !seqBefore(endSn, *outOfOrderFinSn_)) {
+		endSn = *outOfOrderFinSn_;
+		fin = true;
+	}
+
+	recvRing_.commit(endSn - remoteKnownSn_);
+	remoteKnownSn_ = endSn;
+	if(fin) {
+		receiveFin_();
+		outOfOrder_.clear();
+		outOfOrderFinSn_.reset();
+	}
+	growRecvRing_();
+
+	uint32_t received = remoteKnownSn_ - previousKnownSn;
+	announcedWindow_ -= std::min(announcedWindow_, received);
+
+	inSeq_ = ++currentSeq_;
+	inEvent_.raise();
+	flushEvent_.raise();
+	pollEvent_.raise();
+}
+
+bool Tcp4Socket::addOutOfOrder_(uint32_t left, uint32_t right) {
+	// Merge all ranges that overlap or touch [left, right).
+	auto it = std::find_if(outOfOrder_.begin(), outOfOrder_.end(), [&] (const TcpSackBlock &block) {
+		return !seqBefore(block.right, left);
+	});
+	auto last = it;
+	while(last != outOfOrder_.end() && !seqBefore(right, last->left)) {
+		if(seqBefore(last->left, left))
+			left = last->left;
+		if(seqBefore(right, last->right))
+			right = last->right;
+		++last;
+	}
+
+	if(it == last && outOfOrder_.size() == maxOutOfOrderBlocks)
+		return false;
+	it = outOfOrder_.erase(it, last);
+	outOfOrder_.insert(it, {left, right});
+	return true;
+}
+
+void Tcp4Socket::receiveFin_() {
+	++remoteKnownSn_; // FIN counts as one byte.
+	remoteClosed_ = true;
+	hupSeq_ = ++currentSeq_;
+}
+
+void Tcp4Socket::handleAck_(TcpPacket &packet) {
+	auto ackSn = packet.header.ackNumber.load();
+	auto windowSn = ackSn + (uint32_t{packet.header.window.load()} << sendWindowScale_);
+
+	size_t validWindow = localMaxSn_ - localSettledSn_;
+	size_t ackPointer = ackSn - localSettledSn_;
+	if(ackPointer > validWindow) {
+		std::cout << "netserver: Rejecting ack-number outside of valid window"
+				<< std::endl;
+		return;
+	}
+
+	auto now = currentClock();
+
+	if(ackPointer) {
+		localSettledSn_ = ackSn;
+		sendRing_.dequeueAdvance(ackPointer);
+	}
+	updateSacked_(packet.options);
+
+	if(!ackPointer) {
+		// Duplicate ACK as defined by RFC 5681, section 2.
+		bool isDuplicate = validWindow
+				&& !packet.payload().size()
+				&& !(packet.header.flags.load() & TcpHeader::synFlag)
+				&& !(packet.header.flags.load() & TcpHeader::finFlag)
+				&& windowSn == localWindowSn_;
+		if(windowSn != localWindowSn_) {
+			localWindowSn_ = windowSn;
+			flushEvent_.raise();
+		}
+		if(!isDuplicate)
+			return;
+
+		++dupAcks_;
+		if(inRecovery_) {
+			// Every duplicate ACK indicates that a segment left the network.
+			cc_.cwnd += mss_;
+
+			// With SACK, retransmit the next hole below the highest SACKed byte.
+			uint32_t holeSn;
+			uint32_t holeEnd;
+			if(!sacked_.empty()
+					&& findHole_(highRetransmitSn_, holeSn, holeEnd)
+					&& seqBefore(holeSn, sacked_.back().left)) {
+				retransmitFront_ = true;
+				retransmitSn_ = holeSn;
 			}
+			flushEvent_.raise();
+		}else if(dupAcks_ == dupAckThreshold && seqBefore(recoverSn_, ackSn)) {
+			if(debugTcp)
+				std::cout << "netserver: TCP fast retransmit" << std::endl;
+
+			ccAlgorithm_->onLoss(cc_, validWindow, now);
+			cc_.cwnd = cc_.ssthresh + dupAckThreshold * mss_;
+			inRecovery_ = true;
+			recoverSn_ = localMaxSn_;
+			retransmitFront_ = true;
+			retransmitSn_ = localSettledSn_;
+			highRetransmitSn_ = localSettledSn_;
+			++fastRetransmits_;
+			flushEvent_.raise();
 		}
+		return;
+	}
+
+	localWindowSn_ = windowSn;
+	if(seqBefore(localFlushedSn_, localSettledSn_))
+		localFlushedSn_ = localSettledSn_;
+	if(seqBefore(highRetransmitSn_, localSettledSn_))
+		highRetransmitSn_ = localSettledSn_;
+	dupAcks_ = 0;
+
+	if(timestampsEnabled_ && packet.options.hasTimestamp && packet.options.tsEcr) {
+		// RTTM (RFC 7323, section 4): timestamps are unambiguous even for retransmissions.
+		uint32_t nowMs = now / 1'000'000;
+		sampleRtt_(uint64_t{nowMs - packet.options.tsEcr} * 1'000'000);
+		rttTiming_ = false;
+	}else if(rttTiming_ && !seqBefore(ackSn, rttSampleSn_)) {
+		sampleRtt_(now - rttSampleTime_);
+		rttTiming_ = false;
 	}
+	backoff_ = 0;
+
+	if(inRecovery_) {
+		if(!seqBefore(ackSn, recoverSn_)) {
+			// Full acknowledgement: deflate the window (RFC 6582, section 3.2, step 3).
+			uint32_t flightSize = localMaxSn_ - localSettledSn_;
+			cc_.cwnd = std::min(cc_.ssthresh, std::max(flightSize, mss_) + mss_);
+			inRecovery_ = false;
+		}else{
+			// Partial acknowledgement: retransmit the next hole and partially deflate.
+			cc_.cwnd -= std::min(cc_.cwnd, static_cast<uint32_t>(ackPointer));
+			if(ackPointer >= mss_)
+				cc_.cwnd += mss_;
+			cc_.cwnd = std::max(cc_.cwnd, mss_);
+			retransmitFront_ = true;
+			retransmitSn_ = localSettledSn_;
+		}
+	}else{
+		ccAlgorithm_->onAck(cc_, ackPointer, now, srtt_);
+	}
+
+	// Restart the timer for the remaining outstanding data (RFC 6298, section 5).
+	if(localMaxSn_ == localSettledSn_) {
+		rtoDeadline_ = 0;
+	}else{
+		armRetransmitTimer_(now);
+	}
+
+	outSeq_ = ++currentSeq_;
+	flushEvent_.raise();
+	settleEvent_.raise();
+	pollEvent_.raise();
 }
 
 void Tcp4::feedDatagram(smarter::shared_ptr<const Ip4Packet> packet) {
@@ -850,38 +1906,45 @@ void Tcp4::feedDatagram(smarter::shared_ptr<const Ip4Packet> packet) {
 		std::cout << "netserver: Received TCP packet at port " << tcp.header.destPort.load()
 				<< " (" << tcp.payload().size() << " bytes)" << std::endl;
 
-	auto it = binds.lower_bound({ 0, tcp.header.destPort.load() });
-	for (; it != binds.end() && it->first.port == tcp.header.destPort.load(); it++) {
-		auto existingEp = it->first;
-		if (existingEp.ipAddress == tcp.packet->header.destination
-				|| existingEp.ipAddress == INADDR_ANY) {
-			it->second->handleInPacket_(std::move(tcp));
-			break;
-		}
+	TcpConnectionKey key{
+		{tcp.packet->header.destination, tcp.header.destPort.load()},
+		{tcp.packet->header.source, tcp.header.srcPort.load()}
+	};
+	auto it = connections_.find(key);
+	if(it == connections_.end()) {
+		key.local.ipAddress = INADDR_ANY;
+		it = connections_.find(key);
+	}
+	if(it != connections_.end()) {
+		it->second->handleInPacket_(std::move(tcp));
+		return;
 	}
+
+	if(auto socket = binds.find(tcp.packet->header.destination, tcp.header.destPort.load()))
+		(*socket)->handleInPacket_(std::move(tcp));
 }
 
 bool Tcp4::tryBind(smarter::shared_ptr<Tcp4Socket> socket, TcpEndpoint wantedEp) {
-	auto it = binds.lower_bound(wantedEp);
-	for (; it != binds.end() && it->first.port == wantedEp.port; it++) {
-		auto existingEp = it->first;
-		if (existingEp.ipAddress == INADDR_ANY || wantedEp.ipAddress == INADDR_ANY
-				|| existingEp.ipAddress == wantedEp.ipAddress) {
-			return false;
-		}
-	}
-	socket->localEp_ = wantedEp;
-	binds.emplace(wantedEp, std::move(socket));
+	auto raw = socket.get();
+	if(!binds.tryBind(wantedEp.ipAddress, wantedEp.port, std::move(socket)))
+		return false;
+	raw->localEp_ = wantedEp;
 	return true;
 }
 
 bool Tcp4::unbind(TcpEndpoint e) {
-	return binds.erase(e) != 0;
+	return binds.unbind(e.ipAddress, e.port);
+}
+
+void Tcp4::addConnection(smarter::shared_ptr<Tcp4Socket> socket, TcpConnectionKey key) {
+	connections_.emplace(key, std::move(socket));
+}
+
+void Tcp4::removeConnection(TcpConnectionKey key) {
+	connections_.erase(key);
 }
 
 void Tcp4::serveSocket(int flags, helix::UniqueLane lane) {
-	using protocols::fs::servePassthrough;
 	auto sock = Tcp4Socket::makeSocket(this, flags & SOCK_NONBLOCK);
-	async::detach(servePassthrough(std::move(lane), std::move(sock),
-			&Tcp4Socket::ops));
+	async::detach(Tcp4Socket::serve(std::move(sock), std::move(lane)));
 }
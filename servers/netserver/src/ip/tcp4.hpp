@@ -2,7 +2,9 @@
 
 #include <helix/ipc.hpp>
 #include <smarter.hpp>
-#include <map>
+#include <unordered_map>
+
+#include "bind-table.hpp"
 
 class Ip4Packet;
 
@@ -11,18 +13,48 @@ struct TcpEndpoint {
 		return std::tie(l.port, l.ipAddress) < std::tie(r.port, r.ipAddress);
 	}
 
+	friend bool operator==(const TcpEndpoint &, const TcpEndpoint &) = default;
+
 	uint32_t ipAddress = 0;
 	uint16_t port = 0;
 };
 
+// Identifies a connection. local.ipAddress is INADDR_ANY if the socket
+// was not bound to a specific address.
+struct TcpConnectionKey {
+	friend bool operator==(const TcpConnectionKey &, const TcpConnectionKey &) = default;
+
+	TcpEndpoint local;
+	TcpEndpoint remote;
+};
+
+struct TcpConnectionKeyHash {
+	size_t operator() (const TcpConnectionKey &k) const {
+		uint64_t x = (uint64_t(k.local.ipAddress) << 32) | k.remote.ipAddress;
+		uint64_t y = (uint64_t(k.local.port) << 16) | k.remote.port;
+		x ^= y * 0x9E3779B97F4A7C15;
+		x ^= x >> 32;
+		x *= 0xD6E8FEB86659FD93;
+		x ^= x >> 32;
+		return x;
+	}
+};
+
 struct Tcp4Socket;
 
 struct Tcp4 {
 	void feedDatagram(smarter::shared_ptr<const Ip4Packet>);
 	bool tryBind(smarter::shared_ptr<Tcp4Socket> socket, TcpEndpoint ipAddress);
 	bool unbind(TcpEndpoint remote);
+	// Registers a connected socket such that incoming segments are found by their 4-tuple.
+	void addConnection(smarter::shared_ptr<Tcp4Socket> socket, TcpConnectionKey key);
+	void removeConnection(TcpConnectionKey key);
 	void serveSocket(int flags, helix::UniqueLane lane);
 
 private:
-	std::map<TcpEndpoint, smarter::shared_ptr<Tcp4Socket>> binds;
+	// Connected sockets.
+	std::unordered_map<TcpConnectionKey, smarter::shared_ptr<Tcp4Socket>,
+			TcpConnectionKeyHash> connections_;
+	// All bound sockets. Receives segments that do not match a connection.
+	BindTable<smarter::shared_ptr<Tcp4Socket>> binds;
 };
@@ -81,7 +81,7 @@ struct Udp {
 		if (payload.size() < header.len) {
 			return false;
 		}
-		if (header.chk != 0) {
+		if (header.chk != 0 && !packet->l4ChecksumValid) {
 			PseudoHeader phdr;
 			phdr.src = packet->header.source;
 			phdr.dst = packet->header.destination;
@@ -144,16 +144,21 @@ using namespace protocols::fs;
 struct Udp4Socket {
 	Udp4Socket(Udp4 *parent) : parent_(parent) {}
 
-	~Udp4Socket() {
-		parent_->unbind(local_);
-	}
-
 	static auto make_socket(Udp4 *parent) {
 		auto s = smarter::make_shared<Udp4Socket>(parent);
 		s->holder_ = s;
 		return s;
 	}
 
+	// Serves the socket until its lane is closed, then unbinds it.
+	// The bind table refers to the socket; unbinding drops that reference.
+	static async::result<void> serve(smarter::shared_ptr<Udp4Socket> self,
+			helix::UniqueLane lane) {
+		co_await servePassthrough(std::move(lane), self, &ops);
+		if(self->local_.port)
+			self->parent_->unbind(self->local_);
+	}
+
 	static async::result<protocols::fs::Error> connect(void* obj,
 			helix_ng::CredentialsView creds,
 			const void *addr_ptr, size_t addr_size) {
@@ -442,11 +447,6 @@ struct Udp4Socket {
 		auto number = dist(rng);
 		auto range_size = dist.b() - dist.a();
 		auto shared_from_this = holder_.lock();
-		// TODO(arsen): optimize to not call lower_bound every time?
-		// I believe that such a thing is not needed right now: nearly
-		// (read: absolutely) every case is is an immediate miss: we are
-		// using next to nothing in this region, or any other region for
-		// that manner
 		for (int i = 0; i < range_size; i++) {
 			uint16_t port = dist.a() + ((number + i) % range_size);
 			if (parent_->tryBind(shared_from_this, { addr, port })) {
@@ -481,40 +481,29 @@ void Udp4::feedDatagram(smarter::shared_ptr<const Ip4Packet> packet, std::weak_p
 
 	std::cout << "received udp datagram to port " << udp.header.dst << std::endl;
 
-	auto i = binds.lower_bound({ 0, udp.header.dst });
-	for (; i != binds.end() && i->first.port == udp.header.dst; i++) {
-		auto ep = i->first;
-		if (ep.addr == udp.packet->header.destination
-			|| ep.addr == INADDR_ANY) {
-			i->second->queue_.emplace(std::move(udp));
-			i->second->_inSeq = ++i->second->_currentSeq;
-			i->second->_statusBell.raise();
-			break;
-		}
-	}
+	auto socket = binds.find(udp.packet->header.destination, udp.header.dst);
+	if(!socket)
+		return;
+
+	auto s = socket->get();
+	s->queue_.emplace(std::move(udp));
+	s->_inSeq = ++s->_currentSeq;
+	s->_statusBell.raise();
 }
 
 bool Udp4::tryBind(smarter::shared_ptr<Udp4Socket> socket, Endpoint addr) {
-	auto i = binds.lower_bound(addr);
-	for (; i != binds.end() && i->first.port == addr.port; i++) {
-		auto ep = i->first;
-		if (ep.addr == INADDR_ANY || addr.addr == INADDR_ANY
-			|| ep.addr == addr.addr) {
-			return false;
-		}
-	}
-	socket->local_ = addr;
-	binds.emplace(addr, std::move(socket));
+	auto raw = socket.get();
+	if(!binds.tryBind(addr.addr, addr.port, std::move(socket)))
+		return false;
+	raw->local_ = addr;
 	return true;
 }
 
 bool Udp4::unbind(Endpoint e) {
-	return binds.erase(e) != 0;
+	return binds.unbind(e.addr, e.port);
 }
 
 void Udp4::serveSocket(helix::UniqueLane lane) {
-	using protocols::fs::servePassthrough;
 	auto sock = Udp4Socket::make_socket(this);
-	async::detach(servePassthrough(std::move(lane), std::move(sock),
-			&Udp4Socket::ops));
+	async::detach(Udp4Socket::serve(std::move(sock), std::move(lane)));
 }
@@ -2,9 +2,10 @@
 
 #include <helix/ipc.hpp>
 #include <smarter.hpp>
-#include <map>
 #include <netserver/nic.hpp>
 
+#include "bind-table.hpp"
+
 class Ip4Packet;
 
 struct Endpoint {
@@ -24,5 +25,5 @@ struct Udp4 {
 	bool unbind(Endpoint remote);
 	void serveSocket(helix::UniqueLane lane);
 private:
-	std::map<Endpoint, smarter::shared_ptr<Udp4Socket>> binds;
+	BindTable<smarter::shared_ptr<Udp4Socket>> binds;
 };
@@ -4,12 +4,14 @@
 
 #include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <arch/bit.hpp>
 #include <frg/formatting.hpp>
 #include <frg/logging.hpp>
 #include <net/if.h>
 
 #include "ip/arp.hpp"
+#include "ip/checksum.hpp"
 #include "ip/ip4.hpp"
 #include "raw.hpp"
 
@@ -126,6 +128,79 @@ Link::AllocatedBuffer Link::allocateFrame(MacAddress to, EtherType type,
 	return buf;
 }
 
+async::result<Link::ReceivedFrame> Link::receiveFrame(arch::dma_buffer_view frame) {
+	co_return ReceivedFrame{co_await receive(frame)};
+}
+
+async::result<void> Link::sendWithChecksum(const arch::dma_buffer_view frame,
+		ChecksumRequest csum) {
+	// The checksum field already contains the pseudo header sum.
+	auto data = reinterpret_cast<uint8_t *>(frame.data());
+	Checksum chk;
+	chk.update(frame.subview(csum.start));
+	uint16_t result = chk.finalize();
+	data[csum.start + csum.offset] = result >> 8;
+	data[csum.start + csum.offset + 1] = result;
+	co_await send(frame);
+}
+
+async::result<std::vector<Link::RxFrame>> Link::receiveBatch(size_t) {
+	arch::dma_buffer buffer{dmaPool(), 1514};
+	auto [size, checksumValid] = co_await receiveFrame(buffer);
+
+	std::vector<RxFrame> frames;
+	auto frame = buffer.subview(0, size);
+	frames.push_back({std::move(buffer), frame, checksumValid});
+	co_return frames;
+}
+
+async::result<void> Link::sendBatch(std::vector<TxFrame> frames) {
+	for(auto &tx : frames) {
+		if(tx.checksum)
+			co_await sendWithChecksum(tx.frame, *tx.checksum);
+		else
+			co_await send(tx.frame);
+	}
+}
+
+async::result<void> Link::transmit(arch::dma_buffer frame,
+		std::optional<ChecksumRequest> checksum) {
+	// Apply backpressure if the NIC cannot keep up.
+	while(txQueue_.size() >= maxQueuedFrames && txFlushing_)
+		co_await txSpaceEvent_.async_wait();
+
+	txQueue_.push_back({std::move(frame), checksum});
+	if(!txCorked_ || txQueue_.size() >= maxQueuedFrames)
+		co_await flushTransmitQueue_();
+}
+
+void Link::corkTransmit() {
+	txCorked_++;
+}
+
+async::result<void> Link::uncorkTransmit() {
+	assert(txCorked_);
+	if(!--txCorked_)
+		co_await flushTransmitQueue_();
+}
+
+async::result<void> Link::flushTransmitQueue_() {
+	// Frames that are queued during sendBatch() are sent by the running flush.
+	if(txFlushing_)
+		co_return;
+
+	txFlushing_ = true;
+	while(!txQueue_.empty()) {
+		std::vector<TxFrame> batch{std::make_move_iterator(txQueue_.begin()),
+				std::make_move_iterator(txQueue_.end())};
+		txQueue_.clear();
+		txSpaceEvent_.raise();
+
+		co_await sendBatch(std::move(batch));
+	}
+	txFlushing_ = false;
+}
+
 unsigned int Link::iff_flags() {
 	unsigned int flags = 0;
 
@@ -143,36 +218,51 @@ unsigned int Link::iff_flags() {
 	return flags;
 }
 
-async::detached runDevice(std::shared_ptr<nic::Link> dev) {
+namespace {
+
+// Maximal number of frames that runDevice() takes from the NIC at once.
+constexpr size_t maxReceiveBatch = 64;
+
+void feedFrame(std::shared_ptr<Link> &dev, Link::RxFrame rx) {
 	using namespace arch;
-	while(true) {
-		dma_buffer frameBuffer { dev->dmaPool(), 1514 };
-		auto len = co_await dev->receive(frameBuffer);
-
-		if(!dev->rawIp()) {
-			auto capsule = frameBuffer.subview(14, len - 14);
-			auto data = reinterpret_cast<uint8_t*>(frameBuffer.data());
-			uint16_t ethertype = data[12] << 8 | data[13];
-			nic::MacAddress dstsrc[2];
-			std::memcpy(dstsrc, data, sizeof(dstsrc));
-
-			raw().feedPacket(frameBuffer.subview(0, len));
-
-			switch (ethertype) {
-			case ETHER_TYPE_IP4:
-				ip4().feedPacket(dstsrc[0], dstsrc[1],
-					std::move(frameBuffer), capsule, dev);
-				break;
-			case ETHER_TYPE_ARP:
-				neigh4().feedArp(dstsrc[0], capsule, dev);
-				break;
-			default:
-				break;
-			}
-		} else {
-			dma_buffer_view capsule = frameBuffer;
-			ip4().feedPacket({}, {}, std::move(frameBuffer), capsule, dev);
+	auto frame = rx.frame;
+
+	if(!dev->rawIp()) {
+		auto capsule = frame.subview(14, frame.size() - 14);
+		auto data = reinterpret_cast<uint8_t*>(frame.data());
+		uint16_t ethertype = data[12] << 8 | data[13];
+		nic::MacAddress dstsrc[2];
+		std::memcpy(dstsrc, data, sizeof(dstsrc));
+
+		raw().feedPacket(frame);
+
+		switch (ethertype) {
+		case ETHER_TYPE_IP4:
+			ip4().feedPacket(dstsrc[0], dstsrc[1],
+				std::move(rx.buffer), capsule, dev, rx.checksumValid);
+			break;
+		case ETHER_TYPE_ARP:
+			neigh4().feedArp(dstsrc[0], capsule, dev);
+			break;
+		default:
+			break;
 		}
+	} else {
+		ip4().feedPacket({}, {}, std::move(rx.buffer), frame, dev, rx.checksumValid);
+	}
+}
+
+} // anonymous namespace
+
+async::detached runDevice(std::shared_ptr<nic::Link> dev) {
+	while(true) {
+		auto frames = co_await dev->receiveBatch(maxReceiveBatch);
+
+		// Replies that are generated while processing the batch are sent together.
+		dev->corkTransmit();
+		for(auto &frame : frames)
+			feedFrame(dev, std::move(frame));
+		co_await dev->uncorkTransmit();
 	}
 }
 } // namespace nic
@@ -1,16 +1,130 @@
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include <async/result.hpp>
 #include <async/algorithm.hpp>
 #include <helix/ipc.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace {
 
+// Results of all benchmarks that ran. Printed as a JSON array at exit.
+std::vector<std::string> jsonResults;
+
+// Only benchmark groups whose name contains this string are run.
+std::string benchFilter;
+
+bool isSelected(const std::string &name) {
+	return name.find(benchFilter) != std::string::npos;
+}
+
+std::string formatSize(size_t size) {
+	if(size < 1024) {
+		return std::to_string(size) + " B";
+	}else if(size < 1024 * 1024) {
+		return std::to_string(size / 1024) + " KiB";
+	}else{
+		return std::to_string(size / (1024 * 1024)) + " MiB";
+	}
+}
+
+// Restricts the calling thread to a single CPU.
+void pinToCpu(unsigned int cpu) {
+	std::vector<uint8_t> mask((std::thread::hardware_concurrency() + 7) / 8);
+	mask[cpu / 8] |= 1 << (cpu % 8);
+	HEL_CHECK(helSetAffinity(kHelThisThread, mask.data(), mask.size()));
+}
+
+// Allows the calling thread to run on all CPUs again.
+void unpin() {
+	unsigned int numCpus = std::thread::hardware_concurrency();
+	std::vector<uint8_t> mask((numCpus + 7) / 8);
+	for(unsigned int cpu = 0; cpu < numCpus; ++cpu)
+		mask[cpu / 8] |= 1 << (cpu % 8);
+	HEL_CHECK(helSetAffinity(kHelThisThread, mask.data(), mask.size()));
+}
+
+// Measures the latency of individual operations and reports percentiles.
+struct LatencyBenchmark {
+	using clock = std::chrono::high_resolution_clock;
+
+	explicit LatencyBenchmark(std::string name)
+	: name_{std::move(name)} {
+		std::cout << name_ << std::endl;
+	}
+
+	static clock::time_point now() {
+		return clock::now();
+	}
+
+	void record(clock::time_point start) {
+		auto elapsed = duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+		samples_.push_back(elapsed.count());
+	}
+
+	void recordNanos(uint64_t ns) {
+		samples_.push_back(ns);
+	}
+
+	void finalizeStatistics() {
+		assert(!samples_.empty());
+		std::sort(samples_.begin(), samples_.end());
+
+		double avg = 0;
+		for(uint64_t n : samples_)
+			avg += n;
+		avg /= samples_.size();
+
+		// Nearest-rank percentiles.
+		auto percentile = [&] (double p) -> uint64_t {
+			auto rank = static_cast<size_t>(ceil(p * samples_.size()));
+			return samples_[std::clamp(rank, size_t{1}, samples_.size()) - 1];
+		};
+
+		std::cout << "    " << samples_.size() << " samples, avg: "
+				<< static_cast<uint64_t>(avg) << " ns" << std::endl;
+		std::cout << "    min: " << samples_.front()
+				<< " ns, p50: " << percentile(0.5)
+				<< " ns, p99: " << percentile(0.99)
+				<< " ns, p999: " << percentile(0.999)
+				<< " ns, max: " << samples_.back() << " ns" << std::endl;
+
+		std::stringstream json;
+		json << "{\"name\": \"" << name_ << "\", \"unit\": \"ns\""
+				<< ", \"samples\": " << samples_.size()
+				<< ", \"avg\": " << static_cast<uint64_t>(avg)
+				<< ", \"min\": " << samples_.front()
+				<< ", \"p50\": " << percentile(0.5)
+				<< ", \"p99\": " << percentile(0.99)
+				<< ", \"p999\": " << percentile(0.999)
+				<< ", \"max\": " << samples_.back() << "}";
+		jsonResults.push_back(json.str());
+	}
+
+private:
+	std::string name_;
+	std::vector<uint64_t> samples_;
+};
+
 struct IterationsPerSecondBenchmark {
 	using clock = std::chrono::high_resolution_clock;
 
+	explicit IterationsPerSecondBenchmark(std::string name)
+	: name_{std::move(name)} {
+		std::cout << name_ << std::endl;
+	}
+
 	void launchRepetition() {
 		ref_ = clock::now();
 	}
@@ -39,17 +153,23 @@ struct IterationsPerSecondBenchmark {
 
 		std::cout << "    avg: " << static_cast<uint64_t>(avg)
 				<< ", std: " << static_cast<uint64_t>(sqrt(var)) << std::endl;
+
+		std::stringstream json;
+		json << "{\"name\": \"" << name_ << "\", \"unit\": \"ops/s\""
+				<< ", \"samples\": " << results_.size()
+				<< ", \"avg\": " << static_cast<uint64_t>(avg)
+				<< ", \"std\": " << static_cast<uint64_t>(sqrt(var)) << "}";
+		jsonResults.push_back(json.str());
 	}
 
 private:
+	std::string name_;
 	std::vector<double> results_;
 	std::chrono::time_point<clock> ref_;
 };
 
 void doNopBenchmark() {
-	std::cout << "syscall ops" << std::endl;
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"syscall ops"};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -65,9 +185,7 @@ void doNopBenchmark() {
 }
 
 async::result<void> doAsyncNopBenchmark() {
-	std::cout << "ipc ops" << std::endl;
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"ipc ops"};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -83,10 +201,41 @@ async::result<void> doAsyncNopBenchmark() {
 	bench.finalizeStatistics();
 }
 
-void doFutexBenchmark() {
-	std::cout << "futex waits" << std::endl;
+async::result<void> runAsyncNops(IterationsPerSecondBenchmark &bench, uint64_t &n) {
+	while(!bench.isRepetitionDone()) {
+		for(int i = 0; i < 100; ++i) {
+			auto result = co_await helix_ng::asyncNop();
+			HEL_CHECK(result.error());
+			++n;
+		}
+	}
+}
 
-	IterationsPerSecondBenchmark bench;
+// Runs the ipc ops benchmark on multiple threads concurrently.
+// Each thread has its own dispatcher, so throughput should scale with the number of CPUs
+// unless the threads contend in the kernel (e.g., on the kernel heap).
+void doParallelAsyncNopBenchmark(unsigned int numThreads) {
+	IterationsPerSecondBenchmark bench{"ipc ops, " + std::to_string(numThreads) + " threads"};
+	for(int k = 0; k < 5; ++k) {
+		std::atomic<uint64_t> total{0};
+		std::vector<std::thread> threads;
+		bench.launchRepetition();
+		for(unsigned int t = 0; t < numThreads; ++t) {
+			threads.emplace_back([&] {
+				uint64_t n = 0;
+				async::run(runAsyncNops(bench, n), helix::currentDispatcher);
+				total += n;
+			});
+		}
+		for(auto &thread : threads)
+			thread.join();
+		bench.announceIterations(total.load());
+	}
+	bench.finalizeStatistics();
+}
+
+void doFutexBenchmark() {
+	IterationsPerSecondBenchmark bench{"futex waits"};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -103,9 +252,7 @@ void doFutexBenchmark() {
 }
 
 void doAllocateBenchmark(size_t size) {
-	std::cout << "allocate memory, size = " << (size / (1024 * 1024)) << " MiB" << std::endl;
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"allocate memory, size = " + formatSize(size)};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -121,9 +268,7 @@ void doAllocateBenchmark(size_t size) {
 }
 
 void doMapBenchmark(size_t size) {
-	std::cout << "memory mapping, size = " << (size / (1024 * 1024)) << " MiB" << std::endl;
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"memory mapping, size = " + formatSize(size)};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -143,7 +288,6 @@ void doMapBenchmark(size_t size) {
 }
 
 void doMapPopulatedBenchmark(size_t size) {
-	std::cout << "populated mapping, size = " << (size / (1024 * 1024)) << " MiB" << std::endl;
 
 	HelHandle handle;
 	HEL_CHECK(helAllocateMemory(size, 0, nullptr, &handle));
@@ -158,7 +302,7 @@ void doMapPopulatedBenchmark(size_t size) {
 
 	HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
 
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"populated mapping, size = " + formatSize(size)};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -177,9 +321,7 @@ void doMapPopulatedBenchmark(size_t size) {
 }
 
 void doPageFaultBenchmark(size_t size) {
-	std::cout << "page faults (mapping size = " << (size / (1024 * 1024)) << " MiB)" << std::endl;
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"page faults, mapping size = " + formatSize(size)};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -210,15 +352,7 @@ async::result<void> doSendRecvBufferBenchmark(size_t size) {
 	std::vector<std::byte> sBuf(size);
 	std::vector<std::byte> rBuf(size);
 
-	if(size < 1024) {
-		std::cout << "size = " << size << std::endl;
-	}else if(size < 1024 * 1024) {
-		std::cout << "size = " << (size / 1024) << " KiB" << std::endl;
-	}else{
-		std::cout << "size = " << (size / (1024 * 1024)) << " MiB" << std::endl;
-	}
-
-	IterationsPerSecondBenchmark bench;
+	IterationsPerSecondBenchmark bench{"send/recv buffer, size = " + formatSize(size)};
 	for(int k = 0; k < 5; ++k) {
 		uint64_t n = 0;
 		bench.launchRepetition();
@@ -247,21 +381,426 @@ async::result<void> doSendRecvBufferBenchmark(size_t size) {
 	bench.finalizeStatistics();
 }
 
+// Serves numIterations requests of doStreamRoundTripBenchmark().
+async::result<void> serveRoundTrips(helix::UniqueLane lane, size_t size, int numIterations) {
+	std::vector<std::byte> buffer(size);
+	for(int i = 0; i < numIterations; ++i) {
+		auto [accept, recv] = co_await helix_ng::exchangeMsgs(
+			lane,
+			helix_ng::accept(
+				helix_ng::recvBuffer(buffer.data(), size)
+			)
+		);
+		HEL_CHECK(accept.error());
+		HEL_CHECK(recv.error());
+
+		auto conversation = accept.descriptor();
+		auto [send] = co_await helix_ng::exchangeMsgs(
+			conversation,
+			helix_ng::sendBuffer(buffer.data(), size)
+		);
+		HEL_CHECK(send.error());
+	}
+}
+
+// Measures a request/response exchange (offer/accept + send/recv) between two threads.
+async::result<void> doStreamRoundTripBenchmark(size_t size, int numIterations) {
+	auto [lane1, lane2] = helix::createStream();
+	std::vector<std::byte> request(size);
+	std::vector<std::byte> response(size);
+
+	std::thread server{[&, lane = std::move(lane2)] () mutable {
+		async::run(serveRoundTrips(std::move(lane), size, numIterations),
+				helix::currentDispatcher);
+	}};
+
+	LatencyBenchmark bench{"stream round trip, size = " + formatSize(size)};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		auto [offer, send, recv] = co_await helix_ng::exchangeMsgs(
+			lane1,
+			helix_ng::offer(
+				helix_ng::sendBuffer(request.data(), size),
+				helix_ng::recvBuffer(response.data(), size)
+			)
+		);
+		HEL_CHECK(offer.error());
+		HEL_CHECK(send.error());
+		HEL_CHECK(recv.error());
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+
+	server.join();
+}
+
+// Measures the exchange of a descriptor between two lanes of the same thread.
+async::result<void> doDescriptorBenchmark(int numIterations) {
+	auto [lane1, lane2] = helix::createStream();
+
+	HelHandle memoryHandle;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &memoryHandle));
+	helix::UniqueDescriptor memory{memoryHandle};
+
+	LatencyBenchmark bench{"descriptor push/pull"};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		co_await async::when_all(
+			async::transform(
+				helix_ng::exchangeMsgs(lane1, helix_ng::pushDescriptor(memory)
+			), [&] (auto result) {
+				auto [push] = std::move(result);
+				HEL_CHECK(push.error());
+			}),
+			async::transform(
+				helix_ng::exchangeMsgs(lane2, helix_ng::pullDescriptor()
+			), [&] (auto result) {
+				auto [pull] = std::move(result);
+				HEL_CHECK(pull.error());
+				// The pulled descriptor is closed here.
+				pull.descriptor();
+			})
+		);
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+}
+
+// Measures the latency of individual faults on anonymous memory.
+void doAnonFaultLatencyBenchmark(size_t size) {
+	LatencyBenchmark bench{"anonymous fault latency"};
+
+	for(int k = 0; k < 5; ++k) {
+		HelHandle handle;
+		HEL_CHECK(helAllocateMemory(size, 0, nullptr, &handle));
+		void *window;
+		HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, size,
+				kHelMapProtRead | kHelMapProtWrite, &window));
+
+		auto p = reinterpret_cast<volatile std::byte *>(window);
+		for(size_t progress = 0; progress < size; progress += 0x1000) {
+			auto start = LatencyBenchmark::now();
+			p[progress] = static_cast<std::byte>(0);
+			bench.record(start);
+		}
+
+		HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+		HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+	}
+	bench.finalizeStatistics();
+}
+
+// Measures the latency of write faults that break copy-on-write sharing.
+void doCowFaultLatencyBenchmark(size_t size) {
+	HelHandle sourceHandle;
+	HEL_CHECK(helAllocateMemory(size, 0, nullptr, &sourceHandle));
+	{
+		void *window;
+		HEL_CHECK(helMapMemory(sourceHandle, kHelNullHandle, nullptr, 0, size,
+				kHelMapProtRead | kHelMapProtWrite, &window));
+		memset(window, 0x42, size);
+		HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+	}
+
+	LatencyBenchmark bench{"copy-on-write fault latency"};
+	for(int k = 0; k < 5; ++k) {
+		HelHandle handle;
+		HEL_CHECK(helCopyOnWrite(sourceHandle, 0, size, &handle));
+		void *window;
+		HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, size,
+				kHelMapProtRead | kHelMapProtWrite, &window));
+
+		auto p = reinterpret_cast<volatile std::byte *>(window);
+		for(size_t progress = 0; progress < size; progress += 0x1000) {
+			auto start = LatencyBenchmark::now();
+			p[progress] = static_cast<std::byte>(0);
+			bench.record(start);
+		}
+
+		HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+		HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+	}
+	bench.finalizeStatistics();
+
+	HEL_CHECK(helCloseDescriptor(kHelThisUniverse, sourceHandle));
+}
+
+// Completes all initialization requests of a managed memory object (without filling in data).
+async::result<void> manageMemory(helix::UniqueDescriptor backing) {
+	while(true) {
+		helix::ManageMemory manage;
+		auto &&submit = helix::submitManageMemory(backing, &manage,
+				helix::Dispatcher::global());
+		co_await submit.async_wait();
+		HEL_CHECK(manage.error());
+
+		HEL_CHECK(helUpdateMemory(backing.getHandle(), manage.type(),
+				manage.offset(), manage.length()));
+	}
+}
+
+// Measures the latency of faults on managed (i.e., file-backed) memory.
+// This includes the round trip to the userspace manager.
+void doManagedFaultLatencyBenchmark(size_t size) {
+	HelHandle backingHandle, frontalHandle;
+	HEL_CHECK(helCreateManagedMemory(size, 0, &backingHandle, &frontalHandle));
+
+	// The manager runs forever; it is torn down when the process exits.
+	std::thread manager{[backingHandle] {
+		async::run(manageMemory(helix::UniqueDescriptor{backingHandle}),
+				helix::currentDispatcher);
+	}};
+	manager.detach();
+
+	void *window;
+	HEL_CHECK(helMapMemory(frontalHandle, kHelNullHandle, nullptr, 0, size,
+			kHelMapProtRead, &window));
+
+	LatencyBenchmark bench{"managed fault latency"};
+	auto p = reinterpret_cast<volatile std::byte *>(window);
+	for(size_t progress = 0; progress < size; progress += 0x1000) {
+		auto start = LatencyBenchmark::now();
+		(void)p[progress];
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+
+	HEL_CHECK(helUnmapMemory(kHelNullHandle, window, size));
+	HEL_CHECK(helCloseDescriptor(kHelThisUniverse, frontalHandle));
+}
+
+// Measures map + touch + unmap while other threads of the same address space
+// run on numCpus - 1 other CPUs, i.e., unmapping requires TLB shootdown.
+void doShootdownBenchmark(unsigned int numCpus, int numIterations) {
+	pinToCpu(0);
+
+	std::atomic<bool> stop{false};
+	std::vector<std::thread> threads;
+	for(unsigned int cpu = 1; cpu < numCpus; ++cpu) {
+		threads.emplace_back([&stop, cpu] {
+			pinToCpu(cpu);
+			while(!stop.load(std::memory_order_relaxed))
+				;
+		});
+	}
+
+	HelHandle handle;
+	HEL_CHECK(helAllocateMemory(0x1000, 0, nullptr, &handle));
+
+	LatencyBenchmark bench{"map/unmap with shootdown, " + std::to_string(numCpus) + " CPUs"};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		void *window;
+		HEL_CHECK(helMapMemory(handle, kHelNullHandle, nullptr, 0, 0x1000,
+				kHelMapProtRead | kHelMapProtWrite, &window));
+		*reinterpret_cast<volatile std::byte *>(window) = static_cast<std::byte>(0);
+		HEL_CHECK(helUnmapMemory(kHelNullHandle, window, 0x1000));
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+
+	stop.store(true, std::memory_order_relaxed);
+	for(auto &thread : threads)
+		thread.join();
+	HEL_CHECK(helCloseDescriptor(kHelThisUniverse, handle));
+	unpin();
+}
+
+// Measures futex wake-up round trips between threads on two different CPUs.
+void doFutexPingPongBenchmark(int numIterations) {
+	std::atomic<int> word{0};
+	auto futex = reinterpret_cast<int *>(&word);
+
+	// Waits until word has the given value.
+	auto waitFor = [&] (int value) {
+		while(true) {
+			auto current = word.load(std::memory_order_acquire);
+			if(current == value)
+				return;
+			HEL_CHECK(helFutexWait(futex, current, -1));
+		}
+	};
+
+	std::thread partner{[&] {
+		pinToCpu(1);
+		for(int i = 0; i < numIterations; ++i) {
+			waitFor(1);
+			word.store(0, std::memory_order_release);
+			HEL_CHECK(helFutexWake(futex));
+		}
+	}};
+
+	pinToCpu(0);
+	LatencyBenchmark bench{"futex ping-pong across CPUs"};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		word.store(1, std::memory_order_release);
+		HEL_CHECK(helFutexWake(futex));
+		waitFor(0);
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+
+	partner.join();
+	unpin();
+}
+
+// Measures arming and cancelling a timer (until the cancellation is observed).
+async::result<void> doTimerCancelBenchmark(int numIterations) {
+	LatencyBenchmark bench{"timer arm/cancel"};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		uint64_t tick;
+		HEL_CHECK(helGetClock(&tick));
+
+		helix::AwaitClock await;
+		auto &&submit = helix::submitAwaitClock(&await, tick + 1'000'000'000,
+				helix::Dispatcher::global());
+		HEL_CHECK(helCancelAsync(helix::Dispatcher::global().acquire(), await.asyncId()));
+		co_await submit.async_wait();
+		assert(await.error() == kHelErrCancelled);
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+}
+
+// Measures how late timers fire relative to their deadline.
+async::result<void> doTimerLatenessBenchmark(uint64_t delay, int numIterations) {
+	LatencyBenchmark bench{"timer lateness, delay = " + std::to_string(delay / 1000) + " us"};
+	for(int i = 0; i < numIterations; ++i) {
+		uint64_t tick;
+		HEL_CHECK(helGetClock(&tick));
+
+		helix::AwaitClock await;
+		auto &&submit = helix::submitAwaitClock(&await, tick + delay,
+				helix::Dispatcher::global());
+		co_await submit.async_wait();
+		HEL_CHECK(await.error());
+
+		uint64_t now;
+		HEL_CHECK(helGetClock(&now));
+		bench.recordNanos(now - (tick + delay));
+	}
+	bench.finalizeStatistics();
+}
+
+// Measures the creation of a thread until it has exited.
+void doThreadCreationBenchmark(int numIterations) {
+	LatencyBenchmark bench{"thread create/join"};
+	for(int i = 0; i < numIterations; ++i) {
+		auto start = LatencyBenchmark::now();
+		std::thread thread{[] { }};
+		thread.join();
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+}
+
+// Measures fork() until the child has exited, for a parent whose heap has the given size.
+// The parent touches all pages of its heap before each fork(), i.e., all pages
+// need to be shared with the child.
+void doForkBenchmark(size_t heapSize, int numIterations) {
+	auto heap = mmap(nullptr, heapSize, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(heap != MAP_FAILED);
+
+	LatencyBenchmark bench{"fork/exit, heap size = " + formatSize(heapSize)};
+	auto p = reinterpret_cast<volatile std::byte *>(heap);
+	for(int i = 0; i < numIterations; ++i) {
+		for(size_t progress = 0; progress < heapSize; progress += 0x1000)
+			p[progress] = static_cast<std::byte>(i);
+
+		auto start = LatencyBenchmark::now();
+		auto pid = fork();
+		assert(pid >= 0);
+		if(!pid)
+			_exit(0);
+		int status;
+		auto waited = waitpid(pid, &status, 0);
+		assert(waited == pid);
+		bench.record(start);
+	}
+	bench.finalizeStatistics();
+
+	munmap(heap, heapSize);
+}
+
 } // anonymous namespace
 
-int main() {
-	doNopBenchmark();
-	doFutexBenchmark();
-	async::run(doAsyncNopBenchmark(), helix::currentDispatcher);
-	doAllocateBenchmark(1 << 20);
-	doMapBenchmark(1 << 20);
-	doMapPopulatedBenchmark(1 << 20);
-	doPageFaultBenchmark(1 << 20);
-	async::run(doSendRecvBufferBenchmark(1), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(32), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(128), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(4096), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(16 * 1024), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(64 * 1024), helix::currentDispatcher);
-	async::run(doSendRecvBufferBenchmark(1024 * 1024), helix::currentDispatcher);
+int main(int argc, char **argv) {
+	std::string jsonPath;
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "--json") && i + 1 < argc) {
+			jsonPath = argv[++i];
+		}else if(!strcmp(argv[i], "--filter") && i + 1 < argc) {
+			benchFilter = argv[++i];
+		}else{
+			std::cerr << "usage: kernel-bench [--json <path>] [--filter <substring>]"
+					<< std::endl;
+			return 1;
+		}
+	}
+
+	unsigned int numCpus = std::thread::hardware_concurrency();
+
+	if(isSelected("syscall"))
+		doNopBenchmark();
+	if(isSelected("futex"))
+		doFutexBenchmark();
+	if(isSelected("futex") && numCpus >= 2)
+		doFutexPingPongBenchmark(10'000);
+	if(isSelected("ipc")) {
+		async::run(doAsyncNopBenchmark(), helix::currentDispatcher);
+		for(unsigned int n = 2; n <= numCpus; n *= 2)
+			doParallelAsyncNopBenchmark(n);
+	}
+	if(isSelected("memory")) {
+		doAllocateBenchmark(1 << 20);
+		doMapBenchmark(1 << 20);
+		doMapPopulatedBenchmark(1 << 20);
+	}
+	if(isSelected("fault")) {
+		doPageFaultBenchmark(1 << 20);
+		doAnonFaultLatencyBenchmark(1 << 20);
+		doCowFaultLatencyBenchmark(1 << 20);
+		doManagedFaultLatencyBenchmark(16 << 20);
+	}
+	if(isSelected("shootdown")) {
+		for(unsigned int n = 1; n <= numCpus; n *= 2)
+			doShootdownBenchmark(n, 10'000);
+	}
+	if(isSelected("stream")) {
+		for(size_t size : {1, 32, 128, 4096, 16 * 1024, 64 * 1024, 1024 * 1024})
+			async::run(doSendRecvBufferBenchmark(size), helix::currentDispatcher);
+		for(size_t size : {16, 128, 1024, 4096, 64 * 1024})
+			async::run(doStreamRoundTripBenchmark(size, 10'000), helix::currentDispatcher);
+	}
+	if(isSelected("descriptor"))
+		async::run(doDescriptorBenchmark(10'000), helix::currentDispatcher);
+	if(isSelected("timer")) {
+		async::run(doTimerCancelBenchmark(10'000), helix::currentDispatcher);
+		async::run(doTimerLatenessBenchmark(100'000, 1'000), helix::currentDispatcher);
+	}
+	if(isSelected("thread"))
+		doThreadCreationBenchmark(1'000);
+	if(isSelected("fork")) {
+		for(size_t size : {1 << 20, 16 << 20, 64 << 20, 256 << 20})
+			doForkBenchmark(size, 100);
+	}
+
+	std::stringstream json;
+	json << "[";
+	for(size_t i = 0; i < jsonResults.size(); ++i) {
+		if(i)
+			json << ", ";
+		json << jsonResults[i];
+	}
+	json << "]";
+
+	if(jsonPath.empty()) {
+		std::cout << "kernel-bench results: " << json.str() << std::endl;
+	}else{
+		std::ofstream file{jsonPath};
+		file << json.str() << std::endl;
+	}
 }
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+#include <hel.h>
+#include <hel-syscalls.h>
+
+#include "testsuite.hpp"
+
+namespace {
+	constexpr int numWaiters = 3;
+
+	// Starts threads that wait on the given futex (which must be zero) until they are woken.
+	std::vector<std::thread> startWaiters(int *futex, std::atomic<int> &finished) {
+		std::vector<std::thread> threads;
+		for(int i = 0; i < numWaiters; i++)
+			threads.emplace_back([futex, &finished] {
+				HEL_CHECK(helFutexWait(futex, 0, -1));
+				finished++;
+			});
+		return threads;
+	}
+}
+
+DEFINE_TEST(futexWakeN_noWaiters, ([] {
+	int futex = 0;
+	unsigned int woken;
+	HEL_CHECK(helFutexWakeN(&futex, 5, &woken));
+	assert(!woken);
+}))
+
+DEFINE_TEST(futexWakeN, ([] {
+	int futex = 0;
+	std::atomic<int> finished = 0;
+	auto threads = startWaiters(&futex, finished);
+
+	// Waiters might not be queued yet; keep waking them one at a time.
+	int total = 0;
+	while(total < numWaiters) {
+		unsigned int woken;
+		HEL_CHECK(helFutexWakeN(&futex, 1, &woken));
+		assert(woken <= 1);
+		total += woken;
+		sched_yield();
+	}
+
+	for(auto &thread : threads)
+		thread.join();
+	assert(finished == numWaiters);
+}))
+
+DEFINE_TEST(futexRequeue_valueMismatch, ([] {
+	int futex = 1;
+	int target = 0;
+	unsigned int woken;
+	HelError error = helFutexRequeue(&futex, 0, &target, 1, UINT_MAX, &woken);
+	assert(error == kHelErrFutexValue);
+}))
+
+DEFINE_TEST(futexRequeue, ([] {
+	int futex = 0;
+	int target = 0;
+	std::atomic<int> finished = 0;
+	auto threads = startWaiters(&futex, finished);
+
+	// The original futex is never woken directly, hence the waiters can only
+	// finish after they were moved to the target futex.
+	int total = 0;
+	while(total < numWaiters) {
+		unsigned int woken;
+		HEL_CHECK(helFutexRequeue(&futex, 0, &target, 0, UINT_MAX, &woken));
+		assert(!woken);
+
+		HEL_CHECK(helFutexWakeN(&target, 1, &woken));
+		assert(woken <= 1);
+		total += woken;
+		sched_yield();
+	}
+
+	for(auto &thread : threads)
+		thread.join();
+	assert(finished == numWaiters);
+}))
@@ -0,0 +1,162 @@
+// Synthetic benchmark of netserver's socket tables.
+//
+// Usage: net-bench [num-sockets] [echo-address echo-port]
+//
+// Opens num-sockets (default: 10000) UDP and TCP sockets and binds them.
+// UDP sockets are bound to consecutive ports starting at 10000, TCP sockets
+// to ephemeral ports; num-sockets is limited by the smaller of both ranges.
+// If the address of a TCP echo server is given, all TCP sockets are connected to it
+// and one byte is echoed on every connection in round-robin order, such that
+// each incoming segment has to be demultiplexed among all connections.
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int echoRounds = 10;
+
+constexpr size_t firstUdpPort = 10000;
+// Size of netserver's ephemeral port range (32768 to 60999).
+constexpr size_t maxSockets = 60999 - 32768;
+
+struct Stopwatch {
+	Stopwatch(const char *name, size_t ops)
+	: name_{name}, ops_{ops}, start_{Clock::now()} { }
+
+	~Stopwatch() {
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				Clock::now() - start_).count();
+		std::cout << "    " << name_ << ": " << elapsed / 1'000'000 << " ms, "
+				<< elapsed / ops_ << " ns per op" << std::endl;
+	}
+
+private:
+	const char *name_;
+	size_t ops_;
+	Clock::time_point start_;
+};
+
+void closeAll(std::vector<int> &fds) {
+	Stopwatch sw{"close", fds.size()};
+	for(int fd : fds)
+		close(fd);
+	fds.clear();
+}
+
+void doUdpBenchmark(size_t n) {
+	std::cout << "UDP, " << n << " sockets" << std::endl;
+
+	std::vector<int> fds;
+	{
+		Stopwatch sw{"socket + bind", n};
+		for(size_t i = 0; i < n; i++) {
+			int fd = socket(AF_INET, SOCK_DGRAM, 0);
+			if(fd < 0) {
+				perror("net-bench: socket");
+				exit(1);
+			}
+
+			sockaddr_in sa{};
+			sa.sin_family = AF_INET;
+			sa.sin_port = htons(firstUdpPort + i);
+			sa.sin_addr.s_addr = htonl(INADDR_ANY);
+			if(bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa))) {
+				perror("net-bench: bind");
+				exit(1);
+			}
+			fds.push_back(fd);
+		}
+	}
+
+	closeAll(fds);
+}
+
+void doTcpBenchmark(size_t n, const sockaddr_in *echo) {
+	std::cout << "TCP, " << n << " sockets" << std::endl;
+
+	std::vector<int> fds;
+	{
+		// Binding to port zero exercises ephemeral port allocation.
+		Stopwatch sw{"socket + bind", n};
+		for(size_t i = 0; i < n; i++) {
+			int fd = socket(AF_INET, SOCK_STREAM, 0);
+			if(fd < 0) {
+				perror("net-bench: socket");
+				exit(1);
+			}
+
+			sockaddr_in sa{};
+			sa.sin_family = AF_INET;
+			sa.sin_addr.s_addr = htonl(INADDR_ANY);
+			if(bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa))) {
+				perror("net-bench: bind");
+				exit(1);
+			}
+			fds.push_back(fd);
+		}
+	}
+
+	if(echo) {
+		{
+			Stopwatch sw{"connect", n};
+			for(int fd : fds) {
+				if(connect(fd, reinterpret_cast<const sockaddr *>(echo), sizeof(*echo))) {
+					perror("net-bench: connect");
+					exit(1);
+				}
+			}
+		}
+
+		Stopwatch sw{"echo", n * echoRounds};
+		for(int k = 0; k < echoRounds; k++) {
+			for(int fd : fds) {
+				char c = 'x';
+				if(write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) {
+					perror("net-bench: echo");
+					exit(1);
+				}
+			}
+		}
+	}
+
+	closeAll(fds);
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	size_t n = 10000;
+	if(argc > 1)
+		n = strtoul(argv[1], nullptr, 0);
+	if(!n || n > maxSockets) {
+		std::cerr << "net-bench: Number of sockets must be between 1 and "
+				<< maxSockets << std::endl;
+		return 1;
+	}
+
+	sockaddr_in echo{};
+	bool haveEcho = false;
+	if(argc > 3) {
+		echo.sin_family = AF_INET;
+		echo.sin_port = htons(atoi(argv[3]));
+		if(inet_pton(AF_INET, argv[2], &echo.sin_addr) != 1) {
+			std::cerr << "net-bench: Invalid address " << argv[2] << std::endl;
+			return 1;
+		}
+		haveEcho = true;
+	}
+
+	doUdpBenchmark(n);
+	doTcpBenchmark(n, haveEcho ? &echo : nullptr);
+}
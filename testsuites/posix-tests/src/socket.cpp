@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <netinet/in.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -10,6 +11,7 @@
 #include <sys/time.h>
 #include <sys/poll.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "testsuite.hpp"
@@ -131,3 +133,48 @@ DEFINE_TEST(socket_shutdown_rd, ([] {
 	close(fds[0]);
 	close(fds[1]);
 }));
+
+namespace {
+
+// Binds a socket of the given type to an ephemeral port, closes it
+// and checks that the same port can be bound again.
+void checkRebindAfterClose(int type) {
+	int s = socket(AF_INET, type, 0);
+	assert(s >= 0);
+
+	struct sockaddr_in sa = {};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	int ret = bind(s, (struct sockaddr *) &sa, sizeof(sa));
+	assert(!ret);
+
+	socklen_t len = sizeof(sa);
+	ret = getsockname(s, (struct sockaddr *) &sa, &len);
+	assert(!ret);
+	assert(sa.sin_port);
+
+	close(s);
+
+	// Servers might only notice the close asynchronously; give them a moment.
+	s = socket(AF_INET, type, 0);
+	assert(s >= 0);
+	for(int i = 0; i < 100; i++) {
+		ret = bind(s, (struct sockaddr *) &sa, sizeof(sa));
+		if(!ret || errno != EADDRINUSE)
+			break;
+		struct timespec wait = {0, 10'000'000};
+		nanosleep(&wait, nullptr);
+	}
+	assert(!ret);
+	close(s);
+}
+
+} // namespace anonymous
+
+DEFINE_TEST(socket_udp_rebind_after_close, ([] {
+	checkRebindAfterClose(SOCK_DGRAM);
+}));
+
+DEFINE_TEST(socket_tcp_rebind_after_close, ([] {
+	checkRebindAfterClose(SOCK_STREAM);
+}));
@@ -0,0 +1,278 @@
+#include <cxxabi.h>
+#include <elf.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <CLI/App.hpp>
+#include <CLI/Formatter.hpp>
+#include <CLI/Config.hpp>
+
+namespace {
+
+// Must match the ProfileSample struct in kernel/thor/generic/thor-internal/profile.hpp.
+struct ProfileSample {
+	static constexpr uint32_t sampleMagic = 0x5350'5254;
+
+	uint32_t magic;
+	uint16_t cpu;
+	uint8_t numKernelFrames;
+	uint8_t numUserFrames;
+	uint64_t threadId;
+	uint64_t universeId;
+	uint64_t reserved;
+};
+static_assert(sizeof(ProfileSample) == 32);
+
+std::string demangle(const char *name) {
+	int status;
+	auto demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if(status)
+		return name;
+	std::string result{demangled};
+	free(demangled);
+	return result;
+}
+
+// ELF image (thor or a user space binary) that is loaded at a given base address.
+struct Image {
+	struct Symbol {
+		uint64_t address;
+		uint64_t size;
+		std::string name;
+	};
+
+	Image(std::string path, uint64_t base)
+	: path_{std::move(path)}, base_{base} {
+		int fd = open(path_.c_str(), O_RDONLY);
+		if(fd < 0)
+			err(1, "failed to open %s", path_.c_str());
+
+		struct stat st;
+		if(fstat(fd, &st) < 0)
+			err(1, "failed to stat %s", path_.c_str());
+
+		auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED)
+			err(1, "failed to mmap %s", path_.c_str());
+		close(fd);
+
+		auto file = reinterpret_cast<const char *>(ptr);
+		auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(file);
+		if(static_cast<size_t>(st.st_size) < sizeof(Elf64_Ehdr)
+				|| memcmp(ehdr->e_ident, ELFMAG, SELFMAG)
+				|| ehdr->e_ident[EI_CLASS] != ELFCLASS64)
+			errx(1, "%s is not a 64-bit ELF file", path_.c_str());
+
+		// Determine the address range that the image covers.
+		for(size_t i = 0; i < ehdr->e_phnum; i++) {
+			auto phdr = reinterpret_cast<const Elf64_Phdr *>(file + ehdr->e_phoff
+					+ i * ehdr->e_phentsize);
+			if(phdr->p_type != PT_LOAD)
+				continue;
+			lowest_ = std::min(lowest_, phdr->p_vaddr);
+			highest_ = std::max(highest_, phdr->p_vaddr + phdr->p_memsz);
+		}
+
+		// Prefer the full symbol table but fall back to the dynamic one for stripped binaries.
+		auto findSymbols = [&] (uint32_t type) -> bool {
+			for(size_t i = 0; i < ehdr->e_shnum; i++) {
+				auto shdr = reinterpret_cast<const Elf64_Shdr *>(file + ehdr->e_shoff
+						+ i * ehdr->e_shentsize);
+				if(shdr->sh_type != type)
+					continue;
+				auto strtab = reinterpret_cast<const Elf64_Shdr *>(file + ehdr->e_shoff
+						+ shdr->sh_link * ehdr->e_shentsize);
+
+				for(size_t j = 0; j < shdr->sh_size / sizeof(Elf64_Sym); j++) {
+					auto sym = reinterpret_cast<const Elf64_Sym *>(file + shdr->sh_offset)
+							+ j;
+					if(ELF64_ST_TYPE(sym->st_info) != STT_FUNC || !sym->st_value)
+						continue;
+					symbols_.push_back({sym->st_value, sym->st_size,
+							demangle(file + strtab->sh_offset + sym->st_name)});
+				}
+				return true;
+			}
+			return false;
+		};
+		if(!findSymbols(SHT_SYMTAB) && !findSymbols(SHT_DYNSYM))
+			warnx("%s has no symbols", path_.c_str());
+
+		std::sort(symbols_.begin(), symbols_.end(), [] (const Symbol &a, const Symbol &b) {
+			return a.address < b.address;
+		});
+
+		munmap(ptr, st.st_size);
+	}
+
+	bool contains(uint64_t ip) const {
+		return ip >= base_ + lowest_ && ip < base_ + highest_;
+	}
+
+	std::optional<std::string> resolve(uint64_t ip) const {
+		if(!contains(ip))
+			return std::nullopt;
+		auto address = ip - base_;
+
+		auto it = std::upper_bound(symbols_.begin(), symbols_.end(), address,
+				[] (uint64_t address, const Symbol &sym) {
+			return address < sym.address;
+		});
+		if(it == symbols_.begin())
+			return std::nullopt;
+		--it;
+		// Symbols of size zero (e.g., from assembly) cover everything up to the next symbol.
+		if(it->size && address >= it->address + it->size)
+			return std::nullopt;
+		return it->name;
+	}
+
+private:
+	std::string path_;
+	uint64_t base_;
+	uint64_t lowest_ = UINT64_MAX;
+	uint64_t highest_ = 0;
+	std::vector<Symbol> symbols_;
+};
+
+// Parses "path" or "path@base" where base is a hexadecimal load address.
+Image parseImage(const std::string &spec) {
+	auto at = spec.rfind('@');
+	if(at == std::string::npos)
+		return Image{spec, 0};
+	return Image{spec.substr(0, at), std::stoull(spec.substr(at + 1), nullptr, 16)};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	std::string path{"kernel-profile.bin"};
+	std::string kernelPath{"pkg-builds/managarm-kernel/kernel/thor/thor"};
+	std::vector<std::string> userSpecs;
+	std::string groupBy{"none"};
+	std::string outPath;
+	bool kernelOnly = false;
+
+	CLI::App app{"analyze-profile: convert kernel profiles to folded stacks"};
+	app.add_option("path", path, "Path to the profile");
+	app.add_option("--kernel", kernelPath, "Path to the thor binary");
+	app.add_option("--user-binary", userSpecs,
+			"User space binary (path@base, with a hexadecimal load address)");
+	app.add_option("--group-by", groupBy, "Add a root frame per thread or universe")
+		->check(CLI::IsMember({"none", "thread", "universe"}));
+	app.add_option("-o,--output", outPath, "Write folded stacks to this file instead of stdout");
+	app.add_flag("--kernel-only", kernelOnly, "Ignore samples taken in user space");
+	CLI11_PARSE(app, argc, argv);
+
+	std::vector<Image> kernelImages;
+	kernelImages.push_back(Image{kernelPath, 0});
+	std::vector<Image> userImages;
+	for(auto &spec : userSpecs)
+		userImages.push_back(parseImage(spec));
+
+	std::ifstream in{path, std::ios::binary};
+	if(!in)
+		err(1, "failed to open input file %s", path.c_str());
+	std::vector<char> buffer{std::istreambuf_iterator<char>{in}, {}};
+
+	auto symbolize = [] (uint64_t ip, bool isReturnAddress,
+			const std::vector<Image> &images) -> std::string {
+		// Return addresses point after the call instruction; look up the call itself.
+		auto lookupIp = isReturnAddress ? ip - 1 : ip;
+		for(auto &image : images) {
+			if(auto name = image.resolve(lookupIp))
+				return *name;
+		}
+		return std::format("{:#x}", ip);
+	};
+
+	std::map<std::string, uint64_t> stacks;
+	std::map<uint64_t, uint64_t> samplesPerUniverse;
+	size_t numKernel = 0;
+	size_t numUser = 0;
+
+	size_t offset = 0;
+	while(offset + sizeof(ProfileSample) <= buffer.size()) {
+		ProfileSample sample;
+		memcpy(&sample, buffer.data() + offset, sizeof(ProfileSample));
+		if(sample.magic != ProfileSample::sampleMagic) {
+			warnx("halting due to bad sample magic at offset %zu"
+					" (profiles of older kernels are not supported)", offset);
+			break;
+		}
+
+		size_t numFrames = sample.numKernelFrames + sample.numUserFrames;
+		if(offset + sizeof(ProfileSample) + numFrames * sizeof(uint64_t) > buffer.size()) {
+			warnx("halting due to truncated sample");
+			break;
+		}
+		std::vector<uint64_t> frames(numFrames);
+		memcpy(frames.data(), buffer.data() + offset + sizeof(ProfileSample),
+				numFrames * sizeof(uint64_t));
+		offset += sizeof(ProfileSample) + numFrames * sizeof(uint64_t);
+
+		if(sample.numKernelFrames) {
+			++numKernel;
+		}else{
+			++numUser;
+			if(kernelOnly)
+				continue;
+		}
+		++samplesPerUniverse[sample.universeId];
+
+		// Folded stacks list the outermost frame first.
+		std::string stack;
+		if(groupBy == "thread") {
+			stack = sample.threadId ? std::format("thread-{:016x}", sample.threadId) : "[kernel]";
+		}else if(groupBy == "universe") {
+			stack = sample.universeId ? std::format("universe-{:x}", sample.universeId)
+					: "[kernel]";
+		}
+
+		auto appendFrames = [&] (size_t first, size_t count, const std::vector<Image> &images) {
+			for(size_t i = count; i > 0; i--) {
+				if(!stack.empty())
+					stack += ';';
+				stack += symbolize(frames[first + i - 1], i != 1, images);
+			}
+		};
+		appendFrames(sample.numKernelFrames, sample.numUserFrames, userImages);
+		appendFrames(0, sample.numKernelFrames, kernelImages);
+
+		++stacks[stack];
+	}
+
+	std::ofstream outFile;
+	if(!outPath.empty()) {
+		outFile.open(outPath);
+		if(!outFile)
+			err(1, "failed to open output file %s", outPath.c_str());
+	}
+	std::ostream &out = outPath.empty() ? std::cout : outFile;
+	for(auto &[stack, count] : stacks)
+		out << stack << ' ' << count << '\n';
+
+	std::cerr << "analyze-profile: " << numKernel << " samples in the kernel, "
+			<< numUser << " samples in user space" << std::endl;
+	for(auto &[universe, count] : samplesPerUniverse) {
+		if(!universe)
+			continue;
+		std::cerr << std::format("    universe {:x}: {} samples", universe, count) << std::endl;
+	}
+
+	return 0;
+}
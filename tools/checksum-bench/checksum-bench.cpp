@@ -0,0 +1,70 @@
+// Compares the scalar and the wide implementation of the Internet checksum.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "ones-complement.hpp"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+template<typename F>
+double measureThroughput(F sum, const std::vector<unsigned char> &data, size_t size) {
+	// Prevent the compiler from optimizing the calls away.
+	volatile uint16_t sink = 0;
+
+	size_t iterations = 0;
+	auto start = clock::now();
+	auto elapsed = clock::duration{};
+	while(elapsed < std::chrono::milliseconds{500}) {
+		for(int i = 0; i < 64; ++i) {
+			sink = sum(data.data(), size);
+			++iterations;
+		}
+		elapsed = clock::now() - start;
+	}
+	(void)sink;
+
+	auto seconds = std::chrono::duration<double>(elapsed).count();
+	return iterations * size / seconds / 1e9;
+}
+
+} // anonymous namespace
+
+int main() {
+	std::vector<unsigned char> data(65536);
+	std::mt19937 prng{42};
+	for(auto &b : data)
+		b = prng();
+
+	// Check that both implementations agree before measuring them.
+	for(size_t size = 0; size < 4096; ++size) {
+		auto scalar = onesComplementSumScalar(data.data(), size);
+		auto wide = onesComplementSum(data.data(), size);
+		// 0 and 0xFFFF are both representations of zero.
+		if(scalar != wide && (scalar % 0xFFFF) != (wide % 0xFFFF)) {
+			std::cerr << "checksum-bench: Mismatch for size " << size
+					<< ": " << scalar << " vs. " << wide << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << std::setw(8) << "size"
+			<< std::setw(16) << "scalar GB/s"
+			<< std::setw(16) << "wide GB/s"
+			<< std::setw(10) << "speedup" << std::endl;
+	for(size_t size : {20, 40, 64, 576, 1280, 1500, 9000, 65536}) {
+		auto scalar = measureThroughput(onesComplementSumScalar, data, size);
+		auto wide = measureThroughput(onesComplementSum, data, size);
+		std::cout << std::setw(8) << size
+				<< std::fixed << std::setprecision(2)
+				<< std::setw(16) << scalar
+				<< std::setw(16) << wide
+				<< std::setw(9) << wide / scalar << "x" << std::endl;
+	}
+}
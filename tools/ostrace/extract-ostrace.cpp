@@ -18,13 +18,14 @@ void FRG_INTF(panic)(const char *cstring) {
 namespace {
 
 template<typename T>
-concept Policy = requires(T &a, managarm::ostrace::EventRecord &event, managarm::ostrace::Definition &def, managarm::ostrace::UintAttribute &uintAttr, managarm::ostrace::BufferAttribute &bufferAttr, size_t pass) {
+concept Policy = requires(T &a, managarm::ostrace::EventRecord &event, managarm::ostrace::Definition &def, managarm::ostrace::UintAttribute &uintAttr, managarm::ostrace::BufferAttribute &bufferAttr, managarm::ostrace::DroppedRecords &dropped, size_t pass) {
 	{ a.onEvent(event, pass) } -> std::same_as<bool>;
 	{ a.onDefinition(def, pass) } -> std::same_as<bool>;
 	{ a.onEndOfRecord(pass) } -> std::same_as<bool>;
 
 	{ a.onUintAttribute(uintAttr, pass) } -> std::same_as<bool>;
 	{ a.onBufferAttribute(bufferAttr, pass) } -> std::same_as<bool>;
+	{ a.onDroppedRecords(dropped, pass) } -> std::same_as<bool>;
 
 	{ a.passes() } -> std::same_as<size_t>;
 	{ a.reset() } -> std::same_as<void>;
@@ -58,6 +59,11 @@ struct JsonPolicy {
 		return true;
 	}
 
+	bool onDroppedRecords(managarm::ostrace::DroppedRecords &record, size_t) {
+		std::cout << "{\"_dropped\":" << record.count() << ",\"_cpu\":" << record.cpu() << "}\n";
+		return true;
+	}
+
 	size_t passes() {
 		return 1;
 	}
@@ -193,6 +199,10 @@ struct WiresharkPolicy {
 		return true;
 	}
 
+	bool onDroppedRecords(managarm::ostrace::DroppedRecords &, size_t) {
+		return true;
+	}
+
 	size_t passes() {
 		return 2;
 	}
@@ -330,6 +340,17 @@ int main(int argc, char **argv) {
 				return false;
 			}
 		} break;
+		case bragi::message_id<managarm::ostrace::DroppedRecords>: {
+			auto maybeRecord = bragi::parse_head_tail<managarm::ostrace::DroppedRecords>(
+					head_span, tail_span);
+			assert(maybeRecord);
+			auto &record = maybeRecord.value();
+
+			if(!policy.onDroppedRecords(record, pass)) {
+				warnx("failed to parse DroppedRecords");
+				return false;
+			}
+		} break;
 		default:
 			warnx("halting due to unexpected message ID %u", preamble.id());
 			return false;